@@ -0,0 +1,130 @@
+#ifdef __linux__
+
+#include "alsa_source.hpp"
+
+#include <alsa/asoundlib.h>
+
+#include <iostream>
+
+namespace
+{
+
+// The device buffer has to bridge the gap between two Read()s; the recorder polls every 100 ms.
+constexpr unsigned int LATENCY_US = 500 * 1000;
+
+constexpr snd_pcm_uframes_t READ_FRAMES = 4096;
+
+}  // namespace
+
+AlsaSource::AlsaSource(std::string device, int sample_rate)
+    : device(std::move(device)), sample_rate(sample_rate)
+{
+}
+
+AlsaSource::~AlsaSource()
+{
+    if (pcm)
+    {
+        snd_pcm_close(pcm);
+        pcm = nullptr;
+    }
+}
+
+bool AlsaSource::Open()
+{
+    int err = snd_pcm_open(&pcm, device.c_str(), SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
+    if (err < 0)
+    {
+        std::cerr << "Failed to open ALSA device " << device << ": " << snd_strerror(err) << std::endl;
+        pcm = nullptr;
+        return false;
+    }
+
+    // Let alsa-lib resample / downmix if the hardware can't do 16-bit mono at our rate
+    err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 1, sample_rate,
+                             /* soft_resample */ 1, LATENCY_US);
+    if (err < 0)
+    {
+        std::cerr << "Failed to configure ALSA device " << device << ": " << snd_strerror(err) << std::endl;
+        snd_pcm_close(pcm);
+        pcm = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void AlsaSource::Start()
+{
+    if (pcm)
+    {
+        stopped_tail.clear();
+        snd_pcm_prepare(pcm);
+        snd_pcm_start(pcm);
+        running = true;
+    }
+}
+
+void AlsaSource::Stop()
+{
+    if (pcm && running)
+    {
+        // Dropping throws away what the device has buffered, and the last Read() after Stop()
+        // still wants that, so take it out first
+        running = false;
+        ReadAvailable(&stopped_tail);
+        snd_pcm_drop(pcm);
+    }
+}
+
+void AlsaSource::Read(std::vector<short>* out)
+{
+    if (!stopped_tail.empty())
+    {
+        out->insert(out->end(), stopped_tail.begin(), stopped_tail.end());
+        stopped_tail.clear();
+    }
+    if (running)
+    {
+        ReadAvailable(out);
+    }
+}
+
+void AlsaSource::ReadAvailable(std::vector<short>* out)
+{
+    if (!pcm)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        size_t old_size = out->size();
+        out->resize(old_size + READ_FRAMES);
+        snd_pcm_sframes_t frames = snd_pcm_readi(pcm, out->data() + old_size, READ_FRAMES);
+        if (frames < 0)
+        {
+            out->resize(old_size);
+            if (frames == -EAGAIN)
+            {
+                return;
+            }
+
+            // Overrun (we were too slow) or suspend: recover and carry on; the gap is lost
+            if (snd_pcm_recover(pcm, (int)frames, /* silent */ 1) < 0)
+            {
+                return;
+            }
+            snd_pcm_start(pcm);
+            continue;
+        }
+
+        out->resize(old_size + frames);
+        if (frames == 0 || (snd_pcm_uframes_t)frames < READ_FRAMES)
+        {
+            return;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "audio_source.hpp"
+
+#include <string>
+#include <vector>
+
+typedef struct _snd_pcm snd_pcm_t;
+
+// Capture through ALSA, for running the pipeline on Linux. On PipeWire (or PulseAudio) systems the
+// "default" device goes through their ALSA plugin, so this covers those too. Non-blocking: Read()
+// takes whatever the device has buffered and returns.
+struct AlsaSource : AudioSource
+{
+    explicit AlsaSource(std::string device = "default", int sample_rate = 16000);
+    ~AlsaSource() override;
+
+    AlsaSource(const AlsaSource&) = delete;
+    AlsaSource& operator=(const AlsaSource&) = delete;
+
+    bool Open() override;
+    void Start() override;
+    void Stop() override;
+    void Read(std::vector<short>* out) override;
+    int SampleRate() const override { return sample_rate; }
+
+private:
+    void ReadAvailable(std::vector<short>* out);
+
+    std::string device;
+    int sample_rate;
+    snd_pcm_t* pcm = nullptr;
+    bool running = false;
+    std::vector<short> stopped_tail;  // what was still buffered when we stopped
+};
+
+#endif
@@ -0,0 +1,350 @@
+#include "audio_conditioning.hpp"
+
+#include "vad.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// PCM_SCALAR_KERNELS turns the vector paths off (see tests/CMakeLists.txt)
+#if defined(__AVX2__) && !defined(PCM_SCALAR_KERNELS)
+#include <immintrin.h>
+#define CONDITIONING_USE_AVX2 1
+#endif
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(PCM_SCALAR_KERNELS)
+#include <emmintrin.h>
+#define CONDITIONING_USE_SSE2 1
+#endif
+
+namespace
+{
+
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double DC_TIME_CONSTANT_SECONDS = 0.5;
+
+// Per 20 ms frame: come down quickly when it gets loud, go up slowly when it gets quiet.
+constexpr double GAIN_ATTACK = 0.3;
+constexpr double GAIN_RELEASE = 0.02;
+
+short ToPcm16(double value)
+{
+    long rounded = std::lround(value);
+    return static_cast<short>(std::clamp(rounded, -32768L, 32767L));
+}
+
+float DbToGain(double db)
+{
+    return static_cast<float>(std::pow(10.0, db / 20.0));
+}
+
+}  // namespace
+
+int64_t PcmSum(const short* pcm, size_t count)
+{
+    size_t i = 0;
+    int64_t total = 0;
+
+#if defined(CONDITIONING_USE_SSE2)
+    {
+        // madd against ones gives pairwise sums in 32 bits; flush those to 64 bits before they can
+        // overflow (2^15 iterations of at most 2^16 per lane).
+        const __m128i ones = _mm_set1_epi16(1);
+        while (i + 8 <= count)
+        {
+            __m128i acc = _mm_setzero_si128();
+            size_t stop = std::min(count - count % 8, i + 8 * 16384);
+            for (; i < stop; i += 8)
+            {
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(pcm + i)), ones));
+            }
+            alignas(16) int32_t lanes[4];
+            _mm_store_si128((__m128i*)lanes, acc);
+            total += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        total += pcm[i];
+    }
+
+    return total;
+}
+
+int PcmPeak(const short* pcm, size_t count)
+{
+    size_t i = 0;
+    int highest = 0;
+    int lowest = 0;
+
+#if defined(CONDITIONING_USE_AVX2)
+    {
+        __m256i hi = _mm256_setzero_si256();
+        __m256i lo = _mm256_setzero_si256();
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(pcm + i));
+            hi = _mm256_max_epi16(hi, x);
+            lo = _mm256_min_epi16(lo, x);
+        }
+        alignas(32) short hi_lanes[16];
+        alignas(32) short lo_lanes[16];
+        _mm256_store_si256((__m256i*)hi_lanes, hi);
+        _mm256_store_si256((__m256i*)lo_lanes, lo);
+        for (int lane = 0; lane < 16; lane++)
+        {
+            highest = std::max<int>(highest, hi_lanes[lane]);
+            lowest = std::min<int>(lowest, lo_lanes[lane]);
+        }
+    }
+#endif
+
+#if defined(CONDITIONING_USE_SSE2)
+    {
+        __m128i hi = _mm_setzero_si128();
+        __m128i lo = _mm_setzero_si128();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+            hi = _mm_max_epi16(hi, x);
+            lo = _mm_min_epi16(lo, x);
+        }
+        alignas(16) short hi_lanes[8];
+        alignas(16) short lo_lanes[8];
+        _mm_store_si128((__m128i*)hi_lanes, hi);
+        _mm_store_si128((__m128i*)lo_lanes, lo);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            highest = std::max<int>(highest, hi_lanes[lane]);
+            lowest = std::min<int>(lowest, lo_lanes[lane]);
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        highest = std::max<int>(highest, pcm[i]);
+        lowest = std::min<int>(lowest, pcm[i]);
+    }
+
+    return std::max(highest, -lowest);
+}
+
+void PcmAddOffset(short* pcm, size_t count, int offset)
+{
+    offset = std::clamp(offset, -32768, 32767);
+    if (offset == 0)
+    {
+        return;
+    }
+
+    size_t i = 0;
+
+#if defined(CONDITIONING_USE_AVX2)
+    {
+        const __m256i add = _mm256_set1_epi16((short)offset);
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(pcm + i));
+            _mm256_storeu_si256((__m256i*)(pcm + i), _mm256_adds_epi16(x, add));
+        }
+    }
+#endif
+
+#if defined(CONDITIONING_USE_SSE2)
+    {
+        const __m128i add = _mm_set1_epi16((short)offset);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+            _mm_storeu_si128((__m128i*)(pcm + i), _mm_adds_epi16(x, add));
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        pcm[i] = static_cast<short>(std::clamp(pcm[i] + offset, -32768, 32767));
+    }
+}
+
+void PcmApplyGainRamp(short* pcm, size_t count, float start_gain, float end_gain)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Sample i gets start_gain + i * step; the clamp before rounding keeps large values from
+    // wrapping in the float -> int conversion.
+    const float step = (end_gain - start_gain) / count;
+    size_t i = 0;
+
+#if defined(CONDITIONING_USE_AVX2)
+    {
+        const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256 steps = _mm256_set1_ps(step);
+        const __m256 max_value = _mm256_set1_ps(32767.0f);
+        const __m256 min_value = _mm256_set1_ps(-32768.0f);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 gains = _mm256_add_ps(_mm256_set1_ps(start_gain + step * i), _mm256_mul_ps(lanes, steps));
+            __m256i wide = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(pcm + i)));
+            __m256 scaled = _mm256_mul_ps(_mm256_cvtepi32_ps(wide), gains);
+            scaled = _mm256_max_ps(_mm256_min_ps(scaled, max_value), min_value);
+            __m256i rounded = _mm256_cvtps_epi32(scaled);
+            __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+            _mm_storeu_si128((__m128i*)(pcm + i), packed);
+        }
+    }
+#endif
+
+#if defined(CONDITIONING_USE_SSE2)
+    {
+        const __m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+        const __m128 steps = _mm_set1_ps(step);
+        const __m128 max_value = _mm_set1_ps(32767.0f);
+        const __m128 min_value = _mm_set1_ps(-32768.0f);
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+            __m128 gains_lo = _mm_add_ps(_mm_set1_ps(start_gain + step * i), _mm_mul_ps(lanes, steps));
+            __m128 gains_hi = _mm_add_ps(_mm_set1_ps(start_gain + step * (i + 4)), _mm_mul_ps(lanes, steps));
+            __m128 scaled_lo = _mm_mul_ps(_mm_cvtepi32_ps(lo), gains_lo);
+            __m128 scaled_hi = _mm_mul_ps(_mm_cvtepi32_ps(hi), gains_hi);
+            scaled_lo = _mm_max_ps(_mm_min_ps(scaled_lo, max_value), min_value);
+            scaled_hi = _mm_max_ps(_mm_min_ps(scaled_hi, max_value), min_value);
+
+            __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(scaled_lo), _mm_cvtps_epi32(scaled_hi));
+            _mm_storeu_si128((__m128i*)(pcm + i), packed);
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        float scaled = std::clamp(pcm[i] * (start_gain + step * i), -32768.0f, 32767.0f);
+        pcm[i] = static_cast<short>(std::lrint(scaled));
+    }
+}
+
+AudioConditioner::AudioConditioner(const ConditioningSettings& settings)
+{
+    Reset(settings);
+}
+
+void AudioConditioner::Reset(const ConditioningSettings& new_settings)
+{
+    settings = new_settings;
+
+    dc_estimate = 0.0;
+    dc_primed = false;
+
+    // RBJ cookbook high-pass, Butterworth Q; the cutoff has to stay well below Nyquist
+    double cutoff = std::clamp(settings.high_pass_hz, 1.0, 0.45 * settings.sample_rate);
+    double w0 = 2.0 * PI * cutoff / settings.sample_rate;
+    double alpha = std::sin(w0) / (2.0 * std::sqrt(0.5));
+    double cos_w0 = std::cos(w0);
+    double a0 = 1.0 + alpha;
+    b0 = (1.0 + cos_w0) / 2.0 / a0;
+    b1 = -(1.0 + cos_w0) / a0;
+    b2 = (1.0 + cos_w0) / 2.0 / a0;
+    a1 = -2.0 * cos_w0 / a0;
+    a2 = (1.0 - alpha) / a0;
+    z1 = 0.0;
+    z2 = 0.0;
+
+    gain_frame = std::max<size_t>(1, (size_t)settings.sample_rate * 20 / 1000);
+    gain_db = 0.0;
+}
+
+void AudioConditioner::Process(short* pcm, size_t count)
+{
+    if (settings.remove_dc)
+    {
+        RemoveDc(pcm, count);
+    }
+    if (settings.high_pass)
+    {
+        HighPass(pcm, count);
+    }
+    if (settings.normalize)
+    {
+        Normalize(pcm, count);
+    }
+}
+
+void AudioConditioner::RemoveDc(short* pcm, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Track the mean with a slow average over blocks, so a sustained low note doesn't count as DC
+    double mean = (double)PcmSum(pcm, count) / count;
+    if (!dc_primed)
+    {
+        dc_estimate = mean;
+        dc_primed = true;
+    }
+    else
+    {
+        double weight = 1.0 - std::exp(-(double)count / (settings.sample_rate * DC_TIME_CONSTANT_SECONDS));
+        dc_estimate += weight * (mean - dc_estimate);
+    }
+
+    PcmAddOffset(pcm, count, -(int)std::lround(dc_estimate));
+}
+
+void AudioConditioner::HighPass(short* pcm, size_t count)
+{
+    // Recursive, so one sample at a time; it's five multiply-adds per sample.
+    for (size_t i = 0; i < count; i++)
+    {
+        double x = pcm[i];
+        double y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        pcm[i] = ToPcm16(y);
+    }
+}
+
+void AudioConditioner::Normalize(short* pcm, size_t count)
+{
+    while (count > 0)
+    {
+        size_t n = std::min(count, gain_frame);
+
+        double mean_square = (double)PcmSumOfSquares(pcm, n) / n;
+        double rms_db = 10.0 * std::log10(mean_square / (32768.0 * 32768.0) + 1e-12);
+        int peak = PcmPeak(pcm, n);
+
+        double target_db = gain_db;
+        if (rms_db > settings.gate_dbfs)
+        {
+            double desired = std::clamp(settings.target_rms_dbfs - rms_db, settings.min_gain_db, settings.max_gain_db);
+            target_db += (desired < gain_db ? GAIN_ATTACK : GAIN_RELEASE) * (desired - gain_db);
+        }
+
+        // Never push this frame past the peak limit, not even at the start of the ramp
+        double start_db = gain_db;
+        if (peak > 0)
+        {
+            double limit_db = settings.peak_limit_dbfs - 20.0 * std::log10(peak / 32768.0);
+            target_db = std::min(target_db, limit_db);
+            start_db = std::min(start_db, limit_db);
+        }
+
+        PcmApplyGainRamp(pcm, n, DbToGain(start_db), DbToGain(target_db));
+        gain_db = target_db;
+
+        pcm += n;
+        count -= n;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Clean-up for 16-bit mono PCM between capture and everything else: DC offset removal, a
+// high-pass against rumble and fan noise, and gain normalisation so quiet headset mics reach
+// Whisper at a sensible level. Everything runs in place on the blocks as they arrive.
+
+struct ConditioningSettings
+{
+    int sample_rate = 16000;
+
+    bool remove_dc = true;
+
+    bool high_pass = true;
+    double high_pass_hz = 80.0;  // speech has nothing useful below ~100 Hz
+
+    bool normalize = true;
+    double target_rms_dbfs = -20.0;
+    double max_gain_db = 24.0;      // don't dig a whisper out of the noise
+    double min_gain_db = -12.0;
+    double peak_limit_dbfs = -1.0;  // gain is capped so the frame's peak stays under this
+    double gate_dbfs = -50.0;       // quieter frames leave the gain alone (no pumping up silence)
+};
+
+// Kernels; vectorised where the compiler lets us (AVX2, then SSE2), scalar otherwise.
+int64_t PcmSum(const short* pcm, size_t count);
+int PcmPeak(const short* pcm, size_t count);  // largest |sample|, up to 32768
+void PcmAddOffset(short* pcm, size_t count, int offset);  // saturating
+void PcmApplyGainRamp(short* pcm, size_t count, float start_gain, float end_gain);  // saturating
+
+// Streaming: call Process() on consecutive blocks of one take; filter and gain state carry over.
+struct AudioConditioner
+{
+    explicit AudioConditioner(const ConditioningSettings& settings = {});
+
+    void Reset(const ConditioningSettings& settings);
+
+    void Process(short* pcm, size_t count);
+
+    // The individual stages, in the order Process() runs them.
+    void RemoveDc(short* pcm, size_t count);
+    void HighPass(short* pcm, size_t count);
+    void Normalize(short* pcm, size_t count);
+
+    double GainDb() const { return gain_db; }
+
+private:
+    ConditioningSettings settings;
+
+    double dc_estimate = 0.0;
+    bool dc_primed = false;
+
+    // RBJ biquad, transposed direct form II. Double precision: with the poles this close to the
+    // unit circle, float state gets noisy.
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    double z1 = 0.0, z2 = 0.0;
+
+    size_t gain_frame = 320;  // 20 ms at 16 kHz
+    double gain_db = 0.0;
+};
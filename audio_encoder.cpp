@@ -0,0 +1,39 @@
+#include "audio_encoder.hpp"
+
+#include "flac_encoder.hpp"
+#include "mp3_encoder.hpp"
+#include "opus_encoder.hpp"
+#include "wav_encoder.hpp"
+
+std::unique_ptr<AudioEncoder> CreateAudioEncoder(AudioFormat format)
+{
+    switch (format)
+    {
+    case FORMAT_OPUS:
+        return std::make_unique<OpusStreamEncoder>();
+    case FORMAT_FLAC:
+        return std::make_unique<FlacStreamEncoder>();
+    case FORMAT_WAV:
+        return std::make_unique<WavStreamEncoder>();
+    case FORMAT_MP3:
+    default:
+        return std::make_unique<Mp3StreamEncoder>();
+    }
+}
+
+const wchar_t* AudioFormatDisplayName(AudioFormat format)
+{
+    switch (format)
+    {
+    case FORMAT_MP3:
+        return L"MP3 (LAME)";
+    case FORMAT_OPUS:
+        return L"Opus (smallest, for WAN)";
+    case FORMAT_FLAC:
+        return L"FLAC (lossless)";
+    case FORMAT_WAV:
+        return L"WAV (no encoding, for LAN)";
+    default:
+        return L"?";
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Upload formats we can produce. Stored in the registry, so don't renumber.
+enum AudioFormat
+{
+    FORMAT_MP3 = 0,
+    FORMAT_OPUS = 1,
+    FORMAT_FLAC = 2,
+    FORMAT_WAV = 3,
+    FORMAT_COUNT
+};
+
+// A streaming encoder session: 16-bit mono PCM goes in while we record, a complete file comes out
+// of Finish(). Implementations have no Windows dependencies.
+struct AudioEncoder
+{
+    virtual ~AudioEncoder() = default;
+
+    // Opens a new session, writing into `buffer` (typically from Mp3BufferPool).
+    virtual bool Start(int sample_rate, std::vector<char> buffer = {}) = 0;
+    virtual bool Encode(const short* pcm, size_t num_samples) = 0;
+    virtual std::vector<char> Finish() = 0;
+
+    virtual size_t SamplesEncoded() const = 0;
+
+    // The file so far. Whether bytes already in here are final is up to Streamable(): a WAV header
+    // only gets its sizes in Finish(), so those can't be uploaded before the end.
+    virtual const std::vector<char>& Output() const = 0;
+    virtual bool Streamable() const { return true; }
+
+    // Hands over everything in Output() and carries on writing into `next` (emptied first), so a
+    // streaming upload can take the frames without copying them. Streamable() encoders only; from
+    // then on Finish() returns just what came after.
+    virtual std::vector<char> TakeOutput(std::vector<char> next = {}) = 0;
+
+    // What the multipart file part should say about itself
+    virtual AudioFormat Format() const = 0;
+    virtual const char* FileName() const = 0;
+    virtual const char* MimeType() const = 0;
+
+    // Rough upper bound on the output for num_samples, for reserving buffers
+    virtual size_t WorstCaseBytes(size_t num_samples) const = 0;
+};
+
+std::unique_ptr<AudioEncoder> CreateAudioEncoder(AudioFormat format);
+const wchar_t* AudioFormatDisplayName(AudioFormat format);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+// Where a take's PCM comes from: the microphone normally, or a file when we want to drive the
+// pipeline without one. 16-bit mono at SampleRate(); the recorder resamples from there. Not
+// thread-safe: one thread at a time (the capture thread while it runs).
+struct AudioSource
+{
+    virtual ~AudioSource() = default;
+
+    // Acquires the device / loads the file; false (with the reason on stderr) if that fails.
+    virtual bool Open() = 0;
+
+    virtual void Start() = 0;
+    virtual void Stop() = 0;
+
+    // Appends whatever has been captured since the last call to `out`. Called from the capture
+    // thread every poll interval.
+    virtual void Read(std::vector<short>* out) = 0;
+
+    virtual int SampleRate() const = 0;
+
+    // True once a finite source (file replay) has handed out everything it has.
+    virtual bool Finished() const { return false; }
+};
@@ -0,0 +1,267 @@
+#include "capture_pipeline.hpp"
+
+#include "realtime_session.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+
+// What we reserve for a new take's file up front: the encoder's worst case for the first few seconds.
+// Longer takes grow from there; retained buffers from earlier takes usually already cover it.
+constexpr size_t INITIAL_CAPACITY_SAMPLES = CapturePipeline::SAMPLE_RATE * 5;
+
+// Live chunking: while recording, a chunk is sent off once the speaker has paused this long...
+constexpr size_t CHUNK_PAUSE_SAMPLES = CapturePipeline::SAMPLE_RATE * 600 / 1000;
+// ...provided it's at least this long; Whisper does noticeably worse on very short snippets.
+constexpr size_t CHUNK_MIN_SAMPLES = CapturePipeline::SAMPLE_RATE * 5;
+
+}  // namespace
+
+uint64_t SteadyClockMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CapturePipeline::CapturePipeline(PcmStore& take, Mp3BufferPool& buffers, SegmentHandler on_segment)
+    : take(take), buffers(buffers), on_segment(std::move(on_segment))
+{
+}
+
+bool CapturePipeline::StartTake(int take_id, std::unique_ptr<AudioEncoder> encoder, const CaptureSettings& settings,
+                                std::shared_ptr<RealtimeSession> realtime)
+{
+    this->encoder = std::move(encoder);
+    if (!StartEncoderSession())
+    {
+        return false;
+    }
+
+    this->settings = settings;
+    this->take_id = take_id;
+    samples_consumed = 0;
+    chunk_index = 0;
+    chunk_start_sample = 0;
+    streaming_segment.reset();
+
+    if (settings.condition)
+    {
+        ConditioningSettings conditioning = settings.conditioning;
+        conditioning.sample_rate = SAMPLE_RATE;
+        conditioner.Reset(conditioning);
+    }
+    if (settings.trim_silence || settings.live_chunks)
+    {
+        VadSettings vad_settings = settings.vad;
+        vad_settings.sample_rate = SAMPLE_RATE;
+        vad.Reset(vad_settings);
+    }
+
+    // Realtime: the audio goes up while the user talks; streaming the upload as well would be moot
+    this->realtime = std::move(realtime);
+    if (this->realtime)
+    {
+        this->settings.stream_upload = false;
+        realtime_resampler.Init(SAMPLE_RATE, RealtimeSession::SAMPLE_RATE);
+        realtime_samples_sent = 0;
+    }
+    return true;
+}
+
+// Opens a new encoder session for a take or chunk, in a buffer from the pool.
+bool CapturePipeline::StartEncoderSession()
+{
+    size_t initial_capacity = encoder->WorstCaseBytes(INITIAL_CAPACITY_SAMPLES);
+    return encoder->Start(SAMPLE_RATE, buffers.Acquire(initial_capacity));
+}
+
+void CapturePipeline::Append(short* pcm, size_t count)
+{
+    if (settings.condition)
+    {
+        conditioner.Process(pcm, count);
+    }
+    take.Append(pcm, count);
+}
+
+// Sends what's new in the take up the realtime session, if it has one.
+void CapturePipeline::StreamRealtimeAudio()
+{
+    if (!realtime)
+    {
+        return;
+    }
+
+    size_t end = take.Size();
+    realtime_pcm.clear();
+    take.ForEachSpan(realtime_samples_sent, end, [this](const short* pcm, size_t count) {
+        realtime_resampler.Process(pcm, count, &realtime_pcm);
+    });
+    realtime_samples_sent = end;
+    realtime->SendAudio(realtime_pcm.data(), realtime_pcm.size());
+}
+
+// Closes the current encoder session and hands the file on. `chunk_end` is where in the take the
+// chunk stops; the next one (if any) starts there.
+void CapturePipeline::PublishSegment(size_t chunk_end, bool last_in_take, uint64_t stopped_at)
+{
+    // The realtime session gets the same chunk, down to the resampler's last few samples
+    if (realtime)
+    {
+        StreamRealtimeAudio();
+        realtime_pcm.clear();
+        realtime_resampler.Flush(&realtime_pcm);
+        realtime_resampler.Reset();
+        realtime->SendAudio(realtime_pcm.data(), realtime_pcm.size());
+        realtime->Commit();
+    }
+
+    double audio_duration_seconds = (double)(chunk_end - chunk_start_sample) / SAMPLE_RATE;
+    double uploaded_duration_seconds = (double)encoder->SamplesEncoded() / SAMPLE_RATE;
+    chunk_start_sample = chunk_end;
+
+    if (streaming_segment)
+    {
+        // Already queued; send the rest and say how it ended. The last frames go in the buffer the
+        // encoder has; one the reader is done with goes back to the pool in place of the one the
+        // session started with
+        std::vector<char> spare = streaming_segment->stream.TakeSpentBuffer();
+        streaming_segment->stream.Append(encoder->Finish());
+        buffers.Release(std::move(spare));
+        streaming_segment->uploaded_duration_seconds = uploaded_duration_seconds;
+        streaming_segment->audio_duration_seconds = audio_duration_seconds;
+        streaming_segment->last_in_take = last_in_take;
+        streaming_segment->stopped_at = last_in_take ? stopped_at : 0;
+        streaming_segment->stream.Finish();
+        streaming_segment.reset();
+        chunk_index += 1;
+        return;
+    }
+
+    // All that's left to encode is the encoder's flush
+    Mp3Segment segment;
+    segment.data = encoder->Finish();
+    segment.file_name = encoder->FileName();
+    segment.mime_type = encoder->MimeType();
+    segment.format = encoder->Format();
+    segment.audio_duration_seconds = audio_duration_seconds;
+    segment.uploaded_duration_seconds = uploaded_duration_seconds;
+    segment.take_id = take_id;
+    segment.chunk_index = chunk_index;
+    segment.last_in_take = last_in_take;
+    segment.stopped_at = last_in_take ? stopped_at : 0;
+    chunk_index += 1;
+    on_segment(std::move(segment));
+}
+
+// With streaming upload, queues the current segment as soon as the encoder has produced its first
+// bytes, and from then on hands over its buffer whenever there's something in it; the encoder
+// carries on in one the upload has finished reading.
+void CapturePipeline::StreamEncodedBytes()
+{
+    if (!settings.stream_upload || !encoder->Streamable() || encoder->Output().empty())
+    {
+        return;
+    }
+
+    if (!streaming_segment)
+    {
+        streaming_segment = std::make_shared<StreamingSegment>();
+
+        Mp3Segment segment;
+        segment.file_name = encoder->FileName();
+        segment.mime_type = encoder->MimeType();
+    segment.format = encoder->Format();
+        segment.take_id = take_id;
+        segment.chunk_index = chunk_index;
+        segment.last_in_take = false;
+        segment.streaming = streaming_segment;
+        on_segment(std::move(segment));
+    }
+
+    streaming_segment->stream.Append(encoder->TakeOutput(streaming_segment->stream.TakeSpentBuffer()));
+}
+
+// With silence trimming, what's new goes through the VAD first and we encode the ranges it has
+// settled on (which may reach back a little, e.g. for the pre-roll before the first word; that's
+// all still in the take).
+void CapturePipeline::EncodeNewSamples(bool final)
+{
+    auto encode = [this](const short* pcm, size_t count) {
+        encoder->Encode(pcm, count);
+    };
+    auto encode_ranges = [this, &encode]() {
+        for (const SampleRange& range : vad_ranges)
+        {
+            take.ForEachSpan(range.begin, range.end, encode);
+        }
+    };
+
+    StreamRealtimeAudio();
+
+    size_t end = take.Size();
+    if (settings.trim_silence || settings.live_chunks)
+    {
+        vad_ranges.clear();
+        take.ForEachSpan(samples_consumed, end, [this](const short* pcm, size_t count) {
+            vad.Feed(pcm, count, &vad_ranges);
+        });
+        if (final)
+        {
+            vad.Finish(&vad_ranges);
+        }
+    }
+
+    if (!settings.trim_silence)
+    {
+        take.ForEachSpan(samples_consumed, end, encode);
+    }
+    else
+    {
+        encode_ranges();
+    }
+    samples_consumed = end;
+    StreamEncodedBytes();
+
+    if (settings.live_chunks && !final && vad.HeardSpeech() && vad.SilenceSinceSpeech() >= CHUNK_PAUSE_SAMPLES &&
+        end - chunk_start_sample >= CHUNK_MIN_SAMPLES)
+    {
+        // Close the chunk in the pause (after the hangover, when trimming) and keep going
+        vad_ranges.clear();
+        vad.Split(&vad_ranges);
+        if (settings.trim_silence)
+        {
+            encode_ranges();
+        }
+
+        PublishSegment(end, false, 0);
+        if (!StartEncoderSession())
+        {
+            fprintf(stderr, "Failed to restart the encoder for the next chunk\n");
+        }
+    }
+}
+
+bool CapturePipeline::FinishTake(uint64_t stopped_at)
+{
+    EncodeNewSamples(true);
+
+    // Nothing to transcribe (or, with live chunking, nothing since the last chunk went out)
+    bool vad_on = settings.trim_silence || settings.live_chunks;
+    if (vad_on && !vad.HeardSpeech() && (settings.trim_silence || chunk_index > 0))
+    {
+        buffers.Release(encoder->Finish());
+        if (streaming_segment)
+        {
+            streaming_segment->discarded = true;
+            streaming_segment->stream.Abort();
+            streaming_segment.reset();
+        }
+        return false;
+    }
+
+    PublishSegment(take.Size(), true, stopped_at);
+    return true;
+}
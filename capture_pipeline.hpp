@@ -0,0 +1,135 @@
+#pragma once
+
+#include "audio_conditioning.hpp"
+#include "audio_encoder.hpp"
+#include "mp3_buffer_pool.hpp"
+#include "pcm_store.hpp"
+#include "resampler.hpp"
+#include "upload_stream.hpp"
+#include "vad.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct RealtimeSession;
+
+// Milliseconds on a steady clock, for timestamps that both halves of the pipeline compare (e.g.
+// when the user stopped, against when the text went in).
+uint64_t SteadyClockMs();
+
+// A segment whose upload starts while it's still being recorded: the encoder's output goes into
+// `stream` as it's produced. The capture side fills in the rest when it closes the segment,
+// before finishing (or aborting, if it turned out to be silence) the stream.
+struct StreamingSegment
+{
+    UploadStream stream;
+    double audio_duration_seconds = 0.0;
+    double uploaded_duration_seconds = 0.0;
+    bool last_in_take = false;
+    uint64_t stopped_at = 0;
+    bool discarded = false;
+};
+
+// One encoded take, in whatever format the endpoint wants (the name is from when it was always MP3)
+struct Mp3Segment
+{
+    std::vector<char> data;
+    const char* file_name = "output.mp3";
+    const char* mime_type = "audio/mpeg";
+    AudioFormat format = FORMAT_MP3;  // only servers that take it get the segment
+    double audio_duration_seconds = 0.0;     // what the user recorded
+    double uploaded_duration_seconds = 0.0;  // what's left after silence trimming
+
+    // With live chunking, one take is sent as several segments; they're transcribed in order.
+    int take_id = 0;
+    int chunk_index = 0;
+    bool last_in_take = true;
+    uint64_t stopped_at = 0;  // SteadyClockMs() when the user stopped; only on the last one
+
+    // Set (and `data` empty) if the upload was started before the segment was complete; the
+    // fields above that depend on its end are only valid once the stream has finished.
+    std::shared_ptr<StreamingSegment> streaming;
+};
+
+// How a take is recorded; fixed from StartTake() to the end of the take. The sample rates in
+// here are the pipeline's, whatever they say.
+struct CaptureSettings
+{
+    bool condition = false;
+    ConditioningSettings conditioning;
+
+    bool trim_silence = false;
+    bool live_chunks = false;  // send a chunk off whenever the speaker pauses
+    VadSettings vad;           // for either of the above
+
+    bool stream_upload = false;  // queue the segment once the encoder has produced something
+};
+
+// The recording half of the pipeline, shared by the app and whisper_capture: pipeline-rate PCM
+// goes into the take, then through the VAD (for trimming and live chunking) into the encoder,
+// and every segment it closes is handed to `on_segment`. A take with a realtime session also
+// sends its audio up there as it comes in, and commits it with every segment.
+//
+// One take at a time. Not thread-safe: the capture thread calls in while the take runs, and
+// whoever stops it once that thread is done.
+struct CapturePipeline
+{
+    // Whisper resamples everything to 16 kHz anyway, so we do it right after capture; the take,
+    // the VAD and the encoder all run at this rate.
+    static constexpr int SAMPLE_RATE = 16000;
+
+    using SegmentHandler = std::function<void(Mp3Segment segment)>;
+
+    // Encoder output goes into buffers from `buffers`; the segments' data should go back there
+    // once they're sent.
+    CapturePipeline(PcmStore& take, Mp3BufferPool& buffers, SegmentHandler on_segment);
+
+    // Starts a new take (the caller clears the store) with `encoder`; false if that wouldn't start.
+    bool StartTake(int take_id, std::unique_ptr<AudioEncoder> encoder, const CaptureSettings& settings,
+                   std::shared_ptr<RealtimeSession> realtime = nullptr);
+
+    // Conditions (in place) and appends pipeline-rate PCM to the take.
+    void Append(short* pcm, size_t count);
+
+    // Hands whatever part of the take we haven't looked at yet to the encoder, and with live
+    // chunking, sends off what we have whenever the speaker pauses.
+    void EncodeNewSamples(bool final);
+
+    // Encodes the rest of the take and queues its last segment, stamped with `stopped_at`. False
+    // if nothing was queued: the take (or, with live chunking, what came after the last chunk)
+    // was silence, which only gets us hallucinated "thank you"s from Whisper.
+    bool FinishTake(uint64_t stopped_at);
+
+    int TakeId() const { return take_id; }
+    int ChunkIndex() const { return chunk_index; }  // of the chunk being encoded; how many went out
+    bool HasRealtimeSession() const { return realtime != nullptr; }
+
+private:
+    bool StartEncoderSession();
+    void StreamRealtimeAudio();
+    void PublishSegment(size_t chunk_end, bool last_in_take, uint64_t stopped_at);
+    void StreamEncodedBytes();
+
+    PcmStore& take;
+    Mp3BufferPool& buffers;
+    SegmentHandler on_segment;
+
+    std::unique_ptr<AudioEncoder> encoder;
+    CaptureSettings settings;
+    AudioConditioner conditioner;
+    VoiceActivityTrimmer vad;
+    std::vector<SampleRange> vad_ranges;
+    size_t samples_consumed = 0;  // how far into the take the VAD / encoder has got
+
+    int take_id = 0;
+    int chunk_index = 0;
+    size_t chunk_start_sample = 0;  // where in the take the current chunk started
+    std::shared_ptr<StreamingSegment> streaming_segment;
+
+    std::shared_ptr<RealtimeSession> realtime;
+    PolyphaseResampler realtime_resampler;
+    std::vector<short> realtime_pcm;
+    size_t realtime_samples_sent = 0;  // how far into the take has gone up
+};
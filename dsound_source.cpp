@@ -0,0 +1,107 @@
+#include "dsound_source.hpp"
+
+#include <iostream>
+
+DirectSoundSource::DirectSoundSource(LPDIRECTSOUNDCAPTURE8 capture, int sample_rate, DWORD buffer_bytes)
+    : capture(capture), sample_rate(sample_rate), buffer_bytes(buffer_bytes)
+{
+}
+
+DirectSoundSource::~DirectSoundSource()
+{
+    if (buffer)
+    {
+        buffer->Stop();
+        buffer->Release();
+        buffer = NULL;
+    }
+}
+
+bool DirectSoundSource::Open()
+{
+    DSCBUFFERDESC dsbdesc;
+    WAVEFORMATEX wfx;
+
+    // Set up wave format structure.
+    memset(&wfx, 0, sizeof(WAVEFORMATEX));
+    wfx.wFormatTag = WAVE_FORMAT_PCM;
+    wfx.nChannels = 1;
+    wfx.nSamplesPerSec = sample_rate;
+    wfx.wBitsPerSample = 16;
+    wfx.nBlockAlign = wfx.nChannels * (wfx.wBitsPerSample / 8);
+    wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
+
+    // Set up DSBUFFERDESC structure.
+    memset(&dsbdesc, 0, sizeof(DSCBUFFERDESC));
+    dsbdesc.dwSize = sizeof(DSCBUFFERDESC);
+    dsbdesc.dwBufferBytes = buffer_bytes;
+    dsbdesc.lpwfxFormat = &wfx;
+
+    // Create capture buffer.
+    if (!capture || FAILED(capture->CreateCaptureBuffer(&dsbdesc, &buffer, NULL)))
+    {
+        std::cerr << "Failed to create the DirectSound capture buffer." << std::endl;
+        buffer = NULL;
+        return false;
+    }
+
+    read_offset = 0;
+    return true;
+}
+
+void DirectSoundSource::Start()
+{
+    if (buffer)
+    {
+        buffer->Start(DSCBSTART_LOOPING);
+    }
+}
+
+void DirectSoundSource::Stop()
+{
+    if (buffer)
+    {
+        buffer->Stop();
+    }
+}
+
+void DirectSoundSource::Read(std::vector<short>* out)
+{
+    if (!buffer)
+    {
+        return;
+    }
+
+    DWORD readPosition = 0;
+    if (FAILED(buffer->GetCurrentPosition(nullptr, &readPosition)))
+    {
+        return;
+    }
+
+    // The buffer is looping, so the region we read may wrap
+    DWORD available = (readPosition + buffer_bytes - read_offset) % buffer_bytes;
+    available -= available % sizeof(short);
+    if (available == 0)
+    {
+        return;
+    }
+
+    void* part1 = nullptr;
+    void* part2 = nullptr;
+    DWORD part1Bytes = 0;
+    DWORD part2Bytes = 0;
+    if (FAILED(buffer->Lock(read_offset, available, &part1, &part1Bytes, &part2, &part2Bytes, 0)))
+    {
+        return;
+    }
+
+    out->insert(out->end(), (const short*)part1, (const short*)part1 + part1Bytes / sizeof(short));
+    if (part2)
+    {
+        out->insert(out->end(), (const short*)part2, (const short*)part2 + part2Bytes / sizeof(short));
+    }
+
+    buffer->Unlock(part1, part1Bytes, part2, part2Bytes);
+
+    read_offset = (read_offset + available) % buffer_bytes;
+}
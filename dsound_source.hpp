@@ -0,0 +1,31 @@
+#pragma once
+
+#include "audio_source.hpp"
+
+#include <windows.h>
+
+#include <dsound.h>
+
+// The microphone, through a looping DirectSound capture buffer that only has to hold audio until
+// the next Read().
+struct DirectSoundSource : AudioSource
+{
+    DirectSoundSource(LPDIRECTSOUNDCAPTURE8 capture, int sample_rate, DWORD buffer_bytes);
+    ~DirectSoundSource() override;
+
+    DirectSoundSource(const DirectSoundSource&) = delete;
+    DirectSoundSource& operator=(const DirectSoundSource&) = delete;
+
+    bool Open() override;
+    void Start() override;
+    void Stop() override;
+    void Read(std::vector<short>* out) override;
+    int SampleRate() const override { return sample_rate; }
+
+private:
+    LPDIRECTSOUNDCAPTURE8 capture;
+    LPDIRECTSOUNDCAPTUREBUFFER buffer = NULL;
+    int sample_rate;
+    DWORD buffer_bytes;
+    DWORD read_offset = 0;  // next byte of the buffer we haven't read yet
+};
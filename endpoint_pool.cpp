@@ -0,0 +1,344 @@
+#include "endpoint_pool.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+std::vector<std::string> ParseEndpointList(const char* text)
+{
+    std::vector<std::string> urls;
+    if (!text)
+    {
+        return urls;
+    }
+
+    const char* separators = " \t\r\n,;";
+    const char* p = text;
+    while (*p)
+    {
+        p += strspn(p, separators);
+        size_t length = strcspn(p, separators);
+        if (length > 0)
+        {
+            std::string url(p, length);
+            if (std::find(urls.begin(), urls.end(), url) == urls.end())
+            {
+                urls.push_back(url);
+            }
+        }
+        p += length;
+    }
+    return urls;
+}
+
+std::vector<EndpointEntry> ParseEndpointEntries(const char* text, AudioFormat default_format)
+{
+    static const struct
+    {
+        const char* suffix;
+        AudioFormat format;
+    } suffixes[] = {
+        { "#mp3", FORMAT_MP3 },
+        { "#opus", FORMAT_OPUS },
+        { "#flac", FORMAT_FLAC },
+        { "#wav", FORMAT_WAV },
+    };
+
+    std::vector<EndpointEntry> entries;
+    for (const std::string& item : ParseEndpointList(text))
+    {
+        EndpointEntry entry{ item, default_format };
+        for (const auto& suffix : suffixes)
+        {
+            size_t length = strlen(suffix.suffix);
+            if (item.size() > length && item.compare(item.size() - length, length, suffix.suffix) == 0)
+            {
+                entry.url = item.substr(0, item.size() - length);
+                entry.format = suffix.format;
+                break;
+            }
+        }
+
+        // The same server twice is the first one
+        bool listed = std::any_of(entries.begin(), entries.end(), [&entry](const EndpointEntry& other) {
+            return other.url == entry.url;
+        });
+        if (!listed)
+        {
+            entries.push_back(entry);
+        }
+    }
+    return entries;
+}
+
+void EndpointPool::SetServerEntries(const std::vector<EndpointEntry>& entries)
+{
+    bool unchanged = entries.size() == servers.size() &&
+        std::equal(entries.begin(), entries.end(), servers.begin(), [](const EndpointEntry& entry, const Server& server) {
+            return entry.url == server.url && entry.format == server.format;
+        });
+    if (unchanged)
+    {
+        return;
+    }
+
+    std::vector<Server> updated;
+    updated.reserve(entries.size());
+    for (const EndpointEntry& entry : entries)
+    {
+        Server* known = Find(entry.url);
+        if (known)
+        {
+            updated.push_back(*known);
+        }
+        else
+        {
+            Server server;
+            server.url = entry.url;
+            updated.push_back(server);
+        }
+        updated.back().format = entry.format;
+    }
+    servers.swap(updated);
+}
+
+void EndpointPool::SetServers(const std::vector<std::string>& urls)
+{
+    std::vector<EndpointEntry> entries;
+    entries.reserve(urls.size());
+    for (const std::string& url : urls)
+    {
+        entries.push_back({ url, FORMAT_MP3 });
+    }
+    SetServerEntries(entries);
+}
+
+EndpointPool::Server* EndpointPool::Find(const std::string& url)
+{
+    for (Server& server : servers)
+    {
+        if (server.url == url)
+        {
+            return &server;
+        }
+    }
+    return nullptr;
+}
+
+double EndpointPool::PredictedSeconds(const Server& server, double audio_seconds, double unknown_seconds) const
+{
+    if (server.samples == 0)
+    {
+        return unknown_seconds;
+    }
+    if (audio_seconds > 0.0 && server.ewma_realtime_factor > 0.0)
+    {
+        return audio_seconds / server.ewma_realtime_factor;
+    }
+    return server.ewma_seconds;
+}
+
+std::string EndpointPool::Pick(double audio_seconds, const std::string& exclude, AudioFormat format) const
+{
+    // A server that would have to be sent a format it didn't ask for is a last resort
+    bool any_format = format == FORMAT_COUNT ||
+        std::none_of(servers.begin(), servers.end(), [format](const Server& server) { return server.format == format; });
+
+    // A server we know nothing about yet is assumed to be as fast as the average of the others,
+    // so it gets tried without being swamped.
+    double known_total = 0.0;
+    int known = 0;
+    for (const Server& server : servers)
+    {
+        if (server.samples > 0)
+        {
+            known_total += PredictedSeconds(server, audio_seconds, 0.0);
+            known += 1;
+        }
+    }
+    double unknown_seconds = known > 0 ? known_total / known : UNKNOWN_SERVER_SECONDS;
+
+    const Server* best = nullptr;
+    double best_score = std::numeric_limits<double>::infinity();
+    const Server* soonest_back = nullptr;
+    for (const Server& server : servers)
+    {
+        if (server.url == exclude || (!any_format && server.format != format))
+        {
+            continue;
+        }
+        if (server.state == State::Open)
+        {
+            if (!soonest_back || server.open_until < soonest_back->open_until)
+            {
+                soonest_back = &server;
+            }
+            continue;
+        }
+        if (server.state == State::HalfOpen)
+        {
+            // It only gets back in by handling requests, but one at a time until it has a few right
+            if (server.in_flight == 0)
+            {
+                return server.url;
+            }
+            continue;
+        }
+
+        // Each request already running there is roughly one more in line ahead of this one
+        double score = PredictedSeconds(server, audio_seconds, unknown_seconds) * (1 + server.in_flight);
+        if (score < best_score)
+        {
+            best = &server;
+            best_score = score;
+        }
+    }
+
+    if (!best)
+    {
+        best = soonest_back;
+    }
+    return best ? best->url : std::string();
+}
+
+void EndpointPool::OnRequestStarted(const std::string& url)
+{
+    if (Server* server = Find(url))
+    {
+        server->in_flight += 1;
+        server->requests += 1;
+    }
+}
+
+void EndpointPool::Open(Server* server, uint64_t now)
+{
+    server->state = State::Open;
+    server->backoff_ms = server->backoff_ms == 0 ? FIRST_BACKOFF_MS : std::min(server->backoff_ms * 2, MAX_BACKOFF_MS);
+    server->open_until = now + server->backoff_ms;
+    server->half_open_successes = 0;
+}
+
+void EndpointPool::OnRequestFinished(const std::string& url, bool server_ok, double seconds, double audio_seconds, uint64_t now)
+{
+    Server* server = Find(url);
+    if (!server)
+    {
+        return;  // taken off the list in the meantime
+    }
+    server->in_flight = std::max(0, server->in_flight - 1);
+
+    if (!server_ok)
+    {
+        server->failures += 1;
+        server->consecutive_failures += 1;
+        if (server->state == State::HalfOpen ||
+            (server->state == State::Closed && server->consecutive_failures >= FAILURES_TO_OPEN))
+        {
+            Open(server, now);
+        }
+        return;
+    }
+
+    server->consecutive_failures = 0;
+    if (seconds >= 0.0)
+    {
+        double realtime_factor = (audio_seconds > 0.0 && seconds > 0.0) ? audio_seconds / seconds : 0.0;
+        if (server->samples == 0)
+        {
+            server->ewma_seconds = seconds;
+            server->ewma_realtime_factor = realtime_factor;
+        }
+        else
+        {
+            server->ewma_seconds += EWMA_WEIGHT * (seconds - server->ewma_seconds);
+            if (realtime_factor > 0.0)
+            {
+                server->ewma_realtime_factor = server->ewma_realtime_factor > 0.0
+                    ? server->ewma_realtime_factor + EWMA_WEIGHT * (realtime_factor - server->ewma_realtime_factor)
+                    : realtime_factor;
+            }
+        }
+        server->samples += 1;
+    }
+
+    if (server->state == State::Open)
+    {
+        // Got a request through while it was out (every server was), which is as good as a probe
+        server->state = State::HalfOpen;
+        server->half_open_successes = 0;
+    }
+    if (server->state == State::HalfOpen)
+    {
+        server->half_open_successes += 1;
+        if (server->half_open_successes >= SUCCESSES_TO_CLOSE)
+        {
+            server->state = State::Closed;
+            server->backoff_ms = 0;
+        }
+    }
+}
+
+void EndpointPool::OnRequestCancelled(const std::string& url)
+{
+    if (Server* server = Find(url))
+    {
+        server->in_flight = std::max(0, server->in_flight - 1);
+    }
+}
+
+std::vector<std::string> EndpointPool::StartDueProbes(uint64_t now)
+{
+    std::vector<std::string> due;
+    for (Server& server : servers)
+    {
+        if (server.state == State::Open && !server.probing && now >= server.open_until)
+        {
+            server.probing = true;
+            due.push_back(server.url);
+        }
+    }
+    return due;
+}
+
+void EndpointPool::OnProbeFinished(const std::string& url, bool server_ok, uint64_t now)
+{
+    Server* server = Find(url);
+    if (!server)
+    {
+        return;
+    }
+    server->probing = false;
+    if (server->state != State::Open)
+    {
+        return;
+    }
+
+    if (server_ok)
+    {
+        server->state = State::HalfOpen;
+        server->half_open_successes = 0;
+        server->consecutive_failures = 0;
+    }
+    else
+    {
+        Open(server, now);
+    }
+}
+
+std::string EndpointPool::Describe() const
+{
+    std::string text;
+    for (const Server& server : servers)
+    {
+        const char* state = server.state == State::Closed ? "up"
+            : server.state == State::HalfOpen ? "on probation"
+            : "out";
+        char line[512];
+        snprintf(line, sizeof(line), "  %s: %s, %d in flight, %.2fs avg, %.1fx realtime, %d of %d requests failed\n",
+                 server.url.c_str(), state, server.in_flight, server.ewma_seconds, server.ewma_realtime_factor,
+                 server.failures, server.requests);
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "audio_encoder.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Splits the custom endpoint setting into server URLs (separated by whitespace, commas or
+// semicolons).
+std::vector<std::string> ParseEndpointList(const char* text);
+
+// A server from the custom endpoint setting, and the upload format it gets.
+struct EndpointEntry
+{
+    std::string url;
+    AudioFormat format = FORMAT_MP3;
+};
+
+// Same, but an entry can end in "#mp3", "#opus", "#flac" or "#wav" for a server that wants its own
+// format (e.g. "http://gpu:8080/inference#flac"); that's split off, and the rest get `default_format`.
+std::vector<EndpointEntry> ParseEndpointEntries(const char* text, AudioFormat default_format);
+
+// A set of interchangeable Whisper servers, and which one the next request should go to. Each
+// server's recent speed is kept as moving averages; a server that keeps failing is taken out by a
+// circuit breaker, and let back in a little at a time once health probes get through to it again.
+// Only bookkeeping: the caller makes the requests and passes in the time (in ms, any origin), so
+// it can be driven by anything. Not thread-safe.
+struct EndpointPool
+{
+    enum class State
+    {
+        Closed,    // taking requests
+        Open,      // taken out; probed once `open_until` has passed
+        HalfOpen,  // a probe got through: one trial request at a time until it has proven itself
+    };
+
+    struct Server
+    {
+        std::string url;
+        AudioFormat format = FORMAT_MP3;
+        State state = State::Closed;
+        int in_flight = 0;
+
+        int samples = 0;  // requests that went into the averages
+        double ewma_seconds = 0.0;
+        double ewma_realtime_factor = 0.0;  // seconds of audio per second of request
+
+        int consecutive_failures = 0;
+        int half_open_successes = 0;
+        uint64_t open_until = 0;
+        uint64_t backoff_ms = 0;
+        bool probing = false;
+
+        int requests = 0;
+        int failures = 0;
+    };
+
+    static constexpr double EWMA_WEIGHT = 0.3;              // of the newest sample
+    static constexpr int FAILURES_TO_OPEN = 3;              // in a row
+    static constexpr int SUCCESSES_TO_CLOSE = 3;            // in a row, while half-open
+    static constexpr uint64_t FIRST_BACKOFF_MS = 5000;
+    static constexpr uint64_t MAX_BACKOFF_MS = 60000;
+    static constexpr double UNKNOWN_SERVER_SECONDS = 1.0;   // guess when nobody has samples yet
+
+    // Keeps what it knows about servers that are still on the list. Without formats, they all
+    // take MP3.
+    void SetServerEntries(const std::vector<EndpointEntry>& entries);
+    void SetServers(const std::vector<std::string>& urls);
+
+    const std::vector<Server>& Servers() const { return servers; }
+
+    // The server a request for `audio_seconds` of audio should go to, other than `exclude`: a
+    // server on probation that isn't busy with a trial request, or else the one it should be done
+    // soonest on, given how fast each has been and how busy it is now. If every server is out, the
+    // one due back soonest. Empty with no servers (besides `exclude`). Only the servers that take
+    // `format` are considered, unless there are none; FORMAT_COUNT for any.
+    std::string Pick(double audio_seconds, const std::string& exclude = {}, AudioFormat format = FORMAT_COUNT) const;
+
+    void OnRequestStarted(const std::string& url);
+
+    // `server_ok` is whether the server did its job (no connection failure, timeout or 5xx).
+    // `seconds` < 0 leaves the averages alone, for requests whose time says nothing about the
+    // server (a streamed upload, open while the user was still talking).
+    void OnRequestFinished(const std::string& url, bool server_ok, double seconds, double audio_seconds, uint64_t now);
+
+    // We stopped waiting for it (another server answered first).
+    void OnRequestCancelled(const std::string& url);
+
+    // Servers that are out and due for a health probe, marked as being probed.
+    std::vector<std::string> StartDueProbes(uint64_t now);
+    void OnProbeFinished(const std::string& url, bool server_ok, uint64_t now);
+
+    std::string Describe() const;  // one line per server, for the log
+
+private:
+    Server* Find(const std::string& url);
+    double PredictedSeconds(const Server& server, double audio_seconds, double unknown_seconds) const;
+    void Open(Server* server, uint64_t now);
+
+    std::vector<Server> servers;
+};
@@ -0,0 +1,143 @@
+#include "file_audio_source.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+
+uint32_t ReadLE32(const char* p)
+{
+    const unsigned char* u = (const unsigned char*)p;
+    return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+uint16_t ReadLE16(const char* p)
+{
+    const unsigned char* u = (const unsigned char*)p;
+    return (uint16_t)(u[0] | (u[1] << 8));
+}
+
+}  // namespace
+
+FileAudioSource::FileAudioSource(std::string path, ReplayPacing pacing, int raw_sample_rate)
+    : path(std::move(path)), pacing(pacing), sample_rate(raw_sample_rate)
+{
+}
+
+bool FileAudioSource::ParseWav(const std::vector<char>& file)
+{
+    int channels = 0;
+    int bits = 0;
+    int format = 0;
+
+    // Walk the chunks after "RIFF....WAVE"; they're word-aligned
+    size_t pos = 12;
+    while (pos + 8 <= file.size())
+    {
+        const char* id = file.data() + pos;
+        size_t size = ReadLE32(file.data() + pos + 4);
+        size_t body = pos + 8;
+        size = std::min(size, file.size() - body);
+
+        if (memcmp(id, "fmt ", 4) == 0 && size >= 16)
+        {
+            format = ReadLE16(file.data() + body);
+            channels = ReadLE16(file.data() + body + 2);
+            sample_rate = (int)ReadLE32(file.data() + body + 4);
+            bits = ReadLE16(file.data() + body + 14);
+        }
+        else if (memcmp(id, "data", 4) == 0)
+        {
+            // 1 is PCM; 0xFFFE (extensible) is what a lot of tools write for plain PCM too
+            if ((format != 1 && format != 0xFFFE) || bits != 16 || channels < 1)
+            {
+                std::cerr << path << ": only 16-bit PCM WAV files are supported" << std::endl;
+                return false;
+            }
+
+            const short* pcm = (const short*)(file.data() + body);
+            size_t frames = size / (sizeof(short) * channels);
+            samples.resize(frames);
+            for (size_t i = 0; i < frames; i++)
+            {
+                int sum = 0;
+                for (int c = 0; c < channels; c++)
+                {
+                    sum += pcm[i * channels + c];
+                }
+                samples[i] = (short)(sum / channels);
+            }
+            return true;
+        }
+
+        pos = body + size + (size & 1);
+    }
+
+    std::cerr << path << ": no audio data found" << std::endl;
+    return false;
+}
+
+bool FileAudioSource::Open()
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    samples.clear();
+    position = 0;
+    if (file.size() >= 12 && memcmp(file.data(), "RIFF", 4) == 0 && memcmp(file.data() + 8, "WAVE", 4) == 0)
+    {
+        return ParseWav(file);
+    }
+
+    // Headerless: 16-bit mono at the rate we were given
+    samples.resize(file.size() / sizeof(short));
+    memcpy(samples.data(), file.data(), samples.size() * sizeof(short));
+    return true;
+}
+
+void FileAudioSource::Start()
+{
+    started_at = std::chrono::steady_clock::now();
+    running = true;
+}
+
+void FileAudioSource::Stop()
+{
+    stopped_at = std::chrono::steady_clock::now();
+    running = false;
+}
+
+void FileAudioSource::Read(std::vector<short>* out)
+{
+    size_t until = samples.size();
+    if (pacing == ReplayPacing::RealTime)
+    {
+        auto now = running ? std::chrono::steady_clock::now() : stopped_at;
+        double elapsed = std::chrono::duration<double>(now - started_at).count();
+        until = std::min(until, (size_t)(std::max(0.0, elapsed) * sample_rate));
+    }
+    else if (running)
+    {
+        until = std::min(until, position + (size_t)FAST_READ_SECONDS * sample_rate);
+    }
+    else
+    {
+        until = position;
+    }
+
+    if (until > position)
+    {
+        out->insert(out->end(), samples.begin() + position, samples.begin() + until);
+        position = until;
+    }
+}
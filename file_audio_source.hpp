@@ -0,0 +1,47 @@
+#pragma once
+
+#include "audio_source.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class ReplayPacing
+{
+    RealTime,        // hands samples out as a microphone would
+    AsFastAsPossible // FAST_READ_SECONDS per Read(), however often that gets called
+};
+
+// Replays a recording instead of the microphone, so that everything after capture (encoding,
+// upload, post-processing, injection) can be exercised without anybody talking. Reads 16-bit PCM
+// WAV files (multi-channel ones get downmixed) or headerless 16-bit mono at a given rate.
+struct FileAudioSource : AudioSource
+{
+    static constexpr int FAST_READ_SECONDS = 5;
+
+    FileAudioSource(std::string path, ReplayPacing pacing, int raw_sample_rate = 16000);
+
+    bool Open() override;
+    void Start() override;
+    void Stop() override;
+    void Read(std::vector<short>* out) override;
+    int SampleRate() const override { return sample_rate; }
+    bool Finished() const override { return position >= samples.size(); }
+
+    size_t TotalSamples() const { return samples.size(); }
+
+private:
+    bool ParseWav(const std::vector<char>& file);
+
+    std::string path;
+    ReplayPacing pacing;
+    int sample_rate;
+
+    std::vector<short> samples;
+    size_t position = 0;
+    // Like a stopped capture buffer, a stopped replay still hands out what it had "recorded" by then
+    bool running = false;
+    std::chrono::steady_clock::time_point started_at;
+    std::chrono::steady_clock::time_point stopped_at;
+};
@@ -0,0 +1,103 @@
+#include "flac_encoder.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+FlacStreamEncoder::~FlacStreamEncoder()
+{
+    Close();
+}
+
+void FlacStreamEncoder::Close()
+{
+    if (encoder)
+    {
+        FLAC__stream_encoder_delete(encoder);
+        encoder = nullptr;
+    }
+}
+
+FLAC__StreamEncoderWriteStatus FlacStreamEncoder::WriteCallback(const FLAC__StreamEncoder*,
+                                                                const FLAC__byte buffer[],
+                                                                size_t bytes,
+                                                                uint32_t,
+                                                                uint32_t,
+                                                                void* client_data)
+{
+    FlacStreamEncoder* self = static_cast<FlacStreamEncoder*>(client_data);
+    self->output.insert(self->output.end(), (const char*)buffer, (const char*)buffer + bytes);
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+bool FlacStreamEncoder::Start(int rate, std::vector<char> buffer)
+{
+    Close();
+    output = std::move(buffer);
+    output.clear();
+    samples_encoded = 0;
+
+    encoder = FLAC__stream_encoder_new();
+    if (!encoder)
+    {
+        std::cerr << "Failed to create FLAC encoder." << std::endl;
+        return false;
+    }
+
+    FLAC__stream_encoder_set_channels(encoder, 1);
+    FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+    FLAC__stream_encoder_set_sample_rate(encoder, rate);
+    FLAC__stream_encoder_set_compression_level(encoder, COMPRESSION_LEVEL);
+
+    // No seek callback: we never go back to patch STREAMINFO, so the total sample count stays 0
+    // ("unknown"), which every decoder we care about accepts.
+    FLAC__StreamEncoderInitStatus status = FLAC__stream_encoder_init_stream(
+        encoder, &FlacStreamEncoder::WriteCallback, nullptr, nullptr, nullptr, this);
+    if (status != FLAC__STREAM_ENCODER_INIT_STATUS_OK)
+    {
+        std::cerr << "Failed to initialize FLAC encoder: " << FLAC__StreamEncoderInitStatusString[status] << std::endl;
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool FlacStreamEncoder::Encode(const short* pcm, size_t num_samples)
+{
+    if (!encoder)
+    {
+        return false;
+    }
+
+    widened.resize(num_samples);
+    std::copy(pcm, pcm + num_samples, widened.begin());
+
+    if (!FLAC__stream_encoder_process_interleaved(encoder, widened.data(), (uint32_t)num_samples))
+    {
+        std::cerr << "FLAC encoding failed: "
+                  << FLAC__StreamEncoderStateString[FLAC__stream_encoder_get_state(encoder)] << std::endl;
+        return false;
+    }
+    samples_encoded += num_samples;
+    return true;
+}
+
+std::vector<char> FlacStreamEncoder::Finish()
+{
+    if (!encoder)
+    {
+        return {};
+    }
+
+    FLAC__stream_encoder_finish(encoder);
+    Close();
+    return std::move(output);
+}
+
+std::vector<char> FlacStreamEncoder::TakeOutput(std::vector<char> next)
+{
+    std::vector<char> taken = std::move(output);
+    output = std::move(next);
+    output.clear();
+    return taken;
+}
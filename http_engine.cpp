@@ -0,0 +1,215 @@
+#include "http_engine.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+// curl_multi_poll() wakes up for sockets and curl_multi_wakeup(); this only bounds how long a
+// missed wakeup could leave things sitting.
+constexpr int POLL_TIMEOUT_MS = 1000;
+
+}  // namespace
+
+bool HttpEngine::Start()
+{
+    if (multi)
+    {
+        return true;
+    }
+
+    multi = curl_multi_init();
+    if (!multi)
+    {
+        return false;
+    }
+
+    // Several requests to the same HTTP/2 server share one connection
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    stopping = false;
+    thread = std::thread(&HttpEngine::Loop, this);
+    return true;
+}
+
+void HttpEngine::Stop()
+{
+    if (!multi)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    curl_multi_wakeup(multi);
+    thread.join();
+
+    for (auto& [curl, done] : transfers)
+    {
+        curl_multi_remove_handle(multi, curl);
+    }
+    transfers.clear();
+    submitted.clear();
+    tasks.clear();
+    timers.clear();
+
+    curl_multi_cleanup(multi);
+    multi = nullptr;
+}
+
+void HttpEngine::Submit(CURL* curl, Completion done)
+{
+    if (OnLoopThread())
+    {
+        AddTransfer(curl, std::move(done));
+        return;
+    }
+
+    // Not a Post()ed task: Cancel() has to be able to find it before the loop gets to it
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        submitted.emplace_back(curl, std::move(done));
+    }
+    curl_multi_wakeup(multi);
+}
+
+void HttpEngine::AddTransfer(CURL* curl, Completion done)
+{
+    transfers[curl] = std::move(done);
+    curl_multi_add_handle(multi, curl);
+}
+
+void HttpEngine::Post(Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    curl_multi_wakeup(multi);
+}
+
+void HttpEngine::PostDelayed(int delay_ms, Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timers.emplace(Clock::now() + std::chrono::milliseconds(delay_ms), std::move(task));
+    }
+    // So the loop picks a shorter poll timeout if this is the next one due
+    curl_multi_wakeup(multi);
+}
+
+void HttpEngine::Cancel(CURL* curl)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto pending = [curl](const std::pair<CURL*, Completion>& s) { return s.first == curl; };
+        submitted.erase(std::remove_if(submitted.begin(), submitted.end(), pending), submitted.end());
+    }
+
+    auto it = transfers.find(curl);
+    if (it == transfers.end())
+    {
+        return;
+    }
+    curl_multi_remove_handle(multi, curl);
+    transfers.erase(it);
+}
+
+void HttpEngine::RunTasks()
+{
+    std::vector<std::pair<CURL*, Completion>> adding;
+    std::vector<Task> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        adding.swap(submitted);
+        ready.swap(tasks);
+
+        // Timers that are due go after the plain tasks that were already waiting
+        Clock::time_point now = Clock::now();
+        while (!timers.empty() && timers.begin()->first <= now)
+        {
+            ready.push_back(std::move(timers.begin()->second));
+            timers.erase(timers.begin());
+        }
+    }
+    for (auto& [curl, done] : adding)
+    {
+        AddTransfer(curl, std::move(done));
+    }
+    for (Task& task : ready)
+    {
+        task();
+    }
+}
+
+void HttpEngine::ReapFinished()
+{
+    int queued = 0;
+    while (CURLMsg* message = curl_multi_info_read(multi, &queued))
+    {
+        if (message->msg != CURLMSG_DONE)
+        {
+            continue;
+        }
+
+        CURL* curl = message->easy_handle;
+        CURLcode result = message->data.result;
+        curl_multi_remove_handle(multi, curl);
+
+        auto it = transfers.find(curl);
+        if (it == transfers.end())
+        {
+            continue;
+        }
+        Completion done = std::move(it->second);
+        transfers.erase(it);
+
+        // May well submit the next request
+        done(result, HttpTransport::ReadTimings(curl));
+    }
+}
+
+// Until the next timer is due, but no longer than POLL_TIMEOUT_MS.
+int HttpEngine::PollTimeoutMs()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (timers.empty())
+    {
+        return POLL_TIMEOUT_MS;
+    }
+
+    auto until_due = std::chrono::ceil<std::chrono::milliseconds>(timers.begin()->first - Clock::now());
+    return (int)std::clamp<long long>(until_due.count(), 0, POLL_TIMEOUT_MS);
+}
+
+void HttpEngine::Loop()
+{
+    while (true)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+            {
+                break;
+            }
+        }
+
+        RunTasks();
+
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        ReapFinished();
+
+        // Completions may have queued more work; don't sleep on it
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!tasks.empty() || !submitted.empty() || stopping)
+            {
+                continue;
+            }
+        }
+        curl_multi_poll(multi, nullptr, 0, PollTimeoutMs(), nullptr);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "http_transport.hpp"
+
+#include <curl/curl.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// An event loop around curl_multi on its own thread: any number of transfers run at once without
+// anybody blocking on them. Completions and posted tasks all run on that one thread, so state
+// that only they touch needs no locking.
+struct HttpEngine
+{
+    using Completion = std::function<void(CURLcode result, const HttpTimings& timings)>;
+    using Task = std::function<void()>;
+
+    HttpEngine() = default;
+    ~HttpEngine() { Stop(); }
+
+    HttpEngine(const HttpEngine&) = delete;
+    HttpEngine& operator=(const HttpEngine&) = delete;
+
+    bool Start();
+
+    // Abandons whatever is still in flight; their completions never run.
+    void Stop();
+
+    // Starts a transfer for a fully set up handle; `done` runs on the loop thread once it's over,
+    // and the handle is the caller's again from then on. Any thread; on the loop thread, the
+    // transfer is under way (and can be cancelled) straight away.
+    void Submit(CURL* curl, Completion done);
+
+    // Runs `task` on the loop thread. Any thread.
+    void Post(Task task);
+
+    // Same, but not before `delay_ms` from now. There's no cancelling it; the task should check
+    // whether it's still wanted.
+    void PostDelayed(int delay_ms, Task task);
+
+    // Stops a transfer that was submitted, whether or not the loop has picked it up yet; its
+    // completion never runs, and the handle is the caller's again right away. Loop thread only.
+    void Cancel(CURL* curl);
+
+    bool OnLoopThread() const { return std::this_thread::get_id() == thread.get_id(); }
+
+    // Loop thread only.
+    size_t InFlight() const { return transfers.size(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void Loop();
+    void AddTransfer(CURL* curl, Completion done);
+    void RunTasks();
+    void ReapFinished();
+    int PollTimeoutMs();
+
+    CURLM* multi = nullptr;
+    std::thread thread;
+
+    std::mutex mutex;  // for the four below
+    std::vector<std::pair<CURL*, Completion>> submitted;  // from other threads, not added yet
+    std::vector<Task> tasks;
+    std::multimap<Clock::time_point, Task> timers;
+    bool stopping = false;
+
+    std::map<CURL*, Completion> transfers;
+};
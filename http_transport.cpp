@@ -0,0 +1,182 @@
+#include "http_transport.hpp"
+
+#include <cstdio>
+
+namespace
+{
+
+// How long curl may keep a loaded CA store around for new connections instead of reading it again.
+constexpr long CA_CACHE_SECONDS = 24 * 60 * 60;
+
+double Seconds(curl_off_t microseconds)
+{
+    return microseconds / 1e6;
+}
+
+}  // namespace
+
+std::string UrlOrigin(const std::string& url)
+{
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos)
+    {
+        return url;
+    }
+    size_t host_end = url.find_first_of("/?#", scheme_end + 3);
+    return url.substr(0, host_end);
+}
+
+HttpTransport::HttpTransport()
+{
+    share = curl_share_init();
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, &HttpTransport::Lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, &HttpTransport::Unlock);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+HttpTransport::~HttpTransport()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [origin, handles] : idle)
+    {
+        for (CURL* curl : handles)
+        {
+            curl_easy_cleanup(curl);
+        }
+    }
+    idle.clear();
+
+    // Handles still out would be using the share; leaking it beats crashing at exit
+    if (origins.empty())
+    {
+        curl_share_cleanup(share);
+    }
+}
+
+void HttpTransport::Lock(CURL*, curl_lock_data data, curl_lock_access, void* user)
+{
+    static_cast<HttpTransport*>(user)->share_mutexes[data].lock();
+}
+
+void HttpTransport::Unlock(CURL*, curl_lock_data data, void* user)
+{
+    static_cast<HttpTransport*>(user)->share_mutexes[data].unlock();
+}
+
+CURL* HttpTransport::Acquire(const std::string& url)
+{
+    std::string origin = UrlOrigin(url);
+    CURL* curl = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<CURL*>& handles = idle[origin];
+        if (!handles.empty())
+        {
+            curl = handles.back();
+            handles.pop_back();
+        }
+    }
+
+    if (curl)
+    {
+        // Forgets the options from last time; connections and caches stay
+        curl_easy_reset(curl);
+    }
+    else
+    {
+        curl = curl_easy_init();
+        if (!curl)
+        {
+            return nullptr;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        origins[curl] = origin;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA);
+    curl_easy_setopt(curl, CURLOPT_CA_CACHE_TIMEOUT, CA_CACHE_SECONDS);
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    return curl;
+}
+
+void HttpTransport::Release(CURL* curl)
+{
+    if (!curl)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = origins.find(curl);
+    if (it == origins.end())
+    {
+        curl_easy_cleanup(curl);
+        return;
+    }
+    idle[it->second].push_back(curl);
+    origins.erase(it);
+}
+
+HttpTimings HttpTransport::ReadTimings(CURL* curl)
+{
+    curl_off_t dns = 0, connect = 0, tls = 0, ttfb = 0, total = 0;
+    long new_connections = 0;
+    long http_version = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+    curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &http_version);
+
+    HttpTimings timings;
+    timings.dns = Seconds(dns);
+    timings.connect = Seconds(connect);
+    timings.tls = Seconds(tls);
+    timings.ttfb = Seconds(ttfb);
+    timings.total = Seconds(total);
+    timings.reused_connection = (new_connections == 0);
+    timings.http_version = http_version;
+    return timings;
+}
+
+CURLcode HttpTransport::Perform(CURL* curl, HttpTimings* timings)
+{
+    CURLcode res = curl_easy_perform(curl);
+    if (timings)
+    {
+        *timings = ReadTimings(curl);
+    }
+    return res;
+}
+
+std::string DescribeTimings(const HttpTimings& timings)
+{
+    const char* version = timings.http_version == CURL_HTTP_VERSION_2_0 ? "HTTP/2"
+        : timings.http_version == CURL_HTTP_VERSION_3 ? "HTTP/3"
+        : "HTTP/1.1";
+
+    char buffer[160];
+    if (timings.reused_connection)
+    {
+        snprintf(buffer, sizeof(buffer), "reused %s, ttfb %.0f ms, total %.0f ms",
+                 version, timings.ttfb * 1000, timings.total * 1000);
+    }
+    else
+    {
+        snprintf(buffer, sizeof(buffer), "new %s, dns %.0f ms, connect %.0f ms, tls %.0f ms, ttfb %.0f ms, total %.0f ms",
+                 version, timings.dns * 1000, timings.connect * 1000, timings.tls * 1000,
+                 timings.ttfb * 1000, timings.total * 1000);
+    }
+    return buffer;
+}
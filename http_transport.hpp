@@ -0,0 +1,60 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Where the time of one request went, from curl's point of view. Everything is in seconds from
+// the start of the request; the phases we skipped on a reused connection are zero.
+struct HttpTimings
+{
+    double dns = 0.0;
+    double connect = 0.0;   // TCP done
+    double tls = 0.0;       // handshake done (0 for plain HTTP)
+    double ttfb = 0.0;      // first response byte
+    double total = 0.0;
+    bool reused_connection = false;
+    long http_version = 0;  // CURL_HTTP_VERSION_*
+};
+
+// Long-lived home for our curl handles. Handles are kept per origin (scheme://host:port) and
+// reused, and they all share one DNS cache, TLS session cache and connection pool, so a request to
+// an endpoint we've talked to recently skips the resolve, TCP and TLS round trips. Thread-safe.
+struct HttpTransport
+{
+    HttpTransport();
+    ~HttpTransport();
+
+    HttpTransport(const HttpTransport&) = delete;
+    HttpTransport& operator=(const HttpTransport&) = delete;
+
+    // A handle for `url`, with the URL and our common options set (connection sharing, HTTP/2,
+    // native CA store); the caller adds the rest. Give it back with Release().
+    CURL* Acquire(const std::string& url);
+    void Release(CURL* curl);
+
+    // curl_easy_perform(), plus where the time went.
+    CURLcode Perform(CURL* curl, HttpTimings* timings);
+
+    static HttpTimings ReadTimings(CURL* curl);
+
+private:
+    static void Lock(CURL*, curl_lock_data data, curl_lock_access, void* user);
+    static void Unlock(CURL*, curl_lock_data data, void* user);
+
+    CURLSH* share = nullptr;
+    std::mutex share_mutexes[CURL_LOCK_DATA_LAST];
+
+    std::mutex mutex;
+    std::map<std::string, std::vector<CURL*>> idle;  // by origin
+    std::map<CURL*, std::string> origins;            // of the handles out there
+};
+
+// scheme://host[:port] of a URL, or the URL itself if it doesn't parse.
+std::string UrlOrigin(const std::string& url);
+
+// One-line summary for logs, e.g. "reused HTTP/2, ttfb 210 ms, total 640 ms".
+std::string DescribeTimings(const HttpTimings& timings);
@@ -0,0 +1,30 @@
+#include "latency_window.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+void LatencyWindow::Add(double milliseconds)
+{
+    samples.push_back(milliseconds);
+    while (samples.size() > capacity)
+    {
+        samples.pop_front();
+    }
+}
+
+double LatencyWindow::Percentile(double percent, size_t min_samples, double fallback) const
+{
+    if (samples.empty() || samples.size() < min_samples)
+    {
+        return fallback;
+    }
+
+    // Nearest rank
+    std::vector<double> sorted(samples.begin(), samples.end());
+    double clamped = std::clamp(percent, 0.0, 100.0);
+    size_t rank = (size_t)std::ceil(clamped / 100.0 * sorted.size());
+    size_t index = rank > 0 ? rank - 1 : 0;
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+
+// The last few hundred latencies of some kind of request (or latencies per something, such as per
+// second of audio), for picking a timeout or hedge delay from what they've actually been like
+// lately. Not thread-safe.
+struct LatencyWindow
+{
+    static constexpr size_t DEFAULT_CAPACITY = 200;
+
+    explicit LatencyWindow(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+    void Add(double milliseconds);
+
+    // The given percentile (0-100) of what's in the window, or `fallback` with fewer than
+    // `min_samples` in it.
+    double Percentile(double percent, size_t min_samples, double fallback) const;
+
+    size_t Count() const { return samples.size(); }
+
+private:
+    size_t capacity;
+    std::deque<double> samples;  // oldest first
+};
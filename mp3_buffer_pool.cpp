@@ -0,0 +1,75 @@
+#include "mp3_buffer_pool.hpp"
+
+#include <algorithm>
+
+std::vector<char> Mp3BufferPool::Acquire(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.acquires += 1;
+
+    // Smallest retained buffer that is already big enough; failing that, the biggest one, since
+    // growing that is still cheaper than starting from nothing.
+    auto best = retained.end();
+    for (auto it = retained.begin(); it != retained.end(); ++it)
+    {
+        bool fits = it->capacity() >= capacity;
+        if (best == retained.end())
+        {
+            best = it;
+        }
+        else if (fits && (best->capacity() < capacity || it->capacity() < best->capacity()))
+        {
+            best = it;
+        }
+        else if (!fits && best->capacity() < capacity && it->capacity() > best->capacity())
+        {
+            best = it;
+        }
+    }
+
+    std::vector<char> buffer;
+    if (best != retained.end())
+    {
+        buffer = std::move(*best);
+        retained.erase(best);
+        stats.bytes_retained -= buffer.capacity();
+        if (buffer.capacity() >= capacity)
+        {
+            stats.allocations_avoided += 1;
+        }
+    }
+
+    buffer.clear();
+    buffer.reserve(capacity);
+    return buffer;
+}
+
+void Mp3BufferPool::Release(std::vector<char> buffer)
+{
+    if (buffer.capacity() == 0 || buffer.capacity() > MAX_RETAINED_BYTES)
+    {
+        return;
+    }
+
+    buffer.clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.bytes_retained += buffer.capacity();
+    retained.push_back(std::move(buffer));
+
+    // Over the limit: drop the smallest, it's the least useful for the next long take
+    if (retained.size() > MAX_RETAINED_BUFFERS)
+    {
+        auto smallest = std::min_element(retained.begin(), retained.end(), [](const auto& a, const auto& b) {
+            return a.capacity() < b.capacity();
+        });
+        stats.bytes_retained -= smallest->capacity();
+        retained.erase(smallest);
+    }
+}
+
+Mp3BufferPool::Stats Mp3BufferPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Keeps the backing storage of finished MP3 segments around once they've been uploaded, so the
+// next recording can encode into an existing allocation instead of growing a fresh vector.
+struct Mp3BufferPool
+{
+    // Bounds on what we hang on to between recordings.
+    static constexpr size_t MAX_RETAINED_BUFFERS = 4;
+    static constexpr size_t MAX_RETAINED_BYTES = 16 * 1024 * 1024;
+
+    struct Stats
+    {
+        size_t acquires = 0;
+        size_t allocations_avoided = 0;  // acquires served from a retained buffer without growing it
+        size_t bytes_retained = 0;       // capacity currently parked in the pool
+    };
+
+    // Returns an empty buffer with at least `capacity` bytes reserved.
+    std::vector<char> Acquire(size_t capacity);
+
+    // Takes a buffer back once nobody needs its contents any more.
+    void Release(std::vector<char> buffer);
+
+    Stats GetStats() const;
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::vector<char>> retained;
+    Stats stats;
+};
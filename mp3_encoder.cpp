@@ -0,0 +1,116 @@
+#include "mp3_encoder.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+Mp3StreamEncoder::~Mp3StreamEncoder()
+{
+    Close();
+}
+
+void Mp3StreamEncoder::Close()
+{
+    if (lame)
+    {
+        lame_close(lame);
+        lame = nullptr;
+    }
+}
+
+bool Mp3StreamEncoder::Start(int rate, std::vector<char> buffer)
+{
+    Close();
+    output = std::move(buffer);
+    output.clear();
+    samples_encoded = 0;
+    sample_rate = rate;
+
+    lame = lame_init();
+    if (!lame)
+    {
+        std::cerr << "Failed to create LAME encoder." << std::endl;
+        return false;
+    }
+
+    lame_set_in_samplerate(lame, rate);
+    lame_set_num_channels(lame, 1);  // Explicitly set to mono
+    lame_set_mode(lame, MONO);
+    lame_set_VBR(lame, vbr_default);
+    if (lame_init_params(lame) < 0)
+    {
+        std::cerr << "Failed to initialize LAME encoder." << std::endl;
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+bool Mp3StreamEncoder::Encode(const short* pcm, size_t num_samples)
+{
+    if (!lame)
+    {
+        return false;
+    }
+
+    while (num_samples > 0)
+    {
+        size_t block = std::min(num_samples, BLOCK_SAMPLES);
+
+        // Encode straight into the tail of the output, then trim back to what LAME produced.
+        // Room is sized from the samples we actually have, growing geometrically if needed.
+        size_t old_size = output.size();
+        size_t room = WorstCaseMp3Bytes(block);
+        if (output.capacity() < old_size + room)
+        {
+            output.reserve(std::max(old_size + room, output.capacity() * 2));
+        }
+        output.resize(old_size + room);
+
+        int mp3Bytes = lame_encode_buffer(lame,
+                                          pcm,
+                                          nullptr,
+                                          static_cast<int>(block),
+                                          (unsigned char*)output.data() + old_size,
+                                          static_cast<int>(room));
+        if (mp3Bytes < 0)
+        {
+            std::cerr << "lame_encode_buffer failed: " << mp3Bytes << std::endl;
+            output.resize(old_size);
+            return false;
+        }
+        output.resize(old_size + mp3Bytes);
+
+        pcm += block;
+        num_samples -= block;
+        samples_encoded += block;
+    }
+
+    return true;
+}
+
+std::vector<char> Mp3StreamEncoder::Finish()
+{
+    if (!lame)
+    {
+        return {};
+    }
+
+    // lame_encode_flush can emit at most 7200 bytes
+    size_t old_size = output.size();
+    output.resize(old_size + 7200);
+    int mp3Bytes = lame_encode_flush(lame, (unsigned char*)output.data() + old_size, 7200);
+    output.resize(old_size + std::max(mp3Bytes, 0));
+
+    Close();
+
+    return std::move(output);
+}
+
+std::vector<char> Mp3StreamEncoder::TakeOutput(std::vector<char> next)
+{
+    std::vector<char> taken = std::move(output);
+    output = std::move(next);
+    output.clear();
+    return taken;
+}
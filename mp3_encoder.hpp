@@ -0,0 +1,55 @@
+#pragma once
+
+#include "audio_encoder.hpp"
+
+#include <lame/lame.h>
+
+#include <cstddef>
+#include <vector>
+
+// A long-lived LAME session that gets fed PCM while we're still recording, so that stopping only
+// has to flush the last few frames. No Windows dependencies; 16-bit mono PCM in, MP3 bytes out.
+struct Mp3StreamEncoder : AudioEncoder
+{
+    // How many samples we hand to LAME at a time; keeps the scratch space per call bounded.
+    static constexpr size_t BLOCK_SAMPLES = 4096;
+
+    Mp3StreamEncoder() = default;
+    ~Mp3StreamEncoder() override;
+
+    Mp3StreamEncoder(const Mp3StreamEncoder&) = delete;
+    Mp3StreamEncoder& operator=(const Mp3StreamEncoder&) = delete;
+
+    // Opens a new session. Anything left over from a previous one is thrown away. The frames
+    // are written into `buffer` (typically from Mp3BufferPool), reusing whatever it has reserved.
+    bool Start(int sample_rate, std::vector<char> buffer = {}) override;
+
+    // Encodes num_samples more samples; the resulting frames accumulate internally.
+    bool Encode(const short* pcm, size_t num_samples) override;
+
+    // Flushes LAME, closes the session and hands over the complete MP3 stream (in the buffer
+    // passed to Start, grown as needed).
+    std::vector<char> Finish() override;
+
+    bool IsActive() const { return lame != nullptr; }
+    size_t SamplesEncoded() const override { return samples_encoded; }
+    const std::vector<char>& Output() const override { return output; }
+    std::vector<char> TakeOutput(std::vector<char> next = {}) override;
+    int SampleRate() const { return sample_rate; }
+
+    AudioFormat Format() const override { return FORMAT_MP3; }
+    const char* FileName() const override { return "output.mp3"; }
+    const char* MimeType() const override { return "audio/mpeg"; }
+    size_t WorstCaseBytes(size_t num_samples) const override { return WorstCaseMp3Bytes(num_samples); }
+
+    // LAME's documented worst case for a single lame_encode_buffer call.
+    static size_t WorstCaseMp3Bytes(size_t num_samples) { return num_samples + num_samples / 4 + 7200; }
+
+private:
+    void Close();
+
+    lame_t lame = nullptr;
+    std::vector<char> output;
+    size_t samples_encoded = 0;
+    int sample_rate = 0;
+};
@@ -0,0 +1,248 @@
+#include "mp3_parallel.hpp"
+
+#include <lame/lame.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+
+constexpr int BITRATES_MPEG1[16] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, -1 };
+constexpr int BITRATES_MPEG2[16] = { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, -1 };
+constexpr int SAMPLE_RATES_MPEG1[3] = { 44100, 48000, 32000 };
+
+// Frames past the end of a span we still feed in, so the last kept frame sees real audio in its
+// lookahead instead of the zeros of the flush.
+constexpr size_t TAIL_FRAMES = 2;
+
+struct Span
+{
+    size_t first_frame = 0;  // global frame indices we keep: [first_frame, end_frame)
+    size_t end_frame = 0;    // SIZE_MAX for the last span (keep everything to the end)
+    std::vector<char> output;
+    bool ok = false;
+};
+
+lame_t OpenCbrEncoder(const ParallelMp3Options& options)
+{
+    lame_t lame = lame_init();
+    if (!lame)
+    {
+        return nullptr;
+    }
+
+    lame_set_in_samplerate(lame, options.sample_rate);
+    lame_set_num_channels(lame, 1);
+    lame_set_mode(lame, MONO);
+    lame_set_VBR(lame, vbr_off);
+    lame_set_brate(lame, options.bitrate_kbps);
+    lame_set_disable_reservoir(lame, 1);
+    lame_set_bWriteVbrTag(lame, 0);
+    lame_set_write_id3tag_automatic(lame, 0);
+    if (lame_init_params(lame) < 0)
+    {
+        lame_close(lame);
+        return nullptr;
+    }
+    return lame;
+}
+
+// Encodes pcm[begin, end) from scratch, flush included, into `out`.
+bool EncodeRange(const PcmStore& pcm, size_t begin, size_t end, const ParallelMp3Options& options, std::vector<char>* out)
+{
+    lame_t lame = OpenCbrEncoder(options);
+    if (!lame)
+    {
+        return false;
+    }
+
+    bool ok = true;
+    out->reserve(EstimateParallelMp3Bytes(options, end - begin));
+    pcm.ForEachSpan(begin, end, [&](const short* samples, size_t count) {
+        while (ok && count > 0)
+        {
+            size_t block = std::min<size_t>(count, 4096);
+            size_t old_size = out->size();
+            size_t room = block + block / 4 + 7200;
+            out->resize(old_size + room);
+            int bytes = lame_encode_buffer(lame, samples, nullptr, (int)block,
+                                           (unsigned char*)out->data() + old_size, (int)room);
+            if (bytes < 0)
+            {
+                std::cerr << "lame_encode_buffer failed: " << bytes << std::endl;
+                out->resize(old_size);
+                ok = false;
+                break;
+            }
+            out->resize(old_size + bytes);
+            samples += block;
+            count -= block;
+        }
+    });
+
+    if (ok)
+    {
+        size_t old_size = out->size();
+        out->resize(old_size + 7200);
+        int bytes = lame_encode_flush(lame, (unsigned char*)out->data() + old_size, 7200);
+        out->resize(old_size + std::max(bytes, 0));
+    }
+
+    lame_close(lame);
+    return ok;
+}
+
+}  // namespace
+
+bool ParseMp3FrameHeader(const unsigned char* p, size_t available, Mp3FrameHeader* header)
+{
+    if (available < 4 || p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+    {
+        return false;
+    }
+
+    int version = (p[1] >> 3) & 3;  // 3: MPEG-1, 2: MPEG-2, 0: MPEG-2.5
+    int layer = (p[1] >> 1) & 3;     // 1: Layer III
+    int bitrate_index = p[2] >> 4;
+    int rate_index = (p[2] >> 2) & 3;
+    int padding = (p[2] >> 1) & 1;
+    if (version == 1 || layer != 1 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3)
+    {
+        return false;
+    }
+
+    bool mpeg1 = (version == 3);
+    header->bitrate_kbps = mpeg1 ? BITRATES_MPEG1[bitrate_index] : BITRATES_MPEG2[bitrate_index];
+    header->sample_rate = SAMPLE_RATES_MPEG1[rate_index] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+    header->samples = mpeg1 ? 1152 : 576;
+    header->bytes = (size_t)(header->samples / 8) * header->bitrate_kbps * 1000 / header->sample_rate + padding;
+    return true;
+}
+
+std::vector<size_t> FindMp3Frames(const char* data, size_t size)
+{
+    std::vector<size_t> offsets;
+    size_t pos = 0;
+    Mp3FrameHeader header;
+    while (ParseMp3FrameHeader((const unsigned char*)data + pos, size - pos, &header) && pos + header.bytes <= size)
+    {
+        offsets.push_back(pos);
+        pos += header.bytes;
+    }
+    return offsets;
+}
+
+size_t EstimateParallelMp3Bytes(const ParallelMp3Options& options, size_t num_samples)
+{
+    size_t frame_samples = options.sample_rate >= 32000 ? 1152 : 576;
+    size_t frame_bytes = frame_samples / 8 * options.bitrate_kbps * 1000 / options.sample_rate + 1;
+    size_t frames = num_samples / frame_samples + 4;  // + encoder delay and flush padding
+    return frames * frame_bytes;
+}
+
+std::vector<char> EncodeMp3Parallel(const PcmStore& pcm,
+                                    size_t begin,
+                                    size_t end,
+                                    const ParallelMp3Options& options,
+                                    std::vector<char> buffer)
+{
+    buffer.clear();
+    end = std::min(end, pcm.Size());
+    if (end <= begin)
+    {
+        return buffer;
+    }
+
+    // The frame size depends on the sample rate; ask LAME rather than second-guessing it
+    lame_t probe = OpenCbrEncoder(options);
+    if (!probe)
+    {
+        std::cerr << "Failed to initialize LAME encoder." << std::endl;
+        return buffer;
+    }
+    const size_t frame_samples = (size_t)lame_get_framesize(probe);
+    lame_close(probe);
+
+    const size_t num_samples = end - begin;
+    const size_t total_frames = (num_samples + frame_samples - 1) / frame_samples;
+    const unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    const size_t span_frames = std::max(options.min_span_frames, (total_frames + threads - 1) / threads);
+
+    std::vector<Span> spans;
+    for (size_t first = 0; first < total_frames; first += span_frames)
+    {
+        Span span;
+        span.first_frame = first;
+        span.end_frame = (first + span_frames < total_frames) ? first + span_frames : SIZE_MAX;
+        spans.push_back(std::move(span));
+    }
+
+    // Span k starts warmup_frames early and runs TAIL_FRAMES late. Since every span starts on a
+    // frame boundary and LAME's delay is the same for all of them, local frame j of a span that
+    // starts at frame s is global frame s + j.
+    std::atomic<size_t> next_span{ 0 };
+    auto worker = [&]() {
+        size_t index;
+        while ((index = next_span.fetch_add(1)) < spans.size())
+        {
+            Span& span = spans[index];
+            size_t start_frame = span.first_frame > options.warmup_frames ? span.first_frame - options.warmup_frames : 0;
+            size_t input_begin = begin + start_frame * frame_samples;
+            size_t input_end = (span.end_frame == SIZE_MAX) ? end
+                                                            : std::min(end, begin + (span.end_frame + TAIL_FRAMES) * frame_samples);
+
+            std::vector<char> encoded;
+            if (!EncodeRange(pcm, input_begin, input_end, options, &encoded))
+            {
+                continue;
+            }
+
+            std::vector<size_t> frames = FindMp3Frames(encoded.data(), encoded.size());
+            size_t keep_begin = span.first_frame - start_frame;
+            size_t keep_end = (span.end_frame == SIZE_MAX) ? frames.size() : span.end_frame - start_frame;
+            if (keep_end > frames.size() || keep_begin >= keep_end)
+            {
+                std::cerr << "MP3 span " << index << " came out short: " << frames.size() << " frames" << std::endl;
+                continue;
+            }
+
+            size_t from = frames[keep_begin];
+            size_t to = (keep_end < frames.size()) ? frames[keep_end] : encoded.size();
+            span.output.assign(encoded.begin() + from, encoded.begin() + to);
+            span.ok = true;
+        }
+    };
+
+    unsigned num_workers = (unsigned)std::min<size_t>(threads, spans.size());
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < num_workers; i++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();  // this thread takes a share too
+    for (std::thread& thread : pool)
+    {
+        thread.join();
+    }
+
+    size_t total_bytes = 0;
+    for (const Span& span : spans)
+    {
+        if (!span.ok)
+        {
+            return buffer;
+        }
+        total_bytes += span.output.size();
+    }
+
+    buffer.reserve(total_bytes);
+    for (const Span& span : spans)
+    {
+        buffer.insert(buffer.end(), span.output.begin(), span.output.end());
+    }
+    return buffer;
+}
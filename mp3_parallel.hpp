@@ -0,0 +1,46 @@
+#pragma once
+
+#include "pcm_store.hpp"
+
+#include <cstddef>
+#include <vector>
+
+// Whole-take MP3 encoding spread over several cores. The take is cut into spans on MP3 frame
+// boundaries, each span is encoded by its own LAME context on its own thread, and the frames are
+// concatenated. To make that seamless, the encoder runs CBR without the bit reservoir (so no
+// frame borrows bits from its predecessor) and without a Xing/Info tag, and each span starts a
+// few frames early so the psychoacoustic model has settled by the first frame we keep.
+//
+// Meant for re-encoding a finished take; live recording uses Mp3StreamEncoder instead.
+struct ParallelMp3Options
+{
+    int sample_rate = 16000;
+    int bitrate_kbps = 32;        // plenty for 16 kHz speech
+    unsigned threads = 0;         // 0: one per core
+    size_t min_span_frames = 256; // ~9 s at 16 kHz; shorter spans aren't worth a thread
+    size_t warmup_frames = 8;     // encoded before each span and thrown away
+};
+
+std::vector<char> EncodeMp3Parallel(const PcmStore& pcm,
+                                    size_t begin,
+                                    size_t end,
+                                    const ParallelMp3Options& options,
+                                    std::vector<char> buffer = {});
+
+// Output size for num_samples with these options (CBR, so this is close to exact).
+size_t EstimateParallelMp3Bytes(const ParallelMp3Options& options, size_t num_samples);
+
+struct Mp3FrameHeader
+{
+    int sample_rate = 0;
+    int bitrate_kbps = 0;
+    int samples = 0;   // per frame: 1152 for MPEG-1, 576 for MPEG-2/2.5
+    size_t bytes = 0;  // including the header
+};
+
+// Decodes the 4-byte header at `data`; false if it isn't a Layer III frame header.
+bool ParseMp3FrameHeader(const unsigned char* data, size_t available, Mp3FrameHeader* header);
+
+// Offsets of consecutive frames from the start of `data`; stops at the first thing that isn't a
+// complete frame.
+std::vector<size_t> FindMp3Frames(const char* data, size_t size);
@@ -0,0 +1,103 @@
+#include "opus_encoder.hpp"
+
+#include <iostream>
+
+OpusStreamEncoder::~OpusStreamEncoder()
+{
+    Close();
+}
+
+void OpusStreamEncoder::Close()
+{
+    if (encoder)
+    {
+        ope_encoder_destroy(encoder);
+        encoder = nullptr;
+    }
+    if (comments)
+    {
+        ope_comments_destroy(comments);
+        comments = nullptr;
+    }
+}
+
+int OpusStreamEncoder::WriteCallback(void* user_data, const unsigned char* ptr, opus_int32 len)
+{
+    OpusStreamEncoder* self = static_cast<OpusStreamEncoder*>(user_data);
+    self->output.insert(self->output.end(), (const char*)ptr, (const char*)ptr + len);
+    return 0;
+}
+
+int OpusStreamEncoder::CloseCallback(void*)
+{
+    return 0;
+}
+
+bool OpusStreamEncoder::Start(int rate, std::vector<char> buffer)
+{
+    Close();
+    output = std::move(buffer);
+    output.clear();
+    samples_encoded = 0;
+    sample_rate = rate;
+
+    static const OpusEncCallbacks callbacks = { &OpusStreamEncoder::WriteCallback, &OpusStreamEncoder::CloseCallback };
+
+    comments = ope_comments_create();
+    int error = OPE_OK;
+    encoder = ope_encoder_create_callbacks(&callbacks, this, comments, rate, 1, 0, &error);
+    if (!encoder || error != OPE_OK)
+    {
+        std::cerr << "Failed to initialize Opus encoder: " << ope_strerror(error) << std::endl;
+        Close();
+        return false;
+    }
+
+    ope_encoder_ctl(encoder, OPUS_SET_BITRATE(BITRATE));
+    ope_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+    return true;
+}
+
+bool OpusStreamEncoder::Encode(const short* pcm, size_t num_samples)
+{
+    if (!encoder)
+    {
+        return false;
+    }
+
+    int error = ope_encoder_write(encoder, pcm, (int)num_samples);
+    if (error != OPE_OK)
+    {
+        std::cerr << "ope_encoder_write failed: " << ope_strerror(error) << std::endl;
+        return false;
+    }
+    samples_encoded += num_samples;
+    return true;
+}
+
+std::vector<char> OpusStreamEncoder::Finish()
+{
+    if (!encoder)
+    {
+        return {};
+    }
+
+    ope_encoder_drain(encoder);
+    Close();
+    return std::move(output);
+}
+
+size_t OpusStreamEncoder::WorstCaseBytes(size_t num_samples) const
+{
+    // Bitrate plus generous room for Ogg pages and headers
+    size_t rate = sample_rate > 0 ? (size_t)sample_rate : 16000;
+    return num_samples * (BITRATE / 8) / rate * 2 + 4096;
+}
+
+std::vector<char> OpusStreamEncoder::TakeOutput(std::vector<char> next)
+{
+    std::vector<char> taken = std::move(output);
+    output = std::move(next);
+    output.clear();
+    return taken;
+}
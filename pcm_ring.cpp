@@ -0,0 +1,78 @@
+#include "pcm_ring.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+void PcmRing::Resize(size_t min_capacity)
+{
+    capacity = 1;
+    while (capacity < min_capacity)
+    {
+        capacity <<= 1;
+    }
+    mask = capacity - 1;
+    samples = std::make_unique<short[]>(capacity);
+    claimed_position.store(0, std::memory_order_relaxed);
+    write_position.store(0, std::memory_order_release);
+}
+
+uint64_t PcmRing::OldestPosition() const
+{
+    uint64_t position = WritePosition();
+    return position > capacity ? position - capacity : 0;
+}
+
+void PcmRing::Write(const short* pcm, size_t count)
+{
+    if (capacity == 0)
+    {
+        return;
+    }
+
+    // Only the newest `capacity` samples can survive anyway
+    uint64_t position = write_position.load(std::memory_order_relaxed);
+    if (count > capacity)
+    {
+        position += count - capacity;
+        pcm += count - capacity;
+        count = capacity;
+    }
+
+    // Readers copying anything before position + count - capacity from here on get told it's gone;
+    // the fence keeps the claim ahead of the copy below
+    claimed_position.store(position + count, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t offset = (size_t)(position & mask);
+    size_t first = std::min(count, capacity - offset);
+    memcpy(samples.get() + offset, pcm, first * sizeof(short));
+    memcpy(samples.get(), pcm + first, (count - first) * sizeof(short));
+
+    // Publishes the samples above to readers that acquire the new position
+    write_position.store(position + count, std::memory_order_release);
+}
+
+bool PcmRing::Read(uint64_t begin, uint64_t end, short* out) const
+{
+    if (end < begin || end - begin > capacity)
+    {
+        return false;
+    }
+
+    uint64_t written = WritePosition();
+    if (end > written || (written > capacity && begin < written - capacity))
+    {
+        return false;
+    }
+
+    size_t count = (size_t)(end - begin);
+    size_t offset = (size_t)(begin & mask);
+    size_t first = std::min(count, capacity - offset);
+    memcpy(out, samples.get() + offset, first * sizeof(short));
+    memcpy(out + first, samples.get(), (count - first) * sizeof(short));
+
+    // If the writer has claimed any of that space since, finished or not, the copy may be torn
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t claimed = claimed_position.load(std::memory_order_relaxed);
+    return claimed <= capacity || begin >= claimed - capacity;
+}
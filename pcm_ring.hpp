@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Fixed-size ring of the most recent PCM, written by one thread and readable from another
+// without locks. Positions are absolute sample counts since the ring was (re)sized, so a reader
+// can ask for "samples 1000..2000" and find out if they've been overwritten in the meantime.
+// It's a seqlock: the writer claims the range it's about to overwrite before copying, and a
+// reader that finds its range claimed after its own copy throws the copy away.
+struct PcmRing
+{
+    PcmRing() = default;
+    explicit PcmRing(size_t min_capacity) { Resize(min_capacity); }
+
+    PcmRing(const PcmRing&) = delete;
+    PcmRing& operator=(const PcmRing&) = delete;
+
+    // Rounds up to a power of two and forgets the contents. Not safe while anyone else is using it.
+    void Resize(size_t min_capacity);
+
+    size_t Capacity() const { return capacity; }
+
+    // Producer only.
+    void Write(const short* pcm, size_t count);
+
+    // Total samples ever written; everything in [WritePosition() - Capacity(), WritePosition())
+    // is (still) in the ring.
+    uint64_t WritePosition() const { return write_position.load(std::memory_order_acquire); }
+    uint64_t OldestPosition() const;
+
+    // Copies [begin, end) into `out`. False if part of it isn't written yet or was overwritten
+    // before we were done copying (then `out` holds garbage).
+    bool Read(uint64_t begin, uint64_t end, short* out) const;
+
+private:
+    std::unique_ptr<short[]> samples;
+    size_t capacity = 0;
+    size_t mask = 0;
+    std::atomic<uint64_t> write_position{ 0 };
+    std::atomic<uint64_t> claimed_position{ 0 };  // where the write under way (if any) ends
+};
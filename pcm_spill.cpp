@@ -0,0 +1,315 @@
+#include "pcm_spill.hpp"
+
+#include "pcm_store.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+constexpr size_t SEGMENT_BYTES = PcmSpillFile::SEGMENT_BLOCKS * PcmBlockPool::BLOCK_BYTES;
+
+#ifdef _WIN32
+constexpr wchar_t SPILL_PREFIX[] = L"whisper_spill_";
+
+std::wstring TempDirectory()
+{
+    wchar_t path[MAX_PATH + 1] = { 0 };
+    DWORD length = GetTempPathW(MAX_PATH + 1, path);
+    return std::wstring(path, length);
+}
+#else
+constexpr char SPILL_PREFIX[] = "whisper_spill_";
+
+// TMPDIR if it's set, otherwise /var/tmp rather than /tmp: /tmp is RAM-backed (tmpfs) on many
+// distributions, and spilling into RAM saves no memory.
+std::string TempDirectory()
+{
+    const char* dir = getenv("TMPDIR");
+    std::string path = dir && *dir ? dir : "/var/tmp";
+    if (path.back() != '/')
+    {
+        path += '/';
+    }
+    return path;
+}
+
+// When the system came up, from /proc/stat; 0 where there's no such thing
+time_t BootTime()
+{
+    std::ifstream stat("/proc/stat");
+    std::string key;
+    long long value = 0;
+    while (stat >> key)
+    {
+        if (key == "btime" && stat >> value)
+        {
+            return (time_t)value;
+        }
+        stat.ignore(1 << 20, '\n');
+    }
+    return 0;
+}
+
+// Whether the spill file `name` (whisper_spill_<pid>_XXXXXX) could still belong to a running
+// instance: its process is alive and the file is from since the last boot, when pids started over.
+bool OwnerMayBeAlive(const std::string& path, const char* name, time_t boot_time)
+{
+    char* end = nullptr;
+    long pid = strtol(name + sizeof(SPILL_PREFIX) - 1, &end, 10);
+    if (pid <= 0 || *end != '_')
+    {
+        return false;
+    }
+    struct stat info;
+    if (boot_time > 0 && stat(path.c_str(), &info) == 0 && info.st_mtime < boot_time)
+    {
+        return false;
+    }
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+#endif
+
+}  // namespace
+
+#ifdef _WIN32
+
+bool PcmSpillFile::Open()
+{
+    Close();
+
+    wchar_t name[64];
+    swprintf(name, 64, L"%s%lu_%llu.pcm", SPILL_PREFIX, GetCurrentProcessId(), GetTickCount64());
+    std::wstring path = TempDirectory() + name;
+
+    // Not shared, so that RemoveStaleSpillFiles() in another instance can't delete it under us;
+    // delete-on-close takes care of it when we're done or the process goes away.
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                                FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Failed to create a spill file in the temp directory (error " << GetLastError() << ")" << std::endl;
+        return false;
+    }
+
+    file = handle;
+    return true;
+}
+
+void PcmSpillFile::Close()
+{
+    for (Segment& segment : segments)
+    {
+        UnmapViewOfFile(segment.view);
+    }
+    segments.clear();
+    blocks_used = 0;
+
+    if (file)
+    {
+        CloseHandle((HANDLE)file);
+        file = nullptr;
+    }
+}
+
+bool PcmSpillFile::IsOpen() const
+{
+    return file != nullptr;
+}
+
+bool PcmSpillFile::AddSegment()
+{
+    // Sizing the mapping past the end of the file grows the file. The view keeps the mapping
+    // object alive, so its handle can go right away.
+    unsigned long long offset = (unsigned long long)segments.size() * SEGMENT_BYTES;
+    unsigned long long size = offset + SEGMENT_BYTES;
+    HANDLE mapping = CreateFileMappingW((HANDLE)file, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, NULL);
+    if (!mapping)
+    {
+        std::cerr << "Failed to grow the spill file (error " << GetLastError() << ")" << std::endl;
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, (DWORD)(offset >> 32), (DWORD)offset, SEGMENT_BYTES);
+    CloseHandle(mapping);
+    if (!view)
+    {
+        std::cerr << "Failed to map the spill file (error " << GetLastError() << ")" << std::endl;
+        return false;
+    }
+
+    segments.push_back({ (char*)view });
+    return true;
+}
+
+void PcmSpillFile::ReleaseFilledSegment()
+{
+    // Start writing the full segment out, and take it out of our working set: unlocking pages
+    // that aren't locked does exactly that. They come back from the file if somebody reads them.
+    char* view = segments.back().view;
+    FlushViewOfFile(view, SEGMENT_BYTES);
+    VirtualUnlock(view, SEGMENT_BYTES);
+}
+
+void RemoveStaleSpillFiles()
+{
+    std::wstring dir = TempDirectory();
+    WIN32_FIND_DATAW found;
+    HANDLE find = FindFirstFileW((dir + SPILL_PREFIX + L"*.pcm").c_str(), &found);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    do
+    {
+        // Fails with a sharing violation for files that are still in use
+        DeleteFileW((dir + found.cFileName).c_str());
+    } while (FindNextFileW(find, &found));
+    FindClose(find);
+}
+
+#else
+
+bool PcmSpillFile::Open()
+{
+    Close();
+
+    // The pid tells RemoveStaleSpillFiles() in another instance whether we're still around
+    std::string path = TempDirectory() + SPILL_PREFIX + std::to_string(getpid()) + "_XXXXXX";
+    fd = mkstemp(path.data());
+    if (fd < 0)
+    {
+        perror("Failed to create a spill file");
+        return false;
+    }
+
+    // Nothing needs the name; once it's unlinked the file goes away with the last descriptor,
+    // crash or not.
+    unlink(path.c_str());
+    return true;
+}
+
+void PcmSpillFile::Close()
+{
+    for (Segment& segment : segments)
+    {
+        munmap(segment.view, SEGMENT_BYTES);
+    }
+    segments.clear();
+    blocks_used = 0;
+
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool PcmSpillFile::IsOpen() const
+{
+    return fd >= 0;
+}
+
+bool PcmSpillFile::AddSegment()
+{
+    // Actually reserve the space: a file that is only ftruncate()d is sparse, and when the disk
+    // fills up the first write into the mapping is a SIGBUS rather than an error we can handle.
+    off_t offset = (off_t)(segments.size() * SEGMENT_BYTES);
+    int error = posix_fallocate(fd, offset, (off_t)SEGMENT_BYTES);
+    if (error != 0)
+    {
+        fprintf(stderr, "Failed to grow the spill file: %s\n", strerror(error));
+        return false;
+    }
+
+    void* view = mmap(nullptr, SEGMENT_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if (view == MAP_FAILED)
+    {
+        perror("Failed to map the spill file");
+        return false;
+    }
+
+    segments.push_back({ (char*)view });
+    return true;
+}
+
+void PcmSpillFile::ReleaseFilledSegment()
+{
+    // Write the full segment out and drop its pages; reading them again faults them back in
+    // from the file.
+    char* view = segments.back().view;
+    msync(view, SEGMENT_BYTES, MS_SYNC);
+    madvise(view, SEGMENT_BYTES, MADV_DONTNEED);
+}
+
+void RemoveStaleSpillFiles()
+{
+    // Files are unlinked as soon as they're created; one with the prefix is either left over from
+    // a crash between mkstemp() and unlink(), or another instance is in between the two right now.
+    std::string dir = TempDirectory();
+    DIR* listing = opendir(dir.c_str());
+    if (!listing)
+    {
+        return;
+    }
+
+    time_t boot_time = BootTime();
+    while (dirent* entry = readdir(listing))
+    {
+        std::string path = dir + entry->d_name;
+        if (strncmp(entry->d_name, SPILL_PREFIX, sizeof(SPILL_PREFIX) - 1) == 0 && !OwnerMayBeAlive(path, entry->d_name, boot_time))
+        {
+            unlink(path.c_str());
+        }
+    }
+    closedir(listing);
+}
+
+#endif
+
+short* PcmSpillFile::AddBlock()
+{
+    if (!IsOpen())
+    {
+        return nullptr;
+    }
+
+    size_t index_in_segment = blocks_used % SEGMENT_BLOCKS;
+    if (index_in_segment == 0)
+    {
+        if (!segments.empty())
+        {
+            ReleaseFilledSegment();
+        }
+        if (!AddSegment())
+        {
+            return nullptr;
+        }
+    }
+
+    blocks_used += 1;
+    return (short*)(segments.back().view + index_in_segment * PcmBlockPool::BLOCK_BYTES);
+}
+
+size_t PcmSpillFile::Bytes() const
+{
+    return blocks_used * PcmBlockPool::BLOCK_BYTES;
+}
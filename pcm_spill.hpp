@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// A temporary file that PcmStore puts blocks into once a take gets long, mapped into memory so the
+// encoders can read them in place. The OS can write the pages out and drop them, so a meeting-length
+// take doesn't keep its audio resident. The file is gone once this is closed (or the process dies;
+// RemoveStaleSpillFiles() is for what a crash or power cut leaves behind). Its space is reserved a
+// segment at a time, so a full disk shows up as AddBlock() failing, never as a fault later on.
+// On POSIX it goes in $TMPDIR, or /var/tmp, which unlike /tmp is on disk.
+struct PcmSpillFile
+{
+    static constexpr size_t SEGMENT_BLOCKS = 32;  // blocks per mapped view (~2 minutes at 16 kHz)
+
+    PcmSpillFile() = default;
+    ~PcmSpillFile() { Close(); }
+
+    PcmSpillFile(const PcmSpillFile&) = delete;
+    PcmSpillFile& operator=(const PcmSpillFile&) = delete;
+
+    bool Open();
+    void Close();
+    bool IsOpen() const;
+
+    // A fresh block of PcmBlockPool::BLOCK_SAMPLES samples, valid until Close(); null if the disk
+    // is full or the mapping failed.
+    short* AddBlock();
+
+    size_t Bytes() const;
+
+private:
+    bool AddSegment();
+    void ReleaseFilledSegment();
+
+    struct Segment
+    {
+        char* view = nullptr;
+    };
+
+#ifdef _WIN32
+    void* file = nullptr;  // HANDLE
+#else
+    int fd = -1;
+#endif
+    std::vector<Segment> segments;
+    size_t blocks_used = 0;
+};
+
+// Deletes spill files left in the temp directory by an earlier run that didn't get to clean up.
+// Files that another running instance still has open are left alone (on POSIX: files whose
+// owner's pid is alive and that are from since the last boot).
+void RemoveStaleSpillFiles();
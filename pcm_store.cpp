@@ -0,0 +1,124 @@
+#include "pcm_store.hpp"
+
+#include <cstring>
+
+PcmBlockPool::Block PcmBlockPool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Block block;
+    if (!free_blocks.empty())
+    {
+        block = std::move(free_blocks.back());
+        free_blocks.pop_back();
+    }
+    else
+    {
+        block.reset(new short[BLOCK_SAMPLES]);
+        allocated_total += 1;
+    }
+
+    in_use += 1;
+    high_water_blocks = std::max(high_water_blocks, in_use + free_blocks.size());
+    return block;
+}
+
+void PcmBlockPool::Release(Block block)
+{
+    if (!block)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    in_use -= 1;
+    free_blocks.push_back(std::move(block));
+}
+
+void PcmBlockPool::TrimFreeBlocks(size_t max_free)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_blocks.size() > max_free)
+    {
+        free_blocks.resize(max_free);
+    }
+}
+
+size_t PcmBlockPool::BlocksInUse() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return in_use;
+}
+
+size_t PcmBlockPool::BlocksFree() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return free_blocks.size();
+}
+
+size_t PcmBlockPool::BlocksAllocatedTotal() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return allocated_total;
+}
+
+size_t PcmBlockPool::HighWaterBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return high_water_blocks * BLOCK_BYTES;
+}
+
+short* PcmStore::NewBlock()
+{
+    if (spill_threshold > 0 && num_samples >= spill_threshold && !spill_failed)
+    {
+        if (!spill.IsOpen() && !spill.Open())
+        {
+            spill_failed = true;
+        }
+        else if (short* block = spill.AddBlock())
+        {
+            return block;
+        }
+        else
+        {
+            spill_failed = true;
+        }
+    }
+
+    blocks.push_back(pool.Acquire());
+    return blocks.back().get();
+}
+
+void PcmStore::Append(const short* pcm, size_t count)
+{
+    while (count > 0)
+    {
+        size_t offset = num_samples % PcmBlockPool::BLOCK_SAMPLES;
+        if (offset == 0)
+        {
+            block_data.push_back(NewBlock());
+        }
+
+        size_t n = std::min(count, PcmBlockPool::BLOCK_SAMPLES - offset);
+        memcpy(block_data.back() + offset, pcm, n * sizeof(short));
+
+        pcm += n;
+        count -= n;
+        num_samples += n;
+    }
+}
+
+void PcmStore::Clear()
+{
+    for (PcmBlockPool::Block& block : blocks)
+    {
+        pool.Release(std::move(block));
+    }
+    blocks.clear();
+    block_data.clear();
+    num_samples = 0;
+
+    spill.Close();
+    spill_failed = false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "pcm_spill.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Hands out fixed-size blocks of 16-bit PCM and takes them back, so that back-to-back recordings
+// reuse the same memory instead of going through the allocator every time.
+struct PcmBlockPool
+{
+    static constexpr size_t BLOCK_SAMPLES = 64 * 1024;  // ~4 s of 16 kHz mono
+    static constexpr size_t BLOCK_BYTES = BLOCK_SAMPLES * sizeof(short);
+
+    using Block = std::unique_ptr<short[]>;
+
+    Block Acquire();
+    void Release(Block block);
+
+    // Frees idle blocks beyond max_free, so one very long take doesn't pin its memory forever.
+    void TrimFreeBlocks(size_t max_free);
+
+    size_t BlocksInUse() const;
+    size_t BlocksFree() const;
+    size_t BlocksAllocatedTotal() const;  // how many times we actually had to call new[]
+    size_t HighWaterBytes() const;        // peak of (in use + free) blocks, in bytes
+
+private:
+    mutable std::mutex mutex;
+    std::vector<Block> free_blocks;
+    size_t in_use = 0;
+    size_t allocated_total = 0;
+    size_t high_water_blocks = 0;
+};
+
+// A growable PCM buffer for one take, made of pool blocks. It only grows as audio arrives and
+// gives everything back to the pool on Clear(). Past the spill threshold, new blocks come from a
+// memory-mapped temp file instead of the pool; readers can't tell the difference.
+struct PcmStore
+{
+    explicit PcmStore(PcmBlockPool& pool) : pool(pool) {}
+    ~PcmStore() { Clear(); }
+
+    PcmStore(const PcmStore&) = delete;
+    PcmStore& operator=(const PcmStore&) = delete;
+
+    void Append(const short* pcm, size_t num_samples);
+    void Clear();
+
+    // From the next Append() on, anything beyond the first `samples` goes to disk; 0 turns it off.
+    // If the spill file can't be created or grown, we carry on in memory.
+    void SetSpillThreshold(size_t samples) { spill_threshold = samples; }
+
+    size_t Size() const { return num_samples; }
+    size_t SpilledBytes() const { return spill.Bytes(); }
+
+    // Calls fn(const short* pcm, size_t count) for each contiguous piece of [begin, end).
+    template <typename Fn>
+    void ForEachSpan(size_t begin, size_t end, Fn&& fn) const
+    {
+        end = std::min(end, num_samples);
+        while (begin < end)
+        {
+            size_t block = begin / PcmBlockPool::BLOCK_SAMPLES;
+            size_t offset = begin % PcmBlockPool::BLOCK_SAMPLES;
+            size_t count = std::min(end - begin, PcmBlockPool::BLOCK_SAMPLES - offset);
+            fn(static_cast<const short*>(block_data[block] + offset), count);
+            begin += count;
+        }
+    }
+
+private:
+    short* NewBlock();
+
+    PcmBlockPool& pool;
+    std::vector<PcmBlockPool::Block> blocks;  // the ones from the pool, to give back
+    std::vector<short*> block_data;           // every block, pool or spill file, in order
+    size_t num_samples = 0;
+
+    size_t spill_threshold = 0;
+    bool spill_failed = false;  // so we don't retry (and complain) for every block
+    PcmSpillFile spill;
+};
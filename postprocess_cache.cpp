@@ -0,0 +1,222 @@
+#include "postprocess_cache.hpp"
+
+#include <cctype>
+#include <fstream>
+#include <system_error>
+
+namespace
+{
+
+// "WPPC" and a version, then the entry count and the entries, most recently used first: the
+// context hash, a length-prefixed key, output and reasoning each, and the seconds saved. Version 1
+// had a single context for the whole file, and didn't take the endpoint into it.
+constexpr uint32_t FILE_MAGIC = 0x43505057;
+constexpr uint32_t FILE_VERSION = 2;
+
+// Anything longer isn't something we wrote.
+constexpr uint32_t MAX_FIELD_BYTES = 1 << 20;
+
+uint64_t Fnv1a(uint64_t hash, const std::string& text)
+{
+    for (unsigned char c : text)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+void WriteValue(std::ofstream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool ReadValue(std::ifstream& in, T* value)
+{
+    return (bool)in.read(reinterpret_cast<char*>(value), sizeof(*value));
+}
+
+void WriteString(std::ofstream& out, const std::string& text)
+{
+    WriteValue(out, (uint32_t)text.size());
+    out.write(text.data(), text.size());
+}
+
+bool ReadString(std::ifstream& in, std::string* text)
+{
+    uint32_t size = 0;
+    if (!ReadValue(in, &size) || size > MAX_FIELD_BYTES)
+    {
+        return false;
+    }
+    text->resize(size);
+    return size == 0 || (bool)in.read(text->data(), size);
+}
+
+}  // namespace
+
+std::string PostProcessCache::Normalize(const std::string& transcript)
+{
+    std::string normalized;
+    bool space = false;
+    for (char c : transcript)
+    {
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            space = !normalized.empty();
+            continue;
+        }
+        if (space)
+        {
+            normalized += ' ';
+            space = false;
+        }
+        normalized += c;
+    }
+    return normalized;
+}
+
+uint64_t PostProcessCache::SetContext(const std::string& endpoint, const std::string& model, const std::string& prompt_template)
+{
+    // Each field ends in a byte that can't be in it, so moving text from one to the next changes the hash
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const std::string* field : { &endpoint, &model, &prompt_template })
+    {
+        hash = Fnv1a(hash, *field);
+        hash = Fnv1a(hash, std::string(1, '\0'));
+    }
+    context = hash;
+    return context;
+}
+
+void PostProcessCache::Clear()
+{
+    entries.clear();
+    index.clear();
+}
+
+const PostProcessCache::Entry* PostProcessCache::Find(const std::string& transcript)
+{
+    auto it = index.find(Key{ context, Normalize(transcript) });
+    if (it == index.end())
+    {
+        misses += 1;
+        return nullptr;
+    }
+
+    entries.splice(entries.begin(), entries, it->second);
+    hits += 1;
+    seconds_saved += it->second->second.seconds;
+    return &it->second->second;
+}
+
+void PostProcessCache::Insert(uint64_t entry_context, const std::string& transcript, Entry entry)
+{
+    Key key{ entry_context, Normalize(transcript) };
+    if (key.transcript.empty() || capacity == 0)
+    {
+        return;
+    }
+
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        it->second->second = std::move(entry);
+        entries.splice(entries.begin(), entries, it->second);
+    }
+    else
+    {
+        entries.emplace_front(key, std::move(entry));
+        index[key] = entries.begin();
+        while (entries.size() > capacity)
+        {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+    dirty = true;
+}
+
+bool PostProcessCache::Load(const std::filesystem::path& path)
+{
+    file_path = path;
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t count = 0;
+    if (!ReadValue(in, &magic) || magic != FILE_MAGIC || !ReadValue(in, &version) || version != FILE_VERSION ||
+        !ReadValue(in, &count))
+    {
+        return false;
+    }
+
+    Clear();
+    for (uint32_t i = 0; i < count && entries.size() < capacity; ++i)
+    {
+        Key key;
+        Entry entry;
+        if (!ReadValue(in, &key.context) || !ReadString(in, &key.transcript) || !ReadString(in, &entry.processed_text) ||
+            !ReadString(in, &entry.reasoning_text) || !ReadValue(in, &entry.seconds))
+        {
+            break;  // keep what was read before it went wrong
+        }
+        if (index.count(key) == 0)
+        {
+            entries.emplace_back(key, std::move(entry));
+            index[key] = std::prev(entries.end());
+        }
+    }
+    dirty = false;
+    return true;
+}
+
+bool PostProcessCache::Save()
+{
+    if (file_path.empty())
+    {
+        return false;
+    }
+
+    // Written next to it and swapped in, so a crash halfway leaves the old one
+    std::error_code error;
+    std::filesystem::create_directories(file_path.parent_path(), error);
+    std::filesystem::path temp_path = file_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            return false;
+        }
+        WriteValue(out, FILE_MAGIC);
+        WriteValue(out, FILE_VERSION);
+        WriteValue(out, (uint32_t)entries.size());
+        for (const auto& [key, entry] : entries)
+        {
+            WriteValue(out, key.context);
+            WriteString(out, key.transcript);
+            WriteString(out, entry.processed_text);
+            WriteString(out, entry.reasoning_text);
+            WriteValue(out, entry.seconds);
+        }
+        if (!out)
+        {
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp_path, file_path, error);
+    if (error)
+    {
+        return false;
+    }
+    dirty = false;
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+// Post-process results for transcripts we've had before, most recently used first, so a repeated
+// phrase ("new paragraph", a sign-off) doesn't pay for another LLM round trip. Each result is
+// filed under the endpoint, model and prompt template it came from, so switching between setups
+// keeps what each of them had; the least recently used go once it's full. Kept in a small file
+// between runs. Not thread-safe.
+struct PostProcessCache
+{
+    static constexpr size_t DEFAULT_CAPACITY = 1000;
+
+    struct Entry
+    {
+        std::string processed_text;
+        std::string reasoning_text;
+        double seconds = 0.0;  // what the request took, i.e. what a hit saves
+    };
+
+    explicit PostProcessCache(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+    // The endpoint, model and prompt template that results are looked up for. Returns the hash
+    // that stands for them.
+    uint64_t SetContext(const std::string& endpoint, const std::string& model, const std::string& prompt_template);
+    uint64_t Context() const { return context; }
+
+    // Null if it's not in there for the current context. Counts as a hit or a miss.
+    const Entry* Find(const std::string& transcript);
+    // Under the context the request was made in, which may not be the current one any more.
+    void Insert(uint64_t entry_context, const std::string& transcript, Entry entry);
+
+    // Reads the file if there is one; later saves go to the same place.
+    bool Load(const std::filesystem::path& path);
+    bool Save();
+    bool Dirty() const { return dirty; }
+
+    size_t Size() const { return entries.size(); }
+    int Hits() const { return hits; }
+    int Lookups() const { return hits + misses; }
+    double SecondsSaved() const { return seconds_saved; }
+
+    // Whisper's spacing varies from one take to the next; that shouldn't make it a miss.
+    static std::string Normalize(const std::string& transcript);
+
+private:
+    struct Key
+    {
+        uint64_t context = 0;
+        std::string transcript;  // normalized
+
+        bool operator==(const Key& other) const { return context == other.context && transcript == other.transcript; }
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const { return std::hash<std::string>()(key.transcript) ^ (size_t)key.context; }
+    };
+    using List = std::list<std::pair<Key, Entry>>;
+
+    void Clear();
+
+    size_t capacity;
+    uint64_t context = 0;
+    List entries;
+    std::unordered_map<Key, List::iterator, KeyHash> index;
+    std::filesystem::path file_path;
+    bool dirty = false;
+
+    int hits = 0;
+    int misses = 0;
+    double seconds_saved = 0.0;
+};
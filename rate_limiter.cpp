@@ -0,0 +1,79 @@
+#include "rate_limiter.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void TokenBucket::SetRate(double rate)
+{
+    if (rate == per_minute)
+    {
+        return;
+    }
+    per_minute = rate;
+    tokens = std::min(tokens, per_minute);
+}
+
+void TokenBucket::Refill(uint64_t now)
+{
+    if (!started)
+    {
+        // Start out full: the first minute's worth can go right away
+        tokens = per_minute;
+        last_refill = now;
+        started = true;
+        return;
+    }
+
+    if (now > last_refill)
+    {
+        tokens = std::min(per_minute, tokens + per_minute * (now - last_refill) / 60000.0);
+        last_refill = now;
+    }
+}
+
+uint64_t TokenBucket::Reserve(double amount, uint64_t now)
+{
+    if (per_minute <= 0.0)
+    {
+        return 0;
+    }
+
+    Refill(now);
+    tokens -= amount;
+    if (tokens >= 0.0)
+    {
+        return 0;
+    }
+    return (uint64_t)std::ceil(-tokens * 60000.0 / per_minute);
+}
+
+void TokenBucket::Charge(double amount, uint64_t now)
+{
+    if (per_minute <= 0.0)
+    {
+        return;
+    }
+    Refill(now);
+    tokens -= amount;
+}
+
+void RateLimiter::SetLimits(int requests_per_minute, int audio_seconds_per_minute)
+{
+    requests.SetRate(std::max(0, requests_per_minute));
+    audio.SetRate(std::max(0, audio_seconds_per_minute));
+}
+
+uint64_t RateLimiter::Reserve(double audio_seconds, uint64_t now)
+{
+    uint64_t wait = std::max(requests.Reserve(1.0, now), audio.Reserve(audio_seconds, now));
+    if (blocked_until > now)
+    {
+        wait = std::max(wait, blocked_until - now);
+    }
+    return wait;
+}
+
+void RateLimiter::BlockUntil(uint64_t until)
+{
+    blocked_until = std::max(blocked_until, until);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+// A token bucket that refills continuously at `per_minute` tokens a minute and holds at most a
+// minute's worth. Reserve() always takes the tokens, letting the balance go negative, and says how
+// long the caller should wait before going ahead; so callers are served in the order they asked.
+// Times are in ms from any fixed origin. Not thread-safe.
+struct TokenBucket
+{
+    // 0 means no limit.
+    void SetRate(double per_minute);
+
+    uint64_t Reserve(double amount, uint64_t now);
+
+    // For costs that are only known afterwards.
+    void Charge(double amount, uint64_t now);
+
+private:
+    void Refill(uint64_t now);
+
+    double per_minute = 0.0;
+    double tokens = 0.0;
+    uint64_t last_refill = 0;
+    bool started = false;
+};
+
+// The limits for one API key: requests a minute and seconds of audio a minute, and a pause on
+// everything while the server has told us to back off.
+struct RateLimiter
+{
+    void SetLimits(int requests_per_minute, int audio_seconds_per_minute);
+
+    // How long to wait before sending a request with `audio_seconds` of audio (0 if not known yet).
+    uint64_t Reserve(double audio_seconds, uint64_t now);
+
+    void ChargeAudio(double audio_seconds, uint64_t now) { audio.Charge(audio_seconds, now); }
+
+    // After a 429: nothing goes out before `until`.
+    void BlockUntil(uint64_t until);
+
+private:
+    TokenBucket requests;
+    TokenBucket audio;
+    uint64_t blocked_until = 0;
+};
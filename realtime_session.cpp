@@ -0,0 +1,349 @@
+#include "realtime_session.hpp"
+
+#include "json.hpp"
+
+#include <chrono>
+
+namespace
+{
+
+// Nothing tells us when the socket has something to read, so it's checked this often; well under
+// what anybody would notice in the time to text.
+constexpr int POLL_INTERVAL_MS = 10;
+
+constexpr long CONNECT_TIMEOUT_MS = 10000;
+
+std::string Base64Encode(const unsigned char* data, size_t size)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < size; i += 3)
+    {
+        unsigned int triple = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out += alphabet[(triple >> 18) & 63];
+        out += alphabet[(triple >> 12) & 63];
+        out += alphabet[(triple >> 6) & 63];
+        out += alphabet[triple & 63];
+    }
+    if (i < size)
+    {
+        unsigned int triple = data[i] << 16;
+        if (i + 1 < size)
+        {
+            triple |= data[i + 1] << 8;
+        }
+        out += alphabet[(triple >> 18) & 63];
+        out += alphabet[(triple >> 12) & 63];
+        out += (i + 1 < size) ? alphabet[(triple >> 6) & 63] : '=';
+        out += '=';
+    }
+    return out;
+}
+
+// Where curl_ws_recv() puts the frame's details; newer curls declare that const, older ones don't.
+struct FrameOut
+{
+    const curl_ws_frame* frame = nullptr;
+
+    operator const curl_ws_frame**() { return &frame; }
+    operator curl_ws_frame**() { return const_cast<curl_ws_frame**>(&frame); }
+};
+
+}  // namespace
+
+void RealtimeSession::Start(const std::string& session_url, const std::string& api_token, const std::string& model,
+                            const std::string& prompt, Handlers session_handlers)
+{
+    url = session_url;
+    token = api_token;
+    handlers = std::move(session_handlers);
+
+    // Commits only; we know better than a server-side VAD when the user is done
+    nlohmann::json transcription = { { "model", model } };
+    if (!prompt.empty())
+    {
+        transcription["prompt"] = prompt;
+    }
+    nlohmann::json update = {
+        { "type", "transcription_session.update" },
+        { "session", {
+            { "input_audio_format", "pcm16" },
+            { "input_audio_transcription", transcription },
+            { "turn_detection", nullptr },
+        } },
+    };
+    session_update = update.dump();
+
+    thread = std::thread(&RealtimeSession::Run, this);
+}
+
+void RealtimeSession::SendAudio(const short* pcm, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // pcm16 is little-endian, like us
+    nlohmann::json append = {
+        { "type", "input_audio_buffer.append" },
+        { "audio", Base64Encode(reinterpret_cast<const unsigned char*>(pcm), count * sizeof(short)) },
+    };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        outbox.push_back(append.dump());
+    }
+    wake.notify_one();
+}
+
+void RealtimeSession::Commit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        outbox.push_back(R"({"type":"input_audio_buffer.commit"})");
+    }
+    wake.notify_one();
+}
+
+void RealtimeSession::RequestClose()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    wake.notify_one();
+}
+
+void RealtimeSession::Close()
+{
+    if (!thread.joinable())
+    {
+        return;
+    }
+
+    RequestClose();
+    thread.join();
+}
+
+bool RealtimeSession::Closing()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return closing;
+}
+
+// Gives up on a connection that's still being made once we're asked to close.
+int RealtimeSession::OnConnectProgress(void* user, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    return static_cast<RealtimeSession*>(user)->Closing() ? 1 : 0;
+}
+
+bool RealtimeSession::Connect()
+{
+    curl = curl_easy_init();
+    if (!curl)
+    {
+        Fail("Failed to initialize curl for the realtime session");
+        return false;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 2L);  // just the WebSocket upgrade
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, CONNECT_TIMEOUT_MS);
+    curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &RealtimeSession::OnConnectProgress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    if (!token.empty())
+    {
+        headers = curl_slist_append(headers, ("Authorization: Bearer " + token).c_str());
+    }
+    headers = curl_slist_append(headers, "OpenAI-Beta: realtime=v1");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+    CURLcode res = curl_easy_perform(curl);
+    if (res == CURLE_ABORTED_BY_CALLBACK)
+    {
+        return false;  // closed before it was up; nobody is waiting for an error any more
+    }
+    if (res != CURLE_OK)
+    {
+        Fail(std::string("Realtime connection failed: ") + curl_easy_strerror(res));
+        return false;
+    }
+    return SendText(session_update);
+}
+
+void RealtimeSession::Run()
+{
+    if (Connect())
+    {
+        while (!failed)
+        {
+            std::deque<std::string> sending;
+            bool close_now = false;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::chrono::milliseconds(POLL_INTERVAL_MS), [this]() { return !outbox.empty() || closing; });
+                sending.swap(outbox);
+                close_now = closing;
+            }
+
+            for (const std::string& message : sending)
+            {
+                if (!SendText(message))
+                {
+                    break;
+                }
+            }
+            if (close_now || failed || !ReceiveMessages())
+            {
+                break;
+            }
+        }
+
+        if (!failed)
+        {
+            size_t sent = 0;
+            curl_ws_send(curl, "", 0, &sent, 0, CURLWS_CLOSE);
+        }
+    }
+
+    curl_slist_free_all(headers);
+    headers = nullptr;
+    if (curl)
+    {
+        curl_easy_cleanup(curl);
+        curl = nullptr;
+    }
+}
+
+bool RealtimeSession::SendText(const std::string& message)
+{
+    size_t offset = 0;
+    while (offset < message.size())
+    {
+        size_t sent = 0;
+        CURLcode res = curl_ws_send(curl, message.data() + offset, message.size() - offset, &sent, 0, CURLWS_TEXT);
+        if (res == CURLE_AGAIN)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (res != CURLE_OK)
+        {
+            Fail(std::string("Realtime send failed: ") + curl_easy_strerror(res));
+            return false;
+        }
+        offset += sent;
+    }
+    return true;
+}
+
+// Reads whatever has arrived. False once the session is over.
+bool RealtimeSession::ReceiveMessages()
+{
+    char buffer[16384];
+    while (true)
+    {
+        size_t received = 0;
+        FrameOut out;
+        CURLcode res = curl_ws_recv(curl, buffer, sizeof(buffer), &received, out);
+        const curl_ws_frame* frame = out.frame;
+        if (res == CURLE_AGAIN)
+        {
+            return true;
+        }
+        if (res != CURLE_OK)
+        {
+            Fail(std::string("Realtime connection lost: ") + curl_easy_strerror(res));
+            return false;
+        }
+        if (frame->flags & CURLWS_CLOSE)
+        {
+            Fail("The realtime server closed the session");
+            return false;
+        }
+        if (!(frame->flags & (CURLWS_TEXT | CURLWS_CONT)))
+        {
+            continue;  // pings and the like; curl answers those itself
+        }
+
+        incoming.append(buffer, received);
+        if (frame->bytesleft == 0 && !(frame->flags & CURLWS_CONT))
+        {
+            std::string message;
+            message.swap(incoming);
+            HandleMessage(message);
+            if (failed)
+            {
+                return false;
+            }
+        }
+    }
+}
+
+void RealtimeSession::HandleMessage(const std::string& message)
+{
+    nlohmann::json event;
+    try
+    {
+        event = nlohmann::json::parse(message);
+    }
+    catch (const std::exception&)
+    {
+        return;
+    }
+    if (!event.is_object() || !event.contains("type") || !event["type"].is_string())
+    {
+        return;
+    }
+
+    std::string type = event["type"];
+    auto text = [&event](const char* field) {
+        return (event.contains(field) && event[field].is_string()) ? event[field].get<std::string>() : std::string();
+    };
+    if (type == "input_audio_buffer.committed")
+    {
+        if (handlers.on_committed)
+        {
+            handlers.on_committed(text("item_id"));
+        }
+    }
+    else if (type == "conversation.item.input_audio_transcription.delta")
+    {
+        if (event.contains("delta") && event["delta"].is_string() && handlers.on_delta)
+        {
+            handlers.on_delta(text("item_id"), event["delta"]);
+        }
+    }
+    else if (type == "conversation.item.input_audio_transcription.completed")
+    {
+        if (handlers.on_completed)
+        {
+            handlers.on_completed(text("item_id"), text("transcript"));
+        }
+    }
+    else if (type == "error" || type == "conversation.item.input_audio_transcription.failed")
+    {
+        const nlohmann::json& error = event.contains("error") ? event["error"] : event;
+        Fail((error.is_object() && error.contains("message") && error["message"].is_string())
+            ? error["message"].get<std::string>()
+            : error.dump());
+    }
+}
+
+void RealtimeSession::Fail(const std::string& message)
+{
+    if (failed)
+    {
+        return;
+    }
+    failed = true;
+    if (handlers.on_error)
+    {
+        handlers.on_error(message);
+    }
+}
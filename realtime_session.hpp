@@ -0,0 +1,79 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// A realtime transcription session over a WebSocket, in the message shapes of OpenAI's realtime
+// transcription API (which local servers such as speaches implement as well): PCM goes up while
+// it's being captured, and every commit of the audio so far becomes a conversation item with an
+// id of its own, whose transcript comes back under that id. The socket has a thread of its own.
+// Audio and commits can be queued from any thread; the handlers run on the session's thread.
+struct RealtimeSession
+{
+    static constexpr int SAMPLE_RATE = 24000;  // "pcm16" is 24 kHz mono
+
+    struct Handlers
+    {
+        // Once per Commit(), in the same order: the id the server gave that audio
+        std::function<void(const std::string& item_id)> on_committed;
+        std::function<void(const std::string& item_id, const std::string& delta)> on_delta;
+        std::function<void(const std::string& item_id, const std::string& transcript)> on_completed;
+        std::function<void(const std::string& message)> on_error;  // the session is done for after this
+    };
+
+    RealtimeSession() = default;
+    ~RealtimeSession() { Close(); }
+
+    RealtimeSession(const RealtimeSession&) = delete;
+    RealtimeSession& operator=(const RealtimeSession&) = delete;
+
+    // Connects in the background; whatever is queued meanwhile goes out once that's done. An
+    // empty token sends no Authorization header.
+    void Start(const std::string& url, const std::string& token, const std::string& model,
+               const std::string& prompt, Handlers handlers);
+
+    void SendAudio(const short* pcm, size_t count);
+
+    // Asks for the transcript of everything sent since the last commit.
+    void Commit();
+
+    // Tells the session to hang up (or to give up connecting) without waiting for it; a
+    // Close() or the destructor still has to collect its thread. Any thread.
+    void RequestClose();
+
+    // Hangs up and waits for the session's thread. Not from a handler.
+    void Close();
+
+private:
+    void Run();
+    bool Connect();
+    bool SendText(const std::string& message);
+    bool ReceiveMessages();
+    void HandleMessage(const std::string& message);
+    void Fail(const std::string& message);
+    bool Closing();
+    static int OnConnectProgress(void* user, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
+
+    std::string url;
+    std::string token;
+    std::string session_update;
+    Handlers handlers;
+
+    CURL* curl = nullptr;
+    curl_slist* headers = nullptr;
+    std::string incoming;  // a message whose frames haven't all arrived yet
+    bool failed = false;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::string> outbox;  // guarded by mutex
+    bool closing = false;            // guarded by mutex
+};
@@ -5,33 +5,69 @@
 
 #include "emacs.hpp"
 #include "text_injection.hpp"
-#include "json.hpp"
+#include "audio_encoder.hpp"
+#include "audio_source.hpp"
+#include "capture_pipeline.hpp"
+#include "dsound_source.hpp"
+#include "file_audio_source.hpp"
+#include "mp3_buffer_pool.hpp"
+#include "mp3_parallel.hpp"
+#include "pcm_ring.hpp"
+#include "pcm_store.hpp"
+#include "realtime_session.hpp"
+#include "resampler.hpp"
 #include "resource.h"
 #include "settings.hpp"
+#include "transcription_pipeline.hpp"
 #include "utils.hpp"
 
 #include <commctrl.h>
 
-#include <curl/curl.h>
 #include <dsound.h>
-#include <lame/lame.h>
 #include <process.h>
 
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
 #include <iostream>
+#include <memory>
 #include <optional>
-#include <cctype>
+#include <string>
 
-#define BUFFER_SIZE 44100 * 2 * 1220  // a lot of seconds of 44100 Hz, 16-bit mono audio
+constexpr int CAPTURE_SAMPLE_RATE = 44100;
+
+// Everything after the resampler runs at this rate; see CapturePipeline.
+constexpr int PIPELINE_SAMPLE_RATE = CapturePipeline::SAMPLE_RATE;
+
+// How often the capture thread pulls new PCM out of the audio source and feeds the encoder.
+constexpr DWORD CAPTURE_POLL_INTERVAL_MS = 100;
+
+// DirectSound only needs to hold audio until the next poll; the take itself lives in pcm_store.
+constexpr DWORD CAPTURE_BUFFER_SIZE = CAPTURE_SAMPLE_RATE * 2 * 2;  // 2 seconds of 16-bit mono
+
+// With the mic kept open, the pre-roll ring holds this much on top of the pre-roll itself, so that
+// the capture thread has a few polls' worth of slack before a take's start gets overwritten.
+constexpr int PREROLL_RING_SLACK_MS = 2000;
+
+// Idle PCM blocks we keep around between recordings (~1 minute); anything beyond is freed.
+constexpr size_t PCM_POOL_MAX_FREE_BLOCKS = 15;
 
 constexpr int WM_REQUEST_DONE = WM_USER + 1;
 constexpr int WM_TRAYICON = WM_USER + 2;
 constexpr int WM_RAW_READY = WM_USER + 3;
+constexpr int WM_REPLAY_FINISHED = WM_USER + 4;
+constexpr int WM_POSTPROCESS_ERROR = WM_USER + 5;  // lParam: a new std::wstring, ours to delete
+constexpr int WM_PARTIAL_TEXT = WM_USER + 6;       // lParam: a new std::wstring, ours to delete
+constexpr int WM_REALTIME_CLOSED = WM_USER + 7;    // lParam: a new std::shared_ptr<RealtimeSession>, ours to delete
 
 
 #pragma comment(lib, "dsound.lib")
 #pragma comment(lib, "ole32.lib")
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "libmp3lame.lib")
+#pragma comment(lib, "opus.lib")
+#pragma comment(lib, "opusenc.lib")
+#pragma comment(lib, "FLAC.lib")
 #pragma comment(lib, "ComCtl32.lib")
 #pragma comment(lib, "version.lib")
 #pragma comment(lib, "gdi32.lib")
@@ -48,45 +84,64 @@ constexpr int WM_RAW_READY = WM_USER + 3;
 #pragma comment(lib, "libcurl")
 #endif
 
-struct Mp3Segment
-{
-    std::vector<char> data;
-    double audio_duration_seconds = 0.0;
-};
-
-struct Mp3SegmentRing
-{
-    static constexpr int NUM_ELTS = 5;
-
-    std::array<Mp3Segment, NUM_ELTS> segments;
-
-    volatile int last_written = -1;
-
-    HANDLE newEntryEvent; // Producers signal this, consumers ack
-
-    Mp3SegmentRing()
-    {
-        newEntryEvent = CreateEvent(
-            NULL, // security
-            TRUE, // manual reset
-            FALSE, // initial state
-            NULL); // no name
-    };
-};
-
-
 LPDIRECTSOUND8 lpds;
 LPDIRECTSOUNDCAPTURE8 lpdsCapture;
-LPDIRECTSOUNDCAPTUREBUFFER lpdsCaptureBuffer = NULL;
 bool isRecording = false;
-DWORD bufferSize = BUFFER_SIZE;
-
-Mp3SegmentRing mp3_segments;
 
-// Signaled when we're done with everything
-HANDLE terminationEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+// Where the current take's audio comes from: the mic, or a file given with --replay. Exists from
+// the start of a take to its end, or for as long as the mic is kept open.
+std::unique_ptr<AudioSource> audio_source;
+std::vector<short> captured;  // what the last Read() returned, at the source's rate
+
+// --replay <file> [--replay-fast]: takes read this file instead of the mic, and the first one
+// starts by itself, so the pipeline can run without anybody at the keyboard.
+std::string replayPath;
+ReplayPacing replayPacing = ReplayPacing::RealTime;
+
+// --verbose-http: libcurl traces every transcription request, for debugging a server
+bool verboseHttp = false;
+
+// Segment data comes from here and goes back once the transcription side is done with it
+Mp3BufferPool mp3_buffer_pool;
+
+// The capture thread drains the audio source into the encoder while we're recording;
+// StopRecording() signals this and then only has to deal with the last few milliseconds.
+HANDLE captureStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+HANDLE captureThread = NULL;
+
+// Capture rate -> PIPELINE_SAMPLE_RATE, on the way into pcm_store
+PolyphaseResampler resampler;
+std::vector<short> resampled;
+
+// Counts the takes; a resend goes under the last one's
+int takeId = 0;
+
+// Always-armed capture: the DirectSound buffer and the capture thread run all the time, keeping the
+// last few seconds in preroll_ring. A take is then just a range of ring positions: StartRecording
+// says where it begins (the pre-roll length back from now) and the capture thread moves everything
+// from there on into pcm_store. F8 never has to wait for the device.
+bool captureArmed = false;
+PcmRing preroll_ring;
+std::atomic<bool> armedRecording{ false };
+uint64_t armedStoredUpTo = 0;  // ring position the take has been copied into pcm_store up to
+HANDLE armedStopRequest = CreateEvent(NULL, FALSE, FALSE, NULL);
+HANDLE armedStopped = CreateEvent(NULL, TRUE, FALSE, NULL);
+std::vector<short> ring_scratch;
+
+// "Send to Whisper" re-encodes the last take from pcm_store on this thread; StartRecording waits
+// for it before reusing the store.
+HANDLE resendThread = NULL;
+
+// The PCM of the current (or last) take. Blocks go back to the pool when the next one starts.
+PcmBlockPool pcm_pool;
+PcmStore pcm_store(pcm_pool);
+
+// Conditioning, trimming, live chunking, encoding and the realtime session, from pcm_store on; every
+// segment it closes goes straight to the transcription side.
+CapturePipeline capture_pipeline(pcm_store, mp3_buffer_pool, [](Mp3Segment segment) {
+    QueueSegment(std::move(segment));
+});
 
-lame_t lame;
 HWND hwndDialog;
 HWND hwndToggle = NULL;
 HWND hwndToggleRecordButton = NULL;
@@ -105,505 +160,321 @@ std::string the_results;
 std::optional<std::string> returned_text;
 
 // Stats for the last request
-double last_audio_duration_seconds = 0.0;
-double last_request_time_seconds = 0.0;
-double last_postprocess_time_seconds = 0.0;
+TranscriptionStats last_stats;
 std::string last_raw_text;
-std::string last_processed_text;
-std::string last_reasoning_text;
 
 constexpr int HKID_START_OR_STOP = 1;
 
 BOOL InitDirectSound(HWND hWnd);
 void StartRecording();
 void StopRecording();
+void UpdateCaptureArming();
+void DisarmCapture();
 void UpdateRecordButtonText();
 void ShowToggleWindow(bool show);
 LRESULT CALLBACK ToggleWndProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 void InjectVirtualKeyToTarget(WORD vk);
 
-size_t CurlWriteToStringCallback(void* contents, size_t size, size_t nmemb, std::string* s)
+// What the transcription side should go by, from the settings as they are now.
+TranscriptionSettings CurrentTranscriptionSettings()
 {
-    size_t newLength = size * nmemb;
-    s->append((char*)contents, newLength);
-    return newLength;
+    TranscriptionSettings settings;
+    settings.openai = GetAPIType() == API_OPENAI;
+    settings.token = settings.openai ? GetOpenAIToken() : "";
+    settings.custom_endpoints = GetCustomEndpoint();
+    settings.audio_format = GetAudioFormat();
+    settings.verbose_http = verboseHttp;
+    settings.model = GetTranscriptionModel();
+    settings.prompt = GetPromptText();
+    settings.stream_transcript = GetStreamTranscriptEnabled();
+    settings.inject_early = GetInjectEarlyEnabled();
+    settings.backup_endpoint = GetBackupEndpoint();
+    settings.hedge_percentile = GetHedgePercentile();
+    settings.requests_per_minute = GetOpenAIRequestsPerMinute();
+    settings.audio_seconds_per_minute = GetOpenAIAudioSecondsPerMinute();
+    settings.postprocess = GetPostProcessEnabled();
+    settings.postprocess_endpoint = GetPostProcessEndpoint();
+    settings.postprocess_model = GetPostProcessModel();
+    settings.postprocess_prompt = GetPostProcessPrompt();
+    settings.postprocess_keep_alive_minutes = GetPostProcessKeepAliveMinutes();
+    settings.postprocess_stream = GetPostProcessStreamEnabled();
+    settings.rewrite_rules_path = GetRewriteRulesPath();
+    return settings;
 }
 
-std::string TrimString(const std::string& input)
+// The transcription side types into the target window and tells the dialog about the rest.
+TranscriptionHandlers DialogTranscriptionHandlers()
 {
-    size_t start = 0;
-    while (start < input.size() && std::isspace(static_cast<unsigned char>(input[start])))
-    {
-        ++start;
-    }
-
-    size_t end = input.size();
-    while (end > start && std::isspace(static_cast<unsigned char>(input[end - 1])))
-    {
-        --end;
-    }
-
-    return input.substr(start, end - start);
+    TranscriptionHandlers handlers;
+    handlers.inject = [](const std::string& text) {
+        InjectTextToTarget(text);
+    };
+    handlers.on_raw_text = [](const std::string& raw_text) {
+        last_raw_text = raw_text;
+        PostMessage(hwndDialog, WM_RAW_READY, 0, 0);
+    };
+    handlers.on_partial_text = [](const std::string& partial) {
+        PostMessage(hwndDialog, WM_PARTIAL_TEXT, 0, (LPARAM) new std::wstring(to_wstring(partial)));
+    };
+    handlers.on_error = [](const std::string& message) {
+        PostMessage(hwndDialog, WM_POSTPROCESS_ERROR, 0, (LPARAM) new std::wstring(to_wstring(message)));
+    };
+    handlers.on_delivered = [](const TranscriptionStats& stats, const std::string& injected) {
+        last_stats = stats;
+        the_results = stats.response;
+        returned_text = injected;
+        PostMessage(hwndDialog, WM_REQUEST_DONE, 0, 0);
+    };
+    handlers.on_realtime_closed = [](std::shared_ptr<RealtimeSession> session) {
+        PostMessage(hwndDialog, WM_REALTIME_CLOSED, 0, (LPARAM) new std::shared_ptr<RealtimeSession>(std::move(session)));
+    };
+    return handlers;
 }
 
-std::string ExtractTagContent(const std::string& response, const std::string& tag)
+// Where the post-process cache is kept between runs; empty if there's no local app data folder.
+std::filesystem::path PostProcessCachePath()
 {
-    std::string start_tag = "<";
-    start_tag += tag;
-    start_tag += ">";
-    std::string end_tag = "</";
-    end_tag += tag;
-    end_tag += ">";
-    size_t start_pos = response.find(start_tag);
-    size_t end_pos = response.find(end_tag);
-    if (start_pos == std::string::npos || end_pos == std::string::npos || end_pos <= start_pos)
+    char* local_appdata = nullptr;
+    size_t len = 0;
+    if (_dupenv_s(&local_appdata, &len, "LOCALAPPDATA") == 0 && local_appdata != nullptr)
     {
-        return {};
+        std::filesystem::path path = std::filesystem::path(local_appdata) / "whisper_win32" / "postprocess_cache.bin";
+        free(local_appdata);
+        return path;
     }
-
-    start_pos += start_tag.size();
-    return TrimString(response.substr(start_pos, end_pos - start_pos));
+    return std::filesystem::path();
 }
 
-std::string ExtractPostProcessOutput(const std::string& response)
+// Re-encodes the whole of the last take (ignoring silence trimming and chunking) and queues it as
+// one segment. MP3 goes through EncodeMp3Parallel so that even meeting-length takes are quick.
+unsigned int __stdcall ResendWorker(void*)
 {
-    return ExtractTagContent(response, "output");
-}
-
-std::string ExtractPostProcessReasoning(const std::string& response)
-{
-    return ExtractTagContent(response, "explanation");
-}
+    size_t num_samples = pcm_store.Size();
+    AudioFormat format = TakeAudioFormat();
+    ULONGLONG start_time = GetTickCount64();
 
-std::string BuildPostProcessPrompt(const std::string& prompt_template, const std::string& transcript)
-{
-    if (prompt_template.empty())
+    std::vector<char> data;
+    const char* file_name = "output.mp3";
+    const char* mime_type = "audio/mpeg";
+    if (format == FORMAT_MP3)
     {
-        return transcript;
+        ParallelMp3Options options;
+        options.sample_rate = PIPELINE_SAMPLE_RATE;
+        data = EncodeMp3Parallel(pcm_store, 0, num_samples, options,
+                                 mp3_buffer_pool.Acquire(EstimateParallelMp3Bytes(options, num_samples)));
+    }
+    else
+    {
+        std::unique_ptr<AudioEncoder> encoder = CreateAudioEncoder(format);
+        if (encoder->Start(PIPELINE_SAMPLE_RATE, mp3_buffer_pool.Acquire(encoder->WorstCaseBytes(num_samples))))
+        {
+            pcm_store.ForEachSpan(0, num_samples, [&encoder](const short* pcm, size_t count) {
+                encoder->Encode(pcm, count);
+            });
+            data = encoder->Finish();
+        }
+        file_name = encoder->FileName();
+        mime_type = encoder->MimeType();
     }
 
-    const std::string placeholder = "{{transcript}}";
-    std::string prompt = prompt_template;
-    size_t pos = 0;
-    while ((pos = prompt.find(placeholder, pos)) != std::string::npos)
+    printf("Re-encoded %.1fs of audio into %zu bytes in %llu ms\n",
+           (double)num_samples / PIPELINE_SAMPLE_RATE, data.size(), GetTickCount64() - start_time);
+    if (data.empty())
     {
-        prompt.replace(pos, placeholder.size(), transcript);
-        pos += transcript.size();
+        _endthreadex(0);
+        return 0;
     }
 
-    if (prompt == prompt_template)
+    // _endthreadex() skips destructors, so the segment gets a scope of its own
     {
-        prompt.append("\n");
-        prompt.append(transcript);
+        Mp3Segment segment;
+        segment.data = std::move(data);
+        segment.file_name = file_name;
+        segment.mime_type = mime_type;
+        segment.format = format;
+        segment.audio_duration_seconds = (double)num_samples / PIPELINE_SAMPLE_RATE;
+        segment.uploaded_duration_seconds = segment.audio_duration_seconds;
+        segment.take_id = takeId;
+        QueueSegment(std::move(segment));
     }
 
-    return prompt;
+    _endthreadex(0);
+    return 0;
 }
 
-bool PostProcessTranscript(const std::string& transcript, std::string* processed_text, std::string* reasoning_text, std::string* debug_text, std::string* error_message, double* elapsed_seconds)
+void SendToWhisperAsync()
 {
-    if (processed_text)
-    {
-        processed_text->clear();
-    }
-    if (reasoning_text)
-    {
-        reasoning_text->clear();
-    }
-    if (debug_text)
-    {
-        debug_text->clear();
-    }
-    if (error_message)
-    {
-        error_message->clear();
-    }
-    if (elapsed_seconds)
+    if (isRecording || pcm_store.Size() == 0)
     {
-        *elapsed_seconds = 0.0;
+        return;
     }
+    SetTranscriptionSettings(CurrentTranscriptionSettings());
 
-    const char* endpoint = GetPostProcessEndpoint();
-    if (!endpoint || endpoint[0] == '\0')
+    if (resendThread)
     {
-        if (error_message)
+        if (WaitForSingleObject(resendThread, 0) == WAIT_TIMEOUT)
         {
-            *error_message = "Post-process endpoint is empty.";
+            return;  // still encoding the previous one
         }
-        return false;
+        CloseHandle(resendThread);
     }
+    resendThread = (HANDLE)_beginthreadex(NULL, 0, &ResendWorker, NULL, 0, NULL);
+}
 
-    const char* model = GetPostProcessModel();
-    if (!model || model[0] == '\0')
+// Runs everything the audio source has captured since the last call through the resampler into
+// `resampled`. False if there was nothing new.
+bool ReadCaptureBuffer()
+{
+    resampled.clear();
+    captured.clear();
+    audio_source->Read(&captured);
+    if (captured.empty())
     {
-        if (error_message)
-        {
-            *error_message = "Post-process model is empty.";
-        }
         return false;
     }
 
-    const char* prompt_template = GetPostProcessPrompt();
-    std::string prompt = BuildPostProcessPrompt(prompt_template ? prompt_template : "", transcript);
-
-    nlohmann::json payload = {
-        { "model", model },
-        { "prompt", prompt },
-        { "stream", false }
-    };
-    std::string payload_json = payload.dump();
+    resampler.Process(captured.data(), captured.size(), &resampled);
+    return true;
+}
 
-    CURL* curl = curl_easy_init();
-    if (!curl)
+// Moves everything the audio source has captured since the last call into pcm_store, then
+// feeds the new samples to the encoder.
+void DrainCaptureBuffer()
+{
+    if (!ReadCaptureBuffer())
     {
-        if (error_message)
-        {
-            *error_message = "Failed to initialize curl for post-processing.";
-        }
-        return false;
+        return;
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, endpoint);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload_json.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, payload_json.size());
-
-    struct curl_slist* headerlist = NULL;
-    headerlist = curl_slist_append(headerlist, "Expect:");
-    headerlist = curl_slist_append(headerlist, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerlist);
-
-    std::string response;
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteToStringCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    capture_pipeline.Append(resampled.data(), resampled.size());
+    capture_pipeline.EncodeNewSamples(false);
+}
 
-    ULONGLONG start_time = GetTickCount64();
-    CURLcode res = curl_easy_perform(curl);
-    ULONGLONG end_time = GetTickCount64();
-    if (elapsed_seconds)
+unsigned int __stdcall CaptureWorker(void*)
+{
+    bool reportedFinished = false;
+    while (WaitForSingleObject(captureStopEvent, CAPTURE_POLL_INTERVAL_MS) == WAIT_TIMEOUT)
     {
-        *elapsed_seconds = (end_time - start_time) / 1000.0;
-    }
+        DrainCaptureBuffer();
 
-    curl_slist_free_all(headerlist);
-    curl_easy_cleanup(curl);
-
-    if (res != CURLE_OK)
-    {
-        if (error_message)
+        // A replayed file ends the take by itself, as if somebody had pressed stop
+        if (!reportedFinished && audio_source->Finished())
         {
-            *error_message = std::string("Post-process request failed: ") + curl_easy_strerror(res);
+            PostMessage(hwndDialog, WM_REPLAY_FINISHED, 0, 0);
+            reportedFinished = true;
         }
-        return false;
     }
 
-    try
-    {
-        nlohmann::json response_obj = nlohmann::json::parse(response);
-        if (!response_obj.contains("response") || !response_obj["response"].is_string())
-        {
-            if (error_message)
-            {
-                *error_message = "Post-process response is missing the response field.";
-            }
-            if (debug_text)
-            {
-                *debug_text = response;
-            }
-            return false;
-        }
-
-        std::string raw_output = response_obj["response"];
-        std::string extracted = ExtractPostProcessOutput(raw_output);
-        std::string reasoning = ExtractPostProcessReasoning(raw_output);
-        if (extracted.empty())
-        {
-            if (error_message)
-            {
-                *error_message = "Post-process response did not contain a valid <output> section.";
-            }
-            if (debug_text)
-            {
-                *debug_text = raw_output;
-            }
-            return false;
-        }
-
-        if (processed_text)
-        {
-            *processed_text = extracted;
-        }
-        if (reasoning_text)
-        {
-            *reasoning_text = reasoning;
-        }
-        return true;
-    }
-    catch (const std::exception& ex)
-    {
-        if (error_message)
-        {
-            *error_message = std::string("Failed to parse post-process response: ") + ex.what();
-        }
-        if (debug_text)
-        {
-            *debug_text = response;
-        }
-        return false;
-    }
+    _endthreadex(0);
+    return 0;
 }
 
-// Runs on a background thread; sends the mp3 file to Whisper, and waits for the results.
-void SendToWhisper(const Mp3Segment& segment)
+// Copies the current take's part of preroll_ring that isn't in pcm_store yet over there.
+void MoveRingToTake()
 {
-    CURL* curl = curl_easy_init();
-
-    // Set the URL for the request
-    if (GetAPIType() == API_OPENAI)
+    uint64_t end = preroll_ring.WritePosition();
+    uint64_t begin = std::max(armedStoredUpTo, preroll_ring.OldestPosition());
+    if (end <= begin)
     {
-        curl_easy_setopt(curl, CURLOPT_URL, "https://api.openai.com/v1/audio/transcriptions");
-    }
-    else
-    {
-        curl_easy_setopt(curl, CURLOPT_URL, GetCustomEndpoint());
-    }
-
-    // Create a MIME handle for a multipart/form-data POST
-    curl_mime* mime = curl_mime_init(curl);
-
-    // Add the file part
-    curl_mimepart* part = curl_mime_addpart(mime);
-    curl_mime_name(part, "file");
-    curl_mime_data(part, segment.data.data(), segment.data.size());
-    curl_mime_type(part, "application/octet-stream");
-
-    // For some reason, otherwise we would think that it's a string
-    curl_mime_filename(part, "output.mp3");
-
-    curl_mimepart* part2 = curl_mime_addpart(mime);
-    curl_mime_name(part2, "model");
-    curl_mime_data(part2, "whisper-1", CURL_ZERO_TERMINATED);
-
-    // Only add prompt if it's not empty
-    const char* prompt = GetPromptText();
-    if (prompt && prompt[0] != '\0') {
-        curl_mimepart* part3 = curl_mime_addpart(mime);
-        curl_mime_name(part3, "prompt");
-        curl_mime_data(part3, prompt, CURL_ZERO_TERMINATED);
-    }
-
-    // Add the headers
-    struct curl_slist* headerlist = NULL;
-    headerlist = curl_slist_append(headerlist, "Expect:");
-    headerlist = curl_slist_append(headerlist, "Content-Type: multipart/form-data");
-
-    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA);
-    curl_version_info_data* data = curl_version_info(CURLVERSION_NOW);
-    printf("libcurl is using %s for SSL/TLS.\n", data->ssl_version);
-
-    if (GetAPIType() == API_OPENAI)
-    {
-        char auth_header[300];
-        snprintf(auth_header, sizeof(auth_header), "Authorization: Bearer %s", GetOpenAIToken());
-        headerlist = curl_slist_append(headerlist, auth_header);
-    }
-
-    // Set the custom headers
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerlist);
-
-    // Set the mime post data
-    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
-
-    std::string response;
-
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlWriteToStringCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-
-    // Perform the file upload with timing
-    ULONGLONG start_time = GetTickCount64();
-    CURLcode res = curl_easy_perform(curl);
-    ULONGLONG end_time = GetTickCount64();
-    last_request_time_seconds = (end_time - start_time) / 1000.0;
-
-    // Check for errors
-    if (res != CURLE_OK)
-    {
-        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-    }
-    else
-    {
-        printf("Upload completed successfully\n");
+        return;
     }
 
-    std::cout << "Got response: " << response << std::endl;
-
-    // Clean up the MIME part
-    curl_mime_free(mime);
-    curl_slist_free_all(headerlist);
-
-    // Always cleanup
-    curl_easy_cleanup(curl);
-
-    the_results = response;
+    // We're the ring's only writer, so this can't be torn
+    ring_scratch.resize((size_t)(end - begin));
+    preroll_ring.Read(begin, end, ring_scratch.data());
+    capture_pipeline.Append(ring_scratch.data(), ring_scratch.size());
+    armedStoredUpTo = end;
+}
 
-    std::string raw_text;
-    try
+// The capture thread while the mic is kept open: always fills the ring, and while a take is on,
+// also feeds it. armedStopRequest makes it do a last round for the take and acknowledge.
+unsigned int __stdcall ArmedCaptureWorker(void*)
+{
+    HANDLE handles[] { captureStopEvent, armedStopRequest };
+    while (true)
     {
-        nlohmann::json results_obj = nlohmann::json::parse(the_results);
-        if (results_obj.contains("text") && results_obj["text"].is_string())
-        {
-            raw_text = results_obj["text"];
-        }
-        else
+        DWORD result = WaitForMultipleObjects(2, handles, FALSE, CAPTURE_POLL_INTERVAL_MS);
+        if (result == WAIT_OBJECT_0)
         {
-            raw_text = the_results;
+            break;
         }
-    }
-    catch (const std::exception&)
-    {
-        raw_text = the_results;
-    }
-
-    last_raw_text = raw_text;
-    PostMessage(hwndDialog, WM_RAW_READY, 0, 0);
-    last_processed_text.clear();
-    last_reasoning_text.clear();
-    last_postprocess_time_seconds = 0.0;
 
-    std::string inject_text = raw_text;
-    if (GetPostProcessEnabled())
-    {
-        std::string processed_text;
-        std::string reasoning_text;
-        std::string debug_text;
-        std::string error_message;
-        double postprocess_elapsed = 0.0;
-        if (PostProcessTranscript(raw_text, &processed_text, &reasoning_text, &debug_text, &error_message, &postprocess_elapsed))
+        if (ReadCaptureBuffer())
         {
-            last_processed_text = processed_text;
-            last_reasoning_text = reasoning_text;
-            last_postprocess_time_seconds = postprocess_elapsed;
-            inject_text = processed_text;
+            preroll_ring.Write(resampled.data(), resampled.size());
         }
-        else
-        {
-            last_postprocess_time_seconds = postprocess_elapsed;
-            if (!debug_text.empty())
-            {
-                last_processed_text = "Post-process parse failed. Raw output:\r\n";
-                last_processed_text += debug_text;
-            }
-            if (!error_message.empty())
-            {
-                MessageBoxW(hwndDialog, to_wstring(error_message).c_str(), L"Post-process Error", MB_OK | MB_ICONERROR);
-            }
-        }
-    }
 
-    returned_text = inject_text;
-    InjectTextToTarget(inject_text);
-
-    // Set stats from segment (so they're coherent with this request)
-    last_audio_duration_seconds = segment.audio_duration_seconds;
-
-    PostMessage(hwndDialog, WM_REQUEST_DONE, 0, 0);
-}
-
-unsigned int __stdcall SendToWhisperWorker(void* hwnd)
-{
-    int last_consumed = -1;
-
-    // complete yolo, no locking, we just fill the ring and hope we don't wrap over
-    HANDLE handles[] { terminationEvent, mp3_segments.newEntryEvent };
-
-    do {
-        DWORD result = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
-        if (result == WAIT_OBJECT_0) // termination
+        if (armedRecording.load(std::memory_order_acquire))
         {
-            break;
+            MoveRingToTake();
+            capture_pipeline.EncodeNewSamples(false);
         }
 
         if (result == WAIT_OBJECT_0 + 1)
         {
-            ResetEvent(mp3_segments.newEntryEvent);
-
-            // Catch up with all newly written ones
-            while (mp3_segments.last_written > last_consumed)
-            {
-                const Mp3Segment& segment = mp3_segments.segments[(++last_consumed) % Mp3SegmentRing::NUM_ELTS];
-                SendToWhisper(segment);
-            }
+            armedRecording.store(false, std::memory_order_release);
+            SetEvent(armedStopped);
         }
-    } while (true);
+    }
 
     _endthreadex(0);
     return 0;
 }
 
-void SendToWhisperAsync()
-{
-}
-
-// Takes the contents of the captured buffer and encodes the results into an mp3 file on disk.
-std::vector<char> EncodeToMP3(IDirectSoundCaptureBuffer* lpdsCaptureBuffer, DWORD bufferSize)
-{
-    lame_t lame = lame_init();
-    lame_set_in_samplerate(lame, 44100);
-    lame_set_num_channels(lame, 1);  // Explicitly set to mono
-    lame_set_mode(lame, MONO);
-    lame_set_VBR(lame, vbr_default);
-    if (lame_init_params(lame) < 0)
-    {
-        std::cerr << "Failed to initialize LAME encoder." << std::endl;
-        return {};
-    }
-
-    BYTE* pcmBuffer;  // = new BYTE[bufferSize];
-    const int MP3_BUFFER_SIZE = static_cast<int>(1.25 * bufferSize + 7200);
-
-    std::vector<char> mp3Buffer;
-    mp3Buffer.resize(MP3_BUFFER_SIZE);
-
-    DWORD readBytes = 0;
-    lpdsCaptureBuffer->GetCurrentPosition(nullptr, &readBytes);
-    lpdsCaptureBuffer->Lock(0, readBytes, (void**)&pcmBuffer, &bufferSize, nullptr, 0, 0);
-
-    int mp3Bytes = lame_encode_buffer(lame,
-                                      (short int*)pcmBuffer,
-                                      nullptr,
-                                      readBytes / 2,
-                                      (unsigned char*)mp3Buffer.data(),
-                                      mp3Buffer.size());
-    lpdsCaptureBuffer->Unlock(pcmBuffer, bufferSize, nullptr, 0);
-
-    // Finish the encoding
-    mp3Bytes += lame_encode_flush(
-        lame, (unsigned char*)mp3Buffer.data() + mp3Bytes, MP3_BUFFER_SIZE - mp3Bytes);
-    mp3Buffer.resize(mp3Bytes);  // Resize buffer to the actual MP3 size
-
-    lame_close(lame);
-
-    return mp3Buffer;
-}
-
 void ProcessResultsJson()
 {
     std::string raw_text = last_raw_text.empty() ? the_results : last_raw_text;
     SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), to_wstring(raw_text).c_str());
-    SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES_PROCESSED), to_wstring(last_processed_text).c_str());
-    SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES_REASONING), to_wstring(last_reasoning_text).c_str());
+    SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES_PROCESSED), to_wstring(last_stats.processed_text).c_str());
+    SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES_REASONING), to_wstring(last_stats.reasoning_text).c_str());
 
-    // Update stats label
-    wchar_t stats_buffer[128];
-    double whisper_ratio = (last_request_time_seconds > 0)
-        ? last_audio_duration_seconds / last_request_time_seconds
+    // Update stats label. Whisper only saw the trimmed audio, so that's what its ratio is against.
+    wchar_t stats_buffer[512];
+    double whisper_ratio = (last_stats.request_seconds > 0)
+        ? last_stats.uploaded_duration_seconds / last_stats.request_seconds
         : 0.0;
-    double post_ratio = (last_postprocess_time_seconds > 0)
-        ? last_audio_duration_seconds / last_postprocess_time_seconds
+    double post_ratio = (last_stats.postprocess_seconds > 0)
+        ? last_stats.audio_duration_seconds / last_stats.postprocess_seconds
         : 0.0;
-    swprintf(stats_buffer, 128, L"%.1fs audio -> %.1fs whisper (%.2fx realtime), %.1fs post (%.2fx realtime)",
-             last_audio_duration_seconds, last_request_time_seconds, whisper_ratio,
-             last_postprocess_time_seconds, post_ratio);
+    const wchar_t* model_state = (last_stats.rewrite_microseconds >= 0) ? L"rewrite rules"
+        : last_stats.postprocess_cached ? L"cached"
+        : (last_stats.postprocess_load_seconds < 0) ? L"model state unknown"
+        : (last_stats.postprocess_load_seconds > MODEL_COLD_LOAD_SECONDS) ? L"cold model"
+        : L"warm model";
+    wchar_t hedge_buffer[64] = L"";
+    if (last_stats.hedgeable_requests > 0)
+    {
+        swprintf(hedge_buffer, 64, L", hedged %d/%d, second won %d", last_stats.hedges_fired, last_stats.hedgeable_requests, last_stats.hedges_won);
+    }
+    wchar_t queue_buffer[32] = L"";
+    if (last_stats.queue_seconds > 0)
+    {
+        swprintf(queue_buffer, 32, L"%.1fs queued + ", last_stats.queue_seconds);
+    }
+    wchar_t first_output_buffer[32] = L"";
+    if (last_stats.postprocess_first_output_seconds >= 0)
+    {
+        swprintf(first_output_buffer, 32, L", first output %.1fs", last_stats.postprocess_first_output_seconds);
+    }
+    wchar_t rewrite_buffer[32] = L"";
+    if (last_stats.rewrite_microseconds >= 0)
+    {
+        swprintf(rewrite_buffer, 32, L" in %.0fus", last_stats.rewrite_microseconds);
+    }
+    wchar_t cache_buffer[64] = L"";
+    if (last_stats.postprocess_cache_lookups > 0)
+    {
+        swprintf(cache_buffer, 64, L", cache hits %d/%d (%.1fs saved)", last_stats.postprocess_cache_hits, last_stats.postprocess_cache_lookups, last_stats.postprocess_cache_seconds_saved);
+    }
+    wchar_t first_text_buffer[32] = L"";
+    if (last_stats.first_text_seconds >= 0)
+    {
+        swprintf(first_text_buffer, 32, L", first text %.1fs", last_stats.first_text_seconds);
+    }
+    swprintf(stats_buffer, 512, L"%.1fs audio (%.1fs sent) -> %s%.1fs whisper (%.2fx realtime%s, %s connection, warm-up saved %d/%d%s), %.1fs post (%.2fx realtime%s, %s%s%s), text %.1fs after stop",
+             last_stats.audio_duration_seconds, last_stats.uploaded_duration_seconds, queue_buffer, last_stats.request_seconds, whisper_ratio, first_text_buffer,
+             last_stats.timings.reused_connection ? L"reused" : L"new", last_stats.handshakes_saved, last_stats.warmups_started, hedge_buffer,
+             last_stats.postprocess_seconds, post_ratio, first_output_buffer, model_state, rewrite_buffer, cache_buffer, last_stats.stop_to_text_seconds);
     SetWindowText(GetDlgItem(hwndDialog, IDC_STATS), stats_buffer);
 }
 
@@ -882,6 +753,7 @@ INT_PTR CALLBACK DialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             return FALSE;
         }
         hwndDialog = hwnd;
+        UpdateCaptureArming();
         SendMessage(GetDlgItem(hwnd, IDC_SHOW_TOGGLE), BM_SETCHECK, BST_UNCHECKED, 0);
         SendMessage(GetDlgItem(hwnd, IDC_POSTPROCESS_ENABLE), BM_SETCHECK,
                     GetPostProcessEnabled() ? BST_CHECKED : BST_UNCHECKED, 0);
@@ -895,6 +767,7 @@ INT_PTR CALLBACK DialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         case IDC_POSTPROCESS_ENABLE:
             SetPostProcessEnabled(IsDlgButtonChecked(hwnd, IDC_POSTPROCESS_ENABLE) == BST_CHECKED);
             SaveSettingsToRegistry();
+            SetTranscriptionSettings(CurrentTranscriptionSettings());
             break;
         case IDC_SHOW_TOGGLE:
             ShowToggleWindow(IsDlgButtonChecked(hwnd, IDC_SHOW_TOGGLE) == BST_CHECKED);
@@ -910,6 +783,7 @@ INT_PTR CALLBACK DialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             {
                 StopRecording();
             }
+            DisarmCapture();
             if (hwndToggle)
             {
                 DestroyWindow(hwndToggle);
@@ -920,6 +794,8 @@ INT_PTR CALLBACK DialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             break;
         case IDC_SETTINGS:
             ShowSettingsDialog(hwnd);
+            UpdateCaptureArming();
+            SetTranscriptionSettings(CurrentTranscriptionSettings());
             break;
         }
         break;
@@ -929,6 +805,31 @@ INT_PTR CALLBACK DialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     case WM_RAW_READY:
         SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), to_wstring(last_raw_text).c_str());
         break;
+    case WM_PARTIAL_TEXT:
+    {
+        std::unique_ptr<std::wstring> partial_text((std::wstring*)lParam);
+        SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), partial_text->c_str());
+        break;
+    }
+    case WM_REALTIME_CLOSED:
+    {
+        // Already told to hang up, so this is quick
+        std::unique_ptr<std::shared_ptr<RealtimeSession>> session((std::shared_ptr<RealtimeSession>*)lParam);
+        (*session)->Close();
+        break;
+    }
+    case WM_POSTPROCESS_ERROR:
+    {
+        std::unique_ptr<std::wstring> error_message((std::wstring*)lParam);
+        MessageBoxW(hwnd, error_message->c_str(), L"Post-process Error", MB_OK | MB_ICONERROR);
+        break;
+    }
+    case WM_REPLAY_FINISHED:
+        if (isRecording)
+        {
+            OnRecordOrStop(hwnd);
+        }
+        break;
     case WM_TRAYICON:
         if (lParam == WM_LBUTTONDOWN)
         {
@@ -971,78 +872,270 @@ BOOL InitDirectSound(HWND hWnd)
     return TRUE;
 }
 
-void StartRecording()
+// Creates audio_source (not started yet): the replay file if there is one, the mic otherwise. The
+// mic is also what you get with `from_mic`, for keeping it open between takes.
+bool CreateCaptureBuffer(bool from_mic = false)
 {
-    DSCBUFFERDESC dsbdesc;
-    WAVEFORMATEX wfx;
-
-    // Set up wave format structure.
-    memset(&wfx, 0, sizeof(WAVEFORMATEX));
-    wfx.wFormatTag = WAVE_FORMAT_PCM;
-    wfx.nChannels = 1;
-    wfx.nSamplesPerSec = 44100;
-    wfx.wBitsPerSample = 16;
-    wfx.nBlockAlign = wfx.nChannels * (wfx.wBitsPerSample / 8);
-    wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
-
-    // Set up DSBUFFERDESC structure.
-    memset(&dsbdesc, 0, sizeof(DSCBUFFERDESC));
-    dsbdesc.dwSize = sizeof(DSCBUFFERDESC);
-    dsbdesc.dwBufferBytes = bufferSize;
-    dsbdesc.lpwfxFormat = &wfx;
-
-    // Create capture buffer.
-    if (FAILED(lpdsCapture->CreateCaptureBuffer(&dsbdesc, &lpdsCaptureBuffer, NULL)))
+    if (!replayPath.empty() && !from_mic)
+    {
+        audio_source = std::make_unique<FileAudioSource>(replayPath, replayPacing);
+    }
+    else
+    {
+        audio_source = std::make_unique<DirectSoundSource>(lpdsCapture, CAPTURE_SAMPLE_RATE, CAPTURE_BUFFER_SIZE);
+    }
+
+    if (!audio_source->Open())
     {
-        SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), L"failed to create capture buffer");
+        SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES),
+                      replayPath.empty() || from_mic ? L"failed to create capture buffer" : L"failed to open the replay file");
+        audio_source.reset();
+        return false;
+    }
+
+    if (resampler.InputRate() != audio_source->SampleRate())
+    {
+        resampler.Init(audio_source->SampleRate(), PIPELINE_SAMPLE_RATE);
+    }
+    resampler.Reset();
+    return true;
+}
+
+// Per-take capture buffers are released when the take ends; an armed one stays.
+void ReleaseTakeCaptureBuffer()
+{
+    if (!captureArmed)
+    {
+        audio_source.reset();
+    }
+}
+
+// Opens the mic for good and starts keeping the pre-roll. Only between takes.
+bool ArmCapture()
+{
+    if (captureArmed)
+    {
+        return true;
+    }
+    if (!CreateCaptureBuffer(true))
+    {
+        return false;
+    }
 
+    preroll_ring.Resize((size_t)PIPELINE_SAMPLE_RATE * (GetPrerollMs() + PREROLL_RING_SLACK_MS) / 1000);
+    armedRecording.store(false);
+    captureArmed = true;
+
+    audio_source->Start();
+    ResetEvent(captureStopEvent);
+    captureThread = (HANDLE)_beginthreadex(NULL, 0, &ArmedCaptureWorker, NULL, 0, NULL);
+    return true;
+}
+
+void DisarmCapture()
+{
+    if (!captureArmed)
+    {
+        return;
+    }
+
+    SetEvent(captureStopEvent);
+    WaitForSingleObject(captureThread, INFINITE);
+    CloseHandle(captureThread);
+    captureThread = NULL;
+
+    audio_source->Stop();
+    audio_source.reset();
+    captureArmed = false;
+}
+
+// Follows the "keep mic open" setting (and a changed pre-roll length); only between takes. Never
+// while replaying a file: takes don't come from the mic then.
+void UpdateCaptureArming()
+{
+    if (isRecording)
+    {
         return;
     }
 
-    if (lpdsCaptureBuffer)
+    DisarmCapture();
+    if (GetAlwaysArmed() && replayPath.empty())
     {
-        lpdsCaptureBuffer->Start(DSCBSTART_LOOPING);
+        ArmCapture();
     }
 }
 
-void StopRecording()
+void StartRecording()
 {
-    if (lpdsCaptureBuffer)
+    // With the mic kept open, the capture buffer is already running
+    if (!captureArmed && !CreateCaptureBuffer())
     {
-        lpdsCaptureBuffer->Stop();
+        return;
+    }
 
-        DWORD dwCapturePosition, dwReadPosition;
-        HRESULT hr = lpdsCaptureBuffer->GetCurrentPosition(&dwCapturePosition, &dwReadPosition);
+    // Connect, and get the post-process model loaded, while the user talks
+    SetTranscriptionSettings(CurrentTranscriptionSettings());
+    PrepareForTake();
 
-        // Calculate audio duration: bytes / (sample_rate * channels * bytes_per_sample)
-        // 44100 Hz, mono, 16-bit = 88200 bytes per second
-        double audio_duration = SUCCEEDED(hr) ? dwCapturePosition / 88200.0 : 0.0;
+    // Hand the previous take's blocks back before we start filling new ones (once a resend of it,
+    // if any, is done reading them)
+    if (resendThread)
+    {
+        WaitForSingleObject(resendThread, INFINITE);
+        CloseHandle(resendThread);
+        resendThread = NULL;
+    }
+    pcm_store.Clear();
+    pcm_pool.TrimFreeBlocks(PCM_POOL_MAX_FREE_BLOCKS);
+    pcm_store.SetSpillThreshold(GetSpillEnabled() ? (size_t)PIPELINE_SAMPLE_RATE * 60 * GetSpillMinutes() : 0);
+
+    CaptureSettings capture_settings;
+    capture_settings.condition = GetConditioningEnabled();
+    capture_settings.conditioning.high_pass = GetHighPassHz() > 0;
+    capture_settings.conditioning.high_pass_hz = GetHighPassHz();
+    capture_settings.trim_silence = GetVadEnabled();
+    capture_settings.live_chunks = GetLiveChunksEnabled();
+    capture_settings.vad.max_pause_ms = GetVadMaxPauseMs();
+    capture_settings.stream_upload = GetStreamUploadEnabled();
+    takeId += 1;
+
+    std::shared_ptr<RealtimeSession> realtime_session;
+    const char* realtime_endpoint = GetRealtimeEndpoint();
+    if (realtime_endpoint && realtime_endpoint[0] != '\0')
+    {
+        realtime_session = StartRealtimeTake(takeId, realtime_endpoint);
+    }
 
-        if (SUCCEEDED(hr))
+    if (!capture_pipeline.StartTake(takeId, CreateAudioEncoder(TakeAudioFormat()), capture_settings, realtime_session))
+    {
+        SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), L"failed to initialize the audio encoder");
+        if (realtime_session)
         {
-            wchar_t buffer[64];
-            wsprintf(buffer, L"%lu bytes recorded", dwCapturePosition);
-            SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), buffer);
+            EndRealtimeTake(takeId);
+        }
+        ReleaseTakeCaptureBuffer();
+        return;
+    }
+
+    if (captureArmed)
+    {
+        // The take starts a pre-roll's length ago; the capture thread takes it from here
+        uint64_t preroll = (uint64_t)PIPELINE_SAMPLE_RATE * GetPrerollMs() / 1000;
+        uint64_t now = preroll_ring.WritePosition();
+        armedStoredUpTo = std::max(preroll_ring.OldestPosition(), now > preroll ? now - preroll : 0);
+        ResetEvent(armedStopped);
+        armedRecording.store(true, std::memory_order_release);
+        return;
+    }
+
+    audio_source->Start();
+
+    ResetEvent(captureStopEvent);
+    captureThread = (HANDLE)_beginthreadex(NULL, 0, &CaptureWorker, NULL, 0, NULL);
+}
+
+void StopRecording()
+{
+    if (audio_source)
+    {
+        uint64_t stopped_at = SteadyClockMs();
+
+        if (captureArmed)
+        {
+            // The capture thread does a last round for the take and lets go of it
+            SetEvent(armedStopRequest);
+            WaitForSingleObject(armedStopped, INFINITE);
         }
         else
         {
-            SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), L"there were issues.");
+            if (captureThread)
+            {
+                SetEvent(captureStopEvent);
+                WaitForSingleObject(captureThread, INFINITE);
+                CloseHandle(captureThread);
+                captureThread = NULL;
+            }
+
+            // Sources aren't thread-safe, so only once the capture thread is done with it
+            audio_source->Stop();
+
+            // Whatever arrived since the capture thread last looked; at most one poll interval.
+            DrainCaptureBuffer();
+
+            resampled.clear();
+            resampler.Flush(&resampled);
+            capture_pipeline.Append(resampled.data(), resampled.size());
+        }
+        bool queued = capture_pipeline.FinishTake(stopped_at);
+
+        wchar_t buffer[128];
+        swprintf(buffer, 128, L"%zu bytes recorded (%zu KB peak PCM memory, %zu KB on disk)",
+                 pcm_store.Size() * sizeof(short), pcm_pool.HighWaterBytes() / 1024, pcm_store.SpilledBytes() / 1024);
+        SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), buffer);
+
+        // Nothing went out for the end of the take: it was silence
+        if (!queued)
+        {
+            if (capture_pipeline.ChunkIndex() == 0)
+            {
+                SetWindowText(GetDlgItem(hwndDialog, IDC_MESSAGES), L"no speech detected");
+            }
+            if (capture_pipeline.HasRealtimeSession())
+            {
+                EndRealtimeTake(takeId);
+            }
         }
 
-        // Reserve a new segment
-        int segment_id = mp3_segments.last_written + 1;
-        Mp3Segment& segment = mp3_segments.segments[segment_id % Mp3SegmentRing::NUM_ELTS];
+        ReleaseTakeCaptureBuffer();
+    }
+}
 
-        // Fill it
-        segment.data = std::move(EncodeToMP3(lpdsCaptureBuffer, BUFFER_SIZE));
-        segment.audio_duration_seconds = audio_duration;
+// Picks --replay <file> and --replay-fast out of the command line. The file name may be quoted.
+void ParseCommandLine(const char* cmdLine)
+{
+    std::vector<std::string> args;
+    const char* p = cmdLine;
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+        if (!*p)
+        {
+            break;
+        }
 
-        // Release it
-        mp3_segments.last_written += 1;
-        SetEvent(mp3_segments.newEntryEvent);
+        std::string arg;
+        bool quoted = false;
+        for (; *p && (quoted || (*p != ' ' && *p != '\t')); p++)
+        {
+            if (*p == '"')
+            {
+                quoted = !quoted;
+            }
+            else
+            {
+                arg += *p;
+            }
+        }
+        args.push_back(arg);
+    }
 
-        lpdsCaptureBuffer->Release();
-        lpdsCaptureBuffer = NULL;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--replay" && i + 1 < args.size())
+        {
+            replayPath = args[++i];
+        }
+        else if (args[i] == "--replay-fast")
+        {
+            replayPacing = ReplayPacing::AsFastAsPossible;
+        }
+        else if (args[i] == "--verbose-http")
+        {
+            verboseHttp = true;
+        }
     }
 }
 
@@ -1056,6 +1149,10 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     g_hInstance = hInstance;
 
     LoadSettingsFromRegistry();
+    ParseCommandLine(lpCmdLine);
+
+    // Spill files from a previous run that crashed
+    RemoveStaleSpillFiles();
 
     // A global hotkey so that we can use it even if we are in the background.
     RegisterHotKey(NULL, HKID_START_OR_STOP, MOD_NOREPEAT, VK_F8);
@@ -1063,8 +1160,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // We need an explicit message pump to be able to process the global hotkey messages.
     HWND hwndDialog = CreateDialog(hInstance, MAKEINTRESOURCE(IDD_RECORDER), NULL, DialogProc);
 
-    // FIXME(ssafar): are we leaking the thread handle here?
-    _beginthreadex(NULL, 0, &SendToWhisperWorker, hwndDialog, 0, NULL);
+    StartTranscription(CurrentTranscriptionSettings(), &mp3_buffer_pool, DialogTranscriptionHandlers());
+    LoadPostProcessCache(PostProcessCachePath());
+
+    // A replay starts right away; it stops by itself at the end of the file
+    if (!replayPath.empty())
+    {
+        SendMessage(hwndDialog, WM_COMMAND, IDC_RECORD, 0);
+    }
 
     MSG msg;
     while (GetMessage(&msg, NULL, 0, 0))
@@ -1085,8 +1188,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
     UnregisterHotKey(NULL, HKID_START_OR_STOP);
 
-    // Stop all the threads
-    SetEvent(terminationEvent);
+    StopTranscription();
 
     NOTIFYICONDATA nid = {0};
     nid.cbSize = sizeof(NOTIFYICONDATA);
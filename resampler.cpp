@@ -0,0 +1,189 @@
+#include "resampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// PCM_SCALAR_KERNELS turns the vector paths off (see tests/CMakeLists.txt)
+#if defined(__AVX2__) && !defined(PCM_SCALAR_KERNELS)
+#include <immintrin.h>
+#define RESAMPLER_USE_AVX2 1
+#endif
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(PCM_SCALAR_KERNELS)
+#include <emmintrin.h>
+#define RESAMPLER_USE_SSE 1
+#endif
+
+namespace
+{
+
+constexpr double PI = 3.14159265358979323846;
+
+// Where the passband ends, as a fraction of the output Nyquist frequency.
+constexpr double ROLLOFF = 0.9;
+constexpr double KAISER_BETA = 7.0;
+
+double BesselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+float DotProduct(const float* a, const float* b, int n)
+{
+    int i = 0;
+    float total = 0.0f;
+
+#if defined(RESAMPLER_USE_AVX2)
+    {
+        __m256 acc = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8)
+        {
+            acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        }
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, acc);
+        for (float lane : lanes)
+        {
+            total += lane;
+        }
+    }
+#endif
+
+#if defined(RESAMPLER_USE_SSE)
+    {
+        __m128 acc = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, acc);
+        total += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        total += a[i] * b[i];
+    }
+
+    return total;
+}
+
+short ToPcm16(float value)
+{
+    long rounded = std::lround(value);
+    return static_cast<short>(std::clamp(rounded, -32768L, 32767L));
+}
+
+}  // namespace
+
+bool PolyphaseResampler::Init(int in_rate, int out_rate, int taps_per_phase)
+{
+    if (in_rate <= 0 || out_rate <= 0 || taps_per_phase <= 0)
+    {
+        return false;
+    }
+
+    input_rate = in_rate;
+    output_rate = out_rate;
+    int divisor = std::gcd(in_rate, out_rate);
+    up = out_rate / divisor;
+    down = in_rate / divisor;
+    taps = taps_per_phase;
+
+    coefficients.clear();
+    if (up != down)
+    {
+        // Windowed-sinc lowpass at the upsampled rate, cutting off below the lower Nyquist
+        const int length = up * taps;
+        const double center = (length - 1) / 2.0;
+        const double cutoff = ROLLOFF * 0.5 / std::max(up, down);  // cycles per upsampled sample
+        const double window_norm = BesselI0(KAISER_BETA);
+
+        std::vector<double> prototype(length);
+        double sum = 0.0;
+        for (int i = 0; i < length; i++)
+        {
+            double x = i - center;
+            double sinc = (x == 0.0) ? 1.0 : std::sin(2.0 * PI * cutoff * x) / (2.0 * PI * cutoff * x);
+            double r = x / (center + 1.0);
+            double window = BesselI0(KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - r * r))) / window_norm;
+            prototype[i] = sinc * window;
+            sum += prototype[i];
+        }
+
+        // Unity gain per phase, i.e. `up` overall
+        coefficients.resize(length);
+        for (int p = 0; p < up; p++)
+        {
+            for (int j = 0; j < taps; j++)
+            {
+                coefficients[p * taps + j] = static_cast<float>(prototype[p + (taps - 1 - j) * up] * up / sum);
+            }
+        }
+    }
+
+    Reset();
+    return true;
+}
+
+void PolyphaseResampler::Reset()
+{
+    history.assign(taps > 0 ? taps - 1 : 0, 0.0f);
+    next_input = history.size();
+    phase = 0;
+}
+
+void PolyphaseResampler::Process(const short* in, size_t count, std::vector<short>* out)
+{
+    if (up == down)
+    {
+        out->insert(out->end(), in, in + count);
+        return;
+    }
+
+    history.reserve(history.size() + count);
+    for (size_t i = 0; i < count; i++)
+    {
+        history.push_back(in[i]);
+    }
+
+    while (next_input < history.size())
+    {
+        const float* window = history.data() + next_input - (taps - 1);
+        out->push_back(ToPcm16(DotProduct(coefficients.data() + phase * taps, window, taps)));
+
+        phase += down;
+        next_input += phase / up;
+        phase %= up;
+    }
+
+    // Keep just enough history for the next window
+    size_t drop = std::min(next_input - (taps - 1), history.size());
+    history.erase(history.begin(), history.begin() + drop);
+    next_input -= drop;
+}
+
+void PolyphaseResampler::Flush(std::vector<short>* out)
+{
+    if (up == down)
+    {
+        return;
+    }
+
+    std::vector<short> silence(taps / 2, 0);
+    Process(silence.data(), silence.size(), out);
+}
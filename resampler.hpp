@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Streaming polyphase FIR resampler for 16-bit mono PCM, for any rational ratio (e.g. 44.1 kHz
+// capture down to the 16 kHz Whisper works at). The inner dot product uses AVX2 or SSE where
+// available and plain C++ otherwise.
+struct PolyphaseResampler
+{
+    static constexpr int DEFAULT_TAPS_PER_PHASE = 64;
+
+    bool Init(int input_rate, int output_rate, int taps_per_phase = DEFAULT_TAPS_PER_PHASE);
+
+    // Forgets buffered input; the filter stays as it is.
+    void Reset();
+
+    // Appends the output for `count` more input samples to `out`.
+    void Process(const short* in, size_t count, std::vector<short>* out);
+
+    // Pushes the filter's last half-window out by feeding it silence.
+    void Flush(std::vector<short>* out);
+
+    int InputRate() const { return input_rate; }
+    int OutputRate() const { return output_rate; }
+    bool IsPassthrough() const { return up == down; }
+
+private:
+    int input_rate = 0;
+    int output_rate = 0;
+    int up = 1;    // L: interpolation factor
+    int down = 1;  // M: decimation factor
+    int taps = 0;  // per phase
+
+    // up * taps coefficients, grouped by phase, each phase reversed so it lines up with a
+    // forward run of input samples.
+    std::vector<float> coefficients;
+
+    std::vector<float> history;  // last taps-1 input samples followed by new input
+    size_t next_input = 0;       // index into history of the input sample the next output ends at
+    int phase = 0;
+};
@@ -27,6 +27,29 @@
 #define IDC_POSTPROCESS_PROMPT             121
 #define IDC_MESSAGES_PROCESSED             122
 #define IDC_MESSAGES_REASONING             123
+#define IDC_VAD_ENABLE                     124
+#define IDC_VAD_MAX_PAUSE                  125
+#define IDC_OPENAI_FORMAT                  126
+#define IDC_CUSTOM_FORMAT                  127
+#define IDC_LIVE_CHUNKS                    128
+#define IDC_CONDITIONING_ENABLE            129
+#define IDC_HIGHPASS_HZ                    130
+#define IDC_ALWAYS_ARMED                   131
+#define IDC_PREROLL_MS                     132
+#define IDC_SPILL_ENABLE                   133
+#define IDC_SPILL_MINUTES                  134
+#define IDC_STREAM_UPLOAD                  135
+#define IDC_POSTPROCESS_KEEP_ALIVE         136
+#define IDC_BACKUP_ENDPOINT                137
+#define IDC_HEDGE_PERCENTILE               138
+#define IDC_OPENAI_RPM                     139
+#define IDC_OPENAI_AUDIO_PER_MINUTE        140
+#define IDC_TRANSCRIPTION_MODEL            141
+#define IDC_STREAM_TRANSCRIPT              142
+#define IDC_INJECT_EARLY                   143
+#define IDC_REALTIME_ENDPOINT              144
+#define IDC_POSTPROCESS_STREAM             145
+#define IDC_REWRITE_RULES                  146
 
 #define IDD_RECORDER                        100
 #define IDD_SETTINGS                        101
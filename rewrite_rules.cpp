@@ -0,0 +1,346 @@
+#include "rewrite_rules.hpp"
+
+#include <cctype>
+#include <deque>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+
+struct Token
+{
+    std::string text;
+    std::string key;    // what rules match against
+    std::string space;  // the whitespace before it
+};
+
+bool IsWordChar(unsigned char c)
+{
+    return std::isalnum(c) || c >= 0x80;  // UTF-8 letters are words too
+}
+
+// Words, and every other character on its own: "example.com," is "example", ".", "com", ",".
+std::vector<Token> Tokenize(const std::string& text)
+{
+    std::vector<Token> tokens;
+    std::string space;
+    size_t i = 0;
+    while (i < text.size())
+    {
+        unsigned char c = text[i];
+        if (std::isspace(c))
+        {
+            space += text[i++];
+            continue;
+        }
+
+        size_t end = i + 1;
+        if (IsWordChar(c))
+        {
+            // "don't" is one word
+            while (end < text.size() && (IsWordChar(text[end]) || (text[end] == '\'' && end + 1 < text.size() && IsWordChar(text[end + 1]))))
+            {
+                ++end;
+            }
+        }
+
+        Token token;
+        token.text = text.substr(i, end - i);
+        token.key = token.text;
+        for (char& k : token.key)
+        {
+            k = static_cast<char>(std::tolower(static_cast<unsigned char>(k)));
+        }
+        token.space.swap(space);
+        tokens.push_back(std::move(token));
+        i = end;
+    }
+    return tokens;
+}
+
+std::string Trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+std::string Unescape(const std::string& text)
+{
+    std::string out;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        if (text[i] == '\\' && i + 1 < text.size())
+        {
+            char next = text[++i];
+            out += (next == 'n') ? '\n' : (next == 't') ? '\t' : next;
+        }
+        else
+        {
+            out += text[i];
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+bool RewriteRules::Load(const std::string& rules_text, std::string* error_message)
+{
+    rules.clear();
+    nodes.assign(1, Node());
+    word_ids.clear();
+
+    std::istringstream lines(rules_text.compare(0, 3, "\xEF\xBB\xBF") == 0 ? rules_text.substr(3) : rules_text);
+    std::string line;
+    int line_number = 0;
+    while (std::getline(lines, line))
+    {
+        ++line_number;
+        line = Trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        Rule rule;
+        std::string pattern;
+        if (line[0] == '@')
+        {
+            rule.in_address = true;
+            line = Trim(line.substr(1));
+        }
+        size_t arrow = line.find("=>");
+        if (!rule.in_address && line[0] == '?')
+        {
+            rule.defer = true;
+            pattern = line.substr(1);
+        }
+        else if (arrow != std::string::npos)
+        {
+            pattern = line.substr(0, arrow);
+            std::string replacement = Trim(line.substr(arrow + 2));
+            if (!replacement.empty() && replacement.front() == '~')
+            {
+                rule.join_before = true;
+                replacement.erase(0, 1);
+            }
+            if (!replacement.empty() && replacement.back() == '~')
+            {
+                rule.join_after = true;
+                replacement.pop_back();
+            }
+            rule.replacement = Unescape(replacement);
+        }
+        else
+        {
+            *error_message = "Rewrite rules line " + std::to_string(line_number) + ": expected \"words => replacement\", \"@ words => replacement\" or \"? words\"";
+            return false;
+        }
+
+        std::vector<std::string> words;
+        for (const Token& token : Tokenize(pattern))
+        {
+            words.push_back(token.key);
+        }
+        if (words.empty())
+        {
+            *error_message = "Rewrite rules line " + std::to_string(line_number) + ": no words to match";
+            return false;
+        }
+        AddPattern(words, std::move(rule));
+    }
+
+    Build();
+    return true;
+}
+
+bool RewriteRules::LoadFile(const std::filesystem::path& path, std::string* error_message)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        *error_message = "Couldn't open the rewrite rules file " + path.string();
+        return false;
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    return Load(text.str(), error_message);
+}
+
+int RewriteRules::WordId(const std::string& word) const
+{
+    auto it = word_ids.find(word);
+    return (it == word_ids.end()) ? -1 : it->second;
+}
+
+// A later rule for the same words replaces the earlier one.
+void RewriteRules::AddPattern(const std::vector<std::string>& words, Rule rule)
+{
+    int node = 0;
+    for (const std::string& word : words)
+    {
+        int id = word_ids.emplace(word, (int)word_ids.size()).first->second;
+        auto it = nodes[node].next.find(id);
+        if (it != nodes[node].next.end())
+        {
+            node = it->second;
+            continue;
+        }
+        nodes.emplace_back();
+        nodes[node].next[id] = (int)nodes.size() - 1;
+        node = (int)nodes.size() - 1;
+    }
+
+    rule.length = words.size();
+    rules.push_back(std::move(rule));
+    nodes[node].rule = (int)rules.size() - 1;
+}
+
+// Fail links breadth-first, so a node's fail target (always shallower) is done before it is.
+void RewriteRules::Build()
+{
+    std::deque<int> queue;
+    for (auto& [id, child] : nodes[0].next)
+    {
+        nodes[child].fail = 0;
+        nodes[child].output = (nodes[child].rule >= 0) ? child : -1;
+        queue.push_back(child);
+    }
+
+    while (!queue.empty())
+    {
+        int node = queue.front();
+        queue.pop_front();
+        for (auto& [id, child] : nodes[node].next)
+        {
+            int fail = nodes[node].fail;
+            while (fail != 0 && nodes[fail].next.count(id) == 0)
+            {
+                fail = nodes[fail].fail;
+            }
+            auto it = nodes[fail].next.find(id);
+            nodes[child].fail = (it != nodes[fail].next.end()) ? it->second : 0;
+            nodes[child].output = (nodes[child].rule >= 0) ? child : nodes[nodes[child].fail].output;
+            queue.push_back(child);
+        }
+    }
+}
+
+RewriteRules::Result RewriteRules::Rewrite(const std::string& transcript) const
+{
+    std::vector<Token> tokens = Tokenize(transcript);
+
+    // The longest match starting at each word
+    std::vector<int> best_rule(tokens.size(), -1);
+    int state = 0;
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        int id = WordId(tokens[i].key);
+        while (state != 0 && nodes[state].next.count(id) == 0)
+        {
+            state = nodes[state].fail;
+        }
+        auto it = nodes[state].next.find(id);
+        state = (it != nodes[state].next.end()) ? it->second : 0;
+
+        for (int node = nodes[state].output; node != -1; node = nodes[nodes[node].fail].output)
+        {
+            int rule = nodes[node].rule;
+            size_t start = i + 1 - rules[rule].length;
+            if (best_rule[start] == -1 || rules[best_rule[start]].length < rules[rule].length)
+            {
+                best_rule[start] = rule;
+            }
+        }
+    }
+
+    // Which match each stretch of the transcript gets: a rule, or -1 for a token left as it is
+    struct Piece
+    {
+        size_t start;
+        int rule;
+    };
+    std::vector<Piece> pieces;
+    for (size_t i = 0; i < tokens.size();)
+    {
+        pieces.push_back({ i, best_rule[i] });
+        i += (best_rule[i] == -1) ? 1 : rules[best_rule[i]].length;
+    }
+
+    // Whether an "@" match at `at` is part of an address, going one way (step +1 or -1): a plain
+    // rewrite before two words in a row, punctuation or a "?" match come up. Past a word, the
+    // rewrite has to join onto it ("at sign example dot com", but not "w w w and dot products").
+    auto in_address = [&](size_t at, int step) {
+        bool after_word = false;
+        for (size_t j = at + step; j < pieces.size(); j += step)
+        {
+            int rule = pieces[j].rule;
+            if (rule == -1)
+            {
+                if (after_word || !IsWordChar(tokens[pieces[j].start].text[0]))
+                {
+                    return false;
+                }
+                after_word = true;
+            }
+            else if (rules[rule].defer)
+            {
+                return false;
+            }
+            else if (rules[rule].in_address)
+            {
+                after_word = false;
+            }
+            else
+            {
+                return !after_word || (step > 0 ? rules[rule].join_before : rules[rule].join_after);
+            }
+        }
+        return false;  // ran off the end (size_t wraps going backwards)
+    };
+
+    Result result;
+    bool joined = false;  // the last piece joins the next one
+    auto append = [&](const std::string& space, const std::string& text, bool join_before, bool join_after) {
+        if (text.empty())
+        {
+            joined = joined || join_after;
+            return;
+        }
+        if (!joined && !join_before)
+        {
+            result.text += space;
+        }
+        result.text += text;
+        joined = join_after;
+    };
+
+    for (size_t k = 0; k < pieces.size(); ++k)
+    {
+        size_t i = pieces[k].start;
+        int rule_index = pieces[k].rule;
+        bool left_alone = rule_index == -1 || rules[rule_index].defer ||
+            (rules[rule_index].in_address && !in_address(k, -1) && !in_address(k, +1));
+        if (left_alone)
+        {
+            result.needs_model = result.needs_model || rule_index != -1;
+            size_t length = (rule_index == -1) ? 1 : rules[rule_index].length;
+            for (size_t j = i; j < i + length; ++j)
+            {
+                append(tokens[j].space, tokens[j].text, false, false);
+            }
+            continue;
+        }
+
+        const Rule& rule = rules[rule_index];
+        append(tokens[i].space, rule.replacement, rule.join_before, rule.join_after);
+        result.rewrites += 1;
+    }
+    return result;
+}
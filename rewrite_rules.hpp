@@ -0,0 +1,69 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Word-level rewrites of spoken punctuation ("colon slash slash" -> "://"), the part of
+// post-processing that doesn't need a model. One rule per line:
+//
+//     # a comment
+//     colon slash slash => ~://~
+//     w w w => www
+//     @ dot => ~.~
+//     ? at
+//
+// Words match whole words, ignoring case. A ~ at either end of the replacement joins it to the
+// word on that side; \n and \t are a newline and a tab. "? words" rewrites nothing, but says the
+// model is needed when they come up ("at" might be "@", or just "at"). "@ words => ..." only
+// rewrites inside an address or a path: next to another rewrite, or a word away from one that
+// joins onto that word, through any number of word-@-word steps. "w w w dot github dot com" qualifies; "polka dot dress" doesn't,
+// and is left to the model like a "?" rule.
+//
+// All the patterns go into one Aho-Corasick automaton over words, so a transcript is rewritten in
+// a single pass however many rules there are. Where matches overlap, the one that starts first
+// wins, then the longest.
+struct RewriteRules
+{
+    struct Result
+    {
+        std::string text;
+        int rewrites = 0;
+        bool needs_model = false;  // a "?" rule came up, or an "@" one outside an address
+    };
+
+    bool Load(const std::string& rules_text, std::string* error_message);
+    bool LoadFile(const std::filesystem::path& path, std::string* error_message);
+
+    bool Empty() const { return rules.empty(); }
+
+    Result Rewrite(const std::string& transcript) const;
+
+private:
+    struct Rule
+    {
+        size_t length = 0;  // in words
+        std::string replacement;
+        bool join_before = false;
+        bool join_after = false;
+        bool defer = false;
+        bool in_address = false;  // "@": only next to another rewrite
+    };
+
+    struct Node
+    {
+        std::unordered_map<int, int> next;  // by word id
+        int fail = 0;
+        int rule = -1;    // the pattern ending here, if one does
+        int output = -1;  // the nearest node on the fail chain (this one included) with a rule
+    };
+
+    int WordId(const std::string& word) const;
+    void AddPattern(const std::vector<std::string>& words, Rule rule);
+    void Build();
+
+    std::vector<Rule> rules;
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, int> word_ids;
+};
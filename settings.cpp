@@ -20,16 +20,62 @@
 #define REGISTRY_POSTPROCESS_ENDPOINT_VALUE L"postprocess_endpoint"
 #define REGISTRY_POSTPROCESS_MODEL_VALUE L"postprocess_model"
 #define REGISTRY_POSTPROCESS_PROMPT_VALUE L"postprocess_prompt"
+#define REGISTRY_POSTPROCESS_KEEP_ALIVE_VALUE L"postprocess_keep_alive_minutes"
+#define REGISTRY_POSTPROCESS_STREAM_VALUE L"postprocess_stream"
+#define REGISTRY_REWRITE_RULES_PATH_VALUE L"rewrite_rules_path"
+#define REGISTRY_VAD_ENABLED_VALUE L"vad_enabled"
+#define REGISTRY_VAD_MAX_PAUSE_VALUE L"vad_max_pause_ms"
+#define REGISTRY_OPENAI_FORMAT_VALUE L"openai_format"
+#define REGISTRY_CUSTOM_FORMAT_VALUE L"custom_format"
+#define REGISTRY_LIVE_CHUNKS_VALUE L"live_chunks"
+#define REGISTRY_CONDITIONING_ENABLED_VALUE L"conditioning_enabled"
+#define REGISTRY_HIGHPASS_HZ_VALUE L"highpass_hz"
+#define REGISTRY_ALWAYS_ARMED_VALUE L"always_armed"
+#define REGISTRY_PREROLL_MS_VALUE L"preroll_ms"
+#define REGISTRY_SPILL_ENABLED_VALUE L"spill_enabled"
+#define REGISTRY_SPILL_MINUTES_VALUE L"spill_minutes"
+#define REGISTRY_STREAM_UPLOAD_VALUE L"stream_upload"
+#define REGISTRY_BACKUP_ENDPOINT_VALUE L"backup_endpoint"
+#define REGISTRY_HEDGE_PERCENTILE_VALUE L"hedge_percentile"
+#define REGISTRY_OPENAI_RPM_VALUE L"openai_requests_per_minute"
+#define REGISTRY_OPENAI_AUDIO_PER_MINUTE_VALUE L"openai_audio_seconds_per_minute"
+#define REGISTRY_TRANSCRIPTION_MODEL_VALUE L"transcription_model"
+#define REGISTRY_STREAM_TRANSCRIPT_VALUE L"stream_transcript"
+#define REGISTRY_INJECT_EARLY_VALUE L"inject_early"
+#define REGISTRY_REALTIME_ENDPOINT_VALUE L"realtime_endpoint"
 
 // Global variables to hold settings
 char g_OpenAIToken[256] = { 0 };
-char g_Endpoint[256] = { 0 };
+char g_Endpoint[1024] = { 0 };  // one or more servers, separated by spaces or commas
 char g_PromptText[1024] = { 0 };
 APIType g_APIType = API_OPENAI;
 bool g_PostProcessEnabled = false;
 char g_PostProcessEndpoint[256] = { 0 };
 char g_PostProcessModel[128] = { 0 };
 char g_PostProcessPrompt[4096] = { 0 };
+int g_PostProcessKeepAliveMinutes = 30;
+bool g_PostProcessStream = false;
+char g_RewriteRulesPath[260] = { 0 };
+bool g_VadEnabled = false;
+int g_VadMaxPauseMs = 800;
+AudioFormat g_OpenAIFormat = FORMAT_MP3;
+AudioFormat g_CustomFormat = FORMAT_MP3;
+bool g_LiveChunks = false;
+bool g_ConditioningEnabled = false;
+int g_HighPassHz = 80;
+bool g_AlwaysArmed = false;
+int g_PrerollMs = 500;
+bool g_SpillEnabled = false;
+int g_SpillMinutes = 10;
+bool g_StreamUpload = false;
+char g_BackupEndpoint[256] = { 0 };
+int g_HedgePercentile = 95;
+int g_OpenAIRequestsPerMinute = 50;
+int g_OpenAIAudioSecondsPerMinute = 1800;
+char g_TranscriptionModel[64] = "whisper-1";
+bool g_StreamTranscript = false;
+bool g_InjectEarly = false;
+char g_RealtimeEndpoint[256] = { 0 };
 
 // Add debugging variables
 DWORD g_LastRegError = 0;
@@ -48,7 +94,38 @@ char* GetPostProcessEndpoint() { return g_PostProcessEndpoint; }
 char* GetPostProcessModel() { return g_PostProcessModel; }
 char* GetPostProcessPrompt() { return g_PostProcessPrompt; }
 void SetPostProcessEnabled(bool enabled) { g_PostProcessEnabled = enabled; }
+int GetPostProcessKeepAliveMinutes() { return g_PostProcessKeepAliveMinutes; }
+bool GetPostProcessStreamEnabled() { return g_PostProcessStream; }
+char* GetRewriteRulesPath() { return g_RewriteRulesPath; }
+bool GetVadEnabled() { return g_VadEnabled; }
+int GetVadMaxPauseMs() { return g_VadMaxPauseMs; }
+bool GetLiveChunksEnabled() { return g_LiveChunks; }
+bool GetConditioningEnabled() { return g_ConditioningEnabled; }
+int GetHighPassHz() { return g_HighPassHz; }
+bool GetAlwaysArmed() { return g_AlwaysArmed; }
+int GetPrerollMs() { return g_PrerollMs; }
+bool GetSpillEnabled() { return g_SpillEnabled; }
+int GetSpillMinutes() { return g_SpillMinutes; }
+bool GetStreamUploadEnabled() { return g_StreamUpload; }
+char* GetBackupEndpoint() { return g_BackupEndpoint; }
+int GetHedgePercentile() { return g_HedgePercentile; }
+int GetOpenAIRequestsPerMinute() { return g_OpenAIRequestsPerMinute; }
+int GetOpenAIAudioSecondsPerMinute() { return g_OpenAIAudioSecondsPerMinute; }
+char* GetTranscriptionModel() { return g_TranscriptionModel; }
+bool GetStreamTranscriptEnabled() { return g_StreamTranscript; }
+bool GetInjectEarlyEnabled() { return g_InjectEarly; }
+char* GetRealtimeEndpoint() { return g_RealtimeEndpoint; }
+AudioFormat GetAudioFormat() { return g_APIType == API_OPENAI ? g_OpenAIFormat : g_CustomFormat; }
 
+static const int kDefaultVadMaxPauseMs = 800;
+static const int kDefaultHighPassHz = 80;
+static const int kDefaultPrerollMs = 500;
+static const int kDefaultSpillMinutes = 10;
+static const int kDefaultPostProcessKeepAliveMinutes = 30;
+static const int kDefaultHedgePercentile = 95;
+static const int kDefaultOpenAIRequestsPerMinute = 50;
+static const int kDefaultOpenAIAudioSecondsPerMinute = 1800;
+static const char kDefaultTranscriptionModel[] = "whisper-1";
 static const char kDefaultPostProcessEndpoint[] = "http://inference.ltn.simonsafar.com/api/generate";
 static const char kDefaultPostProcessModel[] = "zephyr:latest";
 static const char kDefaultPostProcessPrompt[] =
@@ -90,6 +167,29 @@ void LoadSettingsFromRegistry()
     strncpy_s(g_PostProcessEndpoint, sizeof(g_PostProcessEndpoint), kDefaultPostProcessEndpoint, _TRUNCATE);
     strncpy_s(g_PostProcessModel, sizeof(g_PostProcessModel), kDefaultPostProcessModel, _TRUNCATE);
     strncpy_s(g_PostProcessPrompt, sizeof(g_PostProcessPrompt), kDefaultPostProcessPrompt, _TRUNCATE);
+    g_PostProcessKeepAliveMinutes = kDefaultPostProcessKeepAliveMinutes;
+    g_PostProcessStream = false;
+    g_RewriteRulesPath[0] = '\0';
+    g_VadEnabled = false;
+    g_VadMaxPauseMs = kDefaultVadMaxPauseMs;
+    g_OpenAIFormat = FORMAT_MP3;
+    g_CustomFormat = FORMAT_MP3;
+    g_LiveChunks = false;
+    g_ConditioningEnabled = false;
+    g_HighPassHz = kDefaultHighPassHz;
+    g_AlwaysArmed = false;
+    g_PrerollMs = kDefaultPrerollMs;
+    g_SpillEnabled = false;
+    g_SpillMinutes = kDefaultSpillMinutes;
+    g_StreamUpload = false;
+    g_BackupEndpoint[0] = '\0';
+    g_HedgePercentile = kDefaultHedgePercentile;
+    g_OpenAIRequestsPerMinute = kDefaultOpenAIRequestsPerMinute;
+    g_OpenAIAudioSecondsPerMinute = kDefaultOpenAIAudioSecondsPerMinute;
+    strncpy_s(g_TranscriptionModel, sizeof(g_TranscriptionModel), kDefaultTranscriptionModel, _TRUNCATE);
+    g_StreamTranscript = false;
+    g_InjectEarly = false;
+    g_RealtimeEndpoint[0] = '\0';
 
     // Open the registry key - store error code for debugging
     g_LastRegError = RegOpenKeyExW(HKEY_CURRENT_USER, REGISTRY_PATH, 0, KEY_READ, &hKey);
@@ -125,7 +225,7 @@ void LoadSettingsFromRegistry()
         }
 
         // Load endpoint - Unicode to ASCII conversion needed
-        wchar_t wideEndpoint[256] = { 0 };
+        wchar_t wideEndpoint[1024] = { 0 };
         dataSize = sizeof(wideEndpoint);
         g_LastRegError = RegQueryValueExW(
             hKey, REGISTRY_ENDPOINT_VALUE, NULL, NULL, (LPBYTE)wideEndpoint, &dataSize);
@@ -196,6 +296,224 @@ void LoadSettingsFromRegistry()
             WideCharToMultiByte(CP_ACP, 0, widePostProcessPrompt, -1, g_PostProcessPrompt, sizeof(g_PostProcessPrompt), NULL, NULL);
         }
 
+        DWORD keepAliveMinutes = 0;
+        dataSize = sizeof(keepAliveMinutes);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_POSTPROCESS_KEEP_ALIVE_VALUE, NULL, NULL, (LPBYTE)&keepAliveMinutes, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_PostProcessKeepAliveMinutes = static_cast<int>(keepAliveMinutes);
+        }
+
+        DWORD postProcessStream = 0;
+        dataSize = sizeof(postProcessStream);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_POSTPROCESS_STREAM_VALUE, NULL, NULL, (LPBYTE)&postProcessStream, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_PostProcessStream = (postProcessStream != 0);
+        }
+
+        wchar_t wideRewriteRulesPath[260] = { 0 };
+        dataSize = sizeof(wideRewriteRulesPath);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_REWRITE_RULES_PATH_VALUE, NULL, NULL, (LPBYTE)wideRewriteRulesPath, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            WideCharToMultiByte(CP_ACP, 0, wideRewriteRulesPath, -1, g_RewriteRulesPath, sizeof(g_RewriteRulesPath), NULL, NULL);
+        }
+
+        // Load silence trimming
+        DWORD vadEnabled = 0;
+        dataSize = sizeof(vadEnabled);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_VAD_ENABLED_VALUE, NULL, NULL, (LPBYTE)&vadEnabled, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_VadEnabled = (vadEnabled != 0);
+        }
+
+        DWORD vadMaxPauseMs = 0;
+        dataSize = sizeof(vadMaxPauseMs);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_VAD_MAX_PAUSE_VALUE, NULL, NULL, (LPBYTE)&vadMaxPauseMs, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_VadMaxPauseMs = static_cast<int>(vadMaxPauseMs);
+        }
+
+        // Load upload formats; anything we don't know (newer build wrote it?) falls back to MP3
+        DWORD openAIFormat = FORMAT_MP3;
+        dataSize = sizeof(openAIFormat);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_OPENAI_FORMAT_VALUE, NULL, NULL, (LPBYTE)&openAIFormat, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS && openAIFormat < FORMAT_COUNT)
+        {
+            g_OpenAIFormat = static_cast<AudioFormat>(openAIFormat);
+        }
+
+        DWORD customFormat = FORMAT_MP3;
+        dataSize = sizeof(customFormat);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_CUSTOM_FORMAT_VALUE, NULL, NULL, (LPBYTE)&customFormat, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS && customFormat < FORMAT_COUNT)
+        {
+            g_CustomFormat = static_cast<AudioFormat>(customFormat);
+        }
+
+        // Load live chunking
+        DWORD liveChunks = 0;
+        dataSize = sizeof(liveChunks);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_LIVE_CHUNKS_VALUE, NULL, NULL, (LPBYTE)&liveChunks, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_LiveChunks = (liveChunks != 0);
+        }
+
+        // Load audio conditioning
+        DWORD conditioningEnabled = 0;
+        dataSize = sizeof(conditioningEnabled);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_CONDITIONING_ENABLED_VALUE, NULL, NULL, (LPBYTE)&conditioningEnabled, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_ConditioningEnabled = (conditioningEnabled != 0);
+        }
+
+        DWORD highPassHz = 0;
+        dataSize = sizeof(highPassHz);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_HIGHPASS_HZ_VALUE, NULL, NULL, (LPBYTE)&highPassHz, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_HighPassHz = static_cast<int>(highPassHz);
+        }
+
+        // Load always-armed capture
+        DWORD alwaysArmed = 0;
+        dataSize = sizeof(alwaysArmed);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_ALWAYS_ARMED_VALUE, NULL, NULL, (LPBYTE)&alwaysArmed, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_AlwaysArmed = (alwaysArmed != 0);
+        }
+
+        DWORD prerollMs = 0;
+        dataSize = sizeof(prerollMs);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_PREROLL_MS_VALUE, NULL, NULL, (LPBYTE)&prerollMs, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_PrerollMs = static_cast<int>(prerollMs);
+        }
+
+        // Load disk spill for long takes
+        DWORD spillEnabled = 0;
+        dataSize = sizeof(spillEnabled);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_SPILL_ENABLED_VALUE, NULL, NULL, (LPBYTE)&spillEnabled, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_SpillEnabled = (spillEnabled != 0);
+        }
+
+        DWORD spillMinutes = 0;
+        dataSize = sizeof(spillMinutes);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_SPILL_MINUTES_VALUE, NULL, NULL, (LPBYTE)&spillMinutes, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_SpillMinutes = static_cast<int>(spillMinutes);
+        }
+
+        // Load streaming upload
+        DWORD streamUpload = 0;
+        dataSize = sizeof(streamUpload);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_STREAM_UPLOAD_VALUE, NULL, NULL, (LPBYTE)&streamUpload, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_StreamUpload = (streamUpload != 0);
+        }
+
+        // Load the backup endpoint and when to hedge to it
+        wchar_t wideBackupEndpoint[256] = { 0 };
+        dataSize = sizeof(wideBackupEndpoint);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_BACKUP_ENDPOINT_VALUE, NULL, NULL, (LPBYTE)wideBackupEndpoint, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            WideCharToMultiByte(CP_ACP, 0, wideBackupEndpoint, -1, g_BackupEndpoint, sizeof(g_BackupEndpoint), NULL, NULL);
+        }
+
+        DWORD hedgePercentile = 0;
+        dataSize = sizeof(hedgePercentile);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_HEDGE_PERCENTILE_VALUE, NULL, NULL, (LPBYTE)&hedgePercentile, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_HedgePercentile = static_cast<int>(hedgePercentile);
+        }
+
+        // Load the OpenAI rate limits
+        DWORD requestsPerMinute = 0;
+        dataSize = sizeof(requestsPerMinute);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_OPENAI_RPM_VALUE, NULL, NULL, (LPBYTE)&requestsPerMinute, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_OpenAIRequestsPerMinute = static_cast<int>(requestsPerMinute);
+        }
+
+        DWORD audioSecondsPerMinute = 0;
+        dataSize = sizeof(audioSecondsPerMinute);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_OPENAI_AUDIO_PER_MINUTE_VALUE, NULL, NULL, (LPBYTE)&audioSecondsPerMinute, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_OpenAIAudioSecondsPerMinute = static_cast<int>(audioSecondsPerMinute);
+        }
+
+        // Load the transcription model and whether its text comes back as it's ready
+        wchar_t wideTranscriptionModel[64] = { 0 };
+        dataSize = sizeof(wideTranscriptionModel);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_TRANSCRIPTION_MODEL_VALUE, NULL, NULL, (LPBYTE)wideTranscriptionModel, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS && wideTranscriptionModel[0] != L'\0')
+        {
+            WideCharToMultiByte(CP_ACP, 0, wideTranscriptionModel, -1, g_TranscriptionModel, sizeof(g_TranscriptionModel), NULL, NULL);
+        }
+
+        DWORD streamTranscript = 0;
+        dataSize = sizeof(streamTranscript);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_STREAM_TRANSCRIPT_VALUE, NULL, NULL, (LPBYTE)&streamTranscript, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_StreamTranscript = (streamTranscript != 0);
+        }
+
+        DWORD injectEarly = 0;
+        dataSize = sizeof(injectEarly);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_INJECT_EARLY_VALUE, NULL, NULL, (LPBYTE)&injectEarly, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            g_InjectEarly = (injectEarly != 0);
+        }
+
+        // Load the realtime endpoint
+        wchar_t wideRealtimeEndpoint[256] = { 0 };
+        dataSize = sizeof(wideRealtimeEndpoint);
+        g_LastRegError = RegQueryValueExW(
+            hKey, REGISTRY_REALTIME_ENDPOINT_VALUE, NULL, NULL, (LPBYTE)wideRealtimeEndpoint, &dataSize);
+        if (g_LastRegError == ERROR_SUCCESS)
+        {
+            WideCharToMultiByte(CP_ACP, 0, wideRealtimeEndpoint, -1, g_RealtimeEndpoint, sizeof(g_RealtimeEndpoint), NULL, NULL);
+        }
+
         RegCloseKey(hKey);
     }
     else
@@ -253,8 +571,8 @@ void SaveSettingsToRegistry()
             hKey, REGISTRY_API_TYPE_VALUE, 0, REG_DWORD, (const BYTE*)&apiType, sizeof(apiType));
 
         // Convert endpoint string to wide
-        wchar_t wideEndpoint[256] = {0};
-        MultiByteToWideChar(CP_ACP, 0, g_Endpoint, -1, wideEndpoint, 256);
+        wchar_t wideEndpoint[1024] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_Endpoint, -1, wideEndpoint, 1024);
 
         // Save endpoint
         lastError = RegSetValueExW(hKey,
@@ -314,6 +632,129 @@ void SaveSettingsToRegistry()
                       (const BYTE*)widePostProcessPrompt,
                       (wcslen(widePostProcessPrompt) + 1) * sizeof(wchar_t));
 
+        DWORD keepAliveMinutes = static_cast<DWORD>(g_PostProcessKeepAliveMinutes);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_POSTPROCESS_KEEP_ALIVE_VALUE, 0, REG_DWORD, (const BYTE*)&keepAliveMinutes, sizeof(keepAliveMinutes));
+
+        DWORD postProcessStream = g_PostProcessStream ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_POSTPROCESS_STREAM_VALUE, 0, REG_DWORD, (const BYTE*)&postProcessStream, sizeof(postProcessStream));
+
+        wchar_t wideRewriteRulesPath[260] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_RewriteRulesPath, -1, wideRewriteRulesPath, 260);
+        lastError = RegSetValueExW(hKey,
+                      REGISTRY_REWRITE_RULES_PATH_VALUE,
+                      0,
+                      REG_SZ,
+                      (const BYTE*)wideRewriteRulesPath,
+                      (wcslen(wideRewriteRulesPath) + 1) * sizeof(wchar_t));
+
+        // Save silence trimming
+        DWORD vadEnabled = g_VadEnabled ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_VAD_ENABLED_VALUE, 0, REG_DWORD, (const BYTE*)&vadEnabled, sizeof(vadEnabled));
+
+        DWORD vadMaxPauseMs = static_cast<DWORD>(g_VadMaxPauseMs);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_VAD_MAX_PAUSE_VALUE, 0, REG_DWORD, (const BYTE*)&vadMaxPauseMs, sizeof(vadMaxPauseMs));
+
+        // Save upload formats
+        DWORD openAIFormat = static_cast<DWORD>(g_OpenAIFormat);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_OPENAI_FORMAT_VALUE, 0, REG_DWORD, (const BYTE*)&openAIFormat, sizeof(openAIFormat));
+
+        DWORD customFormat = static_cast<DWORD>(g_CustomFormat);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_CUSTOM_FORMAT_VALUE, 0, REG_DWORD, (const BYTE*)&customFormat, sizeof(customFormat));
+
+        // Save live chunking
+        DWORD liveChunks = g_LiveChunks ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_LIVE_CHUNKS_VALUE, 0, REG_DWORD, (const BYTE*)&liveChunks, sizeof(liveChunks));
+
+        // Save audio conditioning
+        DWORD conditioningEnabled = g_ConditioningEnabled ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_CONDITIONING_ENABLED_VALUE, 0, REG_DWORD, (const BYTE*)&conditioningEnabled, sizeof(conditioningEnabled));
+
+        DWORD highPassHz = static_cast<DWORD>(g_HighPassHz);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_HIGHPASS_HZ_VALUE, 0, REG_DWORD, (const BYTE*)&highPassHz, sizeof(highPassHz));
+
+        // Save always-armed capture
+        DWORD alwaysArmed = g_AlwaysArmed ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_ALWAYS_ARMED_VALUE, 0, REG_DWORD, (const BYTE*)&alwaysArmed, sizeof(alwaysArmed));
+
+        DWORD prerollMs = static_cast<DWORD>(g_PrerollMs);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_PREROLL_MS_VALUE, 0, REG_DWORD, (const BYTE*)&prerollMs, sizeof(prerollMs));
+
+        // Save disk spill for long takes
+        DWORD spillEnabled = g_SpillEnabled ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_SPILL_ENABLED_VALUE, 0, REG_DWORD, (const BYTE*)&spillEnabled, sizeof(spillEnabled));
+
+        DWORD spillMinutes = static_cast<DWORD>(g_SpillMinutes);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_SPILL_MINUTES_VALUE, 0, REG_DWORD, (const BYTE*)&spillMinutes, sizeof(spillMinutes));
+
+        // Save streaming upload
+        DWORD streamUpload = g_StreamUpload ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_STREAM_UPLOAD_VALUE, 0, REG_DWORD, (const BYTE*)&streamUpload, sizeof(streamUpload));
+
+        // Save the backup endpoint and when to hedge to it
+        wchar_t wideBackupEndpoint[256] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_BackupEndpoint, -1, wideBackupEndpoint, 256);
+        lastError = RegSetValueExW(hKey,
+                      REGISTRY_BACKUP_ENDPOINT_VALUE,
+                      0,
+                      REG_SZ,
+                      (const BYTE*)wideBackupEndpoint,
+                      (wcslen(wideBackupEndpoint) + 1) * sizeof(wchar_t));
+
+        DWORD hedgePercentile = static_cast<DWORD>(g_HedgePercentile);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_HEDGE_PERCENTILE_VALUE, 0, REG_DWORD, (const BYTE*)&hedgePercentile, sizeof(hedgePercentile));
+
+        // Save the OpenAI rate limits
+        DWORD requestsPerMinute = static_cast<DWORD>(g_OpenAIRequestsPerMinute);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_OPENAI_RPM_VALUE, 0, REG_DWORD, (const BYTE*)&requestsPerMinute, sizeof(requestsPerMinute));
+
+        DWORD audioSecondsPerMinute = static_cast<DWORD>(g_OpenAIAudioSecondsPerMinute);
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_OPENAI_AUDIO_PER_MINUTE_VALUE, 0, REG_DWORD, (const BYTE*)&audioSecondsPerMinute, sizeof(audioSecondsPerMinute));
+
+        // Save the transcription model and streaming
+        wchar_t wideTranscriptionModel[64] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_TranscriptionModel, -1, wideTranscriptionModel, 64);
+        lastError = RegSetValueExW(hKey,
+                      REGISTRY_TRANSCRIPTION_MODEL_VALUE,
+                      0,
+                      REG_SZ,
+                      (const BYTE*)wideTranscriptionModel,
+                      (wcslen(wideTranscriptionModel) + 1) * sizeof(wchar_t));
+
+        DWORD streamTranscript = g_StreamTranscript ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_STREAM_TRANSCRIPT_VALUE, 0, REG_DWORD, (const BYTE*)&streamTranscript, sizeof(streamTranscript));
+
+        DWORD injectEarly = g_InjectEarly ? 1 : 0;
+        lastError = RegSetValueExW(
+            hKey, REGISTRY_INJECT_EARLY_VALUE, 0, REG_DWORD, (const BYTE*)&injectEarly, sizeof(injectEarly));
+
+        // Save the realtime endpoint
+        wchar_t wideRealtimeEndpoint[256] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_RealtimeEndpoint, -1, wideRealtimeEndpoint, 256);
+        lastError = RegSetValueExW(hKey,
+                      REGISTRY_REALTIME_ENDPOINT_VALUE,
+                      0,
+                      REG_SZ,
+                      (const BYTE*)wideRealtimeEndpoint,
+                      (wcslen(wideRealtimeEndpoint) + 1) * sizeof(wchar_t));
+
         RegCloseKey(hKey);
     }
 }
@@ -325,11 +766,156 @@ void UpdateControlStates(HWND hDlg)
     
     // Enable/disable token field based on OpenAI selection
     EnableWindow(GetDlgItem(hDlg, IDC_OPENAI_TOKEN), isOpenAI);
+    EnableWindow(GetDlgItem(hDlg, IDC_OPENAI_RPM), isOpenAI);
+    EnableWindow(GetDlgItem(hDlg, IDC_OPENAI_AUDIO_PER_MINUTE), isOpenAI);
     
     // Enable/disable endpoint field based on Custom server selection
     EnableWindow(GetDlgItem(hDlg, IDC_ENDPOINT), !isOpenAI);
+
+    // Same for the format pickers
+    EnableWindow(GetDlgItem(hDlg, IDC_OPENAI_FORMAT), isOpenAI);
+    EnableWindow(GetDlgItem(hDlg, IDC_CUSTOM_FORMAT), !isOpenAI);
 }
 
+// Fills a format combo box (item index == AudioFormat) and selects `selected`
+static void InitFormatCombo(HWND hDlg, int controlId, AudioFormat selected)
+{
+    HWND combo = GetDlgItem(hDlg, controlId);
+    SendMessageW(combo, CB_RESETCONTENT, 0, 0);
+    for (int format = 0; format < FORMAT_COUNT; format++)
+    {
+        SendMessageW(combo, CB_ADDSTRING, 0, (LPARAM)AudioFormatDisplayName(static_cast<AudioFormat>(format)));
+    }
+    SendMessageW(combo, CB_SETCURSEL, selected, 0);
+}
+
+static AudioFormat ReadFormatCombo(HWND hDlg, int controlId, AudioFormat fallback)
+{
+    LRESULT index = SendDlgItemMessageW(hDlg, controlId, CB_GETCURSEL, 0, 0);
+    return (index >= 0 && index < FORMAT_COUNT) ? static_cast<AudioFormat>(index) : fallback;
+}
+
+
+// Copies what's in the dialog controls into the global settings (shared by OK and Apply)
+static void ReadSettingsFromDialog(HWND hDlg)
+{
+    // Get the entered OpenAI token and endpoint using wide character functions
+    wchar_t wideToken[256] = {0};
+    wchar_t wideEndpoint[1024] = {0};
+    wchar_t widePrompt[1024] = {0};
+    wchar_t widePostProcessEndpoint[256] = {0};
+    wchar_t widePostProcessModel[128] = {0};
+    wchar_t widePostProcessPrompt[4096] = {0};
+
+    GetDlgItemTextW(hDlg, IDC_OPENAI_TOKEN, wideToken, 256);
+    GetDlgItemTextW(hDlg, IDC_ENDPOINT, wideEndpoint, 1024);
+    GetDlgItemTextW(hDlg, IDC_PROMPT, widePrompt, 1024);
+    GetDlgItemTextW(hDlg, IDC_POSTPROCESS_ENDPOINT, widePostProcessEndpoint, 256);
+    GetDlgItemTextW(hDlg, IDC_POSTPROCESS_MODEL, widePostProcessModel, 128);
+    GetDlgItemTextW(hDlg, IDC_POSTPROCESS_PROMPT, widePostProcessPrompt, 4096);
+
+    // Convert wide to ASCII for our global variables
+    WideCharToMultiByte(CP_ACP, 0, wideToken, -1, g_OpenAIToken, sizeof(g_OpenAIToken), NULL, NULL);
+    WideCharToMultiByte(CP_ACP, 0, wideEndpoint, -1, g_Endpoint, sizeof(g_Endpoint), NULL, NULL);
+    WideCharToMultiByte(CP_ACP, 0, widePrompt, -1, g_PromptText, sizeof(g_PromptText), NULL, NULL);
+    WideCharToMultiByte(CP_ACP, 0, widePostProcessEndpoint, -1, g_PostProcessEndpoint, sizeof(g_PostProcessEndpoint), NULL, NULL);
+    WideCharToMultiByte(CP_ACP, 0, widePostProcessModel, -1, g_PostProcessModel, sizeof(g_PostProcessModel), NULL, NULL);
+    WideCharToMultiByte(CP_ACP, 0, widePostProcessPrompt, -1, g_PostProcessPrompt, sizeof(g_PostProcessPrompt), NULL, NULL);
+
+    // Get the selected API type
+    g_APIType = (IsDlgButtonChecked(hDlg, IDC_RADIO_OPENAI) == BST_CHECKED) ? API_OPENAI
+                                                                            : API_CUSTOM;
+
+    // Number fields keep their old value if they don't parse
+    BOOL translated = FALSE;
+    UINT keepAliveMinutes = GetDlgItemInt(hDlg, IDC_POSTPROCESS_KEEP_ALIVE, &translated, FALSE);
+    if (translated)
+    {
+        g_PostProcessKeepAliveMinutes = static_cast<int>(keepAliveMinutes);
+    }
+    g_PostProcessStream = (IsDlgButtonChecked(hDlg, IDC_POSTPROCESS_STREAM) == BST_CHECKED);
+
+    // Rewrite rules; empty turns them off
+    wchar_t wideRewriteRulesPath[260] = {0};
+    GetDlgItemTextW(hDlg, IDC_REWRITE_RULES, wideRewriteRulesPath, 260);
+    WideCharToMultiByte(CP_ACP, 0, wideRewriteRulesPath, -1, g_RewriteRulesPath, sizeof(g_RewriteRulesPath), NULL, NULL);
+
+    // Silence trimming
+    g_VadEnabled = (IsDlgButtonChecked(hDlg, IDC_VAD_ENABLE) == BST_CHECKED);
+    UINT maxPauseMs = GetDlgItemInt(hDlg, IDC_VAD_MAX_PAUSE, &translated, FALSE);
+    if (translated)
+    {
+        g_VadMaxPauseMs = static_cast<int>(maxPauseMs);
+    }
+
+    g_OpenAIFormat = ReadFormatCombo(hDlg, IDC_OPENAI_FORMAT, g_OpenAIFormat);
+    g_CustomFormat = ReadFormatCombo(hDlg, IDC_CUSTOM_FORMAT, g_CustomFormat);
+
+    g_LiveChunks = (IsDlgButtonChecked(hDlg, IDC_LIVE_CHUNKS) == BST_CHECKED);
+
+    // Audio conditioning; 0 Hz turns the high-pass off
+    g_ConditioningEnabled = (IsDlgButtonChecked(hDlg, IDC_CONDITIONING_ENABLE) == BST_CHECKED);
+    UINT highPassHz = GetDlgItemInt(hDlg, IDC_HIGHPASS_HZ, &translated, FALSE);
+    if (translated)
+    {
+        g_HighPassHz = static_cast<int>(highPassHz);
+    }
+
+    g_AlwaysArmed = (IsDlgButtonChecked(hDlg, IDC_ALWAYS_ARMED) == BST_CHECKED);
+    UINT prerollMs = GetDlgItemInt(hDlg, IDC_PREROLL_MS, &translated, FALSE);
+    if (translated)
+    {
+        g_PrerollMs = static_cast<int>(prerollMs);
+    }
+
+    g_SpillEnabled = (IsDlgButtonChecked(hDlg, IDC_SPILL_ENABLE) == BST_CHECKED);
+    UINT spillMinutes = GetDlgItemInt(hDlg, IDC_SPILL_MINUTES, &translated, FALSE);
+    if (translated)
+    {
+        g_SpillMinutes = static_cast<int>(spillMinutes);
+    }
+
+    g_StreamUpload = (IsDlgButtonChecked(hDlg, IDC_STREAM_UPLOAD) == BST_CHECKED);
+
+    // Hedging; an empty backup endpoint turns it off
+    wchar_t wideBackupEndpoint[256] = {0};
+    GetDlgItemTextW(hDlg, IDC_BACKUP_ENDPOINT, wideBackupEndpoint, 256);
+    WideCharToMultiByte(CP_ACP, 0, wideBackupEndpoint, -1, g_BackupEndpoint, sizeof(g_BackupEndpoint), NULL, NULL);
+    UINT hedgePercentile = GetDlgItemInt(hDlg, IDC_HEDGE_PERCENTILE, &translated, FALSE);
+    if (translated && hedgePercentile >= 1 && hedgePercentile <= 100)
+    {
+        g_HedgePercentile = static_cast<int>(hedgePercentile);
+    }
+
+    // OpenAI rate limits; 0 for no limit
+    UINT requestsPerMinute = GetDlgItemInt(hDlg, IDC_OPENAI_RPM, &translated, FALSE);
+    if (translated)
+    {
+        g_OpenAIRequestsPerMinute = static_cast<int>(requestsPerMinute);
+    }
+    UINT audioSecondsPerMinute = GetDlgItemInt(hDlg, IDC_OPENAI_AUDIO_PER_MINUTE, &translated, FALSE);
+    if (translated)
+    {
+        g_OpenAIAudioSecondsPerMinute = static_cast<int>(audioSecondsPerMinute);
+    }
+
+    // Transcription model; empty goes back to the default
+    wchar_t wideTranscriptionModel[64] = {0};
+    GetDlgItemTextW(hDlg, IDC_TRANSCRIPTION_MODEL, wideTranscriptionModel, 64);
+    WideCharToMultiByte(CP_ACP, 0, wideTranscriptionModel, -1, g_TranscriptionModel, sizeof(g_TranscriptionModel), NULL, NULL);
+    if (g_TranscriptionModel[0] == '\0')
+    {
+        strncpy_s(g_TranscriptionModel, sizeof(g_TranscriptionModel), kDefaultTranscriptionModel, _TRUNCATE);
+    }
+
+    g_StreamTranscript = (IsDlgButtonChecked(hDlg, IDC_STREAM_TRANSCRIPT) == BST_CHECKED);
+    g_InjectEarly = (IsDlgButtonChecked(hDlg, IDC_INJECT_EARLY) == BST_CHECKED);
+
+    // Realtime; empty turns it off
+    wchar_t wideRealtimeEndpoint[256] = {0};
+    GetDlgItemTextW(hDlg, IDC_REALTIME_ENDPOINT, wideRealtimeEndpoint, 256);
+    WideCharToMultiByte(CP_ACP, 0, wideRealtimeEndpoint, -1, g_RealtimeEndpoint, sizeof(g_RealtimeEndpoint), NULL, NULL);
+}
 
 // Dialog procedure to handle messages
 INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM lParam)
@@ -343,7 +929,7 @@ INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM
 
         // Use wide string versions for the dialog
         wchar_t wideToken[256] = {0};
-        wchar_t wideEndpoint[256] = {0};
+        wchar_t wideEndpoint[1024] = {0};
         wchar_t widePrompt[1024] = {0};
         wchar_t widePostProcessEndpoint[256] = {0};
         wchar_t widePostProcessModel[128] = {0};
@@ -351,7 +937,7 @@ INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM
 
         // Convert from ASCII to wide strings
         MultiByteToWideChar(CP_ACP, 0, g_OpenAIToken, -1, wideToken, 256);
-        MultiByteToWideChar(CP_ACP, 0, g_Endpoint, -1, wideEndpoint, 256);
+        MultiByteToWideChar(CP_ACP, 0, g_Endpoint, -1, wideEndpoint, 1024);
         MultiByteToWideChar(CP_ACP, 0, g_PromptText, -1, widePrompt, 1024);
         MultiByteToWideChar(CP_ACP, 0, g_PostProcessEndpoint, -1, widePostProcessEndpoint, 256);
         MultiByteToWideChar(CP_ACP, 0, g_PostProcessModel, -1, widePostProcessModel, 128);
@@ -363,6 +949,48 @@ INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM
         SetDlgItemTextW(hDlg, IDC_POSTPROCESS_ENDPOINT, widePostProcessEndpoint);
         SetDlgItemTextW(hDlg, IDC_POSTPROCESS_MODEL, widePostProcessModel);
         SetDlgItemTextW(hDlg, IDC_POSTPROCESS_PROMPT, widePostProcessPrompt);
+        SetDlgItemInt(hDlg, IDC_POSTPROCESS_KEEP_ALIVE, g_PostProcessKeepAliveMinutes, FALSE);
+        CheckDlgButton(hDlg, IDC_POSTPROCESS_STREAM, g_PostProcessStream ? BST_CHECKED : BST_UNCHECKED);
+
+        wchar_t wideRewriteRulesPath[260] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_RewriteRulesPath, -1, wideRewriteRulesPath, 260);
+        SetDlgItemTextW(hDlg, IDC_REWRITE_RULES, wideRewriteRulesPath);
+
+        CheckDlgButton(hDlg, IDC_VAD_ENABLE, g_VadEnabled ? BST_CHECKED : BST_UNCHECKED);
+        SetDlgItemInt(hDlg, IDC_VAD_MAX_PAUSE, g_VadMaxPauseMs, FALSE);
+
+        InitFormatCombo(hDlg, IDC_OPENAI_FORMAT, g_OpenAIFormat);
+        InitFormatCombo(hDlg, IDC_CUSTOM_FORMAT, g_CustomFormat);
+
+        CheckDlgButton(hDlg, IDC_LIVE_CHUNKS, g_LiveChunks ? BST_CHECKED : BST_UNCHECKED);
+
+        CheckDlgButton(hDlg, IDC_CONDITIONING_ENABLE, g_ConditioningEnabled ? BST_CHECKED : BST_UNCHECKED);
+        SetDlgItemInt(hDlg, IDC_HIGHPASS_HZ, g_HighPassHz, FALSE);
+
+        CheckDlgButton(hDlg, IDC_ALWAYS_ARMED, g_AlwaysArmed ? BST_CHECKED : BST_UNCHECKED);
+        SetDlgItemInt(hDlg, IDC_PREROLL_MS, g_PrerollMs, FALSE);
+
+        CheckDlgButton(hDlg, IDC_SPILL_ENABLE, g_SpillEnabled ? BST_CHECKED : BST_UNCHECKED);
+        SetDlgItemInt(hDlg, IDC_SPILL_MINUTES, g_SpillMinutes, FALSE);
+
+        CheckDlgButton(hDlg, IDC_STREAM_UPLOAD, g_StreamUpload ? BST_CHECKED : BST_UNCHECKED);
+
+        wchar_t wideBackupEndpoint[256] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_BackupEndpoint, -1, wideBackupEndpoint, 256);
+        SetDlgItemTextW(hDlg, IDC_BACKUP_ENDPOINT, wideBackupEndpoint);
+        SetDlgItemInt(hDlg, IDC_HEDGE_PERCENTILE, g_HedgePercentile, FALSE);
+        SetDlgItemInt(hDlg, IDC_OPENAI_RPM, g_OpenAIRequestsPerMinute, FALSE);
+        SetDlgItemInt(hDlg, IDC_OPENAI_AUDIO_PER_MINUTE, g_OpenAIAudioSecondsPerMinute, FALSE);
+
+        wchar_t wideTranscriptionModel[64] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_TranscriptionModel, -1, wideTranscriptionModel, 64);
+        SetDlgItemTextW(hDlg, IDC_TRANSCRIPTION_MODEL, wideTranscriptionModel);
+        CheckDlgButton(hDlg, IDC_STREAM_TRANSCRIPT, g_StreamTranscript ? BST_CHECKED : BST_UNCHECKED);
+        CheckDlgButton(hDlg, IDC_INJECT_EARLY, g_InjectEarly ? BST_CHECKED : BST_UNCHECKED);
+
+        wchar_t wideRealtimeEndpoint[256] = {0};
+        MultiByteToWideChar(CP_ACP, 0, g_RealtimeEndpoint, -1, wideRealtimeEndpoint, 256);
+        SetDlgItemTextW(hDlg, IDC_REALTIME_ENDPOINT, wideRealtimeEndpoint);
 
         // Set radio button based on the saved API type
         CheckRadioButton(hDlg,
@@ -385,32 +1013,8 @@ INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM
             break;
         case IDOK:  // OK Button pressed
             {
-                // Get the entered OpenAI token and endpoint using wide character functions
-                wchar_t wideToken[256] = {0};
-                wchar_t wideEndpoint[256] = {0};
-                wchar_t widePrompt[1024] = {0};
-                wchar_t widePostProcessEndpoint[256] = {0};
-                wchar_t widePostProcessModel[128] = {0};
-                wchar_t widePostProcessPrompt[4096] = {0};
-
-                GetDlgItemTextW(hDlg, IDC_OPENAI_TOKEN, wideToken, 256);
-                GetDlgItemTextW(hDlg, IDC_ENDPOINT, wideEndpoint, 256);
-                GetDlgItemTextW(hDlg, IDC_PROMPT, widePrompt, 1024);
-                GetDlgItemTextW(hDlg, IDC_POSTPROCESS_ENDPOINT, widePostProcessEndpoint, 256);
-                GetDlgItemTextW(hDlg, IDC_POSTPROCESS_MODEL, widePostProcessModel, 128);
-                GetDlgItemTextW(hDlg, IDC_POSTPROCESS_PROMPT, widePostProcessPrompt, 4096);
-
-                // Convert wide to ASCII for our global variables
-                WideCharToMultiByte(CP_ACP, 0, wideToken, -1, g_OpenAIToken, sizeof(g_OpenAIToken), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, wideEndpoint, -1, g_Endpoint, sizeof(g_Endpoint), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePrompt, -1, g_PromptText, sizeof(g_PromptText), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePostProcessEndpoint, -1, g_PostProcessEndpoint, sizeof(g_PostProcessEndpoint), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePostProcessModel, -1, g_PostProcessModel, sizeof(g_PostProcessModel), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePostProcessPrompt, -1, g_PostProcessPrompt, sizeof(g_PostProcessPrompt), NULL, NULL);
-
-                // Get the selected API type
-                g_APIType = (IsDlgButtonChecked(hDlg, IDC_RADIO_OPENAI) == BST_CHECKED) ? API_OPENAI
-                                                                                        : API_CUSTOM;
+                ReadSettingsFromDialog(hDlg);
+
                 // Save settings to the registry
                 SaveSettingsToRegistry();
 
@@ -424,32 +1028,8 @@ INT_PTR CALLBACK SettingsDlgProc(HWND hDlg, UINT message, WPARAM wParam, LPARAM
 
         case IDAPPLY:  // Apply Button pressed
             {
-                // Get the entered OpenAI token and endpoint using wide character functions
-                wchar_t wideToken[256] = {0};
-                wchar_t wideEndpoint[256] = {0};
-                wchar_t widePrompt[1024] = {0};
-                wchar_t widePostProcessEndpoint[256] = {0};
-                wchar_t widePostProcessModel[128] = {0};
-                wchar_t widePostProcessPrompt[4096] = {0};
-
-                GetDlgItemTextW(hDlg, IDC_OPENAI_TOKEN, wideToken, 256);
-                GetDlgItemTextW(hDlg, IDC_ENDPOINT, wideEndpoint, 256);
-                GetDlgItemTextW(hDlg, IDC_PROMPT, widePrompt, 1024);
-                GetDlgItemTextW(hDlg, IDC_POSTPROCESS_ENDPOINT, widePostProcessEndpoint, 256);
-                GetDlgItemTextW(hDlg, IDC_POSTPROCESS_MODEL, widePostProcessModel, 128);
-                GetDlgItemTextW(hDlg, IDC_POSTPROCESS_PROMPT, widePostProcessPrompt, 4096);
-
-                // Convert wide to ASCII for our global variables
-                WideCharToMultiByte(CP_ACP, 0, wideToken, -1, g_OpenAIToken, sizeof(g_OpenAIToken), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, wideEndpoint, -1, g_Endpoint, sizeof(g_Endpoint), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePrompt, -1, g_PromptText, sizeof(g_PromptText), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePostProcessEndpoint, -1, g_PostProcessEndpoint, sizeof(g_PostProcessEndpoint), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePostProcessModel, -1, g_PostProcessModel, sizeof(g_PostProcessModel), NULL, NULL);
-                WideCharToMultiByte(CP_ACP, 0, widePostProcessPrompt, -1, g_PostProcessPrompt, sizeof(g_PostProcessPrompt), NULL, NULL);
-
-                // Get the selected API type
-                g_APIType = (IsDlgButtonChecked(hDlg, IDC_RADIO_OPENAI) == BST_CHECKED) ? API_OPENAI
-                                                                                        : API_CUSTOM;
+                ReadSettingsFromDialog(hDlg);
+
                 // Save settings to the registry without closing the dialog
                 SaveSettingsToRegistry();
                 MessageBoxW(hDlg, L"Changes Applied", L"Info", MB_OK | MB_ICONINFORMATION);
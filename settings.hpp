@@ -2,6 +2,8 @@
 
 #include <windows.h>
 
+#include "audio_encoder.hpp"
+
 // Enum for API type
 enum APIType
 {
@@ -17,7 +19,7 @@ void SaveSettingsToRegistry();
 
 // Return the relevant global vars
 char* GetOpenAIToken();
-char* GetCustomEndpoint();
+char* GetCustomEndpoint();  // may list several servers; see ParseEndpointEntries()
 APIType GetAPIType();
 char* GetPromptText();
 
@@ -26,3 +28,64 @@ char* GetPostProcessEndpoint();
 char* GetPostProcessModel();
 char* GetPostProcessPrompt();
 void SetPostProcessEnabled(bool enabled);
+
+// How long Ollama should keep the post-process model loaded after each request
+int GetPostProcessKeepAliveMinutes();
+
+// Have the post-process output streamed, typing what's inside <output> as it's generated and
+// hanging up once it's closed
+bool GetPostProcessStreamEnabled();
+
+// A file of spoken-punctuation rewrites ("dot" -> ".") to apply before post-processing; when they
+// leave nothing for the model to do, it isn't asked at all. Empty for off.
+char* GetRewriteRulesPath();
+
+// Silence trimming before upload
+bool GetVadEnabled();
+int GetVadMaxPauseMs();
+
+// Send chunks at speech pauses while still recording
+bool GetLiveChunksEnabled();
+
+// DC removal, high-pass and gain normalisation after capture
+bool GetConditioningEnabled();
+int GetHighPassHz();
+
+// Keep capturing between takes so a take can start with the audio from just before F8
+bool GetAlwaysArmed();
+int GetPrerollMs();
+
+// Move takes longer than this many minutes to a temp file instead of keeping them in memory
+bool GetSpillEnabled();
+int GetSpillMinutes();
+
+// Start uploading while still recording (not for WAV)
+bool GetStreamUploadEnabled();
+
+// A second Whisper server for requests the first one is slow with: after the given percentile of
+// recent response times, the same audio goes there too. Empty for no hedging.
+char* GetBackupEndpoint();
+int GetHedgePercentile();
+
+// What we let ourselves send OpenAI per API key each minute, so we queue instead of getting 429s;
+// 0 for no limit
+int GetOpenAIRequestsPerMinute();
+int GetOpenAIAudioSecondsPerMinute();
+
+// The model asked for the transcript, and whether it should come back as server-sent events while
+// it's being worked on (OpenAI's gpt-4o transcribe models and many Whisper servers do that; the
+// rest send it all at the end anyway). With post-processing off, the finished parts of a streamed
+// transcript can be typed before the rest is in.
+char* GetTranscriptionModel();
+bool GetStreamTranscriptEnabled();
+bool GetInjectEarlyEnabled();
+
+// A WebSocket URL (ws:// or wss://) to stream audio to while recording, for a transcript right
+// after stop; OpenAI's is wss://api.openai.com/v1/realtime?intent=transcription. The usual upload
+// is the fallback if it fails. Empty for off.
+char* GetRealtimeEndpoint();
+
+// Upload format for each API type; GetAudioFormat() picks the one for the current one. For custom
+// servers it's the default: a "#flac" (etc.) after a URL in the list gives that server its own,
+// see ParseEndpointEntries().
+AudioFormat GetAudioFormat();
@@ -0,0 +1,82 @@
+#include "sse_parser.hpp"
+
+void SseParser::Reset()
+{
+    line.clear();
+    event.clear();
+    data.clear();
+    has_data = false;
+    after_cr = false;
+}
+
+void SseParser::Feed(const char* bytes, size_t size, const Handler& on_event)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        char c = bytes[i];
+        if (c == '\n' && after_cr)
+        {
+            after_cr = false;
+            continue;
+        }
+        after_cr = (c == '\r');
+
+        if (c == '\r' || c == '\n')
+        {
+            ProcessLine(on_event);
+            line.clear();
+        }
+        else
+        {
+            line += c;
+        }
+    }
+}
+
+void SseParser::ProcessLine(const Handler& on_event)
+{
+    // A blank line ends the event
+    if (line.empty())
+    {
+        if (has_data)
+        {
+            on_event(event.empty() ? "message" : event, data);
+        }
+        event.clear();
+        data.clear();
+        has_data = false;
+        return;
+    }
+
+    if (line[0] == ':')
+    {
+        return;
+    }
+
+    size_t colon = line.find(':');
+    std::string field = line.substr(0, colon);
+    std::string value;
+    if (colon != std::string::npos)
+    {
+        size_t value_start = colon + 1;
+        if (value_start < line.size() && line[value_start] == ' ')
+        {
+            value_start += 1;
+        }
+        value = line.substr(value_start);
+    }
+
+    if (field == "data")
+    {
+        if (has_data)
+        {
+            data += '\n';
+        }
+        data += value;
+        has_data = true;
+    }
+    else if (field == "event")
+    {
+        event = value;
+    }
+}
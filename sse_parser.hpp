@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Splits a text/event-stream response into its events as the bytes come in, however they're cut
+// up between write callbacks. Only the `event` and `data` fields matter to us; ids, retry times
+// and comments are skipped. Not thread-safe.
+struct SseParser
+{
+    // `event` is "message" unless the server named it; `data` has its lines joined with '\n'.
+    using Handler = std::function<void(const std::string& event, const std::string& data)>;
+
+    void Feed(const char* bytes, size_t size, const Handler& on_event);
+
+    void Reset();
+
+private:
+    void ProcessLine(const Handler& on_event);
+
+    std::string line;
+    std::string event;
+    std::string data;
+    bool has_data = false;
+    bool after_cr = false;  // a CR ended the last line; a LF right after it belongs to it
+};
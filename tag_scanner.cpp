@@ -0,0 +1,79 @@
+#include "tag_scanner.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+
+// The length of the longest end of `text` that `tag` starts with.
+size_t PartialTagLength(const std::string& text, const std::string& tag)
+{
+    size_t longest = std::min(text.size(), tag.size() - 1);
+    for (size_t length = longest; length > 0; --length)
+    {
+        if (text.compare(text.size() - length, length, tag, 0, length) == 0)
+        {
+            return length;
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+
+TagScanner::TagScanner(const std::string& tag)
+    : open_tag("<" + tag + ">"), close_tag("</" + tag + ">")
+{
+}
+
+std::string TagScanner::Feed(const std::string& text)
+{
+    if (state == State::After)
+    {
+        return {};
+    }
+
+    pending += text;
+    if (state == State::Before)
+    {
+        size_t open = pending.find(open_tag);
+        if (open == std::string::npos)
+        {
+            pending.erase(0, pending.size() - PartialTagLength(pending, open_tag));
+            return {};
+        }
+        pending.erase(0, open + open_tag.size());
+        state = State::Inside;
+    }
+
+    // Everything up to the closing tag, or up to what might be the start of it
+    size_t close = pending.find(close_tag);
+    size_t content_length = (close != std::string::npos) ? close : pending.size() - PartialTagLength(pending, close_tag);
+    std::string content = pending.substr(0, content_length);
+    pending.erase(0, content_length);
+    if (close != std::string::npos)
+    {
+        state = State::After;
+        pending.clear();
+    }
+
+    // Whitespace only goes out once something else follows it, and never first
+    std::string out;
+    for (char c : content)
+    {
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            if (emitted)
+            {
+                whitespace += c;
+            }
+            continue;
+        }
+        out += whitespace;
+        whitespace.clear();
+        out += c;
+        emitted = true;
+    }
+    return out;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+// Pulls the contents of one tag, e.g. <output>, out of text that arrives a few tokens at a time.
+// Feed() returns whatever more of the contents is certain by now: text that can't turn out to be
+// the start of the closing tag, trimmed the way ExtractTagContent() trims the whole thing, so the
+// pieces add up to what that would return once the tag is closed. Not thread-safe.
+struct TagScanner
+{
+    TagScanner() : TagScanner("output") {}
+    explicit TagScanner(const std::string& tag);
+
+    std::string Feed(const std::string& text);
+
+    bool Opened() const { return state != State::Before; }
+    bool Closed() const { return state == State::After; }
+
+private:
+    enum class State { Before, Inside, After };
+
+    std::string open_tag;
+    std::string close_tag;
+    State state = State::Before;
+    std::string pending;     // not yet known to be content, or a possible partial tag
+    std::string whitespace;  // inside, held back until something follows it
+    bool emitted = false;    // anything yet; leading whitespace is dropped
+};
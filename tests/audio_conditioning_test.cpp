@@ -0,0 +1,210 @@
+#include "audio_conditioning.hpp"
+#include "kernel_variant.hpp"
+#include "test_audio.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+namespace
+{
+
+constexpr int RATE = 16000;
+
+// A take with everything the chain is there for: a DC offset, mains hum, a quiet stretch, a loud
+// one and some hiss. Made with an LCG rather than <random> distributions, whose output differs
+// between standard libraries, so the golden values below hold everywhere.
+std::vector<short> GoldenInput()
+{
+    std::vector<short> pcm(RATE);
+    uint32_t state = 12345;
+    for (size_t i = 0; i < pcm.size(); ++i)
+    {
+        state = state * 1664525u + 1013904223u;
+        double t = (double)i / RATE;
+        double voice = (i < pcm.size() / 2 ? 400.0 : 9000.0) * std::sin(2.0 * test_audio::PI * 440.0 * t);
+        double hum = 2500.0 * std::sin(2.0 * test_audio::PI * 50.0 * t);
+        double hiss = (double)(int)((state >> 16) & 0xFF) - 128.0;
+        pcm[i] = (short)std::lround(1500.0 + voice + hum + hiss);
+    }
+    return pcm;
+}
+
+// Every 1000th sample of the output
+std::vector<int> Checkpoints(const std::vector<short>& pcm)
+{
+    std::vector<int> out;
+    for (size_t i = 0; i < pcm.size(); i += 1000)
+    {
+        out.push_back(pcm[i]);
+    }
+    return out;
+}
+
+// Runs the chain the way the recorder does, in 20 ms capture blocks
+std::vector<short> Condition(const ConditioningSettings& settings, std::vector<short> pcm)
+{
+    AudioConditioner conditioner(settings);
+    for (size_t at = 0; at < pcm.size(); at += 320)
+    {
+        conditioner.Process(pcm.data() + at, std::min<size_t>(320, pcm.size() - at));
+    }
+    return pcm;
+}
+
+ConditioningSettings Only(bool dc, bool high_pass, bool normalize)
+{
+    ConditioningSettings settings;
+    settings.remove_dc = dc;
+    settings.high_pass = high_pass;
+    settings.normalize = normalize;
+    return settings;
+}
+
+// Golden output is allowed to be off by one sample value: the gain ramp's vector paths round
+// the per-sample gain slightly differently from the scalar one.
+void ExpectGolden(const std::vector<short>& pcm, const std::vector<int>& golden, const char* stage)
+{
+    std::vector<int> actual = Checkpoints(pcm);
+    ASSERT_EQ(actual.size(), golden.size()) << stage;
+    for (size_t i = 0; i < golden.size(); ++i)
+    {
+        EXPECT_NEAR(actual[i], golden[i], 1) << stage << ", sample " << i * 1000;
+    }
+}
+
+std::vector<short> RandomPcm(size_t count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<short> pcm(count);
+    for (short& s : pcm)
+    {
+        s = (short)(rng() & 0xFFFF);
+    }
+    return pcm;
+}
+
+}  // namespace
+
+TEST(ConditioningKernels, SumAndPeakMatchPlainArithmetic)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = RandomPcm(1000, 1);
+    for (size_t offset = 0; offset < 16; ++offset)
+    {
+        for (size_t count = 0; count < 80; ++count)
+        {
+            const short* p = pcm.data() + offset;
+            int64_t sum = 0;
+            int peak = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                sum += p[i];
+                peak = std::max(peak, std::abs((int)p[i]));
+            }
+            ASSERT_EQ(PcmSum(p, count), sum) << offset << "+" << count;
+            ASSERT_EQ(PcmPeak(p, count), peak) << offset << "+" << count;
+        }
+    }
+
+    // Long enough for the 32-bit partial sums to have to be flushed, all at the extreme
+    std::vector<short> low(8 * 16384 * 3 + 5, -32768);
+    EXPECT_EQ(PcmSum(low.data(), low.size()), -32768LL * (int64_t)low.size());
+    EXPECT_EQ(PcmPeak(low.data(), low.size()), 32768);
+}
+
+TEST(ConditioningKernels, AddOffsetSaturates)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    for (int offset : { 0, 1, -1, 1000, -20000, 40000, -40000 })
+    {
+        std::vector<short> pcm = RandomPcm(77, 2);
+        std::vector<short> expected = pcm;
+        for (short& s : expected)
+        {
+            s = (short)std::clamp(s + std::clamp(offset, -32768, 32767), -32768, 32767);
+        }
+        PcmAddOffset(pcm.data(), pcm.size(), offset);
+        EXPECT_EQ(pcm, expected) << offset;
+    }
+}
+
+TEST(ConditioningKernels, GainRampWithinOneOfExact)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    for (auto [start, end] : { std::pair{ 1.0f, 1.0f }, { 0.5f, 2.0f }, { 4.0f, 0.25f }, { 16.0f, 16.0f } })
+    {
+        for (size_t count : { 1, 7, 8, 9, 16, 31, 320 })
+        {
+            std::vector<short> pcm = RandomPcm(count, (uint32_t)count);
+            std::vector<short> original = pcm;
+            PcmApplyGainRamp(pcm.data(), count, start, end);
+            for (size_t i = 0; i < count; ++i)
+            {
+                double gain = start + (double)(end - start) / count * i;
+                double exact = std::clamp(original[i] * gain, -32768.0, 32767.0);
+                ASSERT_NEAR(pcm[i], exact, 1.0) << start << "->" << end << ", " << i << " of " << count;
+            }
+        }
+    }
+}
+
+TEST(AudioConditioner, GoldenOutputPerStage)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    const std::vector<short> input = GoldenInput();
+    ExpectGolden(Condition(Only(true, false, false), input),
+        { -83, 1674, 2419, 1764, 2, -1751, -2552, -1855, 114, 1719, 2406, 1720, 73, -1729, -2607, -1857 }, "dc");
+    ExpectGolden(Condition(Only(false, true, false), input),
+        { 1398, -11, -464, -1014, -631, -218, 570, 723, 971, -2192, 1715, -3228, 1650, -2430, 2737, -1495 }, "high-pass");
+    ExpectGolden(Condition(Only(false, false, true), input),
+        { 1429, 3251, 4090, 3469, 1627, -269, -1165, -395, 1855, 2068, 2081, 1609, 773, -109, -534, -168 }, "normalize");
+    ExpectGolden(Condition(ConditioningSettings(), input),
+        { -81, -12, -557, -1324, -889, -331, 926, 1252, 1777, -1714, 1011, -1735, 858, -1252, 1403, -765 }, "whole chain");
+}
+
+TEST(AudioConditioner, RemovesOffsetAndHum)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = Condition(Only(true, true, false), GoldenInput());
+    const size_t settled = RATE / 4;
+    EXPECT_LT(std::abs((double)PcmSum(pcm.data() + settled, pcm.size() - settled) / (pcm.size() - settled)), 5.0);
+
+    // The 50 Hz hum is 16 dB down after the 80 Hz high-pass
+    std::vector<short> hum = Condition(Only(false, true, false), test_audio::Sine(RATE, 50.0, RATE, 5000.0));
+    EXPECT_LT(test_audio::Rms(hum.data() + settled, hum.size() - settled), 5000.0 / std::sqrt(2.0) * 0.4);
+    std::vector<short> tone = Condition(Only(false, true, false), test_audio::Sine(RATE, 1000.0, RATE, 5000.0));
+    EXPECT_NEAR(test_audio::Rms(tone.data() + settled, tone.size() - settled), 5000.0 / std::sqrt(2.0), 40.0);
+}
+
+TEST(AudioConditioner, BringsQuietSpeechUpAndStaysUnderThePeakLimit)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    ConditioningSettings settings;
+    std::vector<short> voice = test_audio::Voice(RATE * 10, RATE, 600.0);
+    std::vector<short> quiet = Condition(settings, voice);
+    const size_t settled = RATE * 5;
+    auto rms_db = [&](const std::vector<short>& pcm) { return 20.0 * std::log10(test_audio::Rms(pcm.data() + settled, pcm.size() - settled) / 32768.0); };
+
+    // The gain drops fast on syllables and climbs back slowly, so it settles a little under target
+    EXPECT_GT(rms_db(quiet) - rms_db(voice), 12.0);
+    EXPECT_NEAR(rms_db(quiet), settings.target_rms_dbfs, 5.0);
+
+    std::vector<short> loud = Condition(settings, test_audio::Voice(RATE * 3, RATE, 30000.0));
+    int limit = (int)(32768.0 * std::pow(10.0, settings.peak_limit_dbfs / 20.0)) + 1;
+    EXPECT_LE(PcmPeak(loud.data(), loud.size()), limit);
+
+    // Silence isn't pumped up
+    AudioConditioner conditioner(settings);
+    std::vector<short> hiss = test_audio::Noise(RATE * 3, 5.0);
+    conditioner.Process(hiss.data(), hiss.size());
+    EXPECT_EQ(conditioner.GainDb(), 0.0);
+}
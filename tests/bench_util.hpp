@@ -0,0 +1,143 @@
+#pragma once
+
+#include "http_transport.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Bits the benchmark programs share. They all take --quick (ctest runs them that way, as a smoke
+// test) and otherwise print a table of the real numbers.
+namespace bench
+{
+
+inline bool HasArg(int argc, char** argv, const char* name)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The value after `name`, e.g. ArgValue(..., "--whisper") for "--whisper http://...".
+inline std::string ArgValue(int argc, char** argv, const char* name, const std::string& fallback = {})
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (strcmp(argv[i], name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return fallback;
+}
+
+// Arguments that aren't flags or flag values, e.g. fixture paths.
+inline std::vector<std::string> Positional(int argc, char** argv, std::initializer_list<const char*> with_values)
+{
+    std::vector<std::string> out;
+    for (int i = 1; i < argc; ++i)
+    {
+        bool takes_value = false;
+        for (const char* name : with_values)
+        {
+            takes_value = takes_value || strcmp(argv[i], name) == 0;
+        }
+        if (takes_value)
+        {
+            ++i;
+        }
+        else if (argv[i][0] != '-')
+        {
+            out.push_back(argv[i]);
+        }
+    }
+    return out;
+}
+
+struct Stopwatch
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    double Ms() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Runs `work` `runs` times and returns the fastest, in ms; the minimum is the least noisy.
+template <typename Work>
+double BestMs(int runs, Work&& work)
+{
+    double best = 1e300;
+    for (int i = 0; i < runs; ++i)
+    {
+        Stopwatch watch;
+        work();
+        best = std::min(best, watch.Ms());
+    }
+    return best;
+}
+
+inline size_t AppendToString(char* data, size_t size, size_t count, void* user)
+{
+    static_cast<std::string*>(user)->append(data, size * count);
+    return size * count;
+}
+
+// POSTs a file to an OpenAI-style /v1/audio/transcriptions endpoint and returns the plain-text
+// transcript (empty on failure), along with how long the round trip took.
+inline std::string Transcribe(HttpTransport* transport, const std::string& url, const std::vector<char>& file, const char* file_name,
+    const char* mime_type, double* ms = nullptr)
+{
+    CURL* curl = transport->Acquire(url);
+    curl_mime* mime = curl_mime_init(curl);
+    curl_mimepart* part = curl_mime_addpart(mime);
+    curl_mime_name(part, "file");
+    curl_mime_data(part, file.data(), file.size());
+    curl_mime_filename(part, file_name);
+    curl_mime_type(part, mime_type);
+    part = curl_mime_addpart(mime);
+    curl_mime_name(part, "model");
+    curl_mime_data(part, "whisper-1", CURL_ZERO_TERMINATED);
+    part = curl_mime_addpart(mime);
+    curl_mime_name(part, "response_format");
+    curl_mime_data(part, "text", CURL_ZERO_TERMINATED);
+
+    std::string response;
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, AppendToString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+    HttpTimings timings;
+    CURLcode result = transport->Perform(curl, &timings);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, nullptr);
+    curl_mime_free(mime);
+    transport->Release(curl);
+
+    if (ms)
+    {
+        *ms = timings.total * 1000.0;
+    }
+    if (result != CURLE_OK || status != 200)
+    {
+        return {};
+    }
+    while (!response.empty() && isspace((unsigned char)response.back()))
+    {
+        response.pop_back();
+    }
+    return response;
+}
+
+}  // namespace bench
@@ -0,0 +1,154 @@
+// Every upload format we were built with, on the same take: encode time, bytes, and the end-to-end
+// time of encoding it and posting it to a local mock Whisper endpoint over a LAN-speed and a
+// WAN-speed link. The mock also checks that each format names its file part properly.
+//
+//   codec_benchmark [--quick] [--seconds N] [--wan-kbps N]
+
+#include "bench_util.hpp"
+#include "mock_server.hpp"
+#include "test_audio.hpp"
+#include "wav_encoder.hpp"
+
+#ifdef HAVE_LAME
+#include "mp3_encoder.hpp"
+#endif
+#ifdef HAVE_OPUS
+#include "opus_encoder.hpp"
+#endif
+#ifdef HAVE_FLAC
+#include "flac_encoder.hpp"
+#endif
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+
+namespace
+{
+
+constexpr int RATE = 16000;
+
+struct Codec
+{
+    const char* name;
+    std::function<std::unique_ptr<AudioEncoder>()> create;
+};
+
+std::vector<Codec> Codecs()
+{
+    std::vector<Codec> codecs;
+    codecs.push_back({ "wav", [] { return std::make_unique<WavStreamEncoder>(); } });
+#ifdef HAVE_LAME
+    codecs.push_back({ "mp3", [] { return std::make_unique<Mp3StreamEncoder>(); } });
+#endif
+#ifdef HAVE_OPUS
+    codecs.push_back({ "opus", [] { return std::make_unique<OpusStreamEncoder>(); } });
+#endif
+#ifdef HAVE_FLAC
+    codecs.push_back({ "flac", [] { return std::make_unique<FlacStreamEncoder>(); } });
+#endif
+    return codecs;
+}
+
+// The headers of the multipart part called "file", as the server saw them
+std::string FilePartHeaders(const MockRequest& request)
+{
+    size_t name = request.body.find("name=\"file\"");
+    if (name == std::string::npos)
+    {
+        return {};
+    }
+    size_t begin = request.body.rfind("\r\n--", name);
+    size_t end = request.body.find("\r\n\r\n", name);
+    return request.body.substr(begin == std::string::npos ? 0 : begin, end - (begin == std::string::npos ? 0 : begin));
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    const bool quick = bench::HasArg(argc, argv, "--quick");
+    const double seconds = std::stod(bench::ArgValue(argc, argv, "--seconds", quick ? "3" : "60"));
+    const size_t wan_bytes_per_second = std::stoul(bench::ArgValue(argc, argv, "--wan-kbps", "2000")) * 1000 / 8;
+    const int runs = quick ? 1 : 3;
+
+    std::vector<short> pcm = test_audio::Noise(RATE / 2, 30, 1);
+    while (pcm.size() < seconds * RATE)
+    {
+        test_audio::Append(&pcm, test_audio::Voice(RATE * 4, RATE, 6000, (uint32_t)pcm.size()));
+        test_audio::Append(&pcm, test_audio::Noise(RATE / 2, 30, (uint32_t)pcm.size()));
+    }
+
+    std::mutex mutex;
+    std::string last_file_part;
+    MockServer server([&](const MockRequest& request)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        last_file_part = FilePartHeaders(request);
+        MockResponse response;
+        response.content_type = "text/plain";
+        response.body = "hello";
+        return response;
+    });
+    if (!server.Start())
+    {
+        fprintf(stderr, "can't start the mock endpoint\n");
+        return 1;
+    }
+    const std::string url = server.Url("/v1/audio/transcriptions");
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    bool ok = true;
+    {
+        HttpTransport transport;
+        // Connect once up front so the first codec doesn't pay for it
+        bench::Transcribe(&transport, url, std::vector<char>(16), "warmup.wav", "audio/wav");
+
+        printf("%.0f s of speech at %d Hz, best of %d; WAN is %zu kbit/s up\n\n", (double)pcm.size() / RATE, RATE, runs,
+            wan_bytes_per_second * 8 / 1000);
+        printf("%-6s %10s %10s %8s | %10s %10s | %s\n", "codec", "encode ms", "bytes", "ratio", "LAN ms", "WAN ms", "file part");
+
+        for (const Codec& codec : Codecs())
+        {
+            std::vector<char> file;
+            const char* file_name = nullptr;
+            const char* mime_type = nullptr;
+            double encode_ms = bench::BestMs(runs, [&]
+            {
+                std::unique_ptr<AudioEncoder> encoder = codec.create();
+                encoder->Start(RATE);
+                encoder->Encode(pcm.data(), pcm.size());
+                file = encoder->Finish();
+                file_name = encoder->FileName();
+                mime_type = encoder->MimeType();
+            });
+
+            double link_ms[2] = {};
+            bool answered = true;
+            for (int link = 0; link < 2; ++link)
+            {
+                server.SetReadBytesPerSecond(link == 0 ? 0 : wan_bytes_per_second);
+                link_ms[link] = bench::BestMs(link == 0 ? runs : 1, [&]
+                {
+                    answered = bench::Transcribe(&transport, url, file, file_name, mime_type) == "hello" && answered;
+                });
+            }
+            server.SetReadBytesPerSecond(0);
+
+            std::string part;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                part = last_file_part;
+            }
+            bool labelled = part.find(std::string("filename=\"") + file_name + "\"") != std::string::npos &&
+                part.find(std::string("Content-Type: ") + mime_type) != std::string::npos;
+
+            printf("%-6s %10.1f %10zu %7.1fx | %10.1f %10.1f | %s %s%s\n", codec.name, encode_ms, file.size(),
+                (double)(pcm.size() * sizeof(short)) / std::max<size_t>(file.size(), 1), encode_ms + link_ms[0], encode_ms + link_ms[1],
+                file_name, mime_type, labelled ? "" : " (MISLABELLED)");
+            ok = ok && answered && labelled && !file.empty();
+        }
+    }
+    curl_global_cleanup();
+    return ok ? 0 : 1;
+}
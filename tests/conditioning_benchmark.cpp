@@ -0,0 +1,77 @@
+// Throughput of the conditioning chain, per kernel and per stage, in the block size the recorder
+// uses. Built once per kernel flavour (conditioning_benchmark_scalar, _native, _avx2) so the
+// vector paths can be compared with plain C++.
+//
+//   conditioning_benchmark_<flavour> [--quick] [--seconds N]
+
+#include "audio_conditioning.hpp"
+#include "bench_util.hpp"
+#include "kernel_variant.hpp"
+#include "test_audio.hpp"
+#include "vad.hpp"
+
+#include <cstdio>
+#include <functional>
+
+namespace
+{
+
+constexpr int RATE = 16000;
+constexpr size_t BLOCK = RATE / 50;  // 20 ms, a capture poll's worth
+
+volatile int64_t sink;  // keeps the kernels' results alive
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    if (!CpuRunsKernelVariant())
+    {
+        printf("this CPU can't run the " KERNEL_VARIANT " kernels\n");
+        return 0;
+    }
+
+    const bool quick = bench::HasArg(argc, argv, "--quick");
+    const double seconds = std::stod(bench::ArgValue(argc, argv, "--seconds", quick ? "10" : "600"));
+    const int runs = quick ? 1 : 5;
+
+    const std::vector<short> take = test_audio::Voice((size_t)(seconds * RATE), RATE, 3000.0);
+    std::vector<short> pcm;
+
+    // Each run starts from the original take, outside the timing
+    auto measure = [&](const char* name, const std::function<void(short*, size_t)>& process)
+    {
+        double best = 1e300;
+        for (int run = 0; run < runs; ++run)
+        {
+            pcm = take;
+            bench::Stopwatch watch;
+            for (size_t at = 0; at < pcm.size(); at += BLOCK)
+            {
+                process(pcm.data() + at, std::min(BLOCK, pcm.size() - at));
+            }
+            best = std::min(best, watch.Ms());
+        }
+        double rate = (double)take.size() / (best / 1000.0);
+        printf("%-22s %10.2f ms %10.1f Msamples/s %8.0fx realtime\n", name, best, rate / 1e6, rate / RATE);
+    };
+
+    printf("%s kernels, %.0f s of audio in %zu-sample blocks, best of %d\n\n", KERNEL_VARIANT, seconds, BLOCK, runs);
+
+    measure("PcmSum", [](short* p, size_t n) { sink = sink + PcmSum(p, n); });
+    measure("PcmPeak", [](short* p, size_t n) { sink = sink + PcmPeak(p, n); });
+    measure("PcmSumOfSquares", [](short* p, size_t n) { sink = sink + PcmSumOfSquares(p, n); });
+    measure("PcmAddOffset", [](short* p, size_t n) { PcmAddOffset(p, n, -37); });
+    measure("PcmApplyGainRamp", [](short* p, size_t n) { PcmApplyGainRamp(p, n, 1.5f, 1.6f); });
+    printf("\n");
+
+    AudioConditioner conditioner;
+    measure("RemoveDc", [&](short* p, size_t n) { conditioner.RemoveDc(p, n); });
+    conditioner.Reset(ConditioningSettings());
+    measure("HighPass", [&](short* p, size_t n) { conditioner.HighPass(p, n); });
+    conditioner.Reset(ConditioningSettings());
+    measure("Normalize", [&](short* p, size_t n) { conditioner.Normalize(p, n); });
+    conditioner.Reset(ConditioningSettings());
+    measure("whole chain", [&](short* p, size_t n) { conditioner.Process(p, n); });
+    return 0;
+}
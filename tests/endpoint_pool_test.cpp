@@ -0,0 +1,350 @@
+#include "endpoint_pool.hpp"
+#include "http_engine.hpp"
+#include "mock_server.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using State = EndpointPool::State;
+
+const EndpointPool::Server& ServerFor(const EndpointPool& pool, const std::string& url)
+{
+    for (const EndpointPool::Server& server : pool.Servers())
+    {
+        if (server.url == url)
+        {
+            return server;
+        }
+    }
+    throw std::runtime_error("no server " + url);
+}
+
+uint64_t NowMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A transcription server that takes `delay_ms` over every request, and answers 503 while `broken`
+MockResponse Whisper(int delay_ms, const std::atomic<bool>* broken = nullptr)
+{
+    MockResponse response;
+    if (broken && *broken)
+    {
+        response.status = 503;
+        response.body = "{\"error\":\"overloaded\"}";
+        return response;
+    }
+    response.delay_ms = delay_ms;
+    response.body = "{\"text\":\"ok\"}";
+    return response;
+}
+
+size_t Discard(char*, size_t size, size_t count, void*)
+{
+    return size * count;
+}
+
+// One request to `url`; whether the server did its job, the way the recorder judges it: connection
+// failures and 5xx are the server's fault
+bool Get(HttpTransport* transport, const std::string& url, HttpTimings* timings)
+{
+    CURL* curl = transport->Acquire(url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Discard);
+    CURLcode result = transport->Perform(curl, timings);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    transport->Release(curl);
+    return result == CURLE_OK && status < 500;
+}
+
+// A transcription request, reported to the pool
+bool Send(EndpointPool* pool, HttpTransport* transport, const std::string& url, double audio_seconds, uint64_t now)
+{
+    pool->OnRequestStarted(url);
+    HttpTimings timings;
+    bool server_ok = Get(transport, url, &timings);
+    pool->OnRequestFinished(url, server_ok, timings.total, audio_seconds, now);
+    return server_ok;
+}
+
+// A health probe, which the pool only hears the outcome of
+bool Probe(HttpTransport* transport, const std::string& url)
+{
+    HttpTimings timings;
+    return Get(transport, url, &timings);
+}
+
+}  // namespace
+
+TEST(EndpointPool, ParseEndpointList)
+{
+    EXPECT_EQ(ParseEndpointList(nullptr), std::vector<std::string>{});
+    EXPECT_EQ(ParseEndpointList(" http://a:1/x ,http://b:2/x;\n http://a:1/x\thttp://c/x; "),
+        (std::vector<std::string>{ "http://a:1/x", "http://b:2/x", "http://c/x" }));
+}
+
+TEST(EndpointPool, ParseEndpointEntries)
+{
+    std::vector<EndpointEntry> entries = ParseEndpointEntries("http://a/x#flac, http://b/x http://c/x#opus http://a/x#wav", FORMAT_MP3);
+    ASSERT_EQ(entries.size(), 3u);
+    EXPECT_EQ(entries[0].url, "http://a/x");
+    EXPECT_EQ(entries[0].format, FORMAT_FLAC);
+    EXPECT_EQ(entries[1].url, "http://b/x");
+    EXPECT_EQ(entries[1].format, FORMAT_MP3);
+    EXPECT_EQ(entries[2].url, "http://c/x");
+    EXPECT_EQ(entries[2].format, FORMAT_OPUS);
+
+    // Anything else after a # is left alone
+    entries = ParseEndpointEntries("http://a/x#anchor", FORMAT_WAV);
+    ASSERT_EQ(entries.size(), 1u);
+    EXPECT_EQ(entries[0].url, "http://a/x#anchor");
+    EXPECT_EQ(entries[0].format, FORMAT_WAV);
+}
+
+TEST(EndpointPool, PicksOnlyServersThatTakeTheFormat)
+{
+    EndpointPool pool;
+    pool.SetServerEntries({ { "mp3", FORMAT_MP3 }, { "flac", FORMAT_FLAC } });
+    EXPECT_EQ(pool.Pick(10.0), "mp3");
+    EXPECT_EQ(pool.Pick(10.0, {}, FORMAT_FLAC), "flac");
+    EXPECT_EQ(pool.Pick(10.0, "flac", FORMAT_FLAC), "");
+
+    // Even when it's the slower one
+    pool.OnRequestStarted("flac");
+    pool.OnRequestFinished("flac", true, 5.0, 10.0, 0);
+    EXPECT_EQ(pool.Pick(10.0, {}, FORMAT_MP3), "mp3");
+    EXPECT_EQ(pool.Pick(10.0, {}, FORMAT_FLAC), "flac");
+
+    // Nobody takes it: anyone will do
+    EXPECT_EQ(pool.Pick(10.0, {}, FORMAT_OPUS), "mp3");
+
+    // A server whose format changes keeps its numbers
+    pool.SetServerEntries({ { "mp3", FORMAT_MP3 }, { "flac", FORMAT_OPUS } });
+    EXPECT_EQ(ServerFor(pool, "flac").format, FORMAT_OPUS);
+    EXPECT_EQ(pool.Pick(10.0, {}, FORMAT_OPUS), "flac");
+}
+
+TEST(EndpointPool, PicksByRealtimeFactorAndLoad)
+{
+    EndpointPool pool;
+    pool.SetServers({ "fast", "slow" });
+    EXPECT_EQ(pool.Pick(10.0), "fast");  // nothing known, the first one
+
+    // 20x and 5x realtime
+    pool.OnRequestStarted("fast");
+    pool.OnRequestFinished("fast", true, 0.5, 10.0, 0);
+    pool.OnRequestStarted("slow");
+    pool.OnRequestFinished("slow", true, 2.0, 10.0, 0);
+    EXPECT_EQ(pool.Pick(10.0), "fast");
+    EXPECT_EQ(pool.Pick(10.0, "fast"), "slow");
+
+    // Four requests queued up on the fast one make it the slower choice
+    for (int i = 0; i < 4; ++i)
+    {
+        pool.OnRequestStarted("fast");
+    }
+    EXPECT_EQ(pool.Pick(10.0), "slow");
+    pool.OnRequestCancelled("fast");
+    pool.OnRequestCancelled("fast");
+    EXPECT_EQ(pool.Pick(10.0), "fast");
+
+    // A newcomer is expected to be as fast as the average, so it gets a turn
+    pool.SetServers({ "fast", "slow", "new" });
+    EXPECT_EQ(ServerFor(pool, "fast").in_flight, 2);
+    EXPECT_EQ(pool.Pick(10.0), "new");
+}
+
+TEST(EndpointPool, BreakerOpensProbesAndClosesAgain)
+{
+    EndpointPool pool;
+    pool.SetServers({ "a", "b" });
+
+    for (int i = 0; i < EndpointPool::FAILURES_TO_OPEN; ++i)
+    {
+        EXPECT_EQ(ServerFor(pool, "a").state, State::Closed);
+        pool.OnRequestStarted("a");
+        pool.OnRequestFinished("a", false, 0.1, 5.0, 1000);
+    }
+    EXPECT_EQ(ServerFor(pool, "a").state, State::Open);
+    EXPECT_EQ(pool.Pick(5.0), "b");
+    EXPECT_EQ(pool.Pick(5.0, "b"), "a");  // out, but the only one left
+
+    // Probed once the backoff is over, and not again while that probe runs
+    EXPECT_TRUE(pool.StartDueProbes(1000 + EndpointPool::FIRST_BACKOFF_MS - 1).empty());
+    EXPECT_EQ(pool.StartDueProbes(1000 + EndpointPool::FIRST_BACKOFF_MS), std::vector<std::string>{ "a" });
+    EXPECT_TRUE(pool.StartDueProbes(1000 + EndpointPool::FIRST_BACKOFF_MS).empty());
+
+    // A failed probe doubles the backoff
+    uint64_t now = 1000 + EndpointPool::FIRST_BACKOFF_MS;
+    pool.OnProbeFinished("a", false, now);
+    EXPECT_EQ(ServerFor(pool, "a").open_until, now + 2 * EndpointPool::FIRST_BACKOFF_MS);
+
+    // A good one lets it back in, one trial request at a time
+    now += 2 * EndpointPool::FIRST_BACKOFF_MS;
+    ASSERT_EQ(pool.StartDueProbes(now).size(), 1u);
+    pool.OnProbeFinished("a", true, now);
+    EXPECT_EQ(ServerFor(pool, "a").state, State::HalfOpen);
+    for (int i = 0; i < EndpointPool::SUCCESSES_TO_CLOSE; ++i)
+    {
+        ASSERT_EQ(pool.Pick(5.0), "a") << i;
+        pool.OnRequestStarted("a");
+        EXPECT_EQ(pool.Pick(5.0), "b") << i;
+        pool.OnRequestFinished("a", true, 0.5, 5.0, now);
+    }
+    EXPECT_EQ(ServerFor(pool, "a").state, State::Closed);
+    EXPECT_EQ(ServerFor(pool, "a").backoff_ms, 0u);
+
+    // Once it's out again, a single failure while on probation is enough to send it back
+    for (int i = 0; i < EndpointPool::FAILURES_TO_OPEN; ++i)
+    {
+        pool.OnRequestStarted("a");
+        pool.OnRequestFinished("a", false, 0.1, 5.0, now);
+    }
+    ASSERT_EQ(pool.StartDueProbes(now + EndpointPool::FIRST_BACKOFF_MS).size(), 1u);
+    pool.OnProbeFinished("a", true, now + EndpointPool::FIRST_BACKOFF_MS);
+    pool.OnRequestStarted("a");
+    pool.OnRequestFinished("a", false, 0.1, 5.0, now + EndpointPool::FIRST_BACKOFF_MS);
+    EXPECT_EQ(ServerFor(pool, "a").state, State::Open);
+    EXPECT_EQ(ServerFor(pool, "a").backoff_ms, 2 * EndpointPool::FIRST_BACKOFF_MS);
+}
+
+// Three servers with different latency profiles and requests kept going three at a time on the
+// HTTP loop, the way the recorder overlaps takes: the fast one should end up with most of them,
+// and the slow one shouldn't be left with a queue.
+TEST(EndpointPool, SendsMostRequestsToTheFastestServer)
+{
+    MockServer fast([](const MockRequest&) { return Whisper(20); });
+    MockServer medium([](const MockRequest&) { return Whisper(80); });
+    MockServer slow([](const MockRequest&) { return Whisper(300); });
+    ASSERT_TRUE(fast.Start());
+    ASSERT_TRUE(medium.Start());
+    ASSERT_TRUE(slow.Start());
+    const std::string path = "/v1/audio/transcriptions";
+
+    EndpointPool pool;  // only touched on the loop thread
+    pool.SetServers({ slow.Url(path), medium.Url(path), fast.Url(path) });
+    HttpTransport transport;
+    HttpEngine engine;
+    ASSERT_TRUE(engine.Start());
+
+    const int total = 40;
+    const double audio_seconds = 8.0;
+    int launched = 0;
+    int max_slow_in_flight = 0;
+    std::promise<void> all_done;
+    int finished = 0;
+
+    std::function<void()> launch = [&]
+    {
+        std::string url = pool.Pick(audio_seconds);
+        pool.OnRequestStarted(url);
+        max_slow_in_flight = std::max(max_slow_in_flight, ServerFor(pool, slow.Url(path)).in_flight);
+        launched += 1;
+
+        CURL* curl = transport.Acquire(url);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Discard);
+        engine.Submit(curl, [&, url, curl](CURLcode result, const HttpTimings& timings)
+        {
+            long status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            transport.Release(curl);
+            pool.OnRequestFinished(url, result == CURLE_OK && status < 500, timings.total, audio_seconds, NowMs());
+            if (launched < total)
+            {
+                launch();
+            }
+            if (++finished == total)
+            {
+                all_done.set_value();
+            }
+        });
+    };
+    engine.Post([&]
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            launch();
+        }
+    });
+
+    std::future<void> done = all_done.get_future();
+    ASSERT_EQ(done.wait_for(std::chrono::seconds(20)), std::future_status::ready);
+    engine.Stop();
+
+    EXPECT_EQ(fast.Requests() + medium.Requests() + slow.Requests(), total);
+    EXPECT_GT(fast.Requests(), total / 2) << pool.Describe();
+    EXPECT_GT(fast.Requests(), medium.Requests()) << pool.Describe();
+    EXPECT_GE(medium.Requests(), slow.Requests()) << pool.Describe();
+    EXPECT_LE(max_slow_in_flight, 1) << pool.Describe();
+    EXPECT_GT(ServerFor(pool, fast.Url(path)).ewma_realtime_factor, ServerFor(pool, slow.Url(path)).ewma_realtime_factor);
+}
+
+// A server that starts answering 503 is taken out after a few failures, stays out while its
+// health probes fail, and earns its way back once it recovers.
+TEST(EndpointPool, FailingServerIsTakenOutAndProbedBackIn)
+{
+    std::atomic<bool> broken{ true };
+    MockServer flaky([&](const MockRequest&) { return Whisper(0, &broken); });
+    MockServer steady([](const MockRequest&) { return Whisper(30); });
+    ASSERT_TRUE(flaky.Start());
+    ASSERT_TRUE(steady.Start());
+    const std::string path = "/v1/audio/transcriptions";
+    const std::string flaky_url = flaky.Url(path);
+
+    EndpointPool pool;
+    pool.SetServers({ flaky_url, steady.Url(path) });
+    HttpTransport transport;
+    uint64_t now = 1000000;  // the breaker's clock, moved along by hand
+
+    int failures = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        std::string url = pool.Pick(5.0);
+        if (!Send(&pool, &transport, url, 5.0, now))
+        {
+            failures += 1;
+        }
+        now += 100;
+    }
+    EXPECT_EQ(failures, EndpointPool::FAILURES_TO_OPEN);
+    EXPECT_EQ(flaky.Requests(), EndpointPool::FAILURES_TO_OPEN);
+    EXPECT_EQ(steady.Requests(), 10 - EndpointPool::FAILURES_TO_OPEN);
+    EXPECT_EQ(ServerFor(pool, flaky_url).state, State::Open);
+
+    // Still broken when the probe comes round
+    now = ServerFor(pool, flaky_url).open_until;
+    ASSERT_EQ(pool.StartDueProbes(now), std::vector<std::string>{ flaky_url });
+    pool.OnProbeFinished(flaky_url, Probe(&transport, flaky_url), now);
+    EXPECT_EQ(ServerFor(pool, flaky_url).state, State::Open);
+
+    // Recovered by the next one
+    broken = false;
+    now = ServerFor(pool, flaky_url).open_until;
+    ASSERT_EQ(pool.StartDueProbes(now), std::vector<std::string>{ flaky_url });
+    pool.OnProbeFinished(flaky_url, Probe(&transport, flaky_url), now);
+    EXPECT_EQ(ServerFor(pool, flaky_url).state, State::HalfOpen);
+
+    for (int i = 0; i < EndpointPool::SUCCESSES_TO_CLOSE; ++i)
+    {
+        std::string url = pool.Pick(5.0);
+        ASSERT_EQ(url, flaky_url) << i;
+        EXPECT_TRUE(Send(&pool, &transport, url, 5.0, now));
+    }
+    EXPECT_EQ(ServerFor(pool, flaky_url).state, State::Closed);
+    EXPECT_EQ(ServerFor(pool, flaky_url).failures, EndpointPool::FAILURES_TO_OPEN);
+    EXPECT_EQ(flaky.Requests(), EndpointPool::FAILURES_TO_OPEN + 2 + EndpointPool::SUCCESSES_TO_CLOSE);
+
+    // And now that it's measured as the faster of the two, it's the first choice
+    EXPECT_EQ(pool.Pick(5.0), flaky_url);
+}
@@ -0,0 +1,232 @@
+#include "http_engine.hpp"
+#include "mock_server.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Waits for `count` calls of Done() from other threads
+struct Countdown
+{
+    explicit Countdown(int count) : remaining(count) {}
+
+    void Done()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --remaining;
+        changed.notify_all();
+    }
+
+    bool Wait(int timeout_ms)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return remaining <= 0; });
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    int remaining;
+};
+
+size_t AppendToString(char* data, size_t size, size_t count, void* user)
+{
+    static_cast<std::string*>(user)->append(data, size * count);
+    return size * count;
+}
+
+// Answers /sleep/<ms> after that long, with the number in the body
+MockResponse Sleeper(const MockRequest& request)
+{
+    MockResponse response;
+    response.delay_ms = std::stoi(request.path.substr(request.path.rfind('/') + 1));
+    response.body = std::to_string(response.delay_ms);
+    return response;
+}
+
+double MsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+}  // namespace
+
+TEST(HttpEngine, ConcurrentRequestsTakeTheSlowestNotTheSum)
+{
+    MockServer server(Sleeper);
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+    HttpEngine engine;
+    ASSERT_TRUE(engine.Start());
+
+    // Latencies in the range of a Whisper request and an LLM post-process
+    const int count = 24;
+    std::vector<int> latencies;
+    int sum = 0;
+    int slowest = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        latencies.push_back(100 + (i * 37) % 300);
+        sum += latencies.back();
+        slowest = std::max(slowest, latencies.back());
+    }
+
+    std::vector<CURL*> handles(count);
+    std::vector<std::string> bodies(count);
+    std::vector<CURLcode> results(count, CURLE_FAILED_INIT);
+    std::vector<double> finished_ms(count);
+    std::atomic<bool> on_loop_thread{ true };
+    Countdown countdown(count);
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < count; ++i)
+    {
+        handles[i] = transport.Acquire(server.Url("/sleep/" + std::to_string(latencies[i])));
+        curl_easy_setopt(handles[i], CURLOPT_WRITEFUNCTION, AppendToString);
+        curl_easy_setopt(handles[i], CURLOPT_WRITEDATA, &bodies[i]);
+        engine.Submit(handles[i], [&, i](CURLcode result, const HttpTimings&)
+        {
+            on_loop_thread = on_loop_thread && engine.OnLoopThread();
+            results[i] = result;
+            finished_ms[i] = MsSince(start);
+            countdown.Done();
+        });
+    }
+    ASSERT_TRUE(countdown.Wait(10000));
+    double elapsed = MsSince(start);
+
+    for (int i = 0; i < count; ++i)
+    {
+        EXPECT_EQ(results[i], CURLE_OK) << i;
+        EXPECT_EQ(bodies[i], std::to_string(latencies[i])) << i;
+        EXPECT_GE(finished_ms[i], latencies[i]) << i;
+        transport.Release(handles[i]);
+    }
+    EXPECT_TRUE(on_loop_thread);
+    EXPECT_EQ(server.MaxInFlight(), count);
+
+    // Generous against a loaded CI box, and still nowhere near serial
+    EXPECT_LT(elapsed, slowest + 500.0) << "sum of latencies " << sum << " ms";
+    RecordProperty("elapsed_ms", (int)elapsed);
+}
+
+TEST(HttpEngine, PostedTasksRunOnTheLoopInOrder)
+{
+    HttpEngine engine;
+    ASSERT_TRUE(engine.Start());
+
+    std::vector<int> order;  // only touched on the loop thread
+    std::promise<std::vector<int>> result;
+    Clock::time_point start = Clock::now();
+    double delayed_ms = 0.0;
+
+    engine.PostDelayed(80, [&]
+    {
+        order.push_back(3);
+        delayed_ms = MsSince(start);
+        result.set_value(order);
+    });
+    engine.PostDelayed(20, [&] { order.push_back(2); });
+    engine.Post([&] { order.push_back(engine.OnLoopThread() ? 1 : -1); });
+
+    std::future<std::vector<int>> future = result.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(future.get(), (std::vector<int>{ 1, 2, 3 }));
+    EXPECT_GE(delayed_ms, 80.0);
+    EXPECT_FALSE(engine.OnLoopThread());
+}
+
+TEST(HttpEngine, CancelledTransferNeverCompletes)
+{
+    MockServer server(Sleeper);
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+    HttpEngine engine;
+    ASSERT_TRUE(engine.Start());
+
+    std::atomic<int> completions{ 0 };
+    CURL* slow = transport.Acquire(server.Url("/sleep/300"));
+    CURL* fast = transport.Acquire(server.Url("/sleep/10"));
+    Countdown countdown(1);
+    engine.Submit(slow, [&](CURLcode, const HttpTimings&) { ++completions; });
+    engine.Submit(fast, [&](CURLcode, const HttpTimings&)
+    {
+        // The loser of a race, as the hedging code does it
+        engine.Cancel(slow);
+        EXPECT_EQ(engine.InFlight(), 0u);
+        countdown.Done();
+    });
+
+    ASSERT_TRUE(countdown.Wait(5000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    EXPECT_EQ(completions, 0);
+    transport.Release(slow);
+    transport.Release(fast);
+}
+
+// A hedge submitted and cancelled within one turn of the loop, before it ever got polled
+TEST(HttpEngine, CancelRightAfterSubmitOnTheLoopThread)
+{
+    MockServer server(Sleeper);
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+    HttpEngine engine;
+    ASSERT_TRUE(engine.Start());
+
+    std::atomic<int> completions{ 0 };
+    CURL* curl = transport.Acquire(server.Url("/sleep/50"));
+    std::promise<size_t> in_flight;
+    engine.Post([&]
+    {
+        engine.Submit(curl, [&](CURLcode, const HttpTimings&) { ++completions; });
+        engine.Cancel(curl);
+        in_flight.set_value(engine.InFlight());
+    });
+    EXPECT_EQ(in_flight.get_future().get(), 0u);
+
+    // Released and reused straight away, the way the recorder recycles handles
+    transport.Release(curl);
+    CURL* again = transport.Acquire(server.Url("/sleep/10"));
+    Countdown countdown(1);
+    engine.Submit(again, [&](CURLcode result, const HttpTimings&)
+    {
+        EXPECT_EQ(result, CURLE_OK);
+        countdown.Done();
+    });
+    ASSERT_TRUE(countdown.Wait(5000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(completions, 0);
+    transport.Release(again);
+}
+
+TEST(HttpEngine, StopAbandonsWhatIsInFlight)
+{
+    MockServer server(Sleeper);
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+    std::atomic<int> completions{ 0 };
+
+    CURL* curl = transport.Acquire(server.Url("/sleep/800"));
+    {
+        HttpEngine engine;
+        ASSERT_TRUE(engine.Start());
+        engine.Submit(curl, [&](CURLcode, const HttpTimings&) { ++completions; });
+        engine.PostDelayed(10000, [&] { ++completions; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        Clock::time_point start = Clock::now();
+        engine.Stop();
+        EXPECT_LT(MsSince(start), 500.0);
+    }
+    EXPECT_EQ(completions, 0);
+    transport.Release(curl);
+}
@@ -0,0 +1,151 @@
+#include "http_transport.hpp"
+#include "mock_server.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace
+{
+
+size_t Discard(char*, size_t size, size_t count, void*)
+{
+    return size * count;
+}
+
+MockResponse Ok(const MockRequest&)
+{
+    MockResponse response;
+    response.body = "{}";
+    return response;
+}
+
+// One GET through `transport`, the way the recorder's requests go: acquire, perform, release.
+// `trust` is the server certificate for HTTPS.
+HttpTimings Get(HttpTransport* transport, const std::string& url, const std::string& trust = {})
+{
+    CURL* curl = transport->Acquire(url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Discard);
+    curl_blob blob = { (void*)trust.data(), trust.size(), CURL_BLOB_COPY };
+    if (!trust.empty())
+    {
+        curl_easy_setopt(curl, CURLOPT_CAINFO_BLOB, &blob);
+    }
+
+    HttpTimings timings;
+    CURLcode result = transport->Perform(curl, &timings);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    transport->Release(curl);
+    EXPECT_EQ(result, CURLE_OK) << curl_easy_strerror(result);
+    EXPECT_EQ(status, 200);
+    return timings;
+}
+
+}  // namespace
+
+TEST(HttpTransport, UrlOrigin)
+{
+    EXPECT_EQ(UrlOrigin("https://api.openai.com/v1/audio/transcriptions"), "https://api.openai.com");
+    EXPECT_EQ(UrlOrigin("http://127.0.0.1:8080/v1/chat?x=1"), "http://127.0.0.1:8080");
+    EXPECT_EQ(UrlOrigin("http://host?q"), "http://host");
+    EXPECT_EQ(UrlOrigin("http://host"), "http://host");
+    EXPECT_EQ(UrlOrigin("not a url"), "not a url");
+}
+
+TEST(HttpTransport, SequentialRequestsReuseOneConnection)
+{
+    MockServer server(Ok);
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+
+    HttpTimings first = Get(&transport, server.Url("/v1/audio/transcriptions"));
+    EXPECT_FALSE(first.reused_connection);
+    EXPECT_GT(first.connect, 0.0);
+    EXPECT_GE(first.ttfb, first.connect);
+    EXPECT_GE(first.total, first.ttfb);
+
+    // Different paths on the same origin, like the transcription and the post-process calls
+    for (const char* path : { "/v1/chat/completions", "/v1/audio/transcriptions", "/" })
+    {
+        HttpTimings again = Get(&transport, server.Url(path));
+        EXPECT_TRUE(again.reused_connection) << path;
+        EXPECT_EQ(again.http_version, CURL_HTTP_VERSION_1_1);
+    }
+    EXPECT_EQ(server.Connections(), 1);
+    EXPECT_EQ(server.Requests(), 4);
+}
+
+TEST(HttpTransport, HandlesShareTheConnectionPool)
+{
+    MockServer server(Ok);
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+
+    // While `held` is out, the next Acquire() has to make a second handle; it still gets the
+    // connection the first request left behind, through the share
+    CURL* held = transport.Acquire(server.Url());
+    Get(&transport, server.Url());
+    CURL* other = transport.Acquire(server.Url());
+    EXPECT_NE(other, held);
+    transport.Release(other);
+    transport.Release(held);
+
+    HttpTimings timings = Get(&transport, server.Url());
+    EXPECT_TRUE(timings.reused_connection);
+    EXPECT_EQ(server.Connections(), 1);
+}
+
+TEST(HttpTransport, OriginsDontShareConnections)
+{
+    MockServer one(Ok);
+    MockServer two(Ok);
+    ASSERT_TRUE(one.Start());
+    ASSERT_TRUE(two.Start());
+    HttpTransport transport;
+
+    EXPECT_FALSE(Get(&transport, one.Url()).reused_connection);
+    EXPECT_FALSE(Get(&transport, two.Url()).reused_connection);
+    EXPECT_TRUE(Get(&transport, one.Url()).reused_connection);
+    EXPECT_TRUE(Get(&transport, two.Url()).reused_connection);
+    EXPECT_EQ(one.Connections(), 1);
+    EXPECT_EQ(two.Connections(), 1);
+}
+
+TEST(HttpTransport, TlsHandshakeOnlyOnTheFirstRequest)
+{
+    MockServer server(Ok);
+    if (!server.StartTls())
+    {
+        GTEST_SKIP() << "mock server built without OpenSSL";
+    }
+    HttpTransport transport;
+
+    HttpTimings first = Get(&transport, server.Url("/v1/audio/transcriptions"), server.CertificatePem());
+    EXPECT_FALSE(first.reused_connection);
+    EXPECT_GT(first.tls, first.connect);
+    EXPECT_GE(first.ttfb, first.tls);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        HttpTimings again = Get(&transport, server.Url("/v1/chat/completions"), server.CertificatePem());
+        EXPECT_TRUE(again.reused_connection) << i;
+    }
+    EXPECT_EQ(server.Connections(), 1);
+}
+
+TEST(HttpTransport, DescribeTimings)
+{
+    HttpTimings timings;
+    timings.dns = 0.001;
+    timings.connect = 0.020;
+    timings.tls = 0.080;
+    timings.ttfb = 0.300;
+    timings.total = 0.450;
+    timings.http_version = CURL_HTTP_VERSION_2_0;
+    EXPECT_EQ(DescribeTimings(timings), "new HTTP/2, dns 1 ms, connect 20 ms, tls 80 ms, ttfb 300 ms, total 450 ms");
+
+    timings.reused_connection = true;
+    timings.http_version = CURL_HTTP_VERSION_1_1;
+    EXPECT_EQ(DescribeTimings(timings), "reused HTTP/1.1, ttfb 300 ms, total 450 ms");
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+// Which build of the SIMD kernels this binary was linked with (see whisper_kernel_test).
+#ifndef KERNEL_VARIANT
+#define KERNEL_VARIANT "native"
+#endif
+
+inline bool CpuRunsKernelVariant()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if (strcmp(KERNEL_VARIANT, "avx2") == 0)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return true;
+}
+
+#define SKIP_UNLESS_CPU_RUNS_KERNELS()                                       \
+    if (!CpuRunsKernelVariant())                                             \
+    {                                                                        \
+        GTEST_SKIP() << "this CPU can't run the " KERNEL_VARIANT " kernels"; \
+    }
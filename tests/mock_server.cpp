@@ -0,0 +1,755 @@
+#include "mock_server.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#ifdef MOCK_SERVER_TLS
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#endif
+
+namespace
+{
+
+const char* StatusText(int status)
+{
+    switch (status)
+    {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    default: return "Whatever";
+    }
+}
+
+std::string Lower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return text;
+}
+
+std::string Trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t");
+    size_t end = text.find_last_not_of(" \t\r");
+    return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+}
+
+void SleepMs(int ms)
+{
+    if (ms > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+std::string Sha1(const std::string& text)
+{
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::string message = text;
+    uint64_t bits = (uint64_t)text.size() * 8;
+    message += (char)0x80;
+    while (message.size() % 64 != 56)
+    {
+        message += '\0';
+    }
+    for (int i = 7; i >= 0; --i)
+    {
+        message += (char)(bits >> (i * 8));
+    }
+
+    auto rotl = [](uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+    for (size_t block = 0; block < message.size(); block += 64)
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+        {
+            const unsigned char* p = (const unsigned char*)message.data() + block + i * 4;
+            w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+        for (int i = 16; i < 80; ++i)
+        {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            static const uint32_t k[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+            uint32_t f = i < 20 ? (b & c) | (~b & d)
+                : i < 40 ? b ^ c ^ d
+                : i < 60 ? (b & c) | (b & d) | (c & d)
+                : b ^ c ^ d;
+            uint32_t temp = rotl(a, 5) + f + e + k[i / 20] + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    std::string digest;
+    for (uint32_t word : h)
+    {
+        for (int i = 3; i >= 0; --i)
+        {
+            digest += (char)(word >> (i * 8));
+        }
+    }
+    return digest;
+}
+
+std::string Base64(const std::string& data)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < data.size(); i += 3)
+    {
+        uint32_t triple = (uint32_t)(unsigned char)data[i] << 16;
+        if (i + 1 < data.size())
+        {
+            triple |= (uint32_t)(unsigned char)data[i + 1] << 8;
+        }
+        if (i + 2 < data.size())
+        {
+            triple |= (unsigned char)data[i + 2];
+        }
+        out += alphabet[(triple >> 18) & 63];
+        out += alphabet[(triple >> 12) & 63];
+        out += i + 1 < data.size() ? alphabet[(triple >> 6) & 63] : '=';
+        out += i + 2 < data.size() ? alphabet[triple & 63] : '=';
+    }
+    return out;
+}
+
+// Sec-WebSocket-Accept for the client's Sec-WebSocket-Key (RFC 6455)
+std::string WebSocketAccept(const std::string& key)
+{
+    return Base64(Sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC11B85"));
+}
+
+enum WebSocketOpcode
+{
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA,
+};
+
+#ifdef MOCK_SERVER_TLS
+
+// A P-256 key and a certificate for 127.0.0.1 signed with it, good for a day
+bool MakeCertificate(SSL_CTX* context, std::string* pem)
+{
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* certificate = X509_new();
+    bool ok = key && certificate;
+    if (ok)
+    {
+        X509_set_version(certificate, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+        X509_gmtime_adj(X509_getm_notBefore(certificate), -60);
+        X509_gmtime_adj(X509_getm_notAfter(certificate), 24 * 60 * 60);
+        X509_set_pubkey(certificate, key);
+        X509_NAME* name = X509_get_subject_name(certificate);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"127.0.0.1", -1, -1, 0);
+        X509_set_issuer_name(certificate, name);
+
+        X509V3_CTX v3;
+        X509V3_set_ctx_nodb(&v3);
+        X509V3_set_ctx(&v3, certificate, certificate, nullptr, nullptr, 0);
+        X509_EXTENSION* san = X509V3_EXT_conf_nid(nullptr, &v3, NID_subject_alt_name, "IP:127.0.0.1");
+        ok = san && X509_add_ext(certificate, san, -1) && X509_sign(certificate, key, EVP_sha256()) &&
+             SSL_CTX_use_certificate(context, certificate) && SSL_CTX_use_PrivateKey(context, key);
+        X509_EXTENSION_free(san);
+    }
+
+    if (ok)
+    {
+        BIO* out = BIO_new(BIO_s_mem());
+        PEM_write_bio_X509(out, certificate);
+        char* data;
+        long length = BIO_get_mem_data(out, &data);
+        pem->assign(data, (size_t)length);
+        BIO_free(out);
+    }
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+#endif
+
+}  // namespace
+
+std::string MockRequest::Header(const std::string& name) const
+{
+    auto it = headers.find(Lower(name));
+    return it == headers.end() ? std::string() : it->second;
+}
+
+MockServer::MockServer(Handler handler)
+    : handler(std::move(handler))
+{
+}
+
+MockServer::~MockServer()
+{
+    Stop();
+#ifdef MOCK_SERVER_TLS
+    SSL_CTX_free((SSL_CTX*)tls_context);
+#endif
+}
+
+bool MockServer::Start()
+{
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        return false;
+    }
+    int yes = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (bind(listen_fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, 64) != 0 ||
+        getsockname(listen_fd, (sockaddr*)&address, &length) != 0)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    port = ntohs(address.sin_port);
+
+    stopping = false;
+    accept_thread = std::thread(&MockServer::AcceptLoop, this);
+    return true;
+}
+
+bool MockServer::StartTls()
+{
+#ifdef MOCK_SERVER_TLS
+    if (!tls_context)
+    {
+        SSL_CTX* context = SSL_CTX_new(TLS_server_method());
+        if (!context || !MakeCertificate(context, &certificate_pem))
+        {
+            ERR_print_errors_fp(stderr);
+            SSL_CTX_free(context);
+            return false;
+        }
+        tls_context = context;
+        // SSL_write() goes through write(), which has no MSG_NOSIGNAL
+        signal(SIGPIPE, SIG_IGN);
+    }
+    return Start();
+#else
+    return false;
+#endif
+}
+
+void MockServer::Stop()
+{
+    if (listen_fd < 0)
+    {
+        return;
+    }
+
+    stopping = true;
+    shutdown(listen_fd, SHUT_RDWR);
+    accept_thread.join();
+    close(listen_fd);
+    listen_fd = -1;
+
+    std::vector<std::thread> serving;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int fd : open_fds)
+        {
+            shutdown(fd, SHUT_RDWR);
+        }
+        serving.swap(threads);
+    }
+    for (std::thread& thread : serving)
+    {
+        thread.join();
+    }
+}
+
+std::string MockServer::Url(const std::string& path) const
+{
+    return (tls_context ? "https://127.0.0.1:" : "http://127.0.0.1:") + std::to_string(port) + path;
+}
+
+std::chrono::steady_clock::time_point MockServer::FirstBodyByteAt()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return first_body_byte_at;
+}
+
+void MockServer::AcceptLoop()
+{
+    while (!stopping)
+    {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (stopping || errno != EINTR)
+            {
+                break;
+            }
+            continue;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        open_fds.push_back(fd);
+        threads.emplace_back(&MockServer::Serve, this, fd, ++connections);
+    }
+}
+
+void MockServer::Serve(int fd, int connection)
+{
+    Peer peer;
+    peer.fd = fd;
+#ifdef MOCK_SERVER_TLS
+    SSL* ssl = nullptr;
+    if (tls_context)
+    {
+        ssl = SSL_new((SSL_CTX*)tls_context);
+        SSL_set_fd(ssl, fd);
+        peer.ssl = ssl;
+        if (SSL_accept(ssl) != 1)
+        {
+            peer.fd = -1;  // skips the loop below
+        }
+    }
+#endif
+
+    std::string buffer;
+    while (peer.fd >= 0)
+    {
+        MockRequest request;
+        request.connection = connection;
+        if (!ReadRequest(peer, &buffer, &request))
+        {
+            break;
+        }
+
+        ++requests;
+        int now_in_flight = ++in_flight;
+        int seen = max_in_flight;
+        while (now_in_flight > seen && !max_in_flight.compare_exchange_weak(seen, now_in_flight))
+        {
+        }
+
+        MockResponse response = handler(request);
+        bool sent = SendResponse(peer, request, response);
+        if (sent && response.websocket)
+        {
+            MockWebSocket socket(this, &peer, &buffer);
+            response.websocket(socket);
+            --in_flight;
+            break;
+        }
+        --in_flight;
+
+        if (!sent || Lower(request.Header("connection")) == "close")
+        {
+            break;
+        }
+    }
+
+#ifdef MOCK_SERVER_TLS
+    if (ssl)
+    {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
+#endif
+
+    std::lock_guard<std::mutex> lock(mutex);
+    open_fds.erase(std::remove(open_fds.begin(), open_fds.end(), fd), open_fds.end());
+    close(fd);
+}
+
+bool MockServer::Fill(Peer& peer, std::string* buffer)
+{
+    char data[65536];
+    size_t want = sizeof(data);
+    size_t rate = read_bytes_per_second;
+    if (rate)
+    {
+        // 10 ms worth at a time
+        want = std::clamp<size_t>(rate / 100, 1, sizeof(data));
+    }
+
+    ssize_t got;
+#ifdef MOCK_SERVER_TLS
+    if (peer.ssl)
+    {
+        got = SSL_read((SSL*)peer.ssl, data, (int)want);
+    }
+    else
+#endif
+    {
+        got = recv(peer.fd, data, want, 0);
+    }
+    if (got <= 0)
+    {
+        return false;
+    }
+    buffer->append(data, (size_t)got);
+    if (rate)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds((long long)got * 1000000 / (long long)rate));
+    }
+    return true;
+}
+
+bool MockServer::ReadRequest(Peer& peer, std::string* buffer, MockRequest* request)
+{
+    size_t header_end;
+    while ((header_end = buffer->find("\r\n\r\n")) == std::string::npos)
+    {
+        if (!Fill(peer, buffer))
+        {
+            return false;
+        }
+    }
+
+    std::string head = buffer->substr(0, header_end + 2);
+    buffer->erase(0, header_end + 4);
+
+    size_t line_end = head.find("\r\n");
+    std::string request_line = head.substr(0, line_end);
+    size_t space1 = request_line.find(' ');
+    size_t space2 = request_line.find(' ', space1 + 1);
+    if (space1 == std::string::npos || space2 == std::string::npos)
+    {
+        return false;
+    }
+    request->method = request_line.substr(0, space1);
+    request->path = request_line.substr(space1 + 1, space2 - space1 - 1);
+
+    for (size_t at = line_end + 2; at < head.size();)
+    {
+        size_t end = head.find("\r\n", at);
+        std::string line = head.substr(at, end - at);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos)
+        {
+            request->headers[Lower(Trim(line.substr(0, colon)))] = Trim(line.substr(colon + 1));
+        }
+        at = end + 2;
+    }
+
+    if (Lower(request->Header("expect")) == "100-continue" && !WriteAll(peer, "HTTP/1.1 100 Continue\r\n\r\n"))
+    {
+        return false;
+    }
+
+    bool chunked = Lower(request->Header("transfer-encoding")) == "chunked";
+    std::string length_header = request->Header("content-length");
+    if (!chunked && length_header.empty())
+    {
+        return true;
+    }
+
+    auto need = [&](size_t bytes)
+    {
+        while (buffer->size() < bytes)
+        {
+            if (!Fill(peer, buffer))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto note_first_byte = [&]
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        first_body_byte_at = std::chrono::steady_clock::now();
+    };
+
+    if (!chunked)
+    {
+        size_t length = (size_t)std::stoull(length_header);
+        if (length == 0)
+        {
+            return true;
+        }
+        if (!need(1))
+        {
+            return false;
+        }
+        note_first_byte();
+        if (!need(length))
+        {
+            return false;
+        }
+        request->body = buffer->substr(0, length);
+        buffer->erase(0, length);
+        return true;
+    }
+
+    bool first = true;
+    for (;;)
+    {
+        size_t size_end;
+        while ((size_end = buffer->find("\r\n")) == std::string::npos)
+        {
+            if (!Fill(peer, buffer))
+            {
+                return false;
+            }
+        }
+        size_t size = (size_t)std::stoull(buffer->substr(0, size_end), nullptr, 16);
+        buffer->erase(0, size_end + 2);
+        if (first && size)
+        {
+            note_first_byte();
+            first = false;
+        }
+        if (!need(size + 2))
+        {
+            return false;
+        }
+        request->body.append(*buffer, 0, size);
+        buffer->erase(0, size + 2);
+        if (size == 0)
+        {
+            return true;  // no trailers from curl
+        }
+    }
+}
+
+bool MockServer::WriteAll(Peer& peer, const std::string& data)
+{
+    for (size_t sent = 0; sent < data.size();)
+    {
+        ssize_t n;
+#ifdef MOCK_SERVER_TLS
+        if (peer.ssl)
+        {
+            n = SSL_write((SSL*)peer.ssl, data.data() + sent, (int)(data.size() - sent));
+        }
+        else
+#endif
+        {
+            n = send(peer.fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        sent += (size_t)n;
+    }
+    return true;
+}
+
+bool MockServer::SendResponse(Peer& peer, const MockRequest& request, const MockResponse& response)
+{
+    SleepMs(response.delay_ms);
+
+    if (response.websocket)
+    {
+        return WriteAll(peer, "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: " + WebSocketAccept(request.Header("sec-websocket-key")) + "\r\n\r\n");
+    }
+
+    std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + StatusText(response.status) + "\r\n";
+    if (!response.content_type.empty())
+    {
+        head += "Content-Type: " + response.content_type + "\r\n";
+    }
+    for (const auto& [name, value] : response.headers)
+    {
+        head += name + ": " + value + "\r\n";
+    }
+    if (Lower(request.Header("connection")) == "close")
+    {
+        head += "Connection: close\r\n";
+    }
+
+    if (response.chunks.empty())
+    {
+        head += "Content-Length: " + std::to_string(response.body.size()) + "\r\n\r\n";
+        return WriteAll(peer, head + (request.method == "HEAD" ? std::string() : response.body));
+    }
+
+    head += "Transfer-Encoding: chunked\r\n\r\n";
+    if (!WriteAll(peer, head))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < response.chunks.size(); ++i)
+    {
+        if (i > 0)
+        {
+            SleepMs(response.chunk_delay_ms);
+        }
+        const std::string& chunk = response.chunks[i];
+        char size[32];
+        snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+        if (!chunk.empty() && !WriteAll(peer, size + chunk + "\r\n"))
+        {
+            return false;
+        }
+    }
+    return WriteAll(peer, "0\r\n\r\n");
+}
+
+bool MockWebSocket::Receive(std::string* message)
+{
+    MockServer::Peer& connection = *(MockServer::Peer*)peer;
+    auto need = [&](size_t bytes)
+    {
+        while (buffer->size() < bytes)
+        {
+            if (!server->Fill(connection, buffer))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    message->clear();
+    while (need(2))
+    {
+        const unsigned char* head = (const unsigned char*)buffer->data();
+        bool fin = head[0] & 0x80;
+        int opcode = head[0] & 0x0F;
+        bool masked = head[1] & 0x80;
+        uint64_t length = head[1] & 0x7F;
+        size_t header = 2;
+        if (length == 126 || length == 127)
+        {
+            size_t bytes = length == 126 ? 2 : 8;
+            if (!need(header + bytes))
+            {
+                return false;
+            }
+            head = (const unsigned char*)buffer->data();
+            length = 0;
+            for (size_t i = 0; i < bytes; ++i)
+            {
+                length = (length << 8) | head[header + i];
+            }
+            header += bytes;
+        }
+        size_t mask_at = header;
+        header += masked ? 4 : 0;
+        if (!need(header + length))
+        {
+            return false;
+        }
+
+        std::string payload = buffer->substr(header, length);
+        if (masked)
+        {
+            for (size_t i = 0; i < payload.size(); ++i)
+            {
+                payload[i] ^= (*buffer)[mask_at + i % 4];
+            }
+        }
+        buffer->erase(0, header + length);
+
+        switch (opcode)
+        {
+        case WS_CLOSE:
+            Close();
+            return false;
+        case WS_PING:
+            SendFrame(WS_PONG, payload);
+            continue;
+        case WS_PONG:
+            continue;
+        default:
+            *message += payload;
+            if (fin)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool MockWebSocket::Send(const std::string& text)
+{
+    return SendFrame(WS_TEXT, text);
+}
+
+void MockWebSocket::Close()
+{
+    if (!closed)
+    {
+        SendFrame(WS_CLOSE, std::string("\x03\xE8", 2));  // 1000, normal closure
+        closed = true;
+    }
+}
+
+// Server frames go unmasked and unfragmented
+bool MockWebSocket::SendFrame(int opcode, const std::string& payload)
+{
+    if (closed)
+    {
+        return false;
+    }
+
+    std::string frame(1, (char)(0x80 | opcode));
+    if (payload.size() < 126)
+    {
+        frame += (char)payload.size();
+    }
+    else if (payload.size() <= 0xFFFF)
+    {
+        frame += (char)126;
+        frame += (char)(payload.size() >> 8);
+        frame += (char)payload.size();
+    }
+    else
+    {
+        frame += (char)127;
+        for (int i = 7; i >= 0; --i)
+        {
+            frame += (char)((uint64_t)payload.size() >> (i * 8));
+        }
+    }
+    return server->WriteAll(*(MockServer::Peer*)peer, frame + payload);
+}
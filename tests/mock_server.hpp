@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Stand-in for a Whisper or chat endpoint in the tests and benchmarks: a small HTTP/1.1 server on
+// 127.0.0.1 with keep-alive, chunked request bodies and a handler that decides what to answer and
+// how slowly, and WebSocket upgrades for the realtime API. One thread per connection, POSIX
+// sockets only; HTTPS too when built with OpenSSL.
+struct MockRequest
+{
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers;  // names lower-cased
+    std::string body;                            // de-chunked
+    int connection = 0;                          // which accepted connection it came in on, from 1
+
+    std::string Header(const std::string& name) const;
+};
+
+struct MockServer;
+
+// The server's end of an upgraded connection. Text and binary messages both come out of Receive();
+// pings are answered on the way.
+struct MockWebSocket
+{
+    // The next message from the client; false once it has closed the connection or gone away.
+    bool Receive(std::string* message);
+    bool Send(const std::string& text);
+    // Sends a close frame; the connection ends when the handler returns.
+    void Close();
+
+private:
+    friend struct MockServer;
+    MockWebSocket(MockServer* server, void* peer, std::string* buffer) : server(server), peer(peer), buffer(buffer) {}
+
+    bool SendFrame(int opcode, const std::string& payload);
+
+    MockServer* server;
+    void* peer;           // MockServer::Peer*
+    std::string* buffer;  // what has been read off the connection but not used yet
+    bool closed = false;
+};
+
+struct MockResponse
+{
+    int status = 200;
+    std::string content_type = "application/json";
+    std::map<std::string, std::string> headers;
+    std::string body;
+
+    // Streamed answers (SSE): each piece goes out as its own chunk, chunk_delay_ms apart. Used
+    // instead of `body` when not empty.
+    std::vector<std::string> chunks;
+    int chunk_delay_ms = 0;
+
+    // "Processing time": how long to sit on the request before the status line goes out
+    int delay_ms = 0;
+
+    // Set for a WebSocket upgrade request: the server switches protocols and this runs for the
+    // rest of the connection, on its thread
+    std::function<void(MockWebSocket& socket)> websocket;
+};
+
+struct MockServer
+{
+    using Handler = std::function<MockResponse(const MockRequest&)>;
+
+    explicit MockServer(Handler handler);
+    ~MockServer();
+
+    MockServer(const MockServer&) = delete;
+    MockServer& operator=(const MockServer&) = delete;
+
+    // Listens on an ephemeral port.
+    bool Start();
+    // Same, but speaking TLS with a throwaway self-signed certificate for 127.0.0.1; false if the
+    // tests were built without OpenSSL.
+    bool StartTls();
+    void Stop();
+
+    int Port() const { return port; }
+    std::string Url(const std::string& path = "/") const;
+
+    // The certificate StartTls() made, in PEM, for the client to trust (CURLOPT_CAINFO_BLOB)
+    const std::string& CertificatePem() const { return certificate_pem; }
+
+    // Throttles how fast request bodies are read, to play a slow uplink (0 = as fast as possible).
+    void SetReadBytesPerSecond(size_t bytes_per_second) { read_bytes_per_second = bytes_per_second; }
+
+    int Connections() const { return connections; }
+    int Requests() const { return requests; }
+    int InFlight() const { return in_flight; }
+    int MaxInFlight() const { return max_in_flight; }
+
+    // When the first body byte of the latest request with a body arrived
+    std::chrono::steady_clock::time_point FirstBodyByteAt();
+
+private:
+    friend struct MockWebSocket;
+
+    struct Peer
+    {
+        int fd = -1;
+        void* ssl = nullptr;  // SSL*, for TLS connections
+    };
+
+    void AcceptLoop();
+    void Serve(int fd, int connection);
+    bool ReadRequest(Peer& peer, std::string* buffer, MockRequest* request);
+    bool Fill(Peer& peer, std::string* buffer);
+    bool WriteAll(Peer& peer, const std::string& data);
+    bool SendResponse(Peer& peer, const MockRequest& request, const MockResponse& response);
+
+    Handler handler;
+    int listen_fd = -1;
+    int port = 0;
+    void* tls_context = nullptr;  // SSL_CTX*
+    std::string certificate_pem;
+    std::thread accept_thread;
+    std::atomic<bool> stopping{ false };
+    std::atomic<size_t> read_bytes_per_second{ 0 };
+
+    std::mutex mutex;
+    std::vector<std::thread> threads;
+    std::vector<int> open_fds;
+    std::chrono::steady_clock::time_point first_body_byte_at;
+
+    std::atomic<int> connections{ 0 };
+    std::atomic<int> requests{ 0 };
+    std::atomic<int> in_flight{ 0 };
+    std::atomic<int> max_in_flight{ 0 };
+};
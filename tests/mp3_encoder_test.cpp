@@ -0,0 +1,134 @@
+#include "mp3_encoder.hpp"
+#include "mp3_parallel.hpp"
+#include "test_audio.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+namespace
+{
+
+constexpr int RATE = 16000;
+
+std::vector<char> EncodeInPieces(const std::vector<short>& pcm, size_t piece)
+{
+    Mp3StreamEncoder encoder;
+    EXPECT_TRUE(encoder.Start(RATE));
+    for (size_t at = 0; at < pcm.size(); at += piece)
+    {
+        EXPECT_TRUE(encoder.Encode(pcm.data() + at, std::min(piece, pcm.size() - at)));
+    }
+    return encoder.Finish();
+}
+
+}  // namespace
+
+TEST(Mp3StreamEncoder, SyntheticPcmComesOutAsWholeFrames)
+{
+    std::vector<short> pcm = test_audio::Voice(RATE * 10, RATE);
+    std::vector<char> mp3 = EncodeInPieces(pcm, 1600);
+    ASSERT_FALSE(mp3.empty());
+
+    std::vector<size_t> frames = FindMp3Frames(mp3.data(), mp3.size());
+    ASSERT_FALSE(frames.empty());
+
+    size_t samples = 0;
+    size_t end = 0;
+    for (size_t offset : frames)
+    {
+        Mp3FrameHeader header;
+        ASSERT_TRUE(ParseMp3FrameHeader((const unsigned char*)mp3.data() + offset, mp3.size() - offset, &header));
+        EXPECT_EQ(header.sample_rate, RATE);
+        samples += header.samples;
+        end = offset + header.bytes;
+    }
+    EXPECT_EQ(end, mp3.size());  // nothing but frames
+    EXPECT_GE(samples, pcm.size());
+}
+
+TEST(Mp3StreamEncoder, HowThePcmIsFedDoesNotChangeTheStream)
+{
+    std::vector<short> pcm = test_audio::Voice(RATE * 6, RATE);
+    std::vector<char> whole = EncodeInPieces(pcm, pcm.size());
+
+    EXPECT_EQ(EncodeInPieces(pcm, 160), whole);
+    EXPECT_EQ(EncodeInPieces(pcm, Mp3StreamEncoder::BLOCK_SAMPLES + 1), whole);
+
+    std::mt19937 rng(7);
+    Mp3StreamEncoder encoder;
+    ASSERT_TRUE(encoder.Start(RATE));
+    for (size_t at = 0; at < pcm.size();)
+    {
+        size_t n = std::min<size_t>(pcm.size() - at, 1 + rng() % 9000);
+        ASSERT_TRUE(encoder.Encode(pcm.data() + at, n));
+        at += n;
+    }
+    EXPECT_EQ(encoder.Finish(), whole);
+}
+
+TEST(Mp3StreamEncoder, StoppingOnlyFlushesTheLastFrames)
+{
+    // Whatever the length of the take, all but a few frames are out before Finish()
+    for (int seconds : { 5, 60 })
+    {
+        std::vector<short> pcm = test_audio::Voice((size_t)RATE * seconds, RATE);
+        Mp3StreamEncoder encoder;
+        ASSERT_TRUE(encoder.Start(RATE));
+        ASSERT_TRUE(encoder.Encode(pcm.data(), pcm.size()));
+        EXPECT_EQ(encoder.SamplesEncoded(), pcm.size());
+        size_t before = encoder.Output().size();
+
+        std::vector<char> mp3 = encoder.Finish();
+        EXPECT_LE(mp3.size() - before, 7200u) << seconds << " s";
+        EXPECT_FALSE(encoder.IsActive());
+    }
+}
+
+TEST(Mp3StreamEncoder, EncodesIntoTheBufferItWasGiven)
+{
+    std::vector<short> pcm = test_audio::Voice(RATE * 3, RATE);
+    std::vector<char> buffer;
+    buffer.reserve(Mp3StreamEncoder::WorstCaseMp3Bytes(pcm.size()) + 7200);
+    const char* storage = buffer.data();
+
+    Mp3StreamEncoder encoder;
+    ASSERT_TRUE(encoder.Start(RATE, std::move(buffer)));
+    ASSERT_TRUE(encoder.Encode(pcm.data(), pcm.size()));
+    std::vector<char> mp3 = encoder.Finish();
+    EXPECT_EQ(mp3.data(), storage);
+}
+
+TEST(Mp3StreamEncoder, TakingTheOutputAlongTheWayGivesTheSameStream)
+{
+    std::vector<short> pcm = test_audio::Voice(RATE * 5, RATE);
+    Mp3StreamEncoder encoder;
+    ASSERT_TRUE(encoder.Start(RATE));
+    ASSERT_TRUE(encoder.Encode(pcm.data(), pcm.size()));
+    std::vector<char> whole = encoder.Finish();
+
+    // As the streaming upload does it: a poll's worth at a time, each time into the buffer the
+    // previous piece came in
+    ASSERT_TRUE(encoder.Start(RATE));
+    std::vector<char> pieced;
+    std::vector<char> spare;
+    for (size_t at = 0; at < pcm.size(); at += RATE / 10)
+    {
+        ASSERT_TRUE(encoder.Encode(pcm.data() + at, std::min<size_t>(RATE / 10, pcm.size() - at)));
+        std::vector<char> piece = encoder.TakeOutput(std::move(spare));
+        EXPECT_TRUE(encoder.Output().empty());
+        pieced.insert(pieced.end(), piece.begin(), piece.end());
+        spare = std::move(piece);
+    }
+    std::vector<char> tail = encoder.Finish();
+    pieced.insert(pieced.end(), tail.begin(), tail.end());
+    EXPECT_EQ(pieced, whole);
+}
+
+TEST(Mp3StreamEncoder, NothingHappensOutsideASession)
+{
+    Mp3StreamEncoder encoder;
+    short pcm[16] = {};
+    EXPECT_FALSE(encoder.Encode(pcm, 16));
+    EXPECT_TRUE(encoder.Finish().empty());
+}
@@ -0,0 +1,76 @@
+// Whole-take MP3 encoding: one LAME session on one thread (what EncodeToMP3() used to do on stop,
+// and what the streaming encoder costs in total) against EncodeMp3Parallel on 1, 2, 4, ... cores.
+// Also prints what stopping a take costs now that the streaming encoder has done all but the flush.
+//
+//   mp3_parallel_benchmark [--quick] [--seconds N]
+
+#include "bench_util.hpp"
+#include "mp3_encoder.hpp"
+#include "mp3_parallel.hpp"
+#include "pcm_store.hpp"
+#include "test_audio.hpp"
+
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+
+constexpr int RATE = 16000;
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    const bool quick = bench::HasArg(argc, argv, "--quick");
+    const double seconds = std::stod(bench::ArgValue(argc, argv, "--seconds", quick ? "30" : "900"));
+    const int runs = quick ? 1 : 3;
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+
+    PcmBlockPool pool;
+    PcmStore take(pool);
+    for (uint32_t seed = 1; take.Size() < seconds * RATE; ++seed)
+    {
+        std::vector<short> turn = test_audio::Voice(RATE * 8, RATE, 6000, seed);
+        test_audio::Append(&turn, test_audio::Noise(RATE, 30, seed));
+        take.Append(turn.data(), turn.size());
+    }
+    printf("%.0f s take, %u cores, best of %d\n\n", (double)take.Size() / RATE, cores, runs);
+
+    std::vector<char> serial;
+    double flush_ms = 1e300;
+    double serial_ms = bench::BestMs(runs, [&]
+    {
+        Mp3StreamEncoder encoder;
+        encoder.Start(RATE);
+        take.ForEachSpan(0, take.Size(), [&](const short* pcm, size_t count) { encoder.Encode(pcm, count); });
+        bench::Stopwatch stop;
+        serial = encoder.Finish();
+        flush_ms = std::min(flush_ms, stop.Ms());
+    });
+    printf("%-28s %10.1f ms %10zu bytes\n", "one session (before)", serial_ms, serial.size());
+    printf("%-28s %10.2f ms\n\n", "stop with streaming encoder", flush_ms);
+
+    printf("%8s %10s %8s %10s %10s\n", "threads", "ms", "speedup", "per core", "bytes");
+    double one_thread_ms = 0.0;
+    bool ok = !serial.empty();
+    for (unsigned threads = 1;; threads = std::min(threads * 2, cores))
+    {
+        ParallelMp3Options options;
+        options.sample_rate = RATE;
+        options.threads = threads;
+        std::vector<char> mp3;
+        double ms = bench::BestMs(runs, [&] { mp3 = EncodeMp3Parallel(take, 0, take.Size(), options); });
+        if (threads == 1)
+        {
+            one_thread_ms = ms;
+        }
+        printf("%8u %10.1f %7.2fx %9.0f%% %10zu\n", threads, ms, serial_ms / ms, 100.0 * one_thread_ms / ms / threads, mp3.size());
+        ok = ok && !mp3.empty();
+        if (threads == cores)
+        {
+            break;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+#include "mp3_parallel.hpp"
+#include "pcm_store.hpp"
+#include "test_audio.hpp"
+
+#include <gtest/gtest.h>
+#include <lame/lame.h>
+
+#include <cmath>
+
+namespace
+{
+
+constexpr int RATE = 16000;
+constexpr size_t FRAME = 576;  // MPEG-2 Layer III at 16 kHz
+
+struct Take
+{
+    PcmBlockPool pool;
+    PcmStore store{ pool };
+
+    explicit Take(const std::vector<short>& pcm) { store.Append(pcm.data(), pcm.size()); }
+};
+
+ParallelMp3Options Options(unsigned threads)
+{
+    ParallelMp3Options options;
+    options.sample_rate = RATE;
+    options.threads = threads;
+    options.min_span_frames = 32;  // so even short takes get cut up
+    return options;
+}
+
+std::vector<short> Decode(const std::vector<char>& mp3)
+{
+    hip_t hip = hip_decode_init();
+    std::vector<short> pcm;
+    short left[FRAME * 16];
+    short right[FRAME * 16];
+    int got = hip_decode(hip, (unsigned char*)mp3.data(), mp3.size(), left, right);
+    while (got >= 0)
+    {
+        pcm.insert(pcm.end(), left, left + got);
+        if (got == 0)
+        {
+            break;
+        }
+        got = hip_decode(hip, nullptr, 0, left, right);
+    }
+    hip_decode_exit(hip);
+    return pcm;
+}
+
+double SnrDb(const std::vector<short>& reference, const std::vector<short>& test, size_t begin, size_t end)
+{
+    double signal = 0.0;
+    double noise = 0.0;
+    for (size_t i = begin; i < end && i < reference.size() && i < test.size(); ++i)
+    {
+        signal += (double)reference[i] * reference[i];
+        noise += ((double)reference[i] - test[i]) * ((double)reference[i] - test[i]);
+    }
+    return 10.0 * std::log10(signal / std::max(noise, 1.0));
+}
+
+}  // namespace
+
+TEST(Mp3Parallel, HeaderParsing)
+{
+    // MPEG-2 Layer III, 32 kbit/s, 16 kHz, no padding
+    const unsigned char frame[] = { 0xFF, 0xF3, 0x48, 0xC4 };
+    Mp3FrameHeader header;
+    ASSERT_TRUE(ParseMp3FrameHeader(frame, sizeof(frame), &header));
+    EXPECT_EQ(header.sample_rate, RATE);
+    EXPECT_EQ(header.bitrate_kbps, 32);
+    EXPECT_EQ(header.samples, 576);
+    EXPECT_EQ(header.bytes, 144u);
+
+    const unsigned char layer2[] = { 0xFF, 0xF5, 0x48, 0xC4 };
+    EXPECT_FALSE(ParseMp3FrameHeader(layer2, sizeof(layer2), &header));
+    EXPECT_FALSE(ParseMp3FrameHeader(frame, 3, &header));
+}
+
+TEST(Mp3Parallel, SameFramesWhateverTheThreadCount)
+{
+    Take take(test_audio::Voice(RATE * 40, RATE));
+    std::vector<char> one = EncodeMp3Parallel(take.store, 0, take.store.Size(), Options(1));
+    ASSERT_FALSE(one.empty());
+    std::vector<size_t> one_frames = FindMp3Frames(one.data(), one.size());
+
+    for (unsigned threads : { 2u, 3u, 8u })
+    {
+        std::vector<char> many = EncodeMp3Parallel(take.store, 0, take.store.Size(), Options(threads));
+        std::vector<size_t> frames = FindMp3Frames(many.data(), many.size());
+        EXPECT_EQ(frames.size(), one_frames.size()) << threads << " threads";
+        EXPECT_EQ(many.size(), one.size()) << threads << " threads";  // CBR, and nothing but frames
+        ASSERT_FALSE(frames.empty());
+        Mp3FrameHeader last;
+        ASSERT_TRUE(ParseMp3FrameHeader((const unsigned char*)many.data() + frames.back(), many.size() - frames.back(), &last));
+        EXPECT_EQ(frames.back() + last.bytes, many.size());
+    }
+    size_t estimate = EstimateParallelMp3Bytes(Options(1), take.store.Size());
+    EXPECT_GE(estimate, one.size());
+    EXPECT_LE(estimate, one.size() + 4 * 145);
+}
+
+TEST(Mp3Parallel, JoinsDoNotClick)
+{
+    std::vector<short> pcm = test_audio::Voice(RATE * 20, RATE);
+    Take take(pcm);
+    std::vector<short> one = Decode(EncodeMp3Parallel(take.store, 0, pcm.size(), Options(1)));
+    std::vector<short> four = Decode(EncodeMp3Parallel(take.store, 0, pcm.size(), Options(4)));
+    ASSERT_EQ(four.size(), one.size());
+    ASSERT_GE(one.size(), pcm.size());
+
+    // The single-context encode is the reference; the parallel one should be as good everywhere,
+    // including the frames either side of each join (which the codec delay moves ~2 frames later)
+    const size_t span = (pcm.size() / FRAME + 3) / 4 * FRAME;
+    for (size_t join = span; join < pcm.size(); join += span)
+    {
+        EXPECT_GT(SnrDb(one, four, join - 2 * FRAME, join + 4 * FRAME), 20.0) << "join at " << join;
+    }
+    EXPECT_GT(SnrDb(one, four, 0, one.size()), 20.0);
+}
+
+TEST(Mp3Parallel, PartOfTheTake)
+{
+    Take take(test_audio::Voice(RATE * 12, RATE));
+    std::vector<char> whole = EncodeMp3Parallel(take.store, 0, take.store.Size(), Options(2));
+    std::vector<char> half = EncodeMp3Parallel(take.store, RATE * 6, RATE * 12, Options(2));
+    EXPECT_NEAR((double)half.size(), whole.size() / 2.0, 3 * 144.0);
+
+    EXPECT_TRUE(EncodeMp3Parallel(take.store, 100, 100, Options(2)).empty());
+    EXPECT_TRUE(EncodeMp3Parallel(take.store, take.store.Size() + 10, take.store.Size() + 20, Options(2)).empty());
+}
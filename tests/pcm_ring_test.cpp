@@ -0,0 +1,166 @@
+#include "pcm_ring.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Sample value for an absolute position, so any read can be checked against where it came from
+short At(uint64_t position)
+{
+    return (short)(position * 7919 % 65536);
+}
+
+std::vector<short> Sequence(uint64_t begin, size_t count)
+{
+    std::vector<short> pcm(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        pcm[i] = At(begin + i);
+    }
+    return pcm;
+}
+
+void WriteSequence(PcmRing* ring, size_t count)
+{
+    std::vector<short> pcm = Sequence(ring->WritePosition(), count);
+    ring->Write(pcm.data(), pcm.size());
+}
+
+}  // namespace
+
+TEST(PcmRing, CapacityIsThePowerOfTwoAtOrAboveTheRequest)
+{
+    PcmRing ring;
+    EXPECT_EQ(ring.Capacity(), 0u);
+    for (auto [asked, expected] : { std::pair<size_t, size_t>{ 1, 1 }, { 1000, 1024 }, { 1024, 1024 }, { 1025, 2048 }, { 16000 * 3, 65536 } })
+    {
+        ring.Resize(asked);
+        EXPECT_EQ(ring.Capacity(), expected) << asked;
+    }
+}
+
+TEST(PcmRing, ReadsBackAcrossTheWrap)
+{
+    PcmRing ring(1000);
+    WriteSequence(&ring, 900);
+    WriteSequence(&ring, 300);  // wraps
+    EXPECT_EQ(ring.WritePosition(), 1200u);
+    EXPECT_EQ(ring.OldestPosition(), 1200u - 1024u);
+
+    std::vector<short> out(500);
+    ASSERT_TRUE(ring.Read(700, 1200, out.data()));
+    EXPECT_EQ(out, Sequence(700, 500));
+
+    // The whole ring at once
+    out.resize(1024);
+    ASSERT_TRUE(ring.Read(176, 1200, out.data()));
+    EXPECT_EQ(out, Sequence(176, 1024));
+}
+
+TEST(PcmRing, RefusesWhatIsGoneOrNotThereYet)
+{
+    PcmRing ring(256);
+    WriteSequence(&ring, 600);
+    std::vector<short> out(512);
+
+    EXPECT_FALSE(ring.Read(300, 400, out.data()));  // overwritten
+    EXPECT_TRUE(ring.Read(344, 400, out.data()));   // the oldest sample still there
+    EXPECT_FALSE(ring.Read(550, 601, out.data()));  // not written yet
+    EXPECT_FALSE(ring.Read(500, 400, out.data()));  // backwards
+    EXPECT_TRUE(ring.Read(450, 450, out.data()));   // empty is fine
+}
+
+TEST(PcmRing, OversizedWriteKeepsTheNewest)
+{
+    PcmRing ring(64);
+    std::vector<short> pcm = Sequence(0, 1000);
+    ring.Write(pcm.data(), pcm.size());
+    EXPECT_EQ(ring.WritePosition(), 1000u);
+
+    std::vector<short> out(64);
+    ASSERT_TRUE(ring.Read(936, 1000, out.data()));
+    EXPECT_EQ(out, Sequence(936, 64));
+    EXPECT_FALSE(ring.Read(935, 999, out.data()));
+}
+
+TEST(PcmRing, ResizeStartsOver)
+{
+    PcmRing ring(128);
+    WriteSequence(&ring, 100);
+    ring.Resize(4096);
+    EXPECT_EQ(ring.WritePosition(), 0u);
+    EXPECT_EQ(ring.OldestPosition(), 0u);
+
+    short out[10];
+    EXPECT_FALSE(ring.Read(0, 10, out));
+}
+
+TEST(PcmRing, ReaderOnAnotherThreadNeverGetsTornData)
+{
+    // Small ring and a reader that goes after the oldest samples, so it regularly loses races
+    // against the writer; every read that says it succeeded has to be exactly right. The writer
+    // keeps going until the reader has had its share of successes too (or time is up).
+    PcmRing ring(512);
+    const uint64_t total = 4'000'000;
+    const size_t enough_good = 10'000;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::atomic<bool> done{ false };
+
+    std::thread writer([&]
+    {
+        std::mt19937 rng(1);
+        std::vector<short> pcm;
+        while (!done)
+        {
+            pcm = Sequence(ring.WritePosition(), 1 + rng() % 200);
+            ring.Write(pcm.data(), pcm.size());
+        }
+    });
+
+    std::mt19937 rng(2);
+    std::vector<short> out(512);
+    size_t good = 0;
+    size_t refused = 0;
+    std::string torn;
+    while (torn.empty() && (good < enough_good || ring.WritePosition() < total) && std::chrono::steady_clock::now() < deadline)
+    {
+        uint64_t oldest = ring.OldestPosition();
+        uint64_t newest = ring.WritePosition();
+        if (newest == oldest)
+        {
+            continue;
+        }
+        uint64_t begin = oldest + rng() % (newest - oldest);
+        uint64_t end = std::min<uint64_t>(newest, begin + 1 + rng() % 511);
+        if (ring.Read(begin, end, out.data()))
+        {
+            // No ASSERT in here: returning early would leave the writer thread unjoined
+            for (uint64_t p = begin; p < end && torn.empty(); ++p)
+            {
+                if (out[p - begin] != At(p))
+                {
+                    torn = "[" + std::to_string(begin) + ", " + std::to_string(end) + ") at " + std::to_string(p);
+                }
+            }
+            ++good;
+        }
+        else
+        {
+            ++refused;
+        }
+    }
+    done = true;
+    writer.join();
+
+    EXPECT_EQ(torn, "") << "a read that claimed success was torn";
+    EXPECT_GT(good, 0u);
+    RecordProperty("refused", (int)refused);
+}
@@ -0,0 +1,250 @@
+#include "pcm_spill.hpp"
+#include "pcm_store.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdlib.h>
+#include <signal.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+constexpr size_t BLOCK = PcmBlockPool::BLOCK_SAMPLES;
+
+short At(size_t position)
+{
+    return (short)(position * 31 + 5);
+}
+
+// Spill files this process still has open, found through /proc: they're unlinked, so the
+// directory listing doesn't show them
+int OpenSpillFiles()
+{
+    int count = 0;
+    for (const fs::directory_entry& entry : fs::directory_iterator("/proc/self/fd"))
+    {
+        std::error_code error;
+        std::string target = fs::read_symlink(entry.path(), error).string();
+        if (!error && target.find("whisper_spill_") != std::string::npos)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Points TMPDIR at a directory of our own for the length of a test
+class PcmSpill : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        const char* old = getenv("TMPDIR");
+        old_tmpdir = old ? old : "";
+        had_tmpdir = old != nullptr;
+
+        dir = fs::temp_directory_path() / ("pcm_spill_test_" + std::to_string(getpid()));
+        fs::create_directories(dir);
+        setenv("TMPDIR", dir.c_str(), 1);
+    }
+
+    void TearDown() override
+    {
+        if (had_tmpdir)
+        {
+            setenv("TMPDIR", old_tmpdir.c_str(), 1);
+        }
+        else
+        {
+            unsetenv("TMPDIR");
+        }
+        fs::remove_all(dir);
+    }
+
+    size_t FilesInDir() const { return (size_t)std::distance(fs::directory_iterator(dir), fs::directory_iterator()); }
+
+    fs::path dir;
+    std::string old_tmpdir;
+    bool had_tmpdir = false;
+};
+
+}  // namespace
+
+TEST_F(PcmSpill, BlocksSurviveBeingWrittenOutAndDropped)
+{
+    PcmSpillFile file;
+    EXPECT_EQ(file.AddBlock(), nullptr);  // not open
+    ASSERT_TRUE(file.Open());
+    EXPECT_EQ(FilesInDir(), 0u);  // unlinked straight away
+    EXPECT_EQ(OpenSpillFiles(), 1);
+
+    // Past the first segment, so the first one gets flushed and its pages dropped
+    const size_t count = PcmSpillFile::SEGMENT_BLOCKS + 3;
+    std::vector<short*> blocks;
+    for (size_t b = 0; b < count; ++b)
+    {
+        short* block = file.AddBlock();
+        ASSERT_NE(block, nullptr) << b;
+        for (size_t i = 0; i < BLOCK; ++i)
+        {
+            block[i] = At(b * BLOCK + i);
+        }
+        blocks.push_back(block);
+    }
+    EXPECT_EQ(file.Bytes(), count * PcmBlockPool::BLOCK_BYTES);
+
+    for (size_t b = 0; b < count; ++b)
+    {
+        for (size_t i = 0; i < BLOCK; i += 997)
+        {
+            ASSERT_EQ(blocks[b][i], At(b * BLOCK + i)) << "block " << b << ", sample " << i;
+        }
+    }
+
+    file.Close();
+    EXPECT_FALSE(file.IsOpen());
+    EXPECT_EQ(file.Bytes(), 0u);
+    EXPECT_EQ(OpenSpillFiles(), 0);
+}
+
+TEST_F(PcmSpill, StoreSpillsPastTheThresholdAndReadsBackTheSame)
+{
+    PcmBlockPool pool;
+    PcmStore store(pool);
+    store.SetSpillThreshold(BLOCK * 2);
+
+    std::vector<short> pcm(BLOCK * 5 + 777);
+    for (size_t i = 0; i < pcm.size(); ++i)
+    {
+        pcm[i] = At(i);
+    }
+    for (size_t at = 0; at < pcm.size(); at += 16000)
+    {
+        store.Append(pcm.data() + at, std::min<size_t>(16000, pcm.size() - at));
+    }
+
+    EXPECT_EQ(pool.BlocksInUse(), 2u);
+    EXPECT_EQ(store.SpilledBytes(), 4 * PcmBlockPool::BLOCK_BYTES);
+    EXPECT_EQ(OpenSpillFiles(), 1);
+
+    std::vector<short> out;
+    store.ForEachSpan(0, store.Size(), [&](const short* p, size_t n) { out.insert(out.end(), p, p + n); });
+    EXPECT_EQ(out, pcm);
+
+    // Clear() gives the file up along with the pool blocks
+    store.Clear();
+    EXPECT_EQ(store.SpilledBytes(), 0u);
+    EXPECT_EQ(pool.BlocksInUse(), 0u);
+    EXPECT_EQ(OpenSpillFiles(), 0);
+    EXPECT_EQ(FilesInDir(), 0u);
+}
+
+TEST_F(PcmSpill, StoreCarriesOnInMemoryWithoutATempDirectory)
+{
+    setenv("TMPDIR", (dir / "does_not_exist").c_str(), 1);
+
+    PcmBlockPool pool;
+    PcmStore store(pool);
+    store.SetSpillThreshold(BLOCK);
+    std::vector<short> pcm(BLOCK * 3, 1234);
+    store.Append(pcm.data(), pcm.size());
+
+    EXPECT_EQ(store.Size(), pcm.size());
+    EXPECT_EQ(store.SpilledBytes(), 0u);
+    EXPECT_EQ(pool.BlocksInUse(), 3u);
+}
+
+// The space for a segment is allocated up front, not just promised by a sparse file
+TEST_F(PcmSpill, SegmentSpaceIsReservedUpFront)
+{
+    PcmSpillFile file;
+    ASSERT_TRUE(file.Open());
+    ASSERT_NE(file.AddBlock(), nullptr);
+
+    struct stat info = {};
+    for (const fs::directory_entry& entry : fs::directory_iterator("/proc/self/fd"))
+    {
+        std::error_code error;
+        if (fs::read_symlink(entry.path(), error).string().find("whisper_spill_") != std::string::npos)
+        {
+            ASSERT_EQ(stat(entry.path().c_str(), &info), 0);
+        }
+    }
+    EXPECT_GE((size_t)info.st_blocks * 512, PcmSpillFile::SEGMENT_BLOCKS * PcmBlockPool::BLOCK_BYTES);
+}
+
+// Stands in for a full disk: the file can't grow past the first segment
+TEST_F(PcmSpill, AddBlockFailsWhenTheFileCantGrow)
+{
+    const size_t segment_bytes = PcmSpillFile::SEGMENT_BLOCKS * PcmBlockPool::BLOCK_BYTES;
+    struct rlimit old_limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    struct rlimit limit = old_limit;
+    limit.rlim_cur = segment_bytes;
+    signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    PcmSpillFile file;
+    bool opened = file.Open();
+    size_t blocks = 0;
+    while (opened && blocks < 2 * PcmSpillFile::SEGMENT_BLOCKS && file.AddBlock())
+    {
+        ++blocks;
+    }
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, SIG_DFL);
+
+    ASSERT_TRUE(opened);
+    EXPECT_EQ(blocks, PcmSpillFile::SEGMENT_BLOCKS);
+}
+
+TEST_F(PcmSpill, RemoveStaleSpillFilesOnlyTouchesOurs)
+{
+    // A pid that was in use and now isn't
+    pid_t dead = fork();
+    if (dead == 0)
+    {
+        _exit(0);
+    }
+    waitpid(dead, nullptr, 0);
+    const std::string alive = "whisper_spill_" + std::to_string(getpid()) + "_abc123";
+    const std::string gone = "whisper_spill_" + std::to_string(dead) + "_abc123";
+    const std::string before_boot = "whisper_spill_" + std::to_string(getpid()) + "_def456";
+
+    for (const std::string& name : { alive, gone, before_boot, std::string("whisper_spill_abc123"), std::string("something_else.pcm"),
+             std::string("whisper_spil") })
+    {
+        std::ofstream(dir / name) << "x";
+    }
+    fs::last_write_time(dir / before_boot, fs::file_time_type::clock::now() - std::chrono::hours(24 * 365 * 20));
+
+    RemoveStaleSpillFiles();
+
+    EXPECT_TRUE(fs::exists(dir / alive));  // another instance between mkstemp() and unlink()
+    EXPECT_FALSE(fs::exists(dir / gone));
+    EXPECT_FALSE(fs::exists(dir / before_boot));
+    EXPECT_FALSE(fs::exists(dir / "whisper_spill_abc123"));
+    EXPECT_TRUE(fs::exists(dir / "something_else.pcm"));
+    EXPECT_TRUE(fs::exists(dir / "whisper_spil"));
+
+    // A take in progress isn't affected
+    PcmSpillFile file;
+    ASSERT_TRUE(file.Open());
+    short* block = file.AddBlock();
+    ASSERT_NE(block, nullptr);
+    block[0] = 42;
+    RemoveStaleSpillFiles();
+    EXPECT_EQ(block[0], 42);
+    EXPECT_EQ(OpenSpillFiles(), 1);
+}
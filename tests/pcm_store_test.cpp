@@ -0,0 +1,147 @@
+#include "pcm_store.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace
+{
+
+constexpr size_t BLOCK = PcmBlockPool::BLOCK_SAMPLES;
+
+std::vector<short> Ramp(size_t count, size_t start = 0)
+{
+    std::vector<short> pcm(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        pcm[i] = (short)((start + i) * 7);
+    }
+    return pcm;
+}
+
+std::vector<short> ReadBack(const PcmStore& store, size_t begin, size_t end)
+{
+    std::vector<short> out;
+    store.ForEachSpan(begin, end, [&](const short* pcm, size_t count) { out.insert(out.end(), pcm, pcm + count); });
+    return out;
+}
+
+}  // namespace
+
+TEST(PcmStore, GrowsOnlyAsAudioArrives)
+{
+    PcmBlockPool pool;
+    PcmStore store(pool);
+    EXPECT_EQ(pool.BlocksInUse(), 0u);
+
+    std::vector<short> second(100);
+    store.Append(second.data(), second.size());
+    EXPECT_EQ(pool.BlocksInUse(), 1u);
+
+    std::vector<short> more = Ramp(BLOCK * 2);
+    store.Append(more.data(), more.size());
+    EXPECT_EQ(store.Size(), BLOCK * 2 + 100);
+    EXPECT_EQ(pool.BlocksInUse(), 3u);
+    EXPECT_EQ(pool.HighWaterBytes(), 3 * PcmBlockPool::BLOCK_BYTES);
+}
+
+TEST(PcmStore, ReadsBackAcrossBlockBoundaries)
+{
+    PcmBlockPool pool;
+    PcmStore store(pool);
+
+    // Odd-sized appends, so they straddle blocks
+    std::vector<short> all = Ramp(BLOCK * 3 + 12345);
+    for (size_t at = 0; at < all.size();)
+    {
+        size_t n = std::min<size_t>(all.size() - at, 10007);
+        store.Append(all.data() + at, n);
+        at += n;
+    }
+
+    EXPECT_EQ(ReadBack(store, 0, store.Size()), all);
+
+    size_t begin = BLOCK - 5;
+    size_t end = 2 * BLOCK + 5;
+    EXPECT_EQ(ReadBack(store, begin, end), std::vector<short>(all.begin() + begin, all.begin() + end));
+
+    // Past the end is clipped
+    EXPECT_EQ(ReadBack(store, all.size() - 3, all.size() + 100).size(), 3u);
+
+    int spans = 0;
+    store.ForEachSpan(0, store.Size(), [&](const short*, size_t) { ++spans; });
+    EXPECT_EQ(spans, 4);
+}
+
+TEST(PcmStore, RecyclesBlocksAcrossTakes)
+{
+    PcmBlockPool pool;
+    std::vector<short> take = Ramp(BLOCK * 4 - 1);
+    {
+        PcmStore store(pool);
+        store.Append(take.data(), take.size());
+        EXPECT_EQ(pool.BlocksAllocatedTotal(), 4u);
+        store.Clear();
+        EXPECT_EQ(pool.BlocksInUse(), 0u);
+        EXPECT_EQ(pool.BlocksFree(), 4u);
+
+        // The same take again costs no allocations
+        store.Append(take.data(), take.size());
+        EXPECT_EQ(pool.BlocksAllocatedTotal(), 4u);
+        EXPECT_EQ(ReadBack(store, 0, store.Size()), take);
+    }
+
+    // The destructor gives them back too, and another store picks them up
+    EXPECT_EQ(pool.BlocksFree(), 4u);
+    PcmStore other(pool);
+    other.Append(take.data(), BLOCK);
+    EXPECT_EQ(pool.BlocksAllocatedTotal(), 4u);
+    EXPECT_EQ(pool.BlocksFree(), 3u);
+}
+
+TEST(PcmStore, HighWaterMarkTracksTheLongestTake)
+{
+    PcmBlockPool pool;
+    PcmStore store(pool);
+
+    std::vector<short> short_take = Ramp(BLOCK / 2);
+    std::vector<short> long_take = Ramp(BLOCK * 5);
+
+    for (int i = 0; i < 10; ++i)
+    {
+        store.Append(short_take.data(), short_take.size());
+        store.Clear();
+    }
+    EXPECT_EQ(pool.HighWaterBytes(), PcmBlockPool::BLOCK_BYTES);
+
+    store.Append(long_take.data(), long_take.size());
+    store.Clear();
+    EXPECT_EQ(pool.HighWaterBytes(), 5 * PcmBlockPool::BLOCK_BYTES);
+    EXPECT_EQ(pool.BlocksAllocatedTotal(), 5u);
+
+    // More short takes don't move it
+    for (int i = 0; i < 10; ++i)
+    {
+        store.Append(short_take.data(), short_take.size());
+        store.Clear();
+    }
+    EXPECT_EQ(pool.HighWaterBytes(), 5 * PcmBlockPool::BLOCK_BYTES);
+    EXPECT_EQ(pool.BlocksAllocatedTotal(), 5u);
+}
+
+TEST(PcmStore, TrimFreeBlocksBoundsWhatStaysResident)
+{
+    PcmBlockPool pool;
+    PcmStore store(pool);
+    std::vector<short> take = Ramp(BLOCK * 6);
+    store.Append(take.data(), take.size());
+    store.Clear();
+    EXPECT_EQ(pool.BlocksFree(), 6u);
+
+    pool.TrimFreeBlocks(2);
+    EXPECT_EQ(pool.BlocksFree(), 2u);
+
+    // Beyond what was kept, blocks are allocated again
+    store.Append(take.data(), take.size());
+    EXPECT_EQ(pool.BlocksAllocatedTotal(), 10u);
+}
@@ -0,0 +1,202 @@
+#include "postprocess_cache.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+const std::string OLLAMA = "http://localhost:11434/api/generate";
+const std::string OTHER_SERVER = "http://gpu-box:11434/api/generate";
+const std::string PROMPT = "Fix the punctuation of: {{transcript}}";
+
+PostProcessCache::Entry Result(const std::string& text, double seconds = 1.0)
+{
+    return { text, "", seconds };
+}
+
+// The text cached for `transcript` in the current context, or "(miss)"
+std::string Lookup(PostProcessCache* cache, const std::string& transcript)
+{
+    const PostProcessCache::Entry* entry = cache->Find(transcript);
+    return entry ? entry->processed_text : "(miss)";
+}
+
+class PostProcessCacheFile : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        dir = fs::temp_directory_path() / ("postprocess_cache_test_" + std::to_string(getpid()));
+        fs::create_directories(dir);
+        path = dir / "whisper_win32" / "postprocess_cache.bin";
+    }
+
+    void TearDown() override { fs::remove_all(dir); }
+
+    fs::path dir;
+    fs::path path;
+};
+
+}  // namespace
+
+TEST(PostProcessCache, NormalizesWhitespace)
+{
+    EXPECT_EQ(PostProcessCache::Normalize("  new   paragraph\r\n"), "new paragraph");
+    EXPECT_EQ(PostProcessCache::Normalize("a\tb"), "a b");
+    EXPECT_EQ(PostProcessCache::Normalize(" \n "), "");
+}
+
+TEST(PostProcessCache, HitsMissesAndSecondsSaved)
+{
+    PostProcessCache cache;
+    uint64_t context = cache.SetContext(OLLAMA, "llama3", PROMPT);
+    EXPECT_EQ(Lookup(&cache, "thanks bye"), "(miss)");
+    cache.Insert(context, "thanks bye", Result("Thanks, bye.", 0.8));
+    EXPECT_EQ(Lookup(&cache, " thanks  bye "), "Thanks, bye.");
+    EXPECT_EQ(cache.Hits(), 1);
+    EXPECT_EQ(cache.Lookups(), 2);
+    EXPECT_DOUBLE_EQ(cache.SecondsSaved(), 0.8);
+    EXPECT_TRUE(cache.Dirty());
+
+    // Nothing to key an empty transcript by
+    cache.Insert(context, "   ", Result("x"));
+    EXPECT_EQ(cache.Size(), 1u);
+}
+
+TEST(PostProcessCache, EachEndpointModelAndPromptKeepsItsOwn)
+{
+    PostProcessCache cache;
+    uint64_t llama = cache.SetContext(OLLAMA, "llama3", PROMPT);
+    cache.Insert(llama, "new paragraph", Result("\n\n"));
+
+    uint64_t qwen = cache.SetContext(OLLAMA, "qwen2.5", PROMPT);
+    EXPECT_NE(qwen, llama);
+    EXPECT_EQ(Lookup(&cache, "new paragraph"), "(miss)");
+    cache.Insert(qwen, "new paragraph", Result("\n"));
+
+    uint64_t elsewhere = cache.SetContext(OTHER_SERVER, "llama3", PROMPT);
+    EXPECT_NE(elsewhere, llama);
+    EXPECT_EQ(Lookup(&cache, "new paragraph"), "(miss)");
+    EXPECT_NE(cache.SetContext(OLLAMA, "llama3", PROMPT + "!"), llama);
+    EXPECT_EQ(Lookup(&cache, "new paragraph"), "(miss)");
+
+    // Switching back finds what was there
+    EXPECT_EQ(cache.SetContext(OLLAMA, "llama3", PROMPT), llama);
+    EXPECT_EQ(Lookup(&cache, "new paragraph"), "\n\n");
+    cache.SetContext(OLLAMA, "qwen2.5", PROMPT);
+    EXPECT_EQ(Lookup(&cache, "new paragraph"), "\n");
+    EXPECT_EQ(cache.Size(), 2u);
+
+    // The fields can't run into each other
+    EXPECT_NE(cache.SetContext("ab", "c", PROMPT), cache.SetContext("a", "bc", PROMPT));
+}
+
+TEST(PostProcessCache, ResultGoesUnderTheContextItWasAskedIn)
+{
+    PostProcessCache cache;
+    uint64_t asked_in = cache.SetContext(OLLAMA, "llama3", PROMPT);
+    cache.SetContext(OLLAMA, "qwen2.5", PROMPT);  // changed while the request was out
+
+    cache.Insert(asked_in, "sign off", Result("Best regards"));
+    EXPECT_EQ(Lookup(&cache, "sign off"), "(miss)");
+    cache.SetContext(OLLAMA, "llama3", PROMPT);
+    EXPECT_EQ(Lookup(&cache, "sign off"), "Best regards");
+}
+
+TEST(PostProcessCache, EvictsTheLeastRecentlyUsedAcrossContexts)
+{
+    PostProcessCache cache(3);
+    uint64_t a = cache.SetContext(OLLAMA, "a", PROMPT);
+    uint64_t b = cache.SetContext(OLLAMA, "b", PROMPT);
+    cache.Insert(a, "one", Result("A1"));
+    cache.Insert(b, "one", Result("B1"));
+    cache.Insert(a, "two", Result("A2"));
+
+    // Using A1 makes B1 the oldest
+    cache.SetContext(OLLAMA, "a", PROMPT);
+    EXPECT_EQ(Lookup(&cache, "one"), "A1");
+    cache.Insert(b, "three", Result("B3"));
+    EXPECT_EQ(cache.Size(), 3u);
+
+    EXPECT_EQ(Lookup(&cache, "one"), "A1");
+    EXPECT_EQ(Lookup(&cache, "two"), "A2");
+    cache.SetContext(OLLAMA, "b", PROMPT);
+    EXPECT_EQ(Lookup(&cache, "one"), "(miss)");
+    EXPECT_EQ(Lookup(&cache, "three"), "B3");
+
+    // Replacing an entry doesn't grow it
+    cache.Insert(b, "three", Result("B3 again"));
+    EXPECT_EQ(cache.Size(), 3u);
+    EXPECT_EQ(Lookup(&cache, "three"), "B3 again");
+}
+
+TEST_F(PostProcessCacheFile, RoundTripKeepsContextsAndOrder)
+{
+    PostProcessCache cache;
+    EXPECT_FALSE(cache.Load(path));  // nothing there yet
+    uint64_t a = cache.SetContext(OLLAMA, "llama3", PROMPT);
+    uint64_t b = cache.SetContext(OTHER_SERVER, "llama3", PROMPT);
+    cache.Insert(a, "first", { "First.", "thought about it", 1.5 });
+    cache.Insert(b, "first", Result("FIRST"));
+    cache.Insert(a, "second", Result("Second."));
+    ASSERT_TRUE(cache.Save());
+    EXPECT_FALSE(cache.Dirty());
+
+    // Only room for the two most recent ones
+    PostProcessCache loaded(2);
+    ASSERT_TRUE(loaded.Load(path));
+    EXPECT_EQ(loaded.Size(), 2u);
+    EXPECT_FALSE(loaded.Dirty());
+    loaded.SetContext(OLLAMA, "llama3", PROMPT);
+    EXPECT_EQ(Lookup(&loaded, "second"), "Second.");
+    EXPECT_EQ(Lookup(&loaded, "first"), "(miss)");
+    loaded.SetContext(OTHER_SERVER, "llama3", PROMPT);
+    EXPECT_EQ(Lookup(&loaded, "first"), "FIRST");
+
+    PostProcessCache all;
+    ASSERT_TRUE(all.Load(path));
+    all.SetContext(OLLAMA, "llama3", PROMPT);
+    const PostProcessCache::Entry* entry = all.Find("first");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->reasoning_text, "thought about it");
+    EXPECT_DOUBLE_EQ(entry->seconds, 1.5);
+}
+
+TEST_F(PostProcessCacheFile, OldOrDamagedFilesAreIgnored)
+{
+    fs::create_directories(path.parent_path());
+
+    // A version 1 file: one context for the lot, without the endpoint in it
+    {
+        std::ofstream out(path, std::ios::binary);
+        uint32_t header[2] = { 0x43505057, 1 };
+        uint64_t context = 42;
+        uint32_t count = 0;
+        out.write((const char*)header, sizeof(header));
+        out.write((const char*)&context, sizeof(context));
+        out.write((const char*)&count, sizeof(count));
+    }
+    PostProcessCache cache;
+    EXPECT_FALSE(cache.Load(path));
+    EXPECT_EQ(cache.Size(), 0u);
+
+    // Cut off halfway through the last entry: the ones before it survive
+    uint64_t context = cache.SetContext(OLLAMA, "llama3", PROMPT);
+    cache.Insert(context, "one", Result("One."));
+    cache.Insert(context, "two", Result("Two."));
+    ASSERT_TRUE(cache.Save());
+    fs::resize_file(path, fs::file_size(path) - 5);
+
+    PostProcessCache truncated;
+    ASSERT_TRUE(truncated.Load(path));
+    truncated.SetContext(OLLAMA, "llama3", PROMPT);
+    EXPECT_EQ(truncated.Size(), 1u);
+    EXPECT_EQ(Lookup(&truncated, "two"), "Two.");
+}
@@ -0,0 +1,265 @@
+#include "mock_server.hpp"
+#include "realtime_session.hpp"
+
+#include "json.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+using nlohmann::json;
+
+// What a session's handlers were told, from its thread
+struct Events
+{
+    void Add(const std::string& event)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+        changed.notify_all();
+    }
+
+    // Waits until `count` events are in; false on timeout
+    bool WaitFor(size_t count, int timeout_ms = 5000)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return events.size() >= count; });
+    }
+
+    std::vector<std::string> Get()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return events;
+    }
+
+    RealtimeSession::Handlers Handlers()
+    {
+        RealtimeSession::Handlers handlers;
+        handlers.on_committed = [this](const std::string& item_id) { Add("committed " + item_id); };
+        handlers.on_delta = [this](const std::string& item_id, const std::string& delta) { Add("delta " + item_id + " " + delta); };
+        handlers.on_completed = [this](const std::string& item_id, const std::string& text) { Add("completed " + item_id + " " + text); };
+        handlers.on_error = [this](const std::string& message) { Add("error " + message); };
+        return handlers;
+    }
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::string> events;
+};
+
+double MsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+std::string WsUrl(const MockServer& server, const std::string& path)
+{
+    return "ws://127.0.0.1:" + std::to_string(server.Port()) + path;
+}
+
+bool CurlHasWebSockets()
+{
+    const curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+    for (const char* const* protocol = info->protocols; *protocol; ++protocol)
+    {
+        if (strcmp(*protocol, "ws") == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+// A transcription server in the shape of OpenAI's: commits are confirmed in order, but the second
+// chunk's transcript is done before the first one's, so only the item ids tell them apart.
+TEST(RealtimeSession, TranscriptsComeBackUnderTheirItemIds)
+{
+    if (!CurlHasWebSockets())
+    {
+        GTEST_SKIP() << "libcurl without WebSocket support";
+    }
+
+    std::mutex mutex;
+    MockRequest upgrade;
+    json session_update;
+    size_t audio_bytes = 0;
+    MockServer server([&](const MockRequest& request)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            upgrade = request;
+        }
+        MockResponse response;
+        response.websocket = [&](MockWebSocket& socket)
+        {
+            std::string message;
+            int commits = 0;
+            while (socket.Receive(&message))
+            {
+                json event = json::parse(message);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (event["type"] == "transcription_session.update")
+                {
+                    session_update = event;
+                }
+                else if (event["type"] == "input_audio_buffer.append")
+                {
+                    audio_bytes += event["audio"].get<std::string>().size() / 4 * 3;
+                }
+                else if (event["type"] == "input_audio_buffer.commit")
+                {
+                    commits += 1;
+                    std::string item = "item_" + std::to_string(commits);
+                    socket.Send(json{ { "type", "input_audio_buffer.committed" }, { "item_id", item } }.dump());
+                }
+                if (commits == 2)
+                {
+                    for (const char* reply : {
+                        R"({"type":"conversation.item.input_audio_transcription.delta","item_id":"item_2","delta":"second"})",
+                        R"({"type":"conversation.item.input_audio_transcription.completed","item_id":"item_2","transcript":"Second chunk."})",
+                        R"({"type":"conversation.item.input_audio_transcription.delta","item_id":"item_1","delta":"first"})",
+                        R"({"type":"conversation.item.input_audio_transcription.completed","item_id":"item_1","transcript":"First chunk."})",
+                    })
+                    {
+                        socket.Send(reply);
+                    }
+                    commits += 1;
+                }
+            }
+        };
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+
+    Events events;
+    RealtimeSession session;
+    session.Start(WsUrl(server, "/v1/realtime?intent=transcription"), "sk-test", "gpt-4o-transcribe", "Names: Ada.", events.Handlers());
+    std::vector<short> pcm(RealtimeSession::SAMPLE_RATE / 10, 1000);
+    for (int chunk = 0; chunk < 2; ++chunk)
+    {
+        for (int i = 0; i < 5; ++i)
+        {
+            session.SendAudio(pcm.data(), pcm.size());
+        }
+        session.Commit();
+    }
+
+    ASSERT_TRUE(events.WaitFor(6));
+    session.Close();
+    EXPECT_EQ(events.Get(), (std::vector<std::string>{
+        "committed item_1",
+        "committed item_2",
+        "delta item_2 second",
+        "completed item_2 Second chunk.",
+        "delta item_1 first",
+        "completed item_1 First chunk.",
+    }));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(upgrade.path, "/v1/realtime?intent=transcription");
+    EXPECT_EQ(upgrade.Header("authorization"), "Bearer sk-test");
+    EXPECT_EQ(upgrade.Header("openai-beta"), "realtime=v1");
+    EXPECT_EQ(session_update["session"]["input_audio_format"], "pcm16");
+    EXPECT_EQ(session_update["session"]["input_audio_transcription"]["model"], "gpt-4o-transcribe");
+    EXPECT_EQ(session_update["session"]["input_audio_transcription"]["prompt"], "Names: Ada.");
+    EXPECT_TRUE(session_update["session"]["turn_detection"].is_null());
+    EXPECT_EQ(audio_bytes, 10 * pcm.size() * sizeof(short));
+}
+
+TEST(RealtimeSession, ServerErrorFailsTheSession)
+{
+    if (!CurlHasWebSockets())
+    {
+        GTEST_SKIP() << "libcurl without WebSocket support";
+    }
+
+    MockServer server([](const MockRequest&)
+    {
+        MockResponse response;
+        response.websocket = [](MockWebSocket& socket)
+        {
+            std::string message;
+            socket.Receive(&message);  // the session update
+            socket.Send(R"({"type":"error","error":{"type":"invalid_request_error","message":"Unknown model"}})");
+            while (socket.Receive(&message))
+            {
+            }
+        };
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+
+    Events events;
+    RealtimeSession session;
+    session.Start(WsUrl(server, "/v1/realtime"), "", "no-such-model", "", events.Handlers());
+    ASSERT_TRUE(events.WaitFor(1));
+    session.Close();
+    EXPECT_EQ(events.Get(), std::vector<std::string>{ "error Unknown model" });
+}
+
+TEST(RealtimeSession, ServerHangingUpFailsTheSession)
+{
+    if (!CurlHasWebSockets())
+    {
+        GTEST_SKIP() << "libcurl without WebSocket support";
+    }
+
+    MockServer server([](const MockRequest&)
+    {
+        MockResponse response;
+        response.websocket = [](MockWebSocket& socket) { socket.Close(); };
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+
+    Events events;
+    RealtimeSession session;
+    session.Start(WsUrl(server, "/v1/realtime"), "", "whisper-1", "", events.Handlers());
+    ASSERT_TRUE(events.WaitFor(1));
+    session.Close();
+    ASSERT_EQ(events.Get().size(), 1u);
+    EXPECT_EQ(events.Get()[0].rfind("error ", 0), 0u);
+}
+
+// The recorder asks a session to close from the HTTP loop thread and collects it elsewhere; a
+// session still waiting for the server to take the upgrade mustn't hold up the first, nor the
+// second for long. curl looks in on the connection about once a second while nothing happens.
+TEST(RealtimeSession, CloseGivesUpOnAConnectionInProgress)
+{
+    if (!CurlHasWebSockets())
+    {
+        GTEST_SKIP() << "libcurl without WebSocket support";
+    }
+
+    MockServer server([](const MockRequest&)
+    {
+        MockResponse response;
+        response.delay_ms = 3000;
+        response.websocket = [](MockWebSocket&) {};
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+
+    Events events;
+    RealtimeSession session;
+    session.Start(WsUrl(server, "/v1/realtime"), "", "whisper-1", "", events.Handlers());
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    Clock::time_point start = Clock::now();
+    session.RequestClose();
+    EXPECT_LT(MsSince(start), 50.0);
+    session.Close();
+    EXPECT_LT(MsSince(start), 1500.0);
+    EXPECT_TRUE(events.Get().empty());  // closing isn't an error
+}
@@ -0,0 +1,185 @@
+// Encoding the 44.1 kHz capture as it is, vs resampling it to 16 kHz first: encode time, upload
+// size and, given a Whisper endpoint, whether the transcripts come out the same.
+//
+//   resample_benchmark [--quick] [--whisper http://host:port/v1/audio/transcriptions] [fixture.wav...]
+//
+// Without fixtures it makes up a small corpus of synthetic takes. Encodes to MP3 when LAME was
+// found, to WAV otherwise (then the time is all resampling and the size is just the sample count).
+
+#include "bench_util.hpp"
+#include "file_audio_source.hpp"
+#include "resampler.hpp"
+#include "test_audio.hpp"
+#include "wav_encoder.hpp"
+
+#ifdef HAVE_LAME
+#include "mp3_encoder.hpp"
+#endif
+
+#include <cstdio>
+#include <memory>
+
+namespace
+{
+
+constexpr int CAPTURE_RATE = 44100;
+constexpr int PIPELINE_RATE = 16000;
+
+struct Fixture
+{
+    std::string name;
+    std::vector<short> pcm;
+    int sample_rate;
+};
+
+std::unique_ptr<AudioEncoder> MakeEncoder()
+{
+#ifdef HAVE_LAME
+    return std::make_unique<Mp3StreamEncoder>();
+#else
+    return std::make_unique<WavStreamEncoder>();
+#endif
+}
+
+std::vector<char> Encode(const std::vector<short>& pcm, int sample_rate)
+{
+    std::unique_ptr<AudioEncoder> encoder = MakeEncoder();
+    encoder->Start(sample_rate);
+    encoder->Encode(pcm.data(), pcm.size());
+    return encoder->Finish();
+}
+
+// The way the recorder feeds it: capture-sized chunks as they come in
+std::vector<short> Resample(const std::vector<short>& pcm, int sample_rate)
+{
+    PolyphaseResampler resampler;
+    resampler.Init(sample_rate, PIPELINE_RATE);
+    std::vector<short> out;
+    const size_t chunk = sample_rate / 50;
+    for (size_t at = 0; at < pcm.size(); at += chunk)
+    {
+        resampler.Process(pcm.data() + at, std::min(chunk, pcm.size() - at), &out);
+    }
+    resampler.Flush(&out);
+    return out;
+}
+
+std::vector<Fixture> SyntheticCorpus(bool quick)
+{
+    auto seconds = [](double s) { return (size_t)(s * CAPTURE_RATE); };
+    double scale = quick ? 0.1 : 1.0;
+
+    Fixture dictation{ "dictation", test_audio::Noise(seconds(1), 30, 1), CAPTURE_RATE };
+    test_audio::Append(&dictation.pcm, test_audio::Voice(seconds(20 * scale), CAPTURE_RATE, 6000, 2));
+    test_audio::Append(&dictation.pcm, test_audio::Noise(seconds(1), 30, 3));
+
+    Fixture noisy{ "noisy room", test_audio::Voice(seconds(30 * scale), CAPTURE_RATE, 4000, 4), CAPTURE_RATE };
+    std::vector<short> fan = test_audio::Noise(noisy.pcm.size(), 800, 5);
+    for (size_t i = 0; i < noisy.pcm.size(); ++i)
+    {
+        noisy.pcm[i] = (short)std::clamp(noisy.pcm[i] + fan[i], -32768, 32767);
+    }
+
+    Fixture meeting{ "meeting", {}, CAPTURE_RATE };
+    for (int turn = 0; turn < 12; ++turn)
+    {
+        test_audio::Append(&meeting.pcm, test_audio::Voice(seconds(9 * scale), CAPTURE_RATE, 3000 + 700 * (turn % 4), 10 + turn));
+        test_audio::Append(&meeting.pcm, test_audio::Noise(seconds(1 * scale), 40, 30 + turn));
+    }
+
+    return { dictation, noisy, meeting };
+}
+
+bool LoadFixture(const std::string& path, Fixture* fixture)
+{
+    FileAudioSource source(path, ReplayPacing::AsFastAsPossible);
+    if (!source.Open())
+    {
+        return false;
+    }
+    source.Start();
+    fixture->name = path;
+    fixture->sample_rate = source.SampleRate();
+    while (!source.Finished())
+    {
+        source.Read(&fixture->pcm);
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    const bool quick = bench::HasArg(argc, argv, "--quick");
+    const std::string whisper = bench::ArgValue(argc, argv, "--whisper");
+    const int runs = quick ? 1 : 5;
+
+    std::vector<Fixture> corpus;
+    for (const std::string& path : bench::Positional(argc, argv, { "--whisper" }))
+    {
+        Fixture fixture;
+        if (!LoadFixture(path, &fixture))
+        {
+            fprintf(stderr, "can't read %s\n", path.c_str());
+            return 1;
+        }
+        corpus.push_back(std::move(fixture));
+    }
+    if (corpus.empty())
+    {
+        corpus = SyntheticCorpus(quick);
+    }
+
+    std::unique_ptr<HttpTransport> transport;
+    if (!whisper.empty())
+    {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        transport = std::make_unique<HttpTransport>();
+    }
+
+    printf("codec: %s, best of %d\n\n", MakeEncoder()->MimeType(), runs);
+    printf("%-14s %8s | %10s %10s | %10s %10s %10s | %6s %6s%s\n", "fixture", "seconds", "direct ms", "bytes", "resamp ms", "encode ms",
+        "bytes", "time", "size", whisper.empty() ? "" : " | transcript");
+
+    bool ok = true;
+    for (const Fixture& fixture : corpus)
+    {
+        std::vector<char> direct;
+        double direct_ms = bench::BestMs(runs, [&] { direct = Encode(fixture.pcm, fixture.sample_rate); });
+
+        std::vector<short> resampled;
+        double resample_ms = bench::BestMs(runs, [&] { resampled = Resample(fixture.pcm, fixture.sample_rate); });
+        std::vector<char> small;
+        double encode_ms = bench::BestMs(runs, [&] { small = Encode(resampled, PIPELINE_RATE); });
+
+        double total_ms = resample_ms + encode_ms;
+        printf("%-14s %8.1f | %10.1f %10zu | %10.1f %10.1f %10zu | %5.2fx %5.2fx", fixture.name.c_str(),
+            (double)fixture.pcm.size() / fixture.sample_rate, direct_ms, direct.size(), resample_ms, encode_ms, small.size(),
+            direct_ms / std::max(total_ms, 1e-3), (double)direct.size() / std::max<size_t>(small.size(), 1));
+
+        if (transport)
+        {
+            const char* file_name = MakeEncoder()->FileName();
+            const char* mime_type = MakeEncoder()->MimeType();
+            std::string a = bench::Transcribe(transport.get(), whisper, direct, file_name, mime_type);
+            std::string b = bench::Transcribe(transport.get(), whisper, small, file_name, mime_type);
+            printf(" | %s", a.empty() || b.empty() ? "request failed" : a == b ? "same" : "DIFFERENT");
+            if (a != b && !a.empty() && !b.empty())
+            {
+                printf("\n    44.1k: %s\n    16k:   %s", a.c_str(), b.c_str());
+            }
+        }
+        printf("\n");
+
+        // The 16 kHz file is never the bigger one
+        ok = ok && small.size() <= direct.size();
+    }
+
+    transport.reset();
+    if (!whisper.empty())
+    {
+        curl_global_cleanup();
+    }
+    return ok ? 0 : 1;
+}
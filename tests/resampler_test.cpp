@@ -0,0 +1,212 @@
+#include "kernel_variant.hpp"
+#include "resampler.hpp"
+#include "test_audio.hpp"
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <random>
+
+namespace
+{
+
+constexpr int CAPTURE_RATE = 44100;
+constexpr int PIPELINE_RATE = 16000;
+constexpr int TAPS = PolyphaseResampler::DEFAULT_TAPS_PER_PHASE;
+
+// The same filter and the same walk over the input as PolyphaseResampler, in doubles and without
+// any of the streaming bookkeeping, to hold the float kernels against.
+std::vector<short> ReferenceResample(const std::vector<short>& pcm, int in_rate, int out_rate)
+{
+    const int divisor = std::gcd(in_rate, out_rate);
+    const int up = out_rate / divisor;
+    const int down = in_rate / divisor;
+    const int length = up * TAPS;
+    const double center = (length - 1) / 2.0;
+    const double cutoff = 0.9 * 0.5 / std::max(up, down);
+    const double beta = 7.0;
+
+    auto bessel_i0 = [](double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 50 && term >= sum * 1e-12; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    };
+
+    std::vector<double> prototype(length);
+    double sum = 0.0;
+    for (int i = 0; i < length; i++)
+    {
+        double x = i - center;
+        double sinc = (x == 0.0) ? 1.0 : std::sin(2.0 * test_audio::PI * cutoff * x) / (2.0 * test_audio::PI * cutoff * x);
+        double r = x / (center + 1.0);
+        prototype[i] = sinc * bessel_i0(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel_i0(beta);
+        sum += prototype[i];
+    }
+
+    // History of taps-1 zeros in front, the half window of silence Flush() adds behind
+    std::vector<double> input(TAPS - 1, 0.0);
+    input.insert(input.end(), pcm.begin(), pcm.end());
+    input.resize(input.size() + TAPS / 2, 0.0);
+
+    std::vector<short> out;
+    size_t next_input = TAPS - 1;
+    int phase = 0;
+    while (next_input < input.size())
+    {
+        double total = 0.0;
+        for (int j = 0; j < TAPS; j++)
+        {
+            total += prototype[phase + (TAPS - 1 - j) * up] * up / sum * input[next_input - (TAPS - 1) + j];
+        }
+        out.push_back((short)std::clamp(std::lround(total), -32768L, 32767L));
+
+        phase += down;
+        next_input += phase / up;
+        phase %= up;
+    }
+    return out;
+}
+
+std::vector<short> Resample(const std::vector<short>& pcm, int in_rate, int out_rate)
+{
+    PolyphaseResampler resampler;
+    EXPECT_TRUE(resampler.Init(in_rate, out_rate));
+    std::vector<short> out;
+    resampler.Process(pcm.data(), pcm.size(), &out);
+    resampler.Flush(&out);
+    return out;
+}
+
+// Level of a tone through the resampler, in dB relative to what went in, away from the edges
+double GainDb(double hz, int in_rate, int out_rate)
+{
+    std::vector<short> tone = test_audio::Sine(in_rate, hz, in_rate, 10000.0);
+    std::vector<short> out = Resample(tone, in_rate, out_rate);
+    size_t edge = out_rate / 10;
+    double in_rms = test_audio::Rms(tone.data() + in_rate / 10, tone.size() - in_rate / 5);
+    double out_rms = test_audio::Rms(out.data() + edge, out.size() - 2 * edge - TAPS);
+    return 20.0 * std::log10(std::max(out_rms, 1e-3) / in_rms);
+}
+
+}  // namespace
+
+TEST(ResamplerKernels, MatchTheReferenceWithinOneLsb)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = test_audio::Voice(CAPTURE_RATE * 2, CAPTURE_RATE, 12000.0);
+    test_audio::Append(&pcm, test_audio::Noise(CAPTURE_RATE / 2, 9000.0, 4));
+    test_audio::Append(&pcm, std::vector<short>(2000, 32767));
+    test_audio::Append(&pcm, std::vector<short>(2000, -32768));
+
+    for (int in_rate : { 44100, 48000, 22050, 8000 })
+    {
+        std::vector<short> expected = ReferenceResample(pcm, in_rate, PIPELINE_RATE);
+        std::vector<short> actual = Resample(pcm, in_rate, PIPELINE_RATE);
+        ASSERT_EQ(actual.size(), expected.size()) << in_rate;
+        for (size_t i = 0; i < actual.size(); i++)
+        {
+            ASSERT_NEAR(actual[i], expected[i], 1) << in_rate << " Hz, sample " << i;
+        }
+    }
+}
+
+TEST(Resampler, OutputLengthFollowsTheRatio)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    for (size_t seconds : { 1, 7, 30 })
+    {
+        std::vector<short> pcm(CAPTURE_RATE * seconds);
+        PolyphaseResampler resampler;
+        ASSERT_TRUE(resampler.Init(CAPTURE_RATE, PIPELINE_RATE));
+        std::vector<short> out;
+        resampler.Process(pcm.data(), pcm.size(), &out);
+        // Without Flush() the output ends half a window early, no more
+        EXPECT_NEAR((double)out.size(), (double)PIPELINE_RATE * seconds, 1.0) << seconds << " s";
+        resampler.Flush(&out);
+        EXPECT_NEAR((double)out.size(), (double)PIPELINE_RATE * seconds + TAPS / 2.0 * PIPELINE_RATE / CAPTURE_RATE, 1.0);
+    }
+}
+
+TEST(Resampler, SameRateIsPassedThrough)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = test_audio::Noise(5000, 3000.0);
+    PolyphaseResampler resampler;
+    ASSERT_TRUE(resampler.Init(PIPELINE_RATE, PIPELINE_RATE));
+    EXPECT_TRUE(resampler.IsPassthrough());
+    std::vector<short> out;
+    resampler.Process(pcm.data(), pcm.size(), &out);
+    resampler.Flush(&out);
+    EXPECT_EQ(out, pcm);
+}
+
+TEST(Resampler, KeepsSpeechBandAndRejectsWhatWouldAlias)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    for (double hz : { 200.0, 1000.0, 3400.0, 5000.0 })
+    {
+        EXPECT_NEAR(GainDb(hz, CAPTURE_RATE, PIPELINE_RATE), 0.0, 0.1) << hz << " Hz";
+    }
+    // Above the 8 kHz output Nyquist: these would fold back into the speech band
+    for (double hz : { 9000.0, 12000.0, 15000.0, 20000.0 })
+    {
+        EXPECT_LT(GainDb(hz, CAPTURE_RATE, PIPELINE_RATE), -50.0) << hz << " Hz";
+    }
+}
+
+TEST(Resampler, ChunkingDoesNotChangeTheOutput)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = test_audio::Voice(CAPTURE_RATE * 3, CAPTURE_RATE);
+    std::vector<short> expected = Resample(pcm, CAPTURE_RATE, PIPELINE_RATE);
+
+    std::mt19937 rng(9);
+    PolyphaseResampler resampler;
+    ASSERT_TRUE(resampler.Init(CAPTURE_RATE, PIPELINE_RATE));
+    std::vector<short> out;
+    for (size_t at = 0; at < pcm.size();)
+    {
+        size_t n = std::min<size_t>(pcm.size() - at, rng() % 2000);
+        resampler.Process(pcm.data() + at, n, &out);
+        at += n;
+    }
+    resampler.Flush(&out);
+    EXPECT_EQ(out, expected);
+}
+
+TEST(Resampler, ResetStartsFromSilence)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = test_audio::Voice(CAPTURE_RATE, CAPTURE_RATE);
+    PolyphaseResampler resampler;
+    ASSERT_TRUE(resampler.Init(CAPTURE_RATE, PIPELINE_RATE));
+
+    std::vector<short> first;
+    resampler.Process(pcm.data(), pcm.size() / 3, &first);
+    resampler.Reset();
+
+    std::vector<short> out;
+    resampler.Process(pcm.data(), pcm.size(), &out);
+    resampler.Flush(&out);
+    EXPECT_EQ(out, Resample(pcm, CAPTURE_RATE, PIPELINE_RATE));
+}
+
+TEST(Resampler, RejectsNonsenseRates)
+{
+    PolyphaseResampler resampler;
+    EXPECT_FALSE(resampler.Init(0, PIPELINE_RATE));
+    EXPECT_FALSE(resampler.Init(CAPTURE_RATE, -1));
+    EXPECT_FALSE(resampler.Init(CAPTURE_RATE, PIPELINE_RATE, 0));
+}
@@ -0,0 +1,82 @@
+// What the rewrite rules cost on the transcripts they stand in for the post-process model on: the
+// default prompt's two examples, and a longer dictation with addresses in it. Printed per
+// transcript: its size, the time per rewrite and whether the model would still be asked.
+//
+//   rewrite_rules_benchmark [--quick] [rules.txt]
+//
+// Uses the shipped rewrite_rules.txt unless given another file.
+
+#include "bench_util.hpp"
+#include "rewrite_rules.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct Transcript
+{
+    std::string name;
+    std::string text;
+    std::string expected;  // empty: not checked
+};
+
+std::vector<Transcript> Corpus()
+{
+    std::vector<Transcript> corpus = {
+        { "prompt example 1", "http colon slash slash example dot com", "http://example.com" },
+        { "prompt example 2", "visit w w w dot github dot com", "visit www.github.com" },
+    };
+
+    // About 800 bytes of dictation, an address or two per sentence
+    std::string dictation;
+    while (dictation.size() < 800)
+    {
+        dictation += "The docs are at https colon slash slash example dot com slash docs, and the code is on "
+                     "w w w dot github dot com slash example. Send the polka dot dress photos to my underscore "
+                     "folder slash pictures. ";
+    }
+    corpus.push_back({ "dictation", dictation, "" });
+    return corpus;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    const bool quick = bench::HasArg(argc, argv, "--quick");
+    std::vector<std::string> files = bench::Positional(argc, argv, {});
+    const std::string path = files.empty() ? std::string(REWRITE_RULES_FILE) : files[0];
+    const int runs = quick ? 100 : 10000;
+
+    RewriteRules rules;
+    std::string error;
+    bench::Stopwatch load;
+    if (!rules.LoadFile(path, &error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    printf("%s loaded in %.3f ms\n\n", path.c_str(), load.Ms());
+    printf("%-18s %8s %10s %14s %8s\n", "transcript", "bytes", "rewrites", "us / rewrite", "model");
+
+    bool ok = true;
+    for (const Transcript& transcript : Corpus())
+    {
+        RewriteRules::Result result = rules.Rewrite(transcript.text);
+        double best_ms = bench::BestMs(runs, [&] { result = rules.Rewrite(transcript.text); });
+        bool model = result.rewrites == 0 || result.needs_model;  // the recorder's test
+        printf("%-18s %8zu %10d %14.2f %8s\n", transcript.name.c_str(), transcript.text.size(), result.rewrites,
+            best_ms * 1000.0, model ? "asked" : "skipped");
+
+        if (!transcript.expected.empty() && (result.text != transcript.expected || model))
+        {
+            fprintf(stderr, "%s: got \"%s\", expected \"%s\" without the model\n", transcript.name.c_str(), result.text.c_str(),
+                transcript.expected.c_str());
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
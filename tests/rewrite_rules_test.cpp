@@ -0,0 +1,118 @@
+#include "rewrite_rules.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace
+{
+
+// The rules the recorder ships with
+RewriteRules ShippedRules()
+{
+    RewriteRules rules;
+    std::string error;
+    EXPECT_TRUE(rules.LoadFile(REWRITE_RULES_FILE, &error)) << error;
+    return rules;
+}
+
+RewriteRules Rules(const std::string& text)
+{
+    RewriteRules rules;
+    std::string error;
+    EXPECT_TRUE(rules.Load(text, &error)) << error;
+    return rules;
+}
+
+struct Case
+{
+    const char* transcript;
+    const char* text;
+    int rewrites;
+    bool needs_model;
+};
+
+}  // namespace
+
+// Dictated addresses come out as the default prompt's examples say they should, without the
+// model; anything the rules can't be sure about goes to it untouched.
+TEST(RewriteRules, ShippedRulesCorpus)
+{
+    RewriteRules rules = ShippedRules();
+    const Case corpus[] = {
+        // The default prompt's examples
+        { "http colon slash slash example dot com", "http://example.com", 2, false },
+        { "visit w w w dot github dot com", "visit www.github.com", 3, false },
+        { "w w w dot github dot com", "www.github.com", 3, false },
+
+        // Paths and more of an address
+        { "https colon slash slash example dot com slash docs slash api", "https://example.com/docs/api", 4, false },
+        { "Open C colon backslash Windows", "Open C colon\\Windows", 1, true },
+        { "my underscore file dot txt", "my_file.txt", 2, false },
+        { "HTTP COLON SLASH SLASH Example Dot Org.", "HTTP://Example.Org.", 2, false },
+
+        // "dot" and "slash" in a sentence are only words
+        { "a polka dot dress", "a polka dot dress", 0, true },
+        { "add a slash between them", "add a slash between them", 0, true },
+        { "polka dot dress, then w w w dot github dot com", "polka dot dress, then www.github.com", 3, true },
+        { "example dot com", "example dot com", 0, true },
+
+        // Nothing joins "w w w" to "and", so "dot" isn't in an address
+        { "w w w and dot products", "www and dot products", 1, true },
+
+        // Nothing to rewrite; the recorder still asks the model about these
+        { "new paragraph thanks", "new paragraph thanks", 0, false },
+        { "meet me at noon", "meet me at noon", 0, true },
+        { "", "", 0, false },
+    };
+    for (const Case& expected : corpus)
+    {
+        RewriteRules::Result result = rules.Rewrite(expected.transcript);
+        EXPECT_EQ(result.text, expected.text) << expected.transcript;
+        EXPECT_EQ(result.rewrites, expected.rewrites) << expected.transcript;
+        EXPECT_EQ(result.needs_model, expected.needs_model) << expected.transcript;
+    }
+}
+
+TEST(RewriteRules, LongestMatchFromTheLeftmostWord)
+{
+    RewriteRules rules = Rules(
+        "new line => ~\\n~\n"
+        "new paragraph => ~\\n\\n~\n"
+        "line break => ~<br>\n");
+
+    // "new line" and "line break" overlap; the one starting first wins
+    EXPECT_EQ(rules.Rewrite("one new line break two").text, "one\nbreak two");
+    EXPECT_EQ(rules.Rewrite("one new paragraph two").text, "one\n\ntwo");
+    EXPECT_EQ(rules.Rewrite("a line break").text, "a<br>");
+}
+
+TEST(RewriteRules, AddressRulesNeedAnotherRewriteNearby)
+{
+    RewriteRules rules = Rules(
+        "at sign => ~@~\n"
+        "@ dot => ~.~\n");
+    EXPECT_EQ(rules.Rewrite("mail ada at sign example dot com").text, "mail ada@example.com");
+    EXPECT_EQ(rules.Rewrite("ada at sign example dot co dot uk").text, "ada@example.co.uk");
+
+    // One word too far, or punctuation in between
+    RewriteRules::Result result = rules.Rewrite("ada at sign example now dot com");
+    EXPECT_EQ(result.text, "ada@example now dot com");
+    EXPECT_TRUE(result.needs_model);
+    EXPECT_EQ(rules.Rewrite("ada at sign example, dot com").text, "ada@example, dot com");
+
+    // Either side will do
+    EXPECT_EQ(rules.Rewrite("example dot com at sign").text, "example.com@");
+}
+
+TEST(RewriteRules, BadLinesAreReported)
+{
+    RewriteRules rules;
+    std::string error;
+    EXPECT_FALSE(rules.Load("# fine\nnothing to do here\n", &error));
+    EXPECT_EQ(error.rfind("Rewrite rules line 2:", 0), 0u);
+    EXPECT_FALSE(rules.Load("@\n", &error));
+    EXPECT_FALSE(rules.Load(" => x\n", &error));
+    EXPECT_TRUE(rules.Load("\xEF\xBB\xBF? at\n", &error));
+    EXPECT_TRUE(rules.Rewrite("look at it").needs_model);
+}
@@ -0,0 +1,168 @@
+#include "http_transport.hpp"
+#include "mock_server.hpp"
+#include "sse_parser.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+using Event = std::pair<std::string, std::string>;  // event, data
+
+// What the parser makes of `stream` fed in pieces of `piece` bytes
+std::vector<Event> Parse(const std::string& stream, size_t piece)
+{
+    SseParser parser;
+    std::vector<Event> events;
+    for (size_t at = 0; at < stream.size(); at += piece)
+    {
+        parser.Feed(stream.data() + at, std::min(piece, stream.size() - at),
+            [&](const std::string& event, const std::string& data) { events.emplace_back(event, data); });
+    }
+    return events;
+}
+
+// The same, for every way of cutting it up
+std::vector<Event> ParseEveryWay(const std::string& stream)
+{
+    std::vector<Event> whole = Parse(stream, stream.size());
+    for (size_t piece = 1; piece < stream.size(); ++piece)
+    {
+        EXPECT_EQ(Parse(stream, piece), whole) << "in pieces of " << piece;
+    }
+    return whole;
+}
+
+}  // namespace
+
+TEST(SseParser, EventsAndDefaultName)
+{
+    std::vector<Event> events = ParseEveryWay(
+        "event: transcript.text.delta\n"
+        "data: {\"delta\":\"Hel\"}\n"
+        "\n"
+        "data: {\"delta\":\"lo\"}\n"
+        "\n");
+    EXPECT_EQ(events, (std::vector<Event>{
+        { "transcript.text.delta", "{\"delta\":\"Hel\"}" },
+        { "message", "{\"delta\":\"lo\"}" },  // the name doesn't carry over
+    }));
+}
+
+TEST(SseParser, LineEndingsCrLfAndCrlf)
+{
+    const std::vector<Event> expected = { { "a", "1" }, { "b", "2" } };
+    EXPECT_EQ(ParseEveryWay("event: a\ndata: 1\n\nevent: b\ndata: 2\n\n"), expected);
+    EXPECT_EQ(ParseEveryWay("event: a\rdata: 1\r\revent: b\rdata: 2\r\r"), expected);
+    EXPECT_EQ(ParseEveryWay("event: a\r\ndata: 1\r\n\r\nevent: b\r\ndata: 2\r\n\r\n"), expected);
+
+    // Mixed within one stream
+    EXPECT_EQ(ParseEveryWay("event: a\r\ndata: 1\n\revent: b\rdata: 2\r\n\n"), expected);
+
+    // A CRLF split across two writes is still one line break
+    SseParser parser;
+    std::vector<Event> events;
+    auto collect = [&](const std::string& event, const std::string& data) { events.emplace_back(event, data); };
+    parser.Feed("data: x\r", 8, collect);
+    parser.Feed("\n", 1, collect);  // not a blank line
+    EXPECT_TRUE(events.empty());
+    parser.Feed("\r\n", 2, collect);
+    EXPECT_EQ(events, (std::vector<Event>{ { "message", "x" } }));
+}
+
+TEST(SseParser, CommentsAndOtherFieldsAreSkipped)
+{
+    EXPECT_EQ(ParseEveryWay(
+        ": keep-alive\n"
+        "\n"
+        "id: 7\n"
+        "retry: 1000\n"
+        ":comment in the middle\n"
+        "data: kept\n"
+        "unknown: field\n"
+        "\n"), (std::vector<Event>{ { "message", "kept" } }));
+
+    // An event with no data isn't dispatched
+    EXPECT_EQ(ParseEveryWay("event: ping\n\n: only a comment\n\n"), std::vector<Event>{});
+}
+
+TEST(SseParser, MultiLineDataAndSpacing)
+{
+    EXPECT_EQ(ParseEveryWay("data: first\ndata:second\ndata:  third\ndata\n\n"),
+        (std::vector<Event>{ { "message", "first\nsecond\n third\n" } }));
+    EXPECT_EQ(ParseEveryWay("data:\n\n"), (std::vector<Event>{ { "message", "" } }));
+    EXPECT_EQ(ParseEveryWay("data: a:b: c\n\n"), (std::vector<Event>{ { "message", "a:b: c" } }));
+}
+
+TEST(SseParser, UnfinishedEventIsDroppedOnReset)
+{
+    SseParser parser;
+    std::vector<Event> events;
+    auto collect = [&](const std::string& event, const std::string& data) { events.emplace_back(event, data); };
+    parser.Feed("event: a\ndata: half", 19, collect);
+    parser.Reset();
+    parser.Feed("data: whole\n\n", 13, collect);
+    EXPECT_EQ(events, (std::vector<Event>{ { "message", "whole" } }));
+}
+
+// A streamed transcription the way the recorder receives it: chunks that cut events (and CRLFs)
+// in half, arriving over time, with events handed out as soon as they're complete.
+TEST(SseParser, StreamedResponseFromTheServer)
+{
+    const std::vector<std::string> chunks = {
+        ": connected\r\n\r\nevent: transcript.text.delta\r\nda",
+        "ta: {\"delta\":\"Hello\"}\r",
+        "\n\r\nevent: transcript.text.delta\r\ndata: {\"delta\":\" world\"}\r\n\r\n",
+        "event: transcript.text.done\r\ndata: {\"text\":\"Hello world\"}\r\n\r\n",
+    };
+    MockServer server([&](const MockRequest&)
+    {
+        MockResponse response;
+        response.content_type = "text/event-stream";
+        response.chunks = chunks;
+        response.chunk_delay_ms = 100;
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+
+    struct Received
+    {
+        SseParser parser;
+        std::vector<Event> events;
+        std::vector<std::chrono::steady_clock::time_point> at;
+    } received;
+    CURL* curl = transport.Acquire(server.Url("/v1/audio/transcriptions"));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, +[](char* data, size_t size, size_t count, void* user)
+    {
+        Received* received = static_cast<Received*>(user);
+        received->parser.Feed(data, size * count, [&](const std::string& event, const std::string& text)
+        {
+            received->events.emplace_back(event, text);
+            received->at.push_back(std::chrono::steady_clock::now());
+        });
+        return size * count;
+    });
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &received);
+
+    HttpTimings timings;
+    CURLcode result = transport.Perform(curl, &timings);
+    transport.Release(curl);
+    ASSERT_EQ(result, CURLE_OK);
+
+    EXPECT_EQ(received.events, (std::vector<Event>{
+        { "transcript.text.delta", "{\"delta\":\"Hello\"}" },
+        { "transcript.text.delta", "{\"delta\":\" world\"}" },
+        { "transcript.text.done", "{\"text\":\"Hello world\"}" },
+    }));
+
+    // The first delta was complete with the third chunk, and handed out then rather than at the end
+    ASSERT_EQ(received.at.size(), 3u);
+    double first_to_last_ms = std::chrono::duration<double, std::milli>(received.at[2] - received.at[0]).count();
+    EXPECT_GE(first_to_last_ms, 80.0);
+}
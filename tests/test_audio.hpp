@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic audio for the tests and benchmarks, so none of them need recordings checked in.
+namespace test_audio
+{
+
+constexpr double PI = 3.14159265358979323846;
+
+inline std::vector<short> Sine(size_t count, double hz, int sample_rate, double amplitude = 8000.0)
+{
+    std::vector<short> pcm(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        pcm[i] = (short)std::lround(amplitude * std::sin(2.0 * PI * hz * (double)i / sample_rate));
+    }
+    return pcm;
+}
+
+inline std::vector<short> Noise(size_t count, double amplitude, uint32_t seed = 1)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> dist(0.0, amplitude);
+    std::vector<short> pcm(count);
+    for (short& s : pcm)
+    {
+        s = (short)std::clamp(std::lround(dist(rng)), -32768L, 32767L);
+    }
+    return pcm;
+}
+
+// Something speech-like enough for the VAD: a buzzy vowel with a wobbling pitch and a syllable-rate
+// envelope, over a little background noise.
+inline std::vector<short> Voice(size_t count, int sample_rate, double amplitude = 6000.0, uint32_t seed = 2)
+{
+    std::vector<short> pcm = Noise(count, amplitude / 40.0, seed);
+    double phase = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        double t = (double)i / sample_rate;
+        double pitch = 140.0 + 25.0 * std::sin(2.0 * PI * 3.0 * t);
+        phase += 2.0 * PI * pitch / sample_rate;
+        double envelope = 0.55 + 0.45 * std::sin(2.0 * PI * 4.0 * t);
+        double buzz = std::sin(phase) + 0.5 * std::sin(2.0 * phase) + 0.3 * std::sin(3.0 * phase) + 0.2 * std::sin(5.0 * phase);
+        pcm[i] = (short)std::clamp(std::lround(pcm[i] + amplitude * envelope * buzz / 2.0), -32768L, 32767L);
+    }
+    return pcm;
+}
+
+inline void Append(std::vector<short>* pcm, const std::vector<short>& more)
+{
+    pcm->insert(pcm->end(), more.begin(), more.end());
+}
+
+// 16-bit mono WAV
+inline std::vector<char> WavBytes(const std::vector<short>& pcm, int sample_rate)
+{
+    auto put32 = [](std::vector<char>* out, uint32_t v) { for (int i = 0; i < 4; ++i) out->push_back((char)(v >> (8 * i))); };
+    auto put16 = [](std::vector<char>* out, uint16_t v) { out->push_back((char)v); out->push_back((char)(v >> 8)); };
+
+    uint32_t data_bytes = (uint32_t)(pcm.size() * sizeof(short));
+    std::vector<char> out;
+    out.insert(out.end(), { 'R', 'I', 'F', 'F' });
+    put32(&out, 36 + data_bytes);
+    out.insert(out.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    put32(&out, 16);
+    put16(&out, 1);
+    put16(&out, 1);
+    put32(&out, (uint32_t)sample_rate);
+    put32(&out, (uint32_t)sample_rate * 2);
+    put16(&out, 2);
+    put16(&out, 16);
+    out.insert(out.end(), { 'd', 'a', 't', 'a' });
+    put32(&out, data_bytes);
+    size_t header = out.size();
+    out.resize(header + data_bytes);
+    memcpy(out.data() + header, pcm.data(), data_bytes);
+    return out;
+}
+
+inline bool WriteWav(const std::string& path, const std::vector<short>& pcm, int sample_rate)
+{
+    std::vector<char> bytes = WavBytes(pcm, sample_rate);
+    std::ofstream out(path, std::ios::binary);
+    out.write(bytes.data(), bytes.size());
+    return (bool)out;
+}
+
+inline double Rms(const short* pcm, size_t count)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        sum += (double)pcm[i] * pcm[i];
+    }
+    return count ? std::sqrt(sum / count) : 0.0;
+}
+
+}  // namespace test_audio
@@ -0,0 +1,224 @@
+// Stop-to-upload latency with and without streaming the upload. A take is "recorded" in real time
+// (encoded a capture poll at a time) and sent to a local sink; buffered, the upload only starts
+// once the encoder is finished, streamed, it starts with the first frames and stopping only has
+// to send the flush. Printed per uplink speed: when the sink saw the first body byte and when the
+// response was back, both from the moment recording stopped.
+//
+//   upload_stream_benchmark [--quick] [--seconds N] [--uplink-kbps N]
+
+#include "audio_encoder.hpp"
+#include "bench_util.hpp"
+#include "http_engine.hpp"
+#include "mock_server.hpp"
+#include "test_audio.hpp"
+#include "upload_stream.hpp"
+
+#ifdef HAVE_LAME
+#include "mp3_encoder.hpp"
+#elif defined(HAVE_OPUS)
+#include "opus_encoder.hpp"
+#endif
+
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <thread>
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int RATE = 16000;
+constexpr size_t POLL_SAMPLES = RATE / 10;  // CAPTURE_POLL_INTERVAL_MS worth
+
+// Without a streamable codec in the build, raw PCM frames stand in for the encoder's output; the
+// upload doesn't care what the bytes are.
+struct PcmFrames : AudioEncoder
+{
+    bool Start(int, std::vector<char> buffer = {}) override
+    {
+        output = std::move(buffer);
+        output.clear();
+        samples = 0;
+        return true;
+    }
+    bool Encode(const short* pcm, size_t count) override
+    {
+        output.insert(output.end(), (const char*)pcm, (const char*)(pcm + count));
+        samples += count;
+        return true;
+    }
+    std::vector<char> Finish() override { return std::move(output); }
+    size_t SamplesEncoded() const override { return samples; }
+    const std::vector<char>& Output() const override { return output; }
+    std::vector<char> TakeOutput(std::vector<char> next = {}) override
+    {
+        std::vector<char> taken = std::move(output);
+        output = std::move(next);
+        output.clear();
+        return taken;
+    }
+    AudioFormat Format() const override { return FORMAT_WAV; }  // near enough: PCM without the header
+    const char* FileName() const override { return "output.pcm"; }
+    const char* MimeType() const override { return "application/octet-stream"; }
+    size_t WorstCaseBytes(size_t count) const override { return count * sizeof(short); }
+
+    std::vector<char> output;
+    size_t samples = 0;
+};
+
+std::unique_ptr<AudioEncoder> MakeEncoder()
+{
+#ifdef HAVE_LAME
+    return std::make_unique<Mp3StreamEncoder>();
+#elif defined(HAVE_OPUS)
+    return std::make_unique<OpusStreamEncoder>();
+#else
+    return std::make_unique<PcmFrames>();
+#endif
+}
+
+double Ms(Clock::duration duration)
+{
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+struct Result
+{
+    double first_byte_ms = 0.0;  // negative: before the stop
+    double response_ms = 0.0;
+    size_t bytes = 0;
+};
+
+// Records `pcm` in real time and uploads it, streamed or not, the way the recorder does
+Result RecordAndUpload(const std::vector<short>& pcm, bool streamed, MockServer* server, HttpTransport* transport, HttpEngine* engine)
+{
+    std::unique_ptr<AudioEncoder> encoder = MakeEncoder();
+    encoder->Start(RATE);
+
+    UploadStream stream;
+    MemoryUploadReader reader;
+    std::vector<char> file;
+    CURL* curl = transport->Acquire(server->Url("/v1/audio/transcriptions"));
+    curl_mime* mime = curl_mime_init(curl);
+    curl_mimepart* file_part = curl_mime_addpart(mime);  // its data depends on the mode, below
+    curl_mime_name(file_part, "file");
+    curl_mime_filename(file_part, encoder->FileName());
+    curl_mime_type(file_part, encoder->MimeType());
+    curl_mimepart* part = curl_mime_addpart(mime);
+    curl_mime_name(part, "model");
+    curl_mime_data(part, "whisper-1", CURL_ZERO_TERMINATED);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, bench::AppendToString);
+    std::string response;
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+
+    std::promise<Clock::time_point> done;
+    auto submit = [&]
+    {
+        curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+        engine->Submit(curl, [&](CURLcode, const HttpTimings&) { done.set_value(Clock::now()); });
+    };
+
+    if (streamed)
+    {
+        stream.SetResumeHandler([&] { engine->Post([&] { curl_easy_pause(curl, CURLPAUSE_CONT); }); });
+        curl_mime_data_cb(file_part, -1, &UploadStream::ReadCallback, nullptr, nullptr, &stream);
+    }
+
+    bool submitted = false;
+    Clock::time_point next_poll = Clock::now();
+    for (size_t at = 0; at < pcm.size(); at += POLL_SAMPLES)
+    {
+        next_poll += std::chrono::milliseconds(100);
+        std::this_thread::sleep_until(next_poll);
+        encoder->Encode(pcm.data() + at, std::min(POLL_SAMPLES, pcm.size() - at));
+        if (streamed && !encoder->Output().empty())
+        {
+            stream.Append(encoder->TakeOutput(stream.TakeSpentBuffer()));
+            if (!submitted)
+            {
+                submit();
+                submitted = true;
+            }
+        }
+    }
+
+    Clock::time_point stopped = Clock::now();
+    if (streamed)
+    {
+        stream.Append(encoder->Finish());
+        stream.Finish();
+        if (!submitted)
+        {
+            submit();
+        }
+    }
+    else
+    {
+        file = encoder->Finish();
+        reader = { file.data(), file.size(), 0 };
+        curl_mime_data_cb(file_part, (curl_off_t)file.size(), &MemoryUploadReader::ReadCallback, &MemoryUploadReader::SeekCallback,
+            nullptr, &reader);
+        submit();
+    }
+
+    Result result;
+    result.response_ms = Ms(done.get_future().get() - stopped);
+    result.first_byte_ms = Ms(server->FirstBodyByteAt() - stopped);
+    result.bytes = streamed ? stream.BytesAppended() : file.size();
+
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, nullptr);
+    curl_mime_free(mime);
+    transport->Release(curl);
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    const bool quick = bench::HasArg(argc, argv, "--quick");
+    const double seconds = std::stod(bench::ArgValue(argc, argv, "--seconds", quick ? "2" : "20"));
+    const double uplink_kbps = std::stod(bench::ArgValue(argc, argv, "--uplink-kbps", "1000"));
+
+    MockServer server([](const MockRequest&)
+    {
+        MockResponse response;
+        response.body = "{\"text\":\"ok\"}";
+        return response;
+    });
+    if (!server.Start())
+    {
+        fprintf(stderr, "Failed to start the mock server\n");
+        return 1;
+    }
+    HttpTransport transport;
+    HttpEngine engine;
+    engine.Start();
+
+    std::vector<short> take = test_audio::Voice((size_t)(seconds * RATE), RATE);
+    printf("%.0f s take as %s, recorded in real time\n\n", seconds, MakeEncoder()->MimeType());
+    printf("%-10s %-10s %12s %18s %16s\n", "uplink", "upload", "bytes", "first byte (ms)", "response (ms)");
+
+    bool ok = true;
+    for (double kbps : { 0.0, uplink_kbps })
+    {
+        server.SetReadBytesPerSecond((size_t)(kbps * 1000 / 8));
+        for (bool streamed : { false, true })
+        {
+            Result result = RecordAndUpload(take, streamed, &server, &transport, &engine);
+            char uplink[32] = "LAN";
+            if (kbps > 0)
+            {
+                snprintf(uplink, sizeof(uplink), "%.0f kbps", kbps);
+            }
+            printf("%-10s %-10s %12zu %18.1f %16.1f\n", uplink, streamed ? "streamed" : "buffered", result.bytes,
+                result.first_byte_ms, result.response_ms);
+            ok = ok && result.bytes > 0;
+        }
+    }
+    printf("\nfirst byte < 0: the upload was under way before recording stopped\n");
+    return ok ? 0 : 1;
+}
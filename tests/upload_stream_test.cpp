@@ -0,0 +1,181 @@
+#include "http_engine.hpp"
+#include "mock_server.hpp"
+#include "upload_stream.hpp"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::vector<char> Bytes(const std::string& text)
+{
+    return std::vector<char>(text.begin(), text.end());
+}
+
+// One read callback call with a buffer of `room` bytes; the result as a string, or the
+// callback's special return value in `code`
+std::string Read(UploadStream* stream, size_t room, size_t* code = nullptr)
+{
+    std::vector<char> buffer(room);
+    size_t n = UploadStream::ReadCallback(buffer.data(), 1, room, stream);
+    if (code)
+    {
+        *code = n;
+    }
+    if (n == CURL_READFUNC_PAUSE || n == CURL_READFUNC_ABORT)
+    {
+        return {};
+    }
+    return std::string(buffer.data(), n);
+}
+
+}  // namespace
+
+TEST(UploadStream, ReadsChunksInOrderAcrossCallbacks)
+{
+    UploadStream stream;
+    stream.Append(Bytes("hello "));
+    stream.Append(Bytes("streaming "));
+    stream.Append({});  // ignored
+    stream.Append(Bytes("world"));
+    EXPECT_EQ(stream.BytesAppended(), 21u);
+
+    // Never past the end of a chunk, so the reader copies out of each one in place
+    EXPECT_EQ(Read(&stream, 4), "hell");
+    EXPECT_EQ(Read(&stream, 100), "o ");
+    EXPECT_EQ(Read(&stream, 100), "streaming ");
+    stream.Finish();
+    EXPECT_EQ(Read(&stream, 100), "world");
+
+    size_t code;
+    EXPECT_EQ(Read(&stream, 100, &code), "");
+    EXPECT_EQ(code, 0u);  // end of the body
+}
+
+TEST(UploadStream, PausesWhenCaughtUpAndWakesTheReader)
+{
+    UploadStream stream;
+    int wakeups = 0;
+    stream.SetResumeHandler([&] { ++wakeups; });
+
+    size_t code;
+    Read(&stream, 100, &code);
+    EXPECT_EQ(code, (size_t)CURL_READFUNC_PAUSE);
+
+    stream.Append(Bytes("frame"));
+    EXPECT_EQ(wakeups, 1);
+    stream.Append(Bytes("more"));
+    EXPECT_EQ(wakeups, 1);  // wasn't paused any more
+
+    EXPECT_EQ(Read(&stream, 100), "frame");
+    EXPECT_EQ(Read(&stream, 100), "more");
+    Read(&stream, 100, &code);
+    EXPECT_EQ(code, (size_t)CURL_READFUNC_PAUSE);
+    stream.Finish();
+    EXPECT_EQ(wakeups, 2);
+
+    // Nothing goes in once it's finished
+    stream.Append(Bytes("late"));
+    EXPECT_EQ(stream.BytesAppended(), 9u);
+}
+
+TEST(UploadStream, AbortFailsTheUpload)
+{
+    UploadStream stream;
+    int wakeups = 0;
+    stream.SetResumeHandler([&] { ++wakeups; });
+    stream.Append(Bytes("frame"));
+    stream.Abort();
+
+    size_t code;
+    Read(&stream, 100, &code);
+    EXPECT_EQ(code, (size_t)CURL_READFUNC_ABORT);
+    EXPECT_EQ(wakeups, 0);
+}
+
+TEST(UploadStream, HandsReadBuffersBackForReuse)
+{
+    UploadStream stream;
+    EXPECT_EQ(stream.TakeSpentBuffer().capacity(), 0u);
+
+    std::vector<char> big;
+    big.reserve(4096);
+    big.assign(100, 'x');
+    const char* storage = big.data();
+    stream.Append(std::move(big));
+    stream.Append(Bytes("small"));
+
+    // Not before it's been read all the way through
+    Read(&stream, 60);
+    EXPECT_EQ(stream.TakeSpentBuffer().capacity(), 0u);
+    Read(&stream, 60);
+    Read(&stream, 60);
+
+    // The roomiest of the read ones, i.e. the very allocation that went in
+    std::vector<char> spent = stream.TakeSpentBuffer();
+    EXPECT_TRUE(spent.empty());
+    EXPECT_GE(spent.capacity(), 4096u);
+    EXPECT_EQ(spent.data(), storage);
+    EXPECT_EQ(stream.TakeSpentBuffer().capacity(), 0u);
+}
+
+// The way the recorder uses it: the upload starts before the data is all there, pauses whenever
+// it catches up with the producer and goes on when the resume handler unpauses it.
+TEST(UploadStream, MultipartUploadWhileProducing)
+{
+    std::promise<MockRequest> received;
+    MockServer server([&](const MockRequest& request)
+    {
+        received.set_value(request);
+        MockResponse response;
+        response.body = "{\"text\":\"ok\"}";
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+    HttpTransport transport;
+    HttpEngine engine;
+    ASSERT_TRUE(engine.Start());
+
+    UploadStream stream;
+    CURL* curl = transport.Acquire(server.Url("/v1/audio/transcriptions"));
+    stream.SetResumeHandler([&] { engine.Post([&] { curl_easy_pause(curl, CURLPAUSE_CONT); }); });
+
+    curl_mime* mime = curl_mime_init(curl);
+    curl_mimepart* part = curl_mime_addpart(mime);
+    curl_mime_name(part, "file");
+    curl_mime_data_cb(part, -1, &UploadStream::ReadCallback, nullptr, nullptr, &stream);
+    curl_mime_filename(part, "output.mp3");
+    curl_mime_type(part, "audio/mpeg");
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+
+    std::promise<CURLcode> done;
+    engine.Submit(curl, [&](CURLcode result, const HttpTimings&) { done.set_value(result); });
+
+    std::string expected;
+    for (int frame = 0; frame < 50; ++frame)
+    {
+        std::string bytes = "frame " + std::to_string(frame) + std::string(1000, (char)('a' + frame % 26)) + "\n";
+        expected += bytes;
+        stream.Append(Bytes(bytes));
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    stream.Finish();
+
+    std::future<CURLcode> result = done.get_future();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    EXPECT_EQ(result.get(), CURLE_OK);
+
+    MockRequest request = received.get_future().get();
+    EXPECT_EQ(request.Header("transfer-encoding"), "chunked");
+    EXPECT_NE(request.body.find("filename=\"output.mp3\""), std::string::npos);
+    EXPECT_NE(request.body.find(expected), std::string::npos);
+
+    curl_mime_free(mime);
+    transport.Release(curl);
+}
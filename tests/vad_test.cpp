@@ -0,0 +1,216 @@
+#include "file_audio_source.hpp"
+#include "kernel_variant.hpp"
+#include "test_audio.hpp"
+#include "vad.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <random>
+
+namespace
+{
+
+constexpr int RATE = 16000;
+constexpr size_t FRAME = RATE * 20 / 1000;
+
+int64_t ReferenceSumOfSquares(const short* pcm, size_t count)
+{
+    int64_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        total += (int64_t)pcm[i] * pcm[i];
+    }
+    return total;
+}
+
+size_t ReferenceZeroCrossings(const short* pcm, size_t count)
+{
+    size_t crossings = 0;
+    for (size_t i = 1; i < count; ++i)
+    {
+        crossings += ((pcm[i - 1] < 0) != (pcm[i] < 0)) ? 1 : 0;
+    }
+    return crossings;
+}
+
+size_t Seconds(double seconds)
+{
+    return (size_t)(seconds * RATE);
+}
+
+// 1 s of room noise, 2 s of talking, a 3 s pause, 1.5 s more talking, 1 s of room noise
+std::vector<short> Dictation()
+{
+    std::vector<short> pcm = test_audio::Noise(Seconds(1), 30, 11);
+    test_audio::Append(&pcm, test_audio::Voice(Seconds(2), RATE, 6000, 12));
+    test_audio::Append(&pcm, test_audio::Noise(Seconds(3), 30, 13));
+    test_audio::Append(&pcm, test_audio::Voice(Seconds(1.5), RATE, 6000, 14));
+    test_audio::Append(&pcm, test_audio::Noise(Seconds(1), 30, 15));
+    return pcm;
+}
+
+// Through a WAV file and the replay source, the way a fixture recording would come in
+std::vector<short> LoadFixture(const std::string& name, const std::vector<short>& pcm)
+{
+    std::filesystem::path path = std::filesystem::temp_directory_path() / ("vad_fixture_" + name + "_" KERNEL_VARIANT ".wav");
+    EXPECT_TRUE(test_audio::WriteWav(path.string(), pcm, RATE));
+
+    FileAudioSource source(path.string(), ReplayPacing::AsFastAsPossible);
+    EXPECT_TRUE(source.Open());
+    EXPECT_EQ(source.SampleRate(), RATE);
+    source.Start();
+    std::vector<short> loaded;
+    while (!source.Finished())
+    {
+        source.Read(&loaded);
+    }
+    std::filesystem::remove(path);
+    return loaded;
+}
+
+void ExpectNear(size_t actual, double expected_seconds, const char* what)
+{
+    EXPECT_NEAR((double)actual, (double)Seconds(expected_seconds), 2.0 * FRAME) << what;
+}
+
+}  // namespace
+
+TEST(VadKernels, MatchPlainArithmetic)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::mt19937 rng(3);
+    std::vector<short> pcm(1000);
+    for (short& s : pcm)
+    {
+        s = (short)(rng() & 0xFFFF);
+    }
+
+    // Every length around the vector widths, from every alignment
+    for (size_t offset = 0; offset < 16; ++offset)
+    {
+        for (size_t count = 0; count < 80; ++count)
+        {
+            const short* p = pcm.data() + offset;
+            ASSERT_EQ(PcmSumOfSquares(p, count), ReferenceSumOfSquares(p, count)) << offset << "+" << count;
+            ASSERT_EQ(PcmZeroCrossings(p, count), ReferenceZeroCrossings(p, count)) << offset << "+" << count;
+        }
+    }
+    EXPECT_EQ(PcmSumOfSquares(pcm.data(), pcm.size()), ReferenceSumOfSquares(pcm.data(), pcm.size()));
+    EXPECT_EQ(PcmZeroCrossings(pcm.data(), pcm.size()), ReferenceZeroCrossings(pcm.data(), pcm.size()));
+}
+
+TEST(VadKernels, FullScaleDoesNotOverflow)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm(4096, -32768);
+    EXPECT_EQ(PcmSumOfSquares(pcm.data(), pcm.size()), (int64_t)4096 << 30);
+    EXPECT_EQ(PcmZeroCrossings(pcm.data(), pcm.size()), 0u);
+
+    for (size_t i = 0; i < pcm.size(); ++i)
+    {
+        pcm[i] = (i & 1) ? 32767 : -32768;
+    }
+    EXPECT_EQ(PcmSumOfSquares(pcm.data(), pcm.size()), ReferenceSumOfSquares(pcm.data(), pcm.size()));
+    EXPECT_EQ(PcmZeroCrossings(pcm.data(), pcm.size()), 4095u);
+}
+
+TEST(Vad, TrimsEdgesAndShortensTheLongPause)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = LoadFixture("dictation", Dictation());
+    ASSERT_EQ(pcm.size(), Seconds(8.5));
+
+    VadSettings settings;
+    std::vector<SampleRange> ranges = FindSpeechRanges(pcm.data(), pcm.size(), settings);
+    ASSERT_EQ(ranges.size(), 2u);
+
+    // Pre-roll before the first word, half the allowed pause after it; the other half before
+    // the second stretch, then the hangover
+    ExpectNear(ranges[0].begin, 1.0 - settings.preroll_ms / 1000.0, "start");
+    ExpectNear(ranges[0].end, 3.0 + settings.max_pause_ms / 2000.0, "end of the first stretch");
+    ExpectNear(ranges[1].begin, 6.0 - settings.max_pause_ms / 2000.0, "start of the second stretch");
+    ExpectNear(ranges[1].end, 7.5 + settings.hangover_ms / 1000.0, "end");
+}
+
+TEST(Vad, SilenceYieldsNothing)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = LoadFixture("silence", test_audio::Noise(Seconds(3), 30, 21));
+    EXPECT_TRUE(FindSpeechRanges(pcm.data(), pcm.size(), VadSettings()).empty());
+
+    std::vector<short> zeros(Seconds(1));
+    EXPECT_TRUE(FindSpeechRanges(zeros.data(), zeros.size(), VadSettings()).empty());
+}
+
+TEST(Vad, ShortPausesAreKept)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = test_audio::Noise(Seconds(0.5), 30, 31);
+    test_audio::Append(&pcm, test_audio::Voice(Seconds(1), RATE, 6000, 32));
+    test_audio::Append(&pcm, test_audio::Noise(Seconds(0.5), 30, 33));
+    test_audio::Append(&pcm, test_audio::Voice(Seconds(1), RATE, 6000, 34));
+
+    std::vector<SampleRange> ranges = FindSpeechRanges(pcm.data(), pcm.size(), VadSettings());
+    ASSERT_EQ(ranges.size(), 1u);
+    ExpectNear(ranges[0].begin, 0.35, "start");
+    ExpectNear(ranges[0].end, 3.0, "end");
+}
+
+TEST(Vad, StreamingMatchesOneShot)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> pcm = Dictation();
+    std::vector<SampleRange> expected = FindSpeechRanges(pcm.data(), pcm.size(), VadSettings());
+
+    std::mt19937 rng(5);
+    VoiceActivityTrimmer trimmer;
+    std::vector<SampleRange> ranges;
+    for (size_t at = 0; at < pcm.size();)
+    {
+        size_t n = std::min<size_t>(pcm.size() - at, 1 + rng() % 3000);
+        trimmer.Feed(pcm.data() + at, n, &ranges);
+        at += n;
+    }
+    trimmer.Finish(&ranges);
+
+    ASSERT_EQ(ranges.size(), expected.size());
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        EXPECT_EQ(ranges[i].begin, expected[i].begin);
+        EXPECT_EQ(ranges[i].end, expected[i].end);
+    }
+}
+
+TEST(Vad, SplitClosesTheChunkAndStartsOver)
+{
+    SKIP_UNLESS_CPU_RUNS_KERNELS();
+
+    std::vector<short> first = test_audio::Voice(Seconds(2), RATE, 6000, 41);
+    test_audio::Append(&first, test_audio::Noise(Seconds(1), 30, 42));
+    std::vector<short> second = test_audio::Voice(Seconds(1), RATE, 6000, 43);
+
+    VoiceActivityTrimmer trimmer;
+    std::vector<SampleRange> ranges;
+    trimmer.Feed(first.data(), first.size(), &ranges);
+    EXPECT_TRUE(trimmer.HeardSpeech());
+    ExpectNear(trimmer.SilenceSinceSpeech(), 1.0, "silence before the split");
+
+    trimmer.Split(&ranges);
+    ASSERT_EQ(ranges.size(), 1u);
+    ExpectNear(ranges[0].end, 2.0 + VadSettings().hangover_ms / 1000.0, "end of the first chunk");
+    EXPECT_FALSE(trimmer.HeardSpeech());
+
+    trimmer.Feed(second.data(), second.size(), &ranges);
+    trimmer.Finish(&ranges);
+    ASSERT_EQ(ranges.size(), 2u);
+    EXPECT_GE(ranges[1].begin, ranges[0].end);
+    ExpectNear(ranges[1].end, 4.0, "end of the second chunk");
+}
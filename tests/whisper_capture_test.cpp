@@ -0,0 +1,225 @@
+// Runs the whisper_capture program the way a script would: replays WAV files through it and looks
+// at what it writes and prints.
+
+#include "mock_server.hpp"
+#include "test_audio.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sys/wait.h>
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+struct CaptureRun
+{
+    int exit_code = -1;
+    std::string out;  // stdout; stderr goes to the test log
+};
+
+CaptureRun Capture(const std::string& args)
+{
+    CaptureRun run;
+    std::string command = std::string(WHISPER_CAPTURE) + " " + args;
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe)
+    {
+        return run;
+    }
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+    {
+        run.out.append(buffer, got);
+    }
+    int status = pclose(pipe);
+    run.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return run;
+}
+
+std::vector<char> ReadFile(const fs::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(in), {});
+}
+
+// Sample rate and sample count of a canonical 44-byte-header WAV, as WavStreamEncoder writes them
+std::pair<uint32_t, size_t> WavFormat(const std::vector<char>& wav)
+{
+    if (wav.size() < 44 || memcmp(wav.data(), "RIFF", 4) != 0)
+    {
+        return { 0, 0 };
+    }
+    uint32_t rate;
+    uint32_t data_bytes;
+    memcpy(&rate, wav.data() + 24, 4);
+    memcpy(&data_bytes, wav.data() + 40, 4);
+    return { rate, data_bytes / sizeof(short) };
+}
+
+class WhisperCapture : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        dir = fs::temp_directory_path() / ("whisper_capture_test_" + std::to_string(getpid()));
+        fs::create_directories(dir);
+    }
+    void TearDown() override { fs::remove_all(dir); }
+
+    std::string Path(const char* name) const { return (dir / name).string(); }
+
+    fs::path dir;
+};
+
+}  // namespace
+
+TEST_F(WhisperCapture, ReplaysAndResamplesTo16k)
+{
+    ASSERT_TRUE(test_audio::WriteWav(Path("in.wav"), test_audio::Voice(44100 * 3, 44100), 44100));
+
+    CaptureRun run = Capture("--replay " + Path("in.wav") + " --fast --condition " + Path("out.wav"));
+    ASSERT_EQ(run.exit_code, 0);
+
+    auto [rate, samples] = WavFormat(ReadFile(Path("out.wav")));
+    EXPECT_EQ(rate, 16000u);
+    EXPECT_NEAR((double)samples, 16000.0 * 3, 16.0);
+}
+
+TEST_F(WhisperCapture, TrimDropsTheSilence)
+{
+    std::vector<short> take = test_audio::Noise(16000 * 2, 20.0);
+    test_audio::Append(&take, test_audio::Voice(16000 * 2, 16000));
+    test_audio::Append(&take, test_audio::Noise(16000 * 3, 20.0, 3));
+    ASSERT_TRUE(test_audio::WriteWav(Path("in.wav"), take, 16000));
+
+    ASSERT_EQ(Capture("--replay " + Path("in.wav") + " --fast --trim " + Path("out.wav")).exit_code, 0);
+    size_t samples = WavFormat(ReadFile(Path("out.wav"))).second;
+    EXPECT_GE(samples, 16000u * 2);
+    EXPECT_LT(samples, 16000u * 4);
+}
+
+TEST_F(WhisperCapture, TranscribesWithTheSameRequestAsTheApp)
+{
+    MockRequest seen;
+    MockServer server([&](const MockRequest& request)
+    {
+        // Not the connection warm-up
+        if (request.method == "POST")
+        {
+            seen = request;
+        }
+        MockResponse response;
+        response.content_type = "text/plain";
+        response.body = "hello from the mock";
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+    ASSERT_TRUE(test_audio::WriteWav(Path("in.wav"), test_audio::Voice(16000, 16000), 16000));
+
+    CaptureRun run = Capture("--replay " + Path("in.wav") + " --fast --transcribe " + server.Url("/v1/audio/transcriptions") +
+        " --api-key sk-test " + Path("out.wav"));
+    ASSERT_EQ(run.exit_code, 0);
+    EXPECT_EQ(run.out, "hello from the mock\n");
+    EXPECT_EQ(seen.path, "/v1/audio/transcriptions");
+    EXPECT_EQ(seen.Header("authorization"), "Bearer sk-test");
+    EXPECT_NE(seen.body.find("filename=\"output.wav\""), std::string::npos);
+    EXPECT_NE(seen.body.find("whisper-1"), std::string::npos);
+}
+
+TEST_F(WhisperCapture, PostProcessesWhatItTypes)
+{
+    std::string generate_body;
+    MockServer server([&](const MockRequest& request)
+    {
+        MockResponse response;
+        if (request.path == "/v1/audio/transcriptions")
+        {
+            response.content_type = "text/plain";
+            response.body = "hello from the mock";
+        }
+        else if (request.body.find("hello from the mock") != std::string::npos)
+        {
+            generate_body = request.body;
+            response.body = R"({"response": "<explanation>Capitalized.</explanation><output>Hello from the mock.</output>"})";
+        }
+        else
+        {
+            // The model preload, which has an empty prompt
+            response.body = R"({"response": ""})";
+        }
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+    ASSERT_TRUE(test_audio::WriteWav(Path("in.wav"), test_audio::Voice(16000, 16000), 16000));
+    {
+        std::ofstream prompt(Path("prompt.txt"));
+        prompt << "Fix this up: {{transcript}}";
+    }
+
+    CaptureRun run = Capture("--replay " + Path("in.wav") + " --fast --transcribe " + server.Url("/v1/audio/transcriptions") +
+        " --postprocess " + server.Url("/api/generate") + " --postprocess-model llama --postprocess-prompt " + Path("prompt.txt") +
+        " " + Path("out.wav"));
+    ASSERT_EQ(run.exit_code, 0);
+    EXPECT_EQ(run.out, "Hello from the mock.\n");
+    EXPECT_NE(generate_body.find("Fix this up: hello from the mock"), std::string::npos);
+    EXPECT_NE(generate_body.find("\"model\":\"llama\""), std::string::npos);
+}
+
+TEST_F(WhisperCapture, ChunksAtPausesAndTypesThemInOrder)
+{
+    std::atomic<int> requests{ 0 };
+    MockServer server([&](const MockRequest& request)
+    {
+        MockResponse response;
+        if (request.method == "POST")
+        {
+            // The first chunk takes longer, which mustn't change the order it's typed in
+            int index = requests++;
+            response.content_type = "text/plain";
+            response.body = index == 0 ? "first" : "second";
+            response.delay_ms = index == 0 ? 200 : 0;
+        }
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+
+    std::vector<short> take = test_audio::Voice(16000 * 6, 16000);
+    test_audio::Append(&take, test_audio::Noise(16000, 20.0));
+    test_audio::Append(&take, test_audio::Voice(16000 * 2, 16000));
+    ASSERT_TRUE(test_audio::WriteWav(Path("in.wav"), take, 16000));
+
+    CaptureRun run = Capture("--replay " + Path("in.wav") + " --fast --chunks --transcribe " + server.Url("/v1/audio/transcriptions") +
+        " " + Path("out.wav"));
+    ASSERT_EQ(run.exit_code, 0);
+    EXPECT_EQ(requests.load(), 2);
+    EXPECT_EQ(run.out, "first second\n");
+    EXPECT_TRUE(fs::exists(Path("out.wav")));
+    EXPECT_TRUE(fs::exists(Path("out.1.wav")));
+}
+
+TEST_F(WhisperCapture, FailsCleanly)
+{
+    EXPECT_EQ(Capture("--bogus " + Path("out.wav") + " 2>/dev/null").exit_code, 2);
+    EXPECT_EQ(Capture("--replay " + Path("missing.wav") + " " + Path("out.wav") + " 2>/dev/null").exit_code, 1);
+    EXPECT_FALSE(fs::exists(Path("out.wav")));
+
+    // A server that says no is a failed run, even though the file got written
+    MockServer server([](const MockRequest&)
+    {
+        MockResponse response;
+        response.status = 500;
+        return response;
+    });
+    ASSERT_TRUE(server.Start());
+    ASSERT_TRUE(test_audio::WriteWav(Path("in.wav"), test_audio::Voice(1600, 16000), 16000));
+    EXPECT_EQ(Capture("--replay " + Path("in.wav") + " --fast --transcribe " + server.Url() + " " + Path("out.wav") + " 2>/dev/null").exit_code, 1);
+}
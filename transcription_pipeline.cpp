@@ -0,0 +1,2116 @@
+#include "transcription_pipeline.hpp"
+
+#include "endpoint_pool.hpp"
+#include "http_engine.hpp"
+#include "json.hpp"
+#include "latency_window.hpp"
+#include "postprocess_cache.hpp"
+#include "rate_limiter.hpp"
+#include "realtime_session.hpp"
+#include "rewrite_rules.hpp"
+#include "sse_parser.hpp"
+#include "tag_scanner.hpp"
+
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <set>
+
+namespace
+{
+
+// A warm-up that takes longer than this isn't helping anybody.
+constexpr long WARMUP_TIMEOUT_MS = 10000;
+
+// Loading a big model from disk can take a while; past this, give up on the preload.
+constexpr long MODEL_PRELOAD_TIMEOUT_MS = 120000;
+
+// Transcription requests give up eventually, but only once even a slow server should be done
+// with audio of that length. (Not streamed ones; they're open while the user is still talking.)
+constexpr long TRANSCRIPTION_TIMEOUT_BASE_MS = 60000;
+constexpr long TRANSCRIPTION_TIMEOUT_PER_AUDIO_SECOND_MS = 1000;
+
+// Hedging to a second server: until we've seen enough responses from a server to know what the
+// configured percentile is, hedge after this long; and never sooner than the minimum. Response
+// times are kept per second of audio, with shorter clips counted as the minimum, since below that
+// a request's time is mostly fixed overhead.
+constexpr int HEDGE_DEFAULT_DELAY_MS = 5000;
+constexpr int HEDGE_MIN_DELAY_MS = 500;
+constexpr size_t HEDGE_MIN_SAMPLES = 20;
+constexpr double HEDGE_MIN_AUDIO_SECONDS = 1.0;
+
+// Custom servers that have been taken out are checked on this often, with a HEAD request that
+// has this long to get an answer.
+constexpr int PROBE_INTERVAL_MS = 2000;
+constexpr long PROBE_TIMEOUT_MS = 3000;
+
+// A 429 is retried this many times. The wait is what the server's Retry-After says, or else
+// doubles from the first backoff; either way no longer than the maximum.
+constexpr int RATE_LIMIT_MAX_RETRIES = 4;
+constexpr int RATE_LIMIT_FIRST_BACKOFF_MS = 1000;
+constexpr int RATE_LIMIT_MAX_BACKOFF_MS = 60000;
+
+// A chunk whose realtime transcript hasn't come this long after it was committed goes the usual
+// way instead.
+constexpr int REALTIME_RESULT_TIMEOUT_MS = 10000;
+
+// The post-process cache goes to disk this long after it changed, so a burst of short takes is
+// one write.
+constexpr int POSTPROCESS_CACHE_SAVE_DELAY_MS = 5000;
+
+// How much of the previous chunk's transcript goes into the next one's prompt. Whisper only looks
+// at the last ~224 tokens of the prompt anyway.
+constexpr size_t CHUNK_PROMPT_CONTEXT_CHARS = 600;
+
+// Set up by StartTranscription(); the settings are the loop thread's copy.
+TranscriptionSettings settings;
+TranscriptionHandlers handlers;
+Mp3BufferPool* segment_buffers = nullptr;
+FILE* log_file = stdout;
+
+// Every request goes through here, so they can reuse each other's connections
+HttpTransport http_transport;
+
+// The numbers handed out with every delivered segment.
+TranscriptionStats stats;
+
+void Inject(const std::string& text)
+{
+    if (handlers.inject)
+    {
+        handlers.inject(text);
+    }
+}
+
+void ReportError(const std::string& message)
+{
+    if (handlers.on_error)
+    {
+        handlers.on_error(message);
+    }
+}
+
+void ShowPartialText(const std::string& partial)
+{
+    if (handlers.on_partial_text)
+    {
+        handlers.on_partial_text(partial);
+    }
+}
+
+std::string TrimString(const std::string& input)
+{
+    size_t start = 0;
+    while (start < input.size() && std::isspace(static_cast<unsigned char>(input[start])))
+    {
+        ++start;
+    }
+
+    size_t end = input.size();
+    while (end > start && std::isspace(static_cast<unsigned char>(input[end - 1])))
+    {
+        --end;
+    }
+
+    return input.substr(start, end - start);
+}
+
+std::string ExtractTagContent(const std::string& response, const std::string& tag)
+{
+    std::string start_tag = "<";
+    start_tag += tag;
+    start_tag += ">";
+    std::string end_tag = "</";
+    end_tag += tag;
+    end_tag += ">";
+    size_t start_pos = response.find(start_tag);
+    size_t end_pos = response.find(end_tag);
+    if (start_pos == std::string::npos || end_pos == std::string::npos || end_pos <= start_pos)
+    {
+        return {};
+    }
+
+    start_pos += start_tag.size();
+    return TrimString(response.substr(start_pos, end_pos - start_pos));
+}
+
+std::string ExtractPostProcessOutput(const std::string& response)
+{
+    return ExtractTagContent(response, "output");
+}
+
+std::string ExtractPostProcessReasoning(const std::string& response)
+{
+    return ExtractTagContent(response, "explanation");
+}
+
+std::string BuildPostProcessPrompt(const std::string& prompt_template, const std::string& transcript)
+{
+    if (prompt_template.empty())
+    {
+        return transcript;
+    }
+
+    const std::string placeholder = "{{transcript}}";
+    std::string prompt = prompt_template;
+    size_t pos = 0;
+    while ((pos = prompt.find(placeholder, pos)) != std::string::npos)
+    {
+        prompt.replace(pos, placeholder.size(), transcript);
+        pos += transcript.size();
+    }
+
+    if (prompt == prompt_template)
+    {
+        prompt.append("\n");
+        prompt.append(transcript);
+    }
+
+    return prompt;
+}
+
+// The state of one post-process request while it's in flight.
+struct PostProcessRequest
+{
+    std::string payload_json;
+    curl_slist* headers = nullptr;
+    std::string response;
+    uint64_t started_at = 0;
+
+    // Streamed: Ollama sends a JSON object per line with the next few tokens, and the <output>
+    // is picked out of them as they come. We hang up once it's closed.
+    bool stream = false;
+    std::string partial_line;
+    std::string generated;   // the model's text so far
+    TagScanner output_scanner;
+    std::string output;      // what the scanner has let through
+    std::function<void()> on_output;
+    uint64_t first_output_at = 0;
+    bool closed_early = false;
+    double load_seconds = -1.0;
+    std::string stream_error;
+};
+
+// Ollama's keep_alive for the post-process model, e.g. "30m".
+std::string PostProcessKeepAlive()
+{
+    return std::to_string(settings.postprocess_keep_alive_minutes) + "m";
+}
+
+double ModelLoadSeconds(const nlohmann::json& response_obj);
+
+// One line of a streamed post-process response.
+void OnPostProcessLine(PostProcessRequest* request, const std::string& line)
+{
+    nlohmann::json chunk_obj;
+    try
+    {
+        chunk_obj = nlohmann::json::parse(line);
+    }
+    catch (const std::exception&)
+    {
+        return;
+    }
+    if (!chunk_obj.is_object())
+    {
+        return;
+    }
+
+    if (chunk_obj.contains("error"))
+    {
+        request->stream_error = chunk_obj["error"].is_string() ? chunk_obj["error"].get<std::string>() : chunk_obj["error"].dump();
+        return;
+    }
+    if (chunk_obj.contains("done") && chunk_obj["done"].is_boolean() && chunk_obj["done"].get<bool>())
+    {
+        request->load_seconds = ModelLoadSeconds(chunk_obj);
+    }
+    if (!chunk_obj.contains("response") || !chunk_obj["response"].is_string())
+    {
+        return;
+    }
+
+    std::string tokens = chunk_obj["response"];
+    request->generated += tokens;
+    std::string output = request->output_scanner.Feed(tokens);
+    if (!output.empty())
+    {
+        if (request->first_output_at == 0)
+        {
+            request->first_output_at = SteadyClockMs();
+            fprintf(log_file, "First post-process output %.2fs after sending\n", (request->first_output_at - request->started_at) / 1000.0);
+        }
+        request->output += output;
+        if (request->on_output)
+        {
+            request->on_output();
+        }
+    }
+    if (request->output_scanner.Closed())
+    {
+        request->closed_early = true;
+    }
+}
+
+// Collects a post-process response; a streamed one is also handled line by line as it comes in.
+size_t PostProcessWriteCallback(char* contents, size_t size, size_t nmemb, PostProcessRequest* request)
+{
+    size_t length = size * nmemb;
+    request->response.append(contents, length);
+    if (!request->stream)
+    {
+        return length;
+    }
+
+    request->partial_line.append(contents, length);
+    size_t newline;
+    while ((newline = request->partial_line.find('\n')) != std::string::npos)
+    {
+        std::string line = request->partial_line.substr(0, newline);
+        request->partial_line.erase(0, newline + 1);
+        OnPostProcessLine(request, line);
+
+        // The rest would only be the closing tags and the model's end of turn; this ends the
+        // transfer (with a write error), and Ollama stops generating once we've hung up
+        if (request->closed_early)
+        {
+            return 0;
+        }
+    }
+    return length;
+}
+
+// Sets up a JSON POST to the post-process endpoint with request->payload_json as the body.
+CURL* PreparePostProcessCurl(const char* endpoint, PostProcessRequest* request)
+{
+    CURL* curl = http_transport.Acquire(endpoint);
+    if (!curl)
+    {
+        return nullptr;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->payload_json.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, request->payload_json.size());
+
+    request->headers = curl_slist_append(request->headers, "Expect:");
+    request->headers = curl_slist_append(request->headers, "Content-Type: application/json");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, PostProcessWriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, request);
+    return curl;
+}
+
+// Sets up (but doesn't start) the post-process request for `transcript`; null, with the reason in
+// `error_message`, if the settings don't allow for one. Release the handle and free
+// request->headers when done.
+CURL* BuildPostProcessRequest(const std::string& transcript, PostProcessRequest* request, std::string* error_message)
+{
+    const std::string& endpoint = settings.postprocess_endpoint;
+    if (endpoint.empty())
+    {
+        *error_message = "Post-process endpoint is empty.";
+        return nullptr;
+    }
+
+    const std::string& model = settings.postprocess_model;
+    if (model.empty())
+    {
+        *error_message = "Post-process model is empty.";
+        return nullptr;
+    }
+
+    std::string prompt = BuildPostProcessPrompt(settings.postprocess_prompt, transcript);
+
+    nlohmann::json payload = {
+        { "model", model },
+        { "prompt", prompt },
+        { "stream", settings.postprocess_stream },
+        { "keep_alive", PostProcessKeepAlive() }
+    };
+    request->payload_json = payload.dump();
+    request->stream = settings.postprocess_stream;
+
+    CURL* curl = PreparePostProcessCurl(endpoint.c_str(), request);
+    if (!curl)
+    {
+        *error_message = "Failed to initialize curl for post-processing.";
+        return nullptr;
+    }
+    return curl;
+}
+
+// How long Ollama spent loading the model for this response, or -1 if it doesn't say.
+double ModelLoadSeconds(const nlohmann::json& response_obj)
+{
+    auto it = response_obj.find("load_duration");
+    if (it == response_obj.end() || !it->is_number())
+    {
+        return -1.0;
+    }
+    return it->get<double>() / 1e9;  // nanoseconds
+}
+
+// Pulls the <output> (and <explanation>) out of the model's text.
+bool ParsePostProcessOutput(const std::string& raw_output, std::string* processed_text, std::string* reasoning_text, std::string* debug_text, std::string* error_message)
+{
+    std::string extracted = ExtractPostProcessOutput(raw_output);
+    std::string reasoning = ExtractPostProcessReasoning(raw_output);
+    if (extracted.empty())
+    {
+        *error_message = "Post-process response did not contain a valid <output> section.";
+        *debug_text = raw_output;
+        return false;
+    }
+
+    *processed_text = extracted;
+    *reasoning_text = reasoning;
+    return true;
+}
+
+// Pulls the <output> (and <explanation>) out of a finished post-process response.
+bool ParsePostProcessResponse(const std::string& response, std::string* processed_text, std::string* reasoning_text, double* load_seconds, std::string* debug_text, std::string* error_message)
+{
+    try
+    {
+        nlohmann::json response_obj = nlohmann::json::parse(response);
+        *load_seconds = ModelLoadSeconds(response_obj);
+        if (!response_obj.contains("response") || !response_obj["response"].is_string())
+        {
+            *error_message = "Post-process response is missing the response field.";
+            *debug_text = response;
+            return false;
+        }
+
+        return ParsePostProcessOutput(response_obj["response"], processed_text, reasoning_text, debug_text, error_message);
+    }
+    catch (const std::exception& ex)
+    {
+        *error_message = std::string("Failed to parse post-process response: ") + ex.what();
+        *debug_text = response;
+        return false;
+    }
+}
+
+struct TranscriptionJob;
+
+// One upload of a segment for transcription.
+struct TranscriptionAttempt
+{
+    TranscriptionJob* job = nullptr;
+    std::string url;
+    CURL* curl = nullptr;  // while it's running
+    MemoryUploadReader file_reader;
+    curl_mime* mime = nullptr;
+    curl_slist* headers = nullptr;
+    std::string response;
+    uint64_t started_at = 0;
+    bool failed = false;
+
+    // A response that comes as server-sent events, parsed as it arrives
+    bool response_checked = false;  // looked at its content type yet
+    bool event_stream = false;
+    SseParser sse;
+    std::string streamed_text;  // the deltas or segments so far
+    size_t finished_chars = 0;  // how much of streamed_text won't change any more
+    std::string final_text;     // what the server says the whole transcript is, if it does
+    std::string stream_error;
+    uint64_t first_text_at = 0;
+};
+
+// One segment on its way through transcription and post-processing. Segments are worked on
+// concurrently, but their text is shown and injected in the order they were recorded.
+struct TranscriptionJob
+{
+    int sequence = 0;
+    Mp3Segment segment;  // moved out of the ring; the data goes back to the pool once delivered
+
+    // The transcription request: the upload to the configured server, and a second one of the
+    // same audio to another server if the first is slow. The first good answer wins.
+    TranscriptionAttempt primary;
+    TranscriptionAttempt hedge;
+    bool hedge_fired = false;
+    std::string prompt;
+    std::string response;  // the winner's
+    uint64_t request_started_at = 0;
+    double request_seconds = 0.0;  // not counting queue_seconds
+    double queue_seconds = 0.0;    // held back by the rate limiter, or after a 429
+    int rate_limit_retries = 0;
+    long http_status = 0;          // the winner's
+    bool failed = false;           // no transcript; raw_text says why, and nothing is injected
+    HttpTimings timings;
+
+    // The winner's, if its response was streamed
+    bool event_stream = false;
+    std::string streamed_text;
+    std::string final_text;
+    std::string stream_error;
+    double first_text_seconds = -1.0;
+    size_t injected_chars = 0;  // of streamed_text, typed before the job was done
+
+    // Chunks after the first in a take wait for the previous one's text, for the prompt
+    bool waiting_for_context = false;
+    bool transcribed = false;
+    bool discarded = false;  // a streamed segment that was aborted
+    std::string raw_text;
+
+    PostProcessRequest postprocess;
+    double postprocess_seconds = 0.0;
+    double postprocess_load_seconds = -1.0;
+    double postprocess_first_output_seconds = -1.0;  // streamed only
+    size_t postprocess_injected_chars = 0;            // of postprocess.output, typed before the job was done
+    bool postprocess_cached = false;
+    double rewrite_microseconds = -1.0;  // the rewrite rules did it all
+    uint64_t postprocess_cache_context = 0;  // what the result gets cached under
+    std::string inject_text;
+    std::string processed_text;
+    std::string reasoning_text;
+
+    bool done = false;
+};
+
+// Everything below is only touched on the HTTP engine's thread.
+HttpEngine http_engine;
+std::map<int, std::shared_ptr<TranscriptionJob>> transcription_jobs;  // by sequence
+int next_job_sequence = 0;
+int next_raw_to_show = 0;    // sequence of the next job whose raw text is shown
+int next_to_deliver = 0;     // sequence of the next job to be injected
+int shown_take_id = -1;      // take of the last raw text shown
+std::string shown_raw_text;  // that take's, so far
+int delivered_take_id = -1;  // take of the last text injected
+
+// The last chunk's transcript, for the next chunk of the same take.
+int previous_chunk_take_id = -1;
+std::string previous_chunk_text;
+
+// Connection warm-up: a HEAD request to every server the take could go to when recording starts,
+// so the DNS lookup, TCP connection and TLS handshake are done by the time there's audio to send,
+// wherever the balancer then sends it.
+std::set<std::string> warmups_in_flight;
+std::set<std::string> warmed_urls;  // the warm-up opened a connection there that no request has used yet
+int warmups_started = 0;            // takes it ran for
+int handshakes_saved = 0;           // a request went to a warmed server and reused its connection
+
+// The custom servers, and how they've been doing.
+EndpointPool endpoint_pool;
+
+// What the next take should be encoded in, for TakeAudioFormat(): the format of the server it
+// would go to, as of the last time that could have changed.
+std::atomic<AudioFormat> take_format{ FORMAT_MP3 };
+
+// Hedging: how long each server has been taking lately as the first choice (ms per second of
+// audio, by URL), and how often we had to ask another server as well.
+std::map<std::string, LatencyWindow> primary_latencies;
+int hedgeable_requests = 0;
+int hedges_fired = 0;
+int hedges_won = 0;  // the other server answered first
+
+// What we send OpenAI, by API key, so that a batch job alongside dictation queues instead of
+// running into the account's limits.
+std::map<std::string, RateLimiter> rate_limiters;
+
+// The takes with a realtime session, and which of their chunks are waiting for a transcript.
+// Every chunk is one commit, and the server confirms commits in order with the id of the item it
+// made of each; transcripts come back under that id, in whatever order they're done.
+struct RealtimeTake
+{
+    std::shared_ptr<RealtimeSession> session;
+    std::vector<std::string> item_ids;                   // by chunk index
+    std::map<std::string, std::string> transcripts;      // by item id, not matched to a chunk yet
+    std::deque<std::shared_ptr<TranscriptionJob>> jobs;  // waiting for their transcript
+    std::string partial_item_id;
+    std::string partial;  // deltas of that item's transcript
+    bool ended = false;   // the take's last chunk is in, or it had none
+    bool failed = false;  // its chunks go the usual way
+};
+std::map<int, RealtimeTake> realtime_takes;  // by take id
+
+// Model preload: an empty generate request when recording starts, so Ollama loads the
+// post-process model while the user is still talking instead of after the transcript is in.
+bool preload_in_flight = false;
+PostProcessRequest preload_request;
+
+// Post-process results by transcript, for the current model and prompt. Loaded when the engine
+// starts, and saved a little after it changes, if it has a file.
+PostProcessCache postprocess_cache;
+bool postprocess_cache_has_file = false;
+bool postprocess_cache_save_pending = false;
+
+// The rewrite rules file from the settings, as of when it last changed.
+RewriteRules rewrite_rules;
+std::string rewrite_rules_path;
+std::filesystem::file_time_type rewrite_rules_time;
+bool rewrite_rules_loaded = false;
+
+void SendTranscriptionRequest(TranscriptionJob* job);
+void LaunchTranscriptionRequest(TranscriptionJob* job);
+void OnAttemptDone(TranscriptionJob* job, TranscriptionAttempt* attempt, CURLcode res, const HttpTimings& timings);
+void OnTranscriptionDone(TranscriptionJob* job, CURLcode res, const HttpTimings& timings);
+void OnPostProcessDone(TranscriptionJob* job, CURL* curl, CURLcode res);
+void FinishJob(TranscriptionJob* job);
+void OnTranscriptEvent(TranscriptionAttempt* attempt, const std::string& event, const std::string& data);
+
+std::string TranscriptionModel()
+{
+    return settings.model.empty() ? std::string("whisper-1") : settings.model;
+}
+
+void UpdateServers()
+{
+    endpoint_pool.SetServerEntries(ParseEndpointEntries(settings.custom_endpoints.c_str(), settings.audio_format));
+}
+
+// Where a request for `audio_seconds` of audio in `format` should go, if not to `exclude`: OpenAI,
+// or whichever of the custom servers that take it should be done with it soonest. Empty if
+// there's nowhere.
+std::string TranscriptionUrl(double audio_seconds = 0.0, const std::string& exclude = {}, AudioFormat format = FORMAT_COUNT)
+{
+    if (settings.openai)
+    {
+        std::string url = "https://api.openai.com/v1/audio/transcriptions";
+        return url == exclude ? std::string() : url;
+    }
+
+    UpdateServers();
+    return endpoint_pool.Pick(audio_seconds, exclude, format);
+}
+
+// Loop thread, whenever the servers' standing may have changed.
+void UpdateTakeFormat()
+{
+    AudioFormat format = settings.audio_format;
+    if (!settings.openai)
+    {
+        std::string url = TranscriptionUrl();
+        for (const EndpointPool::Server& server : endpoint_pool.Servers())
+        {
+            if (server.url == url)
+            {
+                format = server.format;
+            }
+        }
+    }
+    take_format.store(format);
+}
+
+// Loop thread, every PROBE_INTERVAL_MS from startup. A custom server that has been taken out gets
+// a HEAD once it's due. Whisper servers don't all do HEAD, so any answer but a gateway error or a
+// 503 counts as being up again, and lets it back in on probation.
+void ProbeEndpoints()
+{
+    uint64_t now = SteadyClockMs();
+    for (const std::string& url : endpoint_pool.StartDueProbes(now))
+    {
+        CURL* curl = http_transport.Acquire(url.c_str());
+        if (!curl)
+        {
+            endpoint_pool.OnProbeFinished(url, false, now);
+            continue;
+        }
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, PROBE_TIMEOUT_MS);
+
+        http_engine.Submit(curl, [curl, url](CURLcode res, const HttpTimings& timings) {
+            long status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            http_transport.Release(curl);
+
+            bool server_ok = (res == CURLE_OK && status != 502 && status != 503 && status != 504);
+            endpoint_pool.OnProbeFinished(url, server_ok, SteadyClockMs());
+            UpdateTakeFormat();
+            fprintf(log_file, "Health probe of %s: %s\n", url.c_str(), server_ok ? "answering again, back on probation" : "still out");
+        });
+    }
+
+    http_engine.PostDelayed(PROBE_INTERVAL_MS, &ProbeEndpoints);
+}
+
+// Loop thread. OpenAI, or each custom server that's taking requests (the ones that are out get
+// health probes instead). What the server says to the HEAD doesn't matter, only that we're connected.
+void WarmUpConnections()
+{
+    std::vector<std::string> urls;
+    if (settings.openai)
+    {
+        urls.push_back(TranscriptionUrl());
+    }
+    else
+    {
+        UpdateServers();
+        for (const EndpointPool::Server& server : endpoint_pool.Servers())
+        {
+            if (server.state != EndpointPool::State::Open)
+            {
+                urls.push_back(server.url);
+            }
+        }
+    }
+
+    bool started = false;
+    for (const std::string& url : urls)
+    {
+        if (warmups_in_flight.count(url))
+        {
+            continue;
+        }
+        CURL* curl = http_transport.Acquire(url.c_str());
+        if (!curl)
+        {
+            continue;
+        }
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, WARMUP_TIMEOUT_MS);
+
+        warmups_in_flight.insert(url);
+        started = true;
+        http_engine.Submit(curl, [curl, url](CURLcode res, const HttpTimings& timings) {
+            warmups_in_flight.erase(url);
+            if (res == CURLE_OK && !timings.reused_connection)
+            {
+                warmed_urls.insert(url);
+            }
+            fprintf(log_file, "Connection warm-up of %s: %s\n", url.c_str(), res == CURLE_OK ? DescribeTimings(timings).c_str() : curl_easy_strerror(res));
+            http_transport.Release(curl);
+        });
+    }
+    warmups_started += started ? 1 : 0;
+}
+
+// Loop thread. An empty prompt makes Ollama load the model (and keep it for keep_alive) without
+// generating anything.
+void PreloadPostProcessModel()
+{
+    const std::string& endpoint = settings.postprocess_endpoint;
+    const std::string& model = settings.postprocess_model;
+    if (preload_in_flight || !settings.postprocess || endpoint.empty() || model.empty())
+    {
+        return;
+    }
+
+    nlohmann::json payload = {
+        { "model", model },
+        { "prompt", "" },
+        { "stream", false },
+        { "keep_alive", PostProcessKeepAlive() }
+    };
+    preload_request = PostProcessRequest{};
+    preload_request.payload_json = payload.dump();
+
+    CURL* curl = PreparePostProcessCurl(endpoint.c_str(), &preload_request);
+    if (!curl)
+    {
+        curl_slist_free_all(preload_request.headers);
+        preload_request.headers = nullptr;
+        return;
+    }
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, MODEL_PRELOAD_TIMEOUT_MS);
+
+    preload_in_flight = true;
+    preload_request.started_at = SteadyClockMs();
+    http_engine.Submit(curl, [curl](CURLcode res, const HttpTimings& timings) {
+        preload_in_flight = false;
+        double seconds = (SteadyClockMs() - preload_request.started_at) / 1000.0;
+
+        double load_seconds = -1.0;
+        if (res == CURLE_OK)
+        {
+            try
+            {
+                load_seconds = ModelLoadSeconds(nlohmann::json::parse(preload_request.response));
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+
+        if (res != CURLE_OK)
+        {
+            fprintf(log_file, "Model preload failed: %s\n", curl_easy_strerror(res));
+        }
+        else if (load_seconds < 0)
+        {
+            fprintf(log_file, "Model preload: %.2fs (the server didn't report a load time)\n", seconds);
+        }
+        else
+        {
+            fprintf(log_file, "Model preload: %.2fs, %s (%.2fs loading)\n", seconds,
+                              load_seconds > MODEL_COLD_LOAD_SECONDS ? "was cold" : "already warm", load_seconds);
+        }
+
+        curl_slist_free_all(preload_request.headers);
+        preload_request.headers = nullptr;
+        preload_request.response.clear();
+        http_transport.Release(curl);
+    });
+}
+
+// The job for the chunk before this one in the same take, if it's still around.
+TranscriptionJob* FindPreviousChunk(const TranscriptionJob& job)
+{
+    if (job.segment.chunk_index == 0)
+    {
+        return nullptr;
+    }
+
+    for (auto& [sequence, other] : transcription_jobs)
+    {
+        if (other->segment.take_id == job.segment.take_id && other->segment.chunk_index == job.segment.chunk_index - 1)
+        {
+            return other.get();
+        }
+    }
+    return nullptr;
+}
+
+// Loop thread: hangs up a realtime session and hands it to somebody who can wait for its thread
+// to finish; that mustn't hold up the requests in flight here. Without a handler, it's left to
+// the last reference.
+void CloseRealtimeSession(std::shared_ptr<RealtimeSession> session)
+{
+    if (!session)
+    {
+        return;
+    }
+    session->RequestClose();
+    if (handlers.on_realtime_closed)
+    {
+        handlers.on_realtime_closed(std::move(session));
+    }
+}
+
+// Done with a take's realtime session once it has nothing left to wait for.
+void CloseFinishedRealtimeTake(int take_id)
+{
+    auto it = realtime_takes.find(take_id);
+    if (it == realtime_takes.end() || !it->second.ended || !it->second.jobs.empty())
+    {
+        return;
+    }
+    CloseRealtimeSession(std::move(it->second.session));
+    realtime_takes.erase(it);
+}
+
+// The realtime session is no good: its chunks, and the take's chunks still to come, are uploaded
+// the usual way.
+void FailRealtimeTake(int take_id, const std::string& message)
+{
+    auto it = realtime_takes.find(take_id);
+    if (it == realtime_takes.end() || it->second.failed)
+    {
+        return;
+    }
+
+    RealtimeTake& take = it->second;
+    fprintf(log_file, "Realtime session for take %d failed (%s); uploading its %zu waiting chunks instead\n",
+                      take_id, message.c_str(), take.jobs.size());
+    take.failed = true;
+    if (take.session)
+    {
+        take.session->RequestClose();
+    }
+
+    std::deque<std::shared_ptr<TranscriptionJob>> jobs;
+    jobs.swap(take.jobs);
+    CloseFinishedRealtimeTake(take_id);
+    for (std::shared_ptr<TranscriptionJob>& job : jobs)
+    {
+        SendTranscriptionRequest(job.get());
+    }
+}
+
+// Hands transcripts that have come back to the chunks that were waiting for them.
+void MatchRealtimeTranscripts(int take_id)
+{
+    auto it = realtime_takes.find(take_id);
+    if (it == realtime_takes.end())
+    {
+        return;
+    }
+
+    RealtimeTake& take = it->second;
+    std::vector<std::shared_ptr<TranscriptionJob>> done;
+    for (auto job_it = take.jobs.begin(); job_it != take.jobs.end();)
+    {
+        size_t chunk = (size_t)(*job_it)->segment.chunk_index;
+        auto transcript = chunk < take.item_ids.size() ? take.transcripts.find(take.item_ids[chunk]) : take.transcripts.end();
+        if (transcript == take.transcripts.end())
+        {
+            ++job_it;
+            continue;
+        }
+        (*job_it)->final_text = std::move(transcript->second);
+        take.transcripts.erase(transcript);
+        done.push_back(std::move(*job_it));
+        job_it = take.jobs.erase(job_it);
+    }
+
+    for (std::shared_ptr<TranscriptionJob>& job : done)
+    {
+        job->event_stream = true;
+        job->response = job->final_text;
+        fprintf(log_file, "Realtime transcript of take %d chunk %d, %llu ms after it was committed\n", take_id,
+                          job->segment.chunk_index, (unsigned long long)(SteadyClockMs() - job->request_started_at));
+        OnTranscriptionDone(job.get(), CURLE_OK, HttpTimings{});
+    }
+    CloseFinishedRealtimeTake(take_id);
+}
+
+void OnRealtimeCommitted(int take_id, const std::string& item_id)
+{
+    auto it = realtime_takes.find(take_id);
+    if (it == realtime_takes.end() || it->second.failed)
+    {
+        return;
+    }
+    it->second.item_ids.push_back(item_id);
+    MatchRealtimeTranscripts(take_id);
+}
+
+void OnRealtimeDelta(int take_id, const std::string& item_id, const std::string& delta)
+{
+    auto it = realtime_takes.find(take_id);
+    if (it == realtime_takes.end() || it->second.failed)
+    {
+        return;
+    }
+
+    // Shown after whatever of the take is in the window already
+    RealtimeTake& take = it->second;
+    if (item_id != take.partial_item_id)
+    {
+        take.partial_item_id = item_id;
+        take.partial.clear();
+    }
+    take.partial += delta;
+    std::string partial = TrimString(take.partial);
+    if (shown_take_id == take_id && !shown_raw_text.empty())
+    {
+        partial = shown_raw_text + " " + partial;
+    }
+    ShowPartialText(partial);
+}
+
+void OnRealtimeTranscript(int take_id, const std::string& item_id, const std::string& transcript)
+{
+    auto it = realtime_takes.find(take_id);
+    if (it == realtime_takes.end() || it->second.failed)
+    {
+        return;
+    }
+    if (item_id == it->second.partial_item_id)
+    {
+        it->second.partial.clear();
+    }
+    it->second.transcripts[item_id] = transcript;
+    MatchRealtimeTranscripts(take_id);
+}
+
+// The take is over without a last chunk (it ended in silence).
+void MarkRealtimeTakeEnded(int take_id)
+{
+    auto it = realtime_takes.find(take_id);
+    if (it != realtime_takes.end())
+    {
+        it->second.ended = true;
+        CloseFinishedRealtimeTake(take_id);
+    }
+}
+
+// Loop thread, when a take starts: connects its session, which has been getting audio queued
+// meanwhile. Its events are handled here too.
+void OpenRealtimeSession(int take_id, std::shared_ptr<RealtimeSession> session, const std::string& url)
+{
+    realtime_takes[take_id].session = session;
+
+    RealtimeSession::Handlers session_handlers;
+    session_handlers.on_committed = [take_id](const std::string& item_id) {
+        http_engine.Post([take_id, item_id]() { OnRealtimeCommitted(take_id, item_id); });
+    };
+    session_handlers.on_delta = [take_id](const std::string& item_id, const std::string& delta) {
+        http_engine.Post([take_id, item_id, delta]() { OnRealtimeDelta(take_id, item_id, delta); });
+    };
+    session_handlers.on_completed = [take_id](const std::string& item_id, const std::string& transcript) {
+        http_engine.Post([take_id, item_id, transcript]() { OnRealtimeTranscript(take_id, item_id, transcript); });
+    };
+    session_handlers.on_error = [take_id](const std::string& message) {
+        http_engine.Post([take_id, message]() { FailRealtimeTake(take_id, message); });
+    };
+
+    session->Start(url, settings.token, TranscriptionModel(), settings.prompt, session_handlers);
+}
+
+// A chunk of a take with a realtime session waits for its transcript from there, unless that
+// has failed; false if it should be uploaded as usual.
+bool WaitForRealtimeTranscript(const std::shared_ptr<TranscriptionJob>& job)
+{
+    int take_id = job->segment.take_id;
+    auto it = realtime_takes.find(take_id);
+    if (it == realtime_takes.end())
+    {
+        return false;
+    }
+
+    RealtimeTake& take = it->second;
+    take.ended = take.ended || job->segment.last_in_take;
+    if (take.failed)
+    {
+        CloseFinishedRealtimeTake(take_id);
+        return false;
+    }
+
+    job->request_started_at = SteadyClockMs();
+    take.jobs.push_back(job);
+    http_engine.PostDelayed(REALTIME_RESULT_TIMEOUT_MS, [take_id, job]() {
+        auto it = realtime_takes.find(take_id);
+        if (it != realtime_takes.end() && std::find(it->second.jobs.begin(), it->second.jobs.end(), job) != it->second.jobs.end())
+        {
+            FailRealtimeTake(take_id, "no transcript in time");
+        }
+    });
+    MatchRealtimeTranscripts(take_id);
+    return true;
+}
+
+void QueueTranscription(std::shared_ptr<TranscriptionJob> job)
+{
+    job->sequence = next_job_sequence++;
+    transcription_jobs[job->sequence] = job;
+    if (WaitForRealtimeTranscript(job))
+    {
+        return;
+    }
+
+    TranscriptionJob* previous = FindPreviousChunk(*job);
+    if (previous && !previous->transcribed)
+    {
+        job->waiting_for_context = true;
+        return;
+    }
+    SendTranscriptionRequest(job.get());
+}
+
+// Where a hedge for the job would go: the backup server if there is one that takes the segment's
+// format, or else the next best of the custom servers that do. Empty if there's nowhere else to
+// send it.
+std::string HedgeUrl(const TranscriptionJob& job)
+{
+    std::vector<EndpointEntry> backup = ParseEndpointEntries(settings.backup_endpoint.c_str(), settings.audio_format);
+    std::string url = !backup.empty() && backup[0].format == job.segment.format ? backup[0].url
+        : !settings.openai ? TranscriptionUrl(job.segment.uploaded_duration_seconds, job.primary.url, job.segment.format)
+        : std::string();
+    return url == job.primary.url ? std::string() : url;
+}
+
+// Whether the job's segment can also be sent to a second server. A streamed segment can't: its
+// bytes are gone once they've been read for the first upload.
+bool CanHedge(const TranscriptionJob& job)
+{
+    return !job.segment.streaming && !HedgeUrl(job).empty();
+}
+
+double HedgeAudioSeconds(const TranscriptionJob& job)
+{
+    return std::max(job.segment.uploaded_duration_seconds, HEDGE_MIN_AUDIO_SECONDS);
+}
+
+// Waits for the configured percentile of the first-choice server's recent response times, scaled
+// to the length of this segment.
+int HedgeDelayMs(const TranscriptionJob& job)
+{
+    auto it = primary_latencies.find(job.primary.url);
+    if (it == primary_latencies.end() || it->second.Count() < HEDGE_MIN_SAMPLES)
+    {
+        return std::max(HEDGE_MIN_DELAY_MS, HEDGE_DEFAULT_DELAY_MS);
+    }
+    double per_audio_second = it->second.Percentile(settings.hedge_percentile, HEDGE_MIN_SAMPLES, 0.0);
+    return std::max(HEDGE_MIN_DELAY_MS, (int)(per_audio_second * HedgeAudioSeconds(job)));
+}
+
+// Collects a transcription response. Once its headers say it's an event stream, its events are
+// also handled as they come in rather than when it's over.
+size_t TranscriptionWriteCallback(char* contents, size_t size, size_t nmemb, TranscriptionAttempt* attempt)
+{
+    size_t length = size * nmemb;
+    attempt->response.append(contents, length);
+
+    if (!attempt->response_checked)
+    {
+        attempt->response_checked = true;
+        char* content_type = nullptr;
+        curl_easy_getinfo(attempt->curl, CURLINFO_CONTENT_TYPE, &content_type);
+        std::string type = content_type ? content_type : "";
+        std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        attempt->event_stream = (type.rfind("text/event-stream", 0) == 0);
+    }
+
+    if (attempt->event_stream)
+    {
+        attempt->sse.Feed(contents, length, [attempt](const std::string& event, const std::string& data) {
+            OnTranscriptEvent(attempt, event, data);
+        });
+    }
+    return length;
+}
+
+// Starts one upload of the job's segment to `url`; false if there's no curl handle for it.
+bool StartTranscriptionAttempt(TranscriptionJob* job, TranscriptionAttempt* attempt, const std::string& url, bool send_token)
+{
+    const Mp3Segment& segment = job->segment;
+    attempt->job = job;
+    attempt->url = url;
+    attempt->response.clear();
+    attempt->response_checked = false;
+    attempt->event_stream = false;
+    attempt->sse.Reset();
+    attempt->streamed_text.clear();
+    attempt->finished_chars = 0;
+    attempt->final_text.clear();
+    attempt->stream_error.clear();
+    attempt->first_text_at = 0;
+
+    // Set the URL for the request
+    CURL* curl = http_transport.Acquire(url.c_str());
+    if (!curl)
+    {
+        fprintf(stderr, "Failed to initialize curl for the transcription request\n");
+        return false;
+    }
+
+    // Create a MIME handle for a multipart/form-data POST
+    attempt->mime = curl_mime_init(curl);
+
+    // Add the file part. It's read straight from the segment rather than copied; a streaming
+    // segment is read as the encoder produces it, which pauses the upload whenever it catches up.
+    curl_mimepart* part = curl_mime_addpart(attempt->mime);
+    curl_mime_name(part, "file");
+    if (segment.streaming)
+    {
+        std::shared_ptr<TranscriptionJob> shared_job = transcription_jobs[job->sequence];
+        segment.streaming->stream.SetResumeHandler([shared_job]() {
+            http_engine.Post([shared_job]() {
+                if (shared_job->primary.curl)
+                {
+                    curl_easy_pause(shared_job->primary.curl, CURLPAUSE_CONT);
+                }
+            });
+        });
+        curl_mime_data_cb(part, -1, &UploadStream::ReadCallback, nullptr, nullptr, &segment.streaming->stream);
+    }
+    else
+    {
+        attempt->file_reader = { segment.data.data(), segment.data.size(), 0 };
+        curl_mime_data_cb(part, (curl_off_t)segment.data.size(), &MemoryUploadReader::ReadCallback,
+                          &MemoryUploadReader::SeekCallback, nullptr, &attempt->file_reader);
+
+        long timeout_ms = TRANSCRIPTION_TIMEOUT_BASE_MS + (long)(segment.audio_duration_seconds * TRANSCRIPTION_TIMEOUT_PER_AUDIO_SECOND_MS);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    }
+    curl_mime_type(part, segment.mime_type);
+
+    // For some reason, otherwise we would think that it's a string; servers also go by the extension
+    curl_mime_filename(part, segment.file_name);
+
+    curl_mimepart* part2 = curl_mime_addpart(attempt->mime);
+    curl_mime_name(part2, "model");
+    curl_mime_data(part2, TranscriptionModel().c_str(), CURL_ZERO_TERMINATED);
+
+    // Servers that can't stream just answer as usual
+    if (settings.stream_transcript)
+    {
+        curl_mimepart* stream_part = curl_mime_addpart(attempt->mime);
+        curl_mime_name(stream_part, "stream");
+        curl_mime_data(stream_part, "true", CURL_ZERO_TERMINATED);
+    }
+
+    // Only add prompt if it's not empty
+    if (!job->prompt.empty()) {
+        curl_mimepart* part3 = curl_mime_addpart(attempt->mime);
+        curl_mime_name(part3, "prompt");
+        curl_mime_data(part3, job->prompt.c_str(), CURL_ZERO_TERMINATED);
+    }
+
+    // Add the headers
+    attempt->headers = curl_slist_append(attempt->headers, "Expect:");
+    attempt->headers = curl_slist_append(attempt->headers, "Content-Type: multipart/form-data");
+
+    if (settings.verbose_http)
+    {
+        curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+        curl_version_info_data* data = curl_version_info(CURLVERSION_NOW);
+        fprintf(log_file, "libcurl is using %s for SSL/TLS.\n", data->ssl_version);
+    }
+
+    if (send_token)
+    {
+        std::string auth_header = "Authorization: Bearer " + settings.token;
+        attempt->headers = curl_slist_append(attempt->headers, auth_header.c_str());
+    }
+
+    // Set the custom headers
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, attempt->headers);
+
+    // Set the mime post data
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, attempt->mime);
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, TranscriptionWriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, attempt);
+
+    attempt->started_at = SteadyClockMs();
+    attempt->curl = curl;
+    endpoint_pool.OnRequestStarted(url);
+    http_engine.Submit(curl, [job, attempt](CURLcode res, const HttpTimings& timings) {
+        OnAttemptDone(job, attempt, res, timings);
+    });
+    return true;
+}
+
+// Frees what an attempt's request needed; the handle (and its connection) stays around for the
+// next request.
+void CleanUpAttempt(TranscriptionAttempt* attempt)
+{
+    curl_mime_free(attempt->mime);
+    attempt->mime = nullptr;
+    curl_slist_free_all(attempt->headers);
+    attempt->headers = nullptr;
+    if (attempt->curl)
+    {
+        http_transport.Release(attempt->curl);
+        attempt->curl = nullptr;
+    }
+}
+
+// Sends the job's segment to a second server as well, unless it's no longer needed. False if that
+// didn't happen.
+bool FireHedge(TranscriptionJob* job)
+{
+    std::string url = HedgeUrl(*job);
+    if (job->transcribed || job->hedge_fired || job->injected_chars > 0 || url.empty())
+    {
+        return false;
+    }
+
+    job->hedge_fired = true;
+    hedges_fired += 1;
+    fprintf(log_file, "Hedging: %.1fs without an answer, sending the segment to %s too (%d of %d requests so far)\n",
+                      (SteadyClockMs() - job->request_started_at) / 1000.0, url.c_str(), hedges_fired, hedgeable_requests);
+    if (!StartTranscriptionAttempt(job, &job->hedge, url, false))
+    {
+        job->hedge.failed = true;
+        return false;
+    }
+    return true;
+}
+
+// Starts the upload of a job's segment to Whisper.
+void SendTranscriptionRequest(TranscriptionJob* job)
+{
+    const Mp3Segment& segment = job->segment;
+    job->waiting_for_context = false;
+
+    // The configured prompt, followed by the tail of the previous chunk's transcript (if this is
+    // a continuation) so that Whisper picks up mid-sentence with the right context.
+    job->prompt = settings.prompt;
+    const std::string* context = nullptr;
+    if (TranscriptionJob* previous = FindPreviousChunk(*job))
+    {
+        context = &previous->raw_text;
+    }
+    else if (segment.chunk_index > 0 && segment.take_id == previous_chunk_take_id)
+    {
+        context = &previous_chunk_text;
+    }
+    if (context && !context->empty())
+    {
+        size_t context_start = context->size() > CHUNK_PROMPT_CONTEXT_CHARS
+            ? context->size() - CHUNK_PROMPT_CONTEXT_CHARS
+            : 0;
+        if (!job->prompt.empty())
+        {
+            job->prompt += " ";
+        }
+        job->prompt += TrimString(context->substr(context_start));
+    }
+
+    job->request_started_at = SteadyClockMs();
+    LaunchTranscriptionRequest(job);
+}
+
+// The rate limiter for the configured OpenAI key, with the configured limits; null for a custom
+// server, which is left to look after itself.
+RateLimiter* OpenAIRateLimiter()
+{
+    if (!settings.openai)
+    {
+        return nullptr;
+    }
+    RateLimiter& limiter = rate_limiters[settings.token];
+    limiter.SetLimits(settings.requests_per_minute, settings.audio_seconds_per_minute);
+    return &limiter;
+}
+
+// Starts the job's first-choice upload, and sets the hedge timer. Called again for a retry.
+void StartPrimaryAttempt(TranscriptionJob* job)
+{
+    const Mp3Segment& segment = job->segment;
+    job->primary.url = TranscriptionUrl(segment.uploaded_duration_seconds, {}, segment.format);
+    job->primary.response.clear();
+    job->primary.failed = false;
+    bool can_hedge = CanHedge(*job);
+    if (job->rate_limit_retries == 0)
+    {
+        hedgeable_requests += can_hedge ? 1 : 0;
+    }
+    if (!StartTranscriptionAttempt(job, &job->primary, job->primary.url, !settings.token.empty()))
+    {
+        job->primary.failed = true;
+        if (!can_hedge || !FireHedge(job))
+        {
+            OnTranscriptionDone(job, CURLE_FAILED_INIT, HttpTimings{});
+        }
+        return;
+    }
+
+    if (can_hedge)
+    {
+        // Only for this try; a retry after a 429 sets its own
+        std::shared_ptr<TranscriptionJob> shared_job = transcription_jobs[job->sequence];
+        int retries = job->rate_limit_retries;
+        http_engine.PostDelayed(HedgeDelayMs(*job), [shared_job, retries]() {
+            if (shared_job->primary.curl && shared_job->rate_limit_retries == retries)
+            {
+                FireHedge(shared_job.get());
+            }
+        });
+    }
+}
+
+// Starts the job's upload once the rate limiter lets it go. A streamed segment's length isn't
+// known yet, so its audio is charged when it's done instead.
+void LaunchTranscriptionRequest(TranscriptionJob* job)
+{
+    RateLimiter* limiter = OpenAIRateLimiter();
+    uint64_t wait_ms = 0;
+    if (limiter)
+    {
+        double audio_seconds = job->segment.streaming ? 0.0 : job->segment.uploaded_duration_seconds;
+        wait_ms = limiter->Reserve(audio_seconds, SteadyClockMs());
+    }
+    if (wait_ms == 0)
+    {
+        StartPrimaryAttempt(job);
+        return;
+    }
+
+    fprintf(log_file, "Rate limit: holding segment %d back for %.1fs\n", job->sequence, wait_ms / 1000.0);
+    job->queue_seconds += wait_ms / 1000.0;
+    std::shared_ptr<TranscriptionJob> shared_job = transcription_jobs[job->sequence];
+    http_engine.PostDelayed((int)wait_ms, [shared_job]() {
+        StartPrimaryAttempt(shared_job.get());
+    });
+}
+
+// How long a 429 says to wait before asking again, in ms.
+int RateLimitBackoffMs(CURL* curl, int retries)
+{
+    curl_off_t retry_after = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after) == CURLE_OK && retry_after > 0)
+    {
+        return (int)std::min<curl_off_t>(retry_after * 1000, RATE_LIMIT_MAX_BACKOFF_MS);
+    }
+    return std::min(RATE_LIMIT_FIRST_BACKOFF_MS << retries, RATE_LIMIT_MAX_BACKOFF_MS);
+}
+
+// Whether a primary that got a 429 may ask again: not once we've asked often enough, and the bytes
+// of a streamed segment are gone by now, so that can't be sent again.
+bool CanRetryAfterRateLimit(const TranscriptionJob& job)
+{
+    return !job.segment.streaming && !job.hedge.curl && job.rate_limit_retries < RATE_LIMIT_MAX_RETRIES;
+}
+
+// Asks again for a primary that got a 429 (and has been cleaned up), once the server says so.
+void RetryAfterRateLimit(TranscriptionJob* job, int backoff_ms)
+{
+    job->rate_limit_retries += 1;
+    fprintf(log_file, "Rate limit: %s said 429, retry %d of %d in %.1fs\n", job->primary.url.c_str(),
+                      job->rate_limit_retries, RATE_LIMIT_MAX_RETRIES, backoff_ms / 1000.0);
+
+    // Everything else for that key waits too, or it would only get the same answer
+    if (RateLimiter* limiter = OpenAIRateLimiter())
+    {
+        limiter->BlockUntil(SteadyClockMs() + backoff_ms);
+    }
+    else
+    {
+        job->queue_seconds += backoff_ms / 1000.0;
+        std::shared_ptr<TranscriptionJob> shared_job = transcription_jobs[job->sequence];
+        http_engine.PostDelayed(backoff_ms, [shared_job]() {
+            StartPrimaryAttempt(shared_job.get());
+        });
+        return;
+    }
+    LaunchTranscriptionRequest(job);
+}
+
+// One of the job's uploads is over. The first good answer goes on to OnTranscriptionDone() and
+// the other upload is called off; a failure waits for the other one, if there's still a chance.
+void OnAttemptDone(TranscriptionJob* job, TranscriptionAttempt* attempt, CURLcode res, const HttpTimings& timings)
+{
+    bool is_primary = (attempt == &job->primary);
+    TranscriptionAttempt* other = is_primary ? &job->hedge : &job->primary;
+    uint64_t now = SteadyClockMs();
+
+    long status = 0;
+    curl_easy_getinfo(attempt->curl, CURLINFO_RESPONSE_CODE, &status);
+    bool rate_limited = (res == CURLE_OK && status == 429 && is_primary);
+    int backoff_ms = rate_limited ? RateLimitBackoffMs(attempt->curl, job->rate_limit_retries) : 0;
+
+    // Before anything can start the next request: a retry reuses this attempt (and may well get
+    // the same handle back)
+    CleanUpAttempt(attempt);
+    if (rate_limited && CanRetryAfterRateLimit(*job))
+    {
+        endpoint_pool.OnRequestCancelled(attempt->url);
+        RetryAfterRateLimit(job, backoff_ms);
+        return;
+    }
+
+    // A streamed upload's time is mostly the user talking, so it's no use for the hedge delay
+    bool ok = (res == CURLE_OK && status < 400);
+    if (is_primary && ok && !job->segment.streaming)
+    {
+        primary_latencies[attempt->url].Add((double)(now - attempt->started_at) / HedgeAudioSeconds(*job));
+    }
+
+    // Same for the balancer: it only counts as a success or failure
+    bool server_ok = (res == CURLE_OK && status < 500);
+    double seconds = job->segment.streaming ? -1.0 : (now - attempt->started_at) / 1000.0;
+    endpoint_pool.OnRequestFinished(attempt->url, server_ok, seconds, job->segment.uploaded_duration_seconds, now);
+    UpdateTakeFormat();
+
+    if (!ok)
+    {
+        attempt->failed = true;
+        fprintf(log_file, "Transcription upload to %s failed: %s, HTTP %ld\n", attempt->url.c_str(), curl_easy_strerror(res), status);
+
+        // The other one may still make it; or, if the first choice gave up early, try another server now
+        if (other->curl)
+        {
+            return;
+        }
+        if (is_primary && CanHedge(*job) && FireHedge(job))
+        {
+            return;
+        }
+    }
+    else if (other->curl)
+    {
+        // Won the race. The loser's time so far says nothing about how long it would have taken,
+        // so it isn't recorded.
+        http_engine.Cancel(other->curl);
+        CleanUpAttempt(other);
+        endpoint_pool.OnRequestCancelled(other->url);
+    }
+
+    if (ok && !is_primary)
+    {
+        hedges_won += 1;
+    }
+    if (job->hedge_fired)
+    {
+        const LatencyWindow& window = primary_latencies[job->primary.url];
+        fprintf(log_file, "Hedging: %s answered first; %d of %d hedges won by the second server, p%d of the first choice is %.0f ms per second of audio over %zu requests\n",
+                          attempt->url.c_str(), hedges_won, hedges_fired, settings.hedge_percentile,
+                          window.Percentile(settings.hedge_percentile, 1, 0.0), window.Count());
+    }
+    if (endpoint_pool.Servers().size() > 1)
+    {
+        fprintf(log_file, "Transcription servers:\n%s", endpoint_pool.Describe().c_str());
+    }
+
+    if (job->segment.streaming && is_primary)
+    {
+        if (RateLimiter* limiter = OpenAIRateLimiter())
+        {
+            limiter->ChargeAudio(job->segment.streaming->uploaded_duration_seconds, now);
+        }
+    }
+
+    job->http_status = status;
+    job->response = std::move(attempt->response);
+    job->event_stream = attempt->event_stream;
+    job->streamed_text = std::move(attempt->streamed_text);
+    job->final_text = std::move(attempt->final_text);
+    job->stream_error = std::move(attempt->stream_error);
+    job->first_text_seconds = attempt->first_text_at ? (attempt->first_text_at - attempt->started_at) / 1000.0 : -1.0;
+
+    // The first request to a server since the warm-up connected to it
+    if (warmed_urls.erase(attempt->url))
+    {
+        handshakes_saved += timings.reused_connection ? 1 : 0;
+        fprintf(log_file, "Warm-up saved a handshake %d of %d times\n", handshakes_saved, warmups_started);
+    }
+
+    OnTranscriptionDone(job, res, timings);
+}
+
+// Types the finished part of a streamed transcript that hasn't been typed yet. Only the job that's
+// next in line can do this, so that text still goes in in recording order.
+void InjectFinishedText(TranscriptionJob* job, TranscriptionAttempt* attempt)
+{
+    if (job->sequence != next_to_deliver || attempt->finished_chars <= job->injected_chars)
+    {
+        return;
+    }
+
+    std::string text = attempt->streamed_text.substr(job->injected_chars, attempt->finished_chars - job->injected_chars);
+    if (job->injected_chars == 0)
+    {
+        // Same as for the whole text at the end: trimmed, and spaced from the take's previous chunk
+        size_t start = 0;
+        while (start < text.size() && std::isspace(static_cast<unsigned char>(text[start])))
+        {
+            ++start;
+        }
+        text.erase(0, start);
+        const Mp3Segment& segment = job->segment;
+        if (!text.empty() && segment.chunk_index > 0 && segment.take_id == delivered_take_id)
+        {
+            text.insert(0, " ");
+        }
+        delivered_take_id = segment.take_id;
+    }
+
+    job->injected_chars = attempt->finished_chars;
+    if (!text.empty())
+    {
+        Inject(text);
+    }
+}
+
+// Types the part of a streamed post-process <output> that hasn't been typed yet, if the job is
+// next in line.
+void InjectPostProcessOutput(TranscriptionJob* job)
+{
+    const std::string& output = job->postprocess.output;
+    if (job->sequence != next_to_deliver || output.size() <= job->postprocess_injected_chars)
+    {
+        return;
+    }
+
+    std::string text = output.substr(job->postprocess_injected_chars);
+    const Mp3Segment& segment = job->segment;
+    if (job->postprocess_injected_chars == 0)
+    {
+        if (segment.chunk_index > 0 && segment.take_id == delivered_take_id)
+        {
+            text.insert(0, " ");
+        }
+        delivered_take_id = segment.take_id;
+    }
+    job->postprocess_injected_chars = output.size();
+    Inject(text);
+}
+
+// Loop thread, from the write callback: one event of a streamed transcript. OpenAI sends
+// transcript.text.delta events and then transcript.text.done; Whisper servers mostly send each
+// segment as {"text": ...} once it's done.
+void OnTranscriptEvent(TranscriptionAttempt* attempt, const std::string& event, const std::string& data)
+{
+    if (data == "[DONE]")
+    {
+        return;
+    }
+
+    nlohmann::json event_obj;
+    try
+    {
+        event_obj = nlohmann::json::parse(data);
+    }
+    catch (const std::exception&)
+    {
+        fprintf(log_file, "Skipping a transcript event that isn't JSON: %s\n", data.c_str());
+        return;
+    }
+    if (!event_obj.is_object())
+    {
+        return;
+    }
+
+    std::string type = (event_obj.contains("type") && event_obj["type"].is_string()) ? event_obj["type"].get<std::string>() : "";
+    if (type == "transcript.text.delta" && event_obj.contains("delta") && event_obj["delta"].is_string())
+    {
+        attempt->streamed_text += event_obj["delta"].get<std::string>();
+    }
+    else if (type == "transcript.text.done" && event_obj.contains("text") && event_obj["text"].is_string())
+    {
+        attempt->final_text = event_obj["text"];
+        attempt->finished_chars = attempt->streamed_text.size();
+    }
+    else if (event_obj.contains("error"))
+    {
+        const nlohmann::json& error = event_obj["error"];
+        attempt->stream_error = (error.is_object() && error.contains("message") && error["message"].is_string())
+            ? error["message"].get<std::string>()
+            : error.dump();
+        return;
+    }
+    else if (event_obj.contains("text") && event_obj["text"].is_string())
+    {
+        attempt->streamed_text += event_obj["text"].get<std::string>();
+        attempt->finished_chars = attempt->streamed_text.size();
+    }
+    else
+    {
+        return;
+    }
+
+    if (attempt->first_text_at == 0 && !attempt->streamed_text.empty())
+    {
+        attempt->first_text_at = SteadyClockMs();
+        fprintf(log_file, "First transcript text %.2fs after sending\n", (attempt->first_text_at - attempt->started_at) / 1000.0);
+    }
+
+    // The hedge only gets a say once the first choice is out of the running
+    TranscriptionJob* job = attempt->job;
+    if (attempt != &job->primary && job->primary.curl)
+    {
+        return;
+    }
+
+    // Shown if everything before it in the window is; the whole text replaces it once it's done
+    if (job->sequence == next_raw_to_show)
+    {
+        const Mp3Segment& segment = job->segment;
+        std::string partial = TrimString(attempt->streamed_text);
+        if (segment.chunk_index > 0 && segment.take_id == shown_take_id)
+        {
+            partial = shown_raw_text + " " + partial;
+        }
+        ShowPartialText(partial);
+    }
+
+    // Typing it early can't be taken back, so not if the text might still be post-processed or
+    // come from the other server instead
+    if (settings.inject_early && !settings.postprocess && attempt == &job->primary && !job->hedge_fired)
+    {
+        InjectFinishedText(job, attempt);
+    }
+}
+
+// Appends newly transcribed raw text to what's shown, in recording order.
+void ShowRawTextsInOrder()
+{
+    auto it = transcription_jobs.find(next_raw_to_show);
+    while (it != transcription_jobs.end() && it->first == next_raw_to_show && it->second->transcribed)
+    {
+        const TranscriptionJob& job = *it->second;
+        if (!job.discarded)
+        {
+            // Chunks of the same take add up in the window; a new take starts over
+            if (job.segment.chunk_index > 0 && job.segment.take_id == shown_take_id)
+            {
+                shown_raw_text += " " + job.raw_text;
+            }
+            else
+            {
+                shown_raw_text = job.raw_text;
+            }
+            shown_take_id = job.segment.take_id;
+            if (handlers.on_raw_text)
+            {
+                handlers.on_raw_text(shown_raw_text);
+            }
+        }
+
+        next_raw_to_show += 1;
+        ++it;
+    }
+}
+
+// What an error response says, for the window; OpenAI's are {"error": {"message": ...}}.
+std::string DescribeTranscriptionError(const TranscriptionJob& job, CURLcode res)
+{
+    if (res != CURLE_OK)
+    {
+        return std::string("Transcription failed: ") + curl_easy_strerror(res);
+    }
+    if (!job.stream_error.empty())
+    {
+        return "Transcription failed: " + job.stream_error;
+    }
+
+    std::string message = job.response;
+    try
+    {
+        nlohmann::json error_obj = nlohmann::json::parse(job.response);
+        if (error_obj.contains("error") && error_obj["error"].contains("message") && error_obj["error"]["message"].is_string())
+        {
+            message = error_obj["error"]["message"];
+        }
+    }
+    catch (const std::exception&)
+    {
+    }
+    return "Transcription failed (HTTP " + std::to_string(job.http_status) + "): " + message;
+}
+
+// Reloaded when the setting or the file changes. Null if there's none, or it didn't load.
+const RewriteRules* CurrentRewriteRules()
+{
+    std::string path = settings.rewrite_rules_path;
+    if (path.empty())
+    {
+        rewrite_rules_path.clear();
+        return nullptr;
+    }
+
+    std::error_code error;
+    std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+    if (path != rewrite_rules_path || time != rewrite_rules_time)
+    {
+        rewrite_rules_path = path;
+        rewrite_rules_time = time;
+        std::string error_message;
+        rewrite_rules_loaded = rewrite_rules.LoadFile(path, &error_message);
+        if (!rewrite_rules_loaded)
+        {
+            ReportError(error_message);
+        }
+    }
+    return rewrite_rules_loaded ? &rewrite_rules : nullptr;
+}
+
+void OnTranscriptionDone(TranscriptionJob* job, CURLcode res, const HttpTimings& timings)
+{
+    job->request_seconds = std::max(0.0, (SteadyClockMs() - job->request_started_at) / 1000.0 - job->queue_seconds);
+    job->timings = timings;
+    fprintf(log_file, "Transcription request: %s\n", DescribeTimings(timings).c_str());
+
+    if (StreamingSegment* streaming = job->segment.streaming.get())
+    {
+        // Done with the stream, whichever way; this also breaks the job -> handler -> job cycle
+        streaming->stream.SetResumeHandler(nullptr);
+
+        // Its details are final now that the upload has read the end of the stream
+        Mp3Segment& segment = job->segment;
+        segment.audio_duration_seconds = streaming->audio_duration_seconds;
+        segment.uploaded_duration_seconds = streaming->uploaded_duration_seconds;
+        segment.last_in_take = streaming->last_in_take;
+        segment.stopped_at = streaming->stopped_at;
+        if (segment.stopped_at != 0)
+        {
+            fprintf(log_file, "Streamed %zu bytes; the upload started %.1fs before the user stopped\n",
+                              streaming->stream.BytesAppended(), ((double)segment.stopped_at - (double)job->request_started_at) / 1000.0);
+        }
+        job->discarded = streaming->discarded;
+    }
+
+    // Check for errors
+    if (res != CURLE_OK)
+    {
+        fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
+    }
+    else
+    {
+        fprintf(log_file, "Upload completed successfully\n");
+    }
+
+    fprintf(log_file, "Got response: %s\n", job->response.c_str());
+
+    // Turned out to be silence; nothing to show or inject, but it keeps its place in line
+    if (job->discarded)
+    {
+        job->transcribed = true;
+        FinishJob(job);
+        return;
+    }
+
+    // An error body (a 429 that ran out of retries, say) is never taken for the transcript
+    job->failed = (res != CURLE_OK || job->http_status >= 400 || !job->stream_error.empty());
+    if (job->failed)
+    {
+        job->raw_text = DescribeTranscriptionError(*job, res);
+    }
+    else if (job->event_stream)
+    {
+        job->raw_text = job->final_text.empty() ? TrimString(job->streamed_text) : job->final_text;
+    }
+    else
+    {
+        try
+        {
+            nlohmann::json results_obj = nlohmann::json::parse(job->response);
+            if (results_obj.contains("text") && results_obj["text"].is_string())
+            {
+                job->raw_text = results_obj["text"];
+            }
+            else
+            {
+                job->raw_text = job->response;
+            }
+        }
+        catch (const std::exception&)
+        {
+            job->raw_text = job->response;
+        }
+    }
+    job->transcribed = true;
+
+    if (!job->failed)
+    {
+        previous_chunk_take_id = job->segment.take_id;
+        previous_chunk_text = TrimString(job->raw_text);
+    }
+    ShowRawTextsInOrder();
+
+    // The next chunk of the take can go now that it has its context
+    for (auto& [sequence, other] : transcription_jobs)
+    {
+        if (other->waiting_for_context && FindPreviousChunk(*other) == job)
+        {
+            SendTranscriptionRequest(other.get());
+            break;
+        }
+    }
+
+    if (job->failed)
+    {
+        FinishJob(job);
+        return;
+    }
+
+    // Part of it has been typed already; the rest goes in as it was streamed, so it lines up
+    if (job->injected_chars > 0)
+    {
+        std::string rest = job->streamed_text.substr(std::min(job->injected_chars, job->streamed_text.size()));
+        size_t end = rest.find_last_not_of(" \t\r\n");
+        job->inject_text = (end == std::string::npos) ? std::string() : rest.substr(0, end + 1);
+        FinishJob(job);
+        return;
+    }
+
+    job->inject_text = job->raw_text;
+    if (!settings.postprocess)
+    {
+        FinishJob(job);
+        return;
+    }
+
+    // Spoken punctuation and nothing the model would have to make a call on. A transcript the
+    // rules don't touch still goes to the model, which does more than punctuation.
+    if (const RewriteRules* rules = CurrentRewriteRules())
+    {
+        auto started = std::chrono::steady_clock::now();
+        RewriteRules::Result rewritten = rules->Rewrite(job->raw_text);
+        if (rewritten.rewrites > 0 && !rewritten.needs_model)
+        {
+            job->rewrite_microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+            job->processed_text = rewritten.text;
+            job->inject_text = rewritten.text;
+            FinishJob(job);
+            return;
+        }
+    }
+
+    // Results are only reused for the server, model and prompt they came from
+    job->postprocess_cache_context = postprocess_cache.SetContext(settings.postprocess_endpoint, settings.postprocess_model, settings.postprocess_prompt);
+    if (const PostProcessCache::Entry* cached = postprocess_cache.Find(job->raw_text))
+    {
+        job->processed_text = cached->processed_text;
+        job->reasoning_text = cached->reasoning_text;
+        job->inject_text = cached->processed_text;
+        job->postprocess_cached = true;
+        FinishJob(job);
+        return;
+    }
+
+    std::string error_message;
+    CURL* postprocess_curl = BuildPostProcessRequest(job->raw_text, &job->postprocess, &error_message);
+    if (!postprocess_curl)
+    {
+        ReportError(error_message);
+        FinishJob(job);
+        return;
+    }
+
+    job->postprocess.started_at = SteadyClockMs();
+    if (job->postprocess.stream)
+    {
+        job->postprocess.on_output = [job]() { InjectPostProcessOutput(job); };
+    }
+    http_engine.Submit(postprocess_curl, [job, postprocess_curl](CURLcode res, const HttpTimings& timings) {
+        fprintf(log_file, "Post-process request: %s\n", DescribeTimings(timings).c_str());
+        OnPostProcessDone(job, postprocess_curl, res);
+    });
+}
+
+void LoadPostProcessCacheFile(const std::filesystem::path& path)
+{
+    postprocess_cache_has_file = !path.empty();
+    if (postprocess_cache_has_file && postprocess_cache.Load(path))
+    {
+        fprintf(log_file, "Post-process cache: %zu results\n", postprocess_cache.Size());
+    }
+}
+
+void SavePostProcessCache()
+{
+    postprocess_cache_save_pending = false;
+    if (postprocess_cache_has_file && postprocess_cache.Dirty() && !postprocess_cache.Save())
+    {
+        fprintf(log_file, "Failed to save the post-process cache\n");
+    }
+}
+
+void SchedulePostProcessCacheSave()
+{
+    if (!postprocess_cache_save_pending)
+    {
+        postprocess_cache_save_pending = true;
+        http_engine.PostDelayed(POSTPROCESS_CACHE_SAVE_DELAY_MS, &SavePostProcessCache);
+    }
+}
+
+void OnPostProcessDone(TranscriptionJob* job, CURL* curl, CURLcode res)
+{
+    PostProcessRequest& request = job->postprocess;
+    job->postprocess_seconds = (SteadyClockMs() - request.started_at) / 1000.0;
+    if (request.first_output_at != 0)
+    {
+        job->postprocess_first_output_seconds = (request.first_output_at - request.started_at) / 1000.0;
+    }
+
+    curl_slist_free_all(request.headers);
+    request.headers = nullptr;
+    http_transport.Release(curl);
+
+    std::string debug_text;
+    std::string error_message;
+    bool parsed = false;
+    if (res != CURLE_OK && !request.closed_early)
+    {
+        error_message = std::string("Post-process request failed: ") + curl_easy_strerror(res);
+    }
+    else if (!request.stream)
+    {
+        parsed = ParsePostProcessResponse(request.response, &job->processed_text, &job->reasoning_text, &job->postprocess_load_seconds, &debug_text, &error_message);
+    }
+    else if (!request.stream_error.empty())
+    {
+        error_message = "Post-process request failed: " + request.stream_error;
+    }
+    else
+    {
+        // Closed early, there's no final line to say how long the model took to load
+        job->postprocess_load_seconds = request.load_seconds;
+        parsed = ParsePostProcessOutput(request.generated, &job->processed_text, &job->reasoning_text, &debug_text, &error_message);
+    }
+    if (parsed)
+    {
+        job->inject_text = job->processed_text;
+
+        // Filed under the settings it was asked with, even if they've been changed while it was out
+        postprocess_cache.Insert(job->postprocess_cache_context, job->raw_text,
+                                 { job->processed_text, job->reasoning_text, job->postprocess_seconds });
+        SchedulePostProcessCacheSave();
+    }
+
+    // Some of it has been typed already: only the rest goes in, and nothing more if it went wrong
+    if (job->postprocess_injected_chars > 0)
+    {
+        job->inject_text = parsed && job->processed_text.size() > job->postprocess_injected_chars
+            ? job->processed_text.substr(job->postprocess_injected_chars)
+            : std::string();
+    }
+
+    if (!debug_text.empty())
+    {
+        job->processed_text = "Post-process parse failed. Raw output:\r\n";
+        job->processed_text += debug_text;
+    }
+    if (!error_message.empty())
+    {
+        ReportError(error_message);
+    }
+
+    FinishJob(job);
+}
+
+// Injects a finished job's text and updates the stats from it.
+void InjectJobResult(const TranscriptionJob& job)
+{
+    const Mp3Segment& segment = job.segment;
+    bool continues_take = segment.chunk_index > 0 && segment.take_id == delivered_take_id;
+    delivered_take_id = segment.take_id;
+
+    std::string inject_text = job.inject_text;
+    if (continues_take)
+    {
+        stats.processed_text += " " + job.processed_text;
+
+        // Whisper trims its output, so the words would run into the previous chunk's otherwise
+        if (job.injected_chars == 0 && job.postprocess_injected_chars == 0 && !inject_text.empty() && !std::isspace(static_cast<unsigned char>(inject_text[0])))
+        {
+            inject_text.insert(0, " ");
+        }
+    }
+    else
+    {
+        stats.processed_text = job.processed_text;
+    }
+    stats.reasoning_text = job.reasoning_text;
+    stats.response = job.response;
+
+    Inject(inject_text);
+
+    if (segment.last_in_take && segment.stopped_at != 0)
+    {
+        stats.stop_to_text_seconds = (SteadyClockMs() - segment.stopped_at) / 1000.0;
+    }
+
+    // Set stats from segment (so they're coherent with this request)
+    stats.audio_duration_seconds = segment.audio_duration_seconds;
+    stats.uploaded_duration_seconds = segment.uploaded_duration_seconds;
+    stats.request_seconds = job.request_seconds;
+    stats.queue_seconds = job.queue_seconds;
+    stats.first_text_seconds = job.first_text_seconds;
+    stats.postprocess_seconds = job.postprocess_seconds;
+    stats.postprocess_load_seconds = job.postprocess_load_seconds;
+    stats.postprocess_first_output_seconds = job.postprocess_first_output_seconds;
+    stats.postprocess_cached = job.postprocess_cached;
+    stats.rewrite_microseconds = job.rewrite_microseconds;
+    stats.postprocess_cache_hits = postprocess_cache.Hits();
+    stats.postprocess_cache_lookups = postprocess_cache.Lookups();
+    stats.postprocess_cache_seconds_saved = postprocess_cache.SecondsSaved();
+    stats.timings = job.timings;
+    stats.warmups_started = warmups_started;
+    stats.handshakes_saved = handshakes_saved;
+    stats.hedgeable_requests = hedgeable_requests;
+    stats.hedges_fired = hedges_fired;
+    stats.hedges_won = hedges_won;
+
+    if (handlers.on_delivered)
+    {
+        handlers.on_delivered(stats, inject_text);
+    }
+}
+
+// Delivers the finished jobs that are next in line.
+void DeliverFinishedJobs()
+{
+    while (!transcription_jobs.empty())
+    {
+        auto it = transcription_jobs.begin();
+        TranscriptionJob& job = *it->second;
+        if (job.sequence != next_to_deliver || !job.done)
+        {
+            break;
+        }
+
+        if (!job.discarded && !job.failed)
+        {
+            InjectJobResult(job);
+        }
+
+        // The upload is done, recycle the buffer for the next recording
+        segment_buffers->Release(std::move(job.segment.data));
+        if (handlers.on_finished)
+        {
+            handlers.on_finished(job.segment, job.failed);
+        }
+
+        Mp3BufferPool::Stats pool_stats = segment_buffers->GetStats();
+        fprintf(log_file, "MP3 buffer pool: %zu of %zu acquires without allocating, %zu bytes retained\n",
+                          pool_stats.allocations_avoided, pool_stats.acquires, pool_stats.bytes_retained);
+
+        transcription_jobs.erase(it);
+        next_to_deliver += 1;
+    }
+
+    // The next one may have streamed output waiting for its turn
+    if (!transcription_jobs.empty() && transcription_jobs.begin()->first == next_to_deliver)
+    {
+        InjectPostProcessOutput(transcription_jobs.begin()->second.get());
+    }
+}
+
+void FinishJob(TranscriptionJob* job)
+{
+    job->done = true;
+    ShowRawTextsInOrder();
+    DeliverFinishedJobs();
+}
+
+}  // namespace
+
+bool StartTranscription(const TranscriptionSettings& initial_settings, Mp3BufferPool* buffers,
+                        TranscriptionHandlers transcription_handlers, FILE* log)
+{
+    settings = initial_settings;
+    segment_buffers = buffers;
+    handlers = std::move(transcription_handlers);
+    log_file = log;
+    UpdateTakeFormat();  // the thread isn't running yet
+    if (!http_engine.Start())
+    {
+        return false;
+    }
+    http_engine.Post(&ProbeEndpoints);
+    return true;
+}
+
+void StopTranscription()
+{
+    http_engine.Stop();
+
+    // Whatever hadn't been saved yet; the engine's thread is gone, so it's ours now
+    SavePostProcessCache();
+}
+
+void SetTranscriptionSettings(const TranscriptionSettings& new_settings)
+{
+    http_engine.Post([new_settings]() {
+        settings = new_settings;
+        UpdateTakeFormat();
+    });
+}
+
+AudioFormat TakeAudioFormat()
+{
+    return take_format.load();
+}
+
+void PrepareForTake()
+{
+    http_engine.Post(&WarmUpConnections);
+    http_engine.Post(&PreloadPostProcessModel);
+}
+
+void QueueSegment(Mp3Segment segment)
+{
+    auto job = std::make_shared<TranscriptionJob>();
+    job->segment = std::move(segment);
+    http_engine.Post([job]() { QueueTranscription(job); });
+}
+
+std::shared_ptr<RealtimeSession> StartRealtimeTake(int take_id, const std::string& url)
+{
+    std::shared_ptr<RealtimeSession> session = std::make_shared<RealtimeSession>();
+    http_engine.Post([take_id, session, url]() { OpenRealtimeSession(take_id, session, url); });
+    return session;
+}
+
+void EndRealtimeTake(int take_id)
+{
+    http_engine.Post([take_id]() { MarkRealtimeTakeEnded(take_id); });
+}
+
+void LoadPostProcessCache(const std::filesystem::path& path)
+{
+    http_engine.Post([path]() { LoadPostProcessCacheFile(path); });
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "capture_pipeline.hpp"
+#include "http_transport.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct RealtimeSession;
+
+// Ollama reports how long it spent loading the model; anything over this was a cold start.
+constexpr double MODEL_COLD_LOAD_SECONDS = 0.5;
+
+// What the transcription side goes by. The app fills this in from its settings, whisper_capture
+// from its command line.
+struct TranscriptionSettings
+{
+    // Where requests go: OpenAI, or whichever of the custom servers (as ParseEndpointEntries()
+    // takes them) should be done soonest. `token` goes to the first choice and the realtime
+    // session, if not empty.
+    bool openai = false;
+    std::string token;
+    std::string custom_endpoints;
+    AudioFormat audio_format = FORMAT_MP3;  // OpenAI's, and any custom server's that doesn't say
+    std::string model;   // empty for whisper-1
+    std::string prompt;
+    bool stream_transcript = false;
+    bool inject_early = false;  // type a streamed transcript as it comes, when nothing can change it
+
+    // Hedging: a second server gets the segment too once the first is slower than its percentile
+    std::string backup_endpoint;
+    int hedge_percentile = 95;
+
+    // OpenAI's limits for the token; 0 for none
+    int requests_per_minute = 0;
+    int audio_seconds_per_minute = 0;
+
+    bool postprocess = false;
+    std::string postprocess_endpoint;
+    std::string postprocess_model;
+    std::string postprocess_prompt;  // {{transcript}} is replaced, or it's appended
+    int postprocess_keep_alive_minutes = 30;
+    bool postprocess_stream = false;
+    std::string rewrite_rules_path;  // spoken punctuation that doesn't need the model
+
+    bool verbose_http = false;  // libcurl's trace of every transcription request, on stderr
+};
+
+// The last delivered segment's numbers, and running totals.
+struct TranscriptionStats
+{
+    std::string response;  // the server's answer, as it came
+    std::string processed_text;  // of the take so far
+    std::string reasoning_text;
+    HttpTimings timings;
+    double audio_duration_seconds = 0.0;
+    double uploaded_duration_seconds = 0.0;
+    double request_seconds = 0.0;
+    double queue_seconds = 0.0;             // of the same request, waiting on the rate limiter
+    double first_text_seconds = -1.0;       // from sending it to its first streamed text, if it was streamed
+    double postprocess_seconds = 0.0;
+    double postprocess_load_seconds = -1.0;  // negative if the server didn't say
+    double postprocess_first_output_seconds = -1.0;  // until the first of <output> was typed, if streamed
+    bool postprocess_cached = false;
+    double rewrite_microseconds = -1.0;  // if the rewrite rules took care of it instead of the model
+    double stop_to_text_seconds = 0.0;   // as of the last take's last segment
+
+    int postprocess_cache_hits = 0;
+    int postprocess_cache_lookups = 0;
+    double postprocess_cache_seconds_saved = 0.0;
+    int warmups_started = 0;   // takes a connection warm-up ran for
+    int handshakes_saved = 0;  // a request went to a warmed server and reused its connection
+    int hedgeable_requests = 0;
+    int hedges_fired = 0;
+    int hedges_won = 0;  // the other server answered first
+};
+
+// What the transcription side does to the world. All of these run on its thread.
+struct TranscriptionHandlers
+{
+    std::function<void(const std::string& text)> inject;            // types text into the target
+    std::function<void(const std::string& raw_text)> on_raw_text;   // the take's transcript so far
+    std::function<void(const std::string& partial)> on_partial_text;  // same, with what's still streaming
+    std::function<void(const std::string& message)> on_error;       // post-process and rewrite rules trouble
+
+    // A segment's text went in; `injected` is what was typed just now.
+    std::function<void(const TranscriptionStats& stats, const std::string& injected)> on_delivered;
+
+    // A segment is out of the line, typed or not: in recording order, after on_delivered if it was.
+    std::function<void(const Mp3Segment& segment, bool failed)> on_finished;
+
+    // A realtime session that has been told to hang up, for somebody who may block to Close() it.
+    std::function<void(std::shared_ptr<RealtimeSession> session)> on_realtime_closed;
+};
+
+// The upload half of the pipeline, shared by the app and whisper_capture: every segment is
+// transcribed (balanced, hedged and rate-limited, streamed or realtime), post-processed and
+// typed, in the order it was recorded. It all happens on one HTTP engine's thread; the calls below
+// can come from any thread.
+
+// Starts that thread, and the health probes of the custom servers. Segment data goes back to
+// `buffers` once it's been sent; the log is everything the user doesn't need to see.
+bool StartTranscription(const TranscriptionSettings& settings, Mp3BufferPool* buffers,
+                        TranscriptionHandlers handlers, FILE* log = stdout);
+
+// Abandons whatever is in flight and saves the post-process cache.
+void StopTranscription();
+
+// For segments queued from now on.
+void SetTranscriptionSettings(const TranscriptionSettings& settings);
+
+// What the next take should be encoded in: the format of the server it would go to now.
+AudioFormat TakeAudioFormat();
+
+// Recording has started: connects to where the take could go, and gets the post-process model
+// loaded, while the user talks.
+void PrepareForTake();
+
+void QueueSegment(Mp3Segment segment);
+
+// A realtime session for the take's audio, which its segments then wait for instead of uploading.
+std::shared_ptr<RealtimeSession> StartRealtimeTake(int take_id, const std::string& url);
+
+// The take had a realtime session but no last segment (it ended in silence).
+void EndRealtimeTake(int take_id);
+
+// Post-process results are kept in this file between runs.
+void LoadPostProcessCache(const std::filesystem::path& path);
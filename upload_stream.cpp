@@ -0,0 +1,146 @@
+#include "upload_stream.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+void UploadStream::Append(std::vector<char> chunk)
+{
+    std::function<void()> wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finished || aborted || chunk.empty())
+        {
+            return;
+        }
+
+        appended += chunk.size();
+        chunks.push_back(std::move(chunk));
+
+        if (reader_paused)
+        {
+            reader_paused = false;
+            wake = resume;
+        }
+    }
+    if (wake)
+    {
+        wake();
+    }
+}
+
+void UploadStream::Finish()
+{
+    std::function<void()> wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        if (reader_paused)
+        {
+            reader_paused = false;
+            wake = resume;
+        }
+    }
+    if (wake)
+    {
+        wake();
+    }
+}
+
+void UploadStream::Abort()
+{
+    std::function<void()> wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        if (reader_paused)
+        {
+            reader_paused = false;
+            wake = resume;
+        }
+    }
+    if (wake)
+    {
+        wake();
+    }
+}
+
+void UploadStream::SetResumeHandler(std::function<void()> handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resume = std::move(handler);
+}
+
+std::vector<char> UploadStream::TakeSpentBuffer()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::move(spent);
+}
+
+size_t UploadStream::BytesAppended() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return appended;
+}
+
+size_t UploadStream::ReadCallback(char* buffer, size_t size, size_t nitems, void* user)
+{
+    UploadStream* self = static_cast<UploadStream*>(user);
+    std::lock_guard<std::mutex> lock(self->mutex);
+    if (self->aborted)
+    {
+        return CURL_READFUNC_ABORT;
+    }
+
+    if (self->chunks.empty())
+    {
+        if (self->finished)
+        {
+            return 0;
+        }
+        self->reader_paused = true;
+        return CURL_READFUNC_PAUSE;
+    }
+
+    // Up to the end of the first chunk; curl comes back for more
+    std::vector<char>& chunk = self->chunks.front();
+    size_t n = std::min(chunk.size() - self->read_offset, size * nitems);
+    memcpy(buffer, chunk.data() + self->read_offset, n);
+    self->read_offset += n;
+    if (self->read_offset == chunk.size())
+    {
+        // Keep the roomiest one for the encoder to reuse
+        if (chunk.capacity() > self->spent.capacity())
+        {
+            chunk.clear();
+            self->spent = std::move(chunk);
+        }
+        self->chunks.pop_front();
+        self->read_offset = 0;
+    }
+    return n;
+}
+
+size_t MemoryUploadReader::ReadCallback(char* buffer, size_t size, size_t nitems, void* user)
+{
+    MemoryUploadReader* self = static_cast<MemoryUploadReader*>(user);
+    size_t n = std::min(self->size - self->offset, size * nitems);
+    memcpy(buffer, self->data + self->offset, n);
+    self->offset += n;
+    return n;
+}
+
+int MemoryUploadReader::SeekCallback(void* user, curl_off_t offset, int origin)
+{
+    MemoryUploadReader* self = static_cast<MemoryUploadReader*>(user);
+    curl_off_t base = origin == SEEK_CUR ? (curl_off_t)self->offset
+        : origin == SEEK_END ? (curl_off_t)self->size
+        : 0;
+    curl_off_t target = base + offset;
+    if (target < 0 || target > (curl_off_t)self->size)
+    {
+        return CURL_SEEKFUNC_FAIL;
+    }
+    self->offset = (size_t)target;
+    return CURL_SEEKFUNC_OK;
+}
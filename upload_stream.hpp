@@ -0,0 +1,61 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Bytes on their way from an encoder that's still running to an upload that has already started.
+// The producer (capture thread) hands over the encoder's buffers as frames come out; curl's read
+// callback (HTTP thread) copies out of them in place and pauses the transfer when it has caught
+// up, and the resume handler gets it going again once there's more.
+struct UploadStream
+{
+    // Queues `chunk` as it is, without copying it.
+    void Append(std::vector<char> chunk);
+
+    // A buffer the reader is done with (emptied, capacity kept), for the encoder to write the next
+    // frames into; empty if there isn't one yet.
+    std::vector<char> TakeSpentBuffer();
+
+    // No more data: the upload ends once the reader has everything.
+    void Finish();
+
+    // The upload fails instead.
+    void Abort();
+
+    // Runs on the producer's thread when a paused reader has something to read again. Must not
+    // call back into the stream.
+    void SetResumeHandler(std::function<void()> resume);
+
+    size_t BytesAppended() const;
+
+    // For curl_mime_data_cb(); `user` is the UploadStream.
+    static size_t ReadCallback(char* buffer, size_t size, size_t nitems, void* user);
+
+private:
+    mutable std::mutex mutex;
+    std::deque<std::vector<char>> chunks;  // appended but not read yet, the first one from read_offset on
+    size_t read_offset = 0;
+    std::vector<char> spent;
+    size_t appended = 0;
+    bool finished = false;
+    bool aborted = false;
+    bool reader_paused = false;
+    std::function<void()> resume;
+};
+
+// curl_mime_data_cb() callbacks over a buffer that outlives the transfer, so curl doesn't have to
+// take a copy of the whole file the way curl_mime_data() does.
+struct MemoryUploadReader
+{
+    const char* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+
+    static size_t ReadCallback(char* buffer, size_t size, size_t nitems, void* user);
+    static int SeekCallback(void* user, curl_off_t offset, int origin);
+};
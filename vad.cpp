@@ -0,0 +1,283 @@
+#include "vad.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+// PCM_SCALAR_KERNELS turns the vector paths off, so the tests can hold them against plain C++
+#if defined(__AVX2__) && !defined(PCM_SCALAR_KERNELS)
+#include <immintrin.h>
+#define VAD_USE_AVX2 1
+#endif
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(PCM_SCALAR_KERNELS)
+#include <emmintrin.h>
+#define VAD_USE_SSE2 1
+#endif
+
+int64_t PcmSumOfSquares(const short* pcm, size_t count)
+{
+    size_t i = 0;
+    int64_t total = 0;
+
+#if defined(VAD_USE_AVX2)
+    {
+        // madd gives pairs of squares in 32 bits; two full-scale samples make exactly 2^31, so
+        // treat them as unsigned and widen to 64 bits before accumulating.
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(pcm + i));
+            __m256i sq = _mm256_madd_epi16(x, x);
+            acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(sq, zero));
+            acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(sq, zero));
+        }
+        alignas(32) int64_t lanes[4];
+        _mm256_store_si256((__m256i*)lanes, acc);
+        total += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+#if defined(VAD_USE_SSE2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*)(pcm + i));
+            __m128i sq = _mm_madd_epi16(x, x);
+            acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+            acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+        }
+        alignas(16) int64_t lanes[2];
+        _mm_store_si128((__m128i*)lanes, acc);
+        total += lanes[0] + lanes[1];
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        total += (int64_t)pcm[i] * pcm[i];
+    }
+
+    return total;
+}
+
+size_t PcmZeroCrossings(const short* pcm, size_t count)
+{
+    if (count < 2)
+    {
+        return 0;
+    }
+
+    // A crossing is a sign change between neighbours: (a ^ b) < 0.
+    size_t i = 0;
+    size_t crossings = 0;
+    const size_t pairs = count - 1;
+
+#if defined(VAD_USE_AVX2)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        for (; i + 16 <= pairs; i += 16)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(pcm + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(pcm + i + 1));
+            __m256i diff = _mm256_cmpgt_epi16(zero, _mm256_xor_si256(a, b));
+            crossings += std::popcount((unsigned)_mm256_movemask_epi8(diff)) / 2;
+        }
+    }
+#endif
+
+#if defined(VAD_USE_SSE2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= pairs; i += 8)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(pcm + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(pcm + i + 1));
+            __m128i diff = _mm_cmplt_epi16(_mm_xor_si128(a, b), zero);
+            crossings += std::popcount((unsigned)_mm_movemask_epi8(diff)) / 2;
+        }
+    }
+#endif
+
+    for (; i < pairs; i++)
+    {
+        crossings += ((pcm[i] ^ pcm[i + 1]) < 0) ? 1 : 0;
+    }
+
+    return crossings;
+}
+
+VoiceActivityTrimmer::VoiceActivityTrimmer(const VadSettings& settings)
+{
+    Reset(settings);
+}
+
+void VoiceActivityTrimmer::Reset(const VadSettings& new_settings)
+{
+    settings = new_settings;
+    frame_samples = std::max<size_t>(1, (size_t)settings.sample_rate * settings.frame_ms / 1000);
+
+    partial.clear();
+    partial.reserve(frame_samples);
+    position = 0;
+
+    noise_floor_db = -60.0;
+    speech_run = 0;
+    speech_run_start = 0;
+
+    heard_speech = false;
+    last_speech_end = 0;
+    kept_upto = 0;
+}
+
+void VoiceActivityTrimmer::Emit(size_t begin, size_t end, std::vector<SampleRange>* ranges)
+{
+    begin = std::max(begin, kept_upto);
+    if (end <= begin)
+    {
+        return;
+    }
+
+    if (!ranges->empty() && ranges->back().end == begin)
+    {
+        ranges->back().end = end;
+    }
+    else
+    {
+        ranges->push_back({ begin, end });
+    }
+    kept_upto = end;
+}
+
+void VoiceActivityTrimmer::ProcessFrame(const short* frame, size_t count, std::vector<SampleRange>* ranges)
+{
+    size_t frame_begin = position;
+    size_t frame_end = position + count;
+    position = frame_end;
+
+    double mean_square = (double)PcmSumOfSquares(frame, count) / count;
+    double energy_db = 10.0 * std::log10(mean_square / (32768.0 * 32768.0) + 1e-12);
+    double zcr = (double)PcmZeroCrossings(frame, count) / count;
+
+    bool loud = energy_db > settings.min_speech_dbfs;
+    bool speech = loud && (energy_db > noise_floor_db + settings.speech_margin_db ||
+                           (energy_db > noise_floor_db + settings.fricative_margin_db && zcr > settings.fricative_zcr));
+
+    if (!speech)
+    {
+        // Follow the floor down immediately, up only slowly (fans spin up, rooms don't get quieter)
+        if (energy_db < noise_floor_db)
+        {
+            noise_floor_db = energy_db;
+        }
+        else
+        {
+            noise_floor_db += 0.01 * (energy_db - noise_floor_db);
+        }
+        speech_run = 0;
+        return;
+    }
+
+    if (speech_run == 0)
+    {
+        speech_run_start = frame_begin;
+    }
+    speech_run += 1;
+    if (speech_run < settings.speech_onset_frames)
+    {
+        return;
+    }
+
+    const size_t rate = (size_t)settings.sample_rate;
+    const size_t max_pause = rate * settings.max_pause_ms / 1000;
+    if (!heard_speech)
+    {
+        // Leading silence: keep only a short pre-roll so the first consonant isn't clipped (but
+        // don't reach back past a Split())
+        size_t preroll = rate * settings.preroll_ms / 1000;
+        kept_upto = std::max(kept_upto, speech_run_start > preroll ? speech_run_start - preroll : 0);
+        Emit(kept_upto, frame_end, ranges);
+        heard_speech = true;
+    }
+    else if (speech_run_start > last_speech_end && speech_run_start - last_speech_end > max_pause)
+    {
+        // Speech again after a long pause: keep half of the allowed pause on either side of the cut
+        Emit(last_speech_end, last_speech_end + max_pause / 2, ranges);
+        Emit(speech_run_start - (max_pause - max_pause / 2), frame_end, ranges);
+    }
+    else
+    {
+        Emit(kept_upto, frame_end, ranges);
+    }
+    last_speech_end = frame_end;
+}
+
+void VoiceActivityTrimmer::Feed(const short* pcm, size_t count, std::vector<SampleRange>* ranges)
+{
+    // Top up a partial frame from a previous call first
+    if (!partial.empty())
+    {
+        size_t n = std::min(count, frame_samples - partial.size());
+        partial.insert(partial.end(), pcm, pcm + n);
+        pcm += n;
+        count -= n;
+        if (partial.size() < frame_samples)
+        {
+            return;
+        }
+        ProcessFrame(partial.data(), partial.size(), ranges);
+        partial.clear();
+    }
+
+    while (count >= frame_samples)
+    {
+        ProcessFrame(pcm, frame_samples, ranges);
+        pcm += frame_samples;
+        count -= frame_samples;
+    }
+
+    partial.assign(pcm, pcm + count);
+}
+
+void VoiceActivityTrimmer::Finish(std::vector<SampleRange>* ranges)
+{
+    if (!partial.empty())
+    {
+        ProcessFrame(partial.data(), partial.size(), ranges);
+        partial.clear();
+    }
+
+    if (heard_speech)
+    {
+        // Trailing silence: just the hangover, so the last word can decay naturally
+        size_t hangover = (size_t)settings.sample_rate * settings.hangover_ms / 1000;
+        Emit(last_speech_end, std::min(position, last_speech_end + hangover), ranges);
+    }
+    kept_upto = position;
+}
+
+void VoiceActivityTrimmer::Split(std::vector<SampleRange>* ranges)
+{
+    // Samples in `partial` haven't been classified yet; they belong to whatever comes next.
+    if (heard_speech)
+    {
+        size_t hangover = (size_t)settings.sample_rate * settings.hangover_ms / 1000;
+        Emit(last_speech_end, std::min(position, last_speech_end + hangover), ranges);
+    }
+    kept_upto = position;
+
+    heard_speech = false;
+    speech_run = 0;
+}
+
+std::vector<SampleRange> FindSpeechRanges(const short* pcm, size_t count, const VadSettings& settings)
+{
+    std::vector<SampleRange> ranges;
+    VoiceActivityTrimmer trimmer(settings);
+    trimmer.Feed(pcm, count, &ranges);
+    trimmer.Finish(&ranges);
+    return ranges;
+}
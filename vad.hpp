@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Voice activity detection over 16-bit mono PCM. Pure computation: samples go in, the ranges
+// worth uploading come out, as absolute sample indices into the take.
+
+struct SampleRange
+{
+    size_t begin = 0;
+    size_t end = 0;
+
+    size_t Length() const { return end - begin; }
+};
+
+struct VadSettings
+{
+    int sample_rate = 16000;
+    int frame_ms = 20;
+
+    // A frame is speech if it's this far above the tracked noise floor (and above the absolute
+    // minimum). Quieter frames with lots of zero crossings (fricatives) get a lower bar.
+    double speech_margin_db = 12.0;
+    double fricative_margin_db = 6.0;
+    double fricative_zcr = 0.25;  // zero crossings per sample
+    double min_speech_dbfs = -55.0;
+
+    int speech_onset_frames = 2;  // consecutive speech frames before we believe it
+
+    int preroll_ms = 150;      // kept before the first word
+    int hangover_ms = 250;     // kept after the last word
+    int max_pause_ms = 800;    // internal pauses longer than this get shortened to it
+};
+
+// Kernels; vectorised where the compiler lets us (AVX2, then SSE2), scalar otherwise.
+int64_t PcmSumOfSquares(const short* pcm, size_t count);
+size_t PcmZeroCrossings(const short* pcm, size_t count);
+
+// Streaming detector. Feed() consumes consecutive samples and appends every range that is final
+// by now; Finish() closes the trailing range. Ranges come out in order and never overlap.
+struct VoiceActivityTrimmer
+{
+    explicit VoiceActivityTrimmer(const VadSettings& settings = {});
+
+    void Reset(const VadSettings& settings);
+
+    void Feed(const short* pcm, size_t count, std::vector<SampleRange>* ranges);
+    void Finish(std::vector<SampleRange>* ranges);
+
+    // Like Finish(), but keeps going afterwards: closes the current range (with its hangover) so
+    // the audio so far can be sent off as a chunk, then waits for speech as if the take had just
+    // started. The noise floor carries over.
+    void Split(std::vector<SampleRange>* ranges);
+
+    bool HeardSpeech() const { return heard_speech; }
+
+    // Where the last confirmed speech frame ended, and how long it's been quiet since.
+    size_t LastSpeechEnd() const { return last_speech_end; }
+    size_t SilenceSinceSpeech() const { return heard_speech ? position - last_speech_end : 0; }
+
+    size_t SamplesSeen() const { return position + partial.size(); }
+
+private:
+    void ProcessFrame(const short* frame, size_t count, std::vector<SampleRange>* ranges);
+    void Emit(size_t begin, size_t end, std::vector<SampleRange>* ranges);
+
+    VadSettings settings;
+    size_t frame_samples = 0;
+
+    std::vector<short> partial;  // samples that don't fill a whole frame yet
+    size_t position = 0;         // absolute index of the next frame to classify
+
+    double noise_floor_db = -60.0;
+    int speech_run = 0;
+    size_t speech_run_start = 0;
+
+    bool heard_speech = false;
+    size_t last_speech_end = 0;
+    size_t kept_upto = 0;  // everything before this has been emitted or dropped
+};
+
+// Convenience for a whole buffer at once.
+std::vector<SampleRange> FindSpeechRanges(const short* pcm, size_t count, const VadSettings& settings);
@@ -0,0 +1,80 @@
+#include "wav_encoder.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+
+void PutLE32(char* p, uint32_t v)
+{
+    p[0] = (char)(v & 0xff);
+    p[1] = (char)((v >> 8) & 0xff);
+    p[2] = (char)((v >> 16) & 0xff);
+    p[3] = (char)((v >> 24) & 0xff);
+}
+
+void PutLE16(char* p, uint16_t v)
+{
+    p[0] = (char)(v & 0xff);
+    p[1] = (char)((v >> 8) & 0xff);
+}
+
+}  // namespace
+
+bool WavStreamEncoder::Start(int rate, std::vector<char> buffer)
+{
+    output = std::move(buffer);
+    output.assign(HEADER_BYTES, 0);
+    samples_encoded = 0;
+    sample_rate = rate;
+    active = true;
+    return true;
+}
+
+bool WavStreamEncoder::Encode(const short* pcm, size_t num_samples)
+{
+    if (!active)
+    {
+        return false;
+    }
+
+    // Our PCM is already little-endian 16-bit, which is exactly what WAV wants
+    size_t old_size = output.size();
+    output.resize(old_size + num_samples * sizeof(short));
+    memcpy(output.data() + old_size, pcm, num_samples * sizeof(short));
+    samples_encoded += num_samples;
+    return true;
+}
+
+void WavStreamEncoder::WriteHeader()
+{
+    const uint32_t data_bytes = (uint32_t)(samples_encoded * sizeof(short));
+    char* h = output.data();
+
+    memcpy(h + 0, "RIFF", 4);
+    PutLE32(h + 4, 36 + data_bytes);
+    memcpy(h + 8, "WAVE", 4);
+    memcpy(h + 12, "fmt ", 4);
+    PutLE32(h + 16, 16);                        // fmt chunk size
+    PutLE16(h + 20, 1);                         // PCM
+    PutLE16(h + 22, 1);                         // mono
+    PutLE32(h + 24, (uint32_t)sample_rate);
+    PutLE32(h + 28, (uint32_t)sample_rate * 2); // byte rate
+    PutLE16(h + 32, 2);                         // block align
+    PutLE16(h + 34, 16);                        // bits per sample
+    memcpy(h + 36, "data", 4);
+    PutLE32(h + 40, data_bytes);
+}
+
+std::vector<char> WavStreamEncoder::Finish()
+{
+    if (!active)
+    {
+        return {};
+    }
+
+    WriteHeader();
+    active = false;
+    return std::move(output);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "audio_encoder.hpp"
+
+// No compression at all: a RIFF header in front of the PCM. Costs nothing to "encode", which
+// wins on a LAN where bandwidth is cheap and the server decodes it fastest.
+struct WavStreamEncoder : AudioEncoder
+{
+    static constexpr size_t HEADER_BYTES = 44;
+
+    bool Start(int sample_rate, std::vector<char> buffer = {}) override;
+    bool Encode(const short* pcm, size_t num_samples) override;
+    std::vector<char> Finish() override;
+
+    size_t SamplesEncoded() const override { return samples_encoded; }
+    const std::vector<char>& Output() const override { return output; }
+    bool Streamable() const override { return false; }
+    std::vector<char> TakeOutput(std::vector<char> = {}) override { return {}; }  // nothing is final before Finish()
+    AudioFormat Format() const override { return FORMAT_WAV; }
+    const char* FileName() const override { return "output.wav"; }
+    const char* MimeType() const override { return "audio/wav"; }
+    size_t WorstCaseBytes(size_t num_samples) const override { return HEADER_BYTES + num_samples * sizeof(short); }
+
+private:
+    void WriteHeader();
+
+    std::vector<char> output;
+    size_t samples_encoded = 0;
+    int sample_rate = 0;
+    bool active = false;
+};
@@ -0,0 +1,417 @@
+// Headless front end to the recorder's pipeline, for Linux: captures from ALSA (or replays a file),
+// resamples to 16 kHz and runs the take through the same capture and transcription pipeline as the
+// app (conditioning, trimming, live chunks, encoding; then upload, post-processing and rewrite
+// rules). The encoded files are written out, and what the app would type goes to stdout, so whole
+// takes can be pushed through from a script, e.g. for soak tests.
+//
+//   whisper_capture [--device NAME | --replay FILE [--fast]] [--seconds N] [--condition] [--trim] [--chunks]
+//                   [--format wav|mp3|opus|flac] [--transcribe URL [--api-key KEY]]
+//                   [--postprocess URL --postprocess-model NAME [--postprocess-prompt FILE]
+//                    [--postprocess-cache FILE]] [--rewrite-rules FILE] [--verbose-http] OUTPUT
+//
+// With --chunks, the take's first chunk goes to OUTPUT and the next ones to OUTPUT.1, OUTPUT.2, ...
+// (before the extension).
+
+#include "capture_pipeline.hpp"
+#include "file_audio_source.hpp"
+#include "transcription_pipeline.hpp"
+#include "wav_encoder.hpp"
+
+#ifdef HAVE_ALSA
+#include "alsa_source.hpp"
+#endif
+#ifdef HAVE_LAME
+#include "mp3_encoder.hpp"
+#endif
+#ifdef HAVE_OPUS
+#include "opus_encoder.hpp"
+#endif
+#ifdef HAVE_FLAC
+#include "flac_encoder.hpp"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+constexpr int CAPTURE_POLL_INTERVAL_MS = 100;
+
+volatile std::sig_atomic_t interrupted = 0;
+
+struct Options
+{
+    std::string device = "default";
+    std::string replay;
+    bool fast = false;
+    double seconds = 10.0;
+    bool condition = false;
+    bool trim = false;
+    bool chunks = false;
+    std::string format = "wav";
+    std::string transcribe_url;
+    std::string api_key;
+    std::string postprocess_url;
+    std::string postprocess_model;
+    std::string postprocess_prompt_path;
+    std::string postprocess_cache_path;
+    std::string rewrite_rules_path;
+    bool verbose_http = false;
+    std::string output;
+};
+
+void Usage()
+{
+    fprintf(stderr,
+        "usage: whisper_capture [--device NAME | --replay FILE [--fast]] [--seconds N] [--condition] [--trim] [--chunks]\n"
+        "                       [--format wav|mp3|opus|flac] [--transcribe URL [--api-key KEY]]\n"
+        "                       [--postprocess URL --postprocess-model NAME [--postprocess-prompt FILE]\n"
+        "                        [--postprocess-cache FILE]] [--rewrite-rules FILE] [--verbose-http] OUTPUT\n");
+}
+
+bool ParseArgs(int argc, char** argv, Options* options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&](std::string* out)
+        {
+            if (i + 1 >= argc)
+            {
+                return false;
+            }
+            *out = argv[++i];
+            return true;
+        };
+
+        std::string seconds;
+        if ((arg == "--device" && value(&options->device)) || (arg == "--replay" && value(&options->replay)) ||
+            (arg == "--format" && value(&options->format)) || (arg == "--transcribe" && value(&options->transcribe_url)) ||
+            (arg == "--api-key" && value(&options->api_key)) || (arg == "--postprocess" && value(&options->postprocess_url)) ||
+            (arg == "--postprocess-model" && value(&options->postprocess_model)) ||
+            (arg == "--postprocess-prompt" && value(&options->postprocess_prompt_path)) ||
+            (arg == "--postprocess-cache" && value(&options->postprocess_cache_path)) ||
+            (arg == "--rewrite-rules" && value(&options->rewrite_rules_path)))
+        {
+            continue;
+        }
+        if (arg == "--seconds" && value(&seconds))
+        {
+            options->seconds = atof(seconds.c_str());
+        }
+        else if (arg == "--fast")
+        {
+            options->fast = true;
+        }
+        else if (arg == "--condition")
+        {
+            options->condition = true;
+        }
+        else if (arg == "--trim")
+        {
+            options->trim = true;
+        }
+        else if (arg == "--chunks")
+        {
+            options->chunks = true;
+        }
+        else if (arg == "--verbose-http")
+        {
+            options->verbose_http = true;
+        }
+        else if (arg[0] != '-' && options->output.empty())
+        {
+            options->output = arg;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // Post-processing is of the transcript, so it needs one, and a model to do it
+    bool postprocess = !options->postprocess_url.empty() || !options->rewrite_rules_path.empty();
+    if (postprocess && options->transcribe_url.empty())
+    {
+        return false;
+    }
+    if (!options->postprocess_url.empty() && options->postprocess_model.empty())
+    {
+        return false;
+    }
+    return !options->output.empty();
+}
+
+std::unique_ptr<AudioSource> CreateSource(const Options& options)
+{
+    if (!options.replay.empty())
+    {
+        return std::make_unique<FileAudioSource>(options.replay, options.fast ? ReplayPacing::AsFastAsPossible : ReplayPacing::RealTime);
+    }
+#ifdef HAVE_ALSA
+    return std::make_unique<AlsaSource>(options.device);
+#else
+    fprintf(stderr, "Built without ALSA; only --replay is available\n");
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<AudioEncoder> CreateEncoder(const std::string& format)
+{
+    if (format == "wav")
+    {
+        return std::make_unique<WavStreamEncoder>();
+    }
+#ifdef HAVE_LAME
+    if (format == "mp3")
+    {
+        return std::make_unique<Mp3StreamEncoder>();
+    }
+#endif
+#ifdef HAVE_OPUS
+    if (format == "opus")
+    {
+        return std::make_unique<OpusStreamEncoder>();
+    }
+#endif
+#ifdef HAVE_FLAC
+    if (format == "flac")
+    {
+        return std::make_unique<FlacStreamEncoder>();
+    }
+#endif
+    fprintf(stderr, "Format %s isn't available in this build\n", format.c_str());
+    return nullptr;
+}
+
+bool ReadTextFile(const std::string& path, std::string* text)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        fprintf(stderr, "Failed to read %s\n", path.c_str());
+        return false;
+    }
+    text->assign(std::istreambuf_iterator<char>(in), {});
+    return true;
+}
+
+// Where chunk `index` of the take goes: OUTPUT itself for the first, OUTPUT.1 etc. after that.
+std::string ChunkPath(const std::string& output, int index)
+{
+    if (index == 0)
+    {
+        return output;
+    }
+    std::filesystem::path path(output);
+    std::filesystem::path numbered = path.parent_path() / path.stem();
+    numbered += "." + std::to_string(index);
+    numbered += path.extension();
+    return numbered.string();
+}
+
+bool WriteFile(const std::string& path, const std::vector<char>& data)
+{
+    std::ofstream out(path, std::ios::binary);
+    out.write(data.data(), data.size());
+    if (!out)
+    {
+        fprintf(stderr, "Failed to write %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Segments go out from the capture loop and come back on the transcription thread; main() waits
+// for the last of them.
+struct Progress
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    int queued = 0;
+    int finished = 0;
+    bool failed = false;
+    bool typed = false;  // anything on stdout yet
+};
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!ParseArgs(argc, argv, &options))
+    {
+        Usage();
+        return 2;
+    }
+
+    bool transcribe = !options.transcribe_url.empty();
+    TranscriptionSettings transcription;
+    transcription.custom_endpoints = options.transcribe_url;
+    transcription.token = options.api_key;
+    transcription.postprocess = !options.postprocess_url.empty() || !options.rewrite_rules_path.empty();
+    transcription.postprocess_endpoint = options.postprocess_url;
+    transcription.postprocess_model = options.postprocess_model;
+    transcription.rewrite_rules_path = options.rewrite_rules_path;
+    transcription.verbose_http = options.verbose_http;
+    if (!options.postprocess_prompt_path.empty() && !ReadTextFile(options.postprocess_prompt_path, &transcription.postprocess_prompt))
+    {
+        return 1;
+    }
+
+    std::unique_ptr<AudioSource> source = CreateSource(options);
+    std::unique_ptr<AudioEncoder> encoder = CreateEncoder(options.format);
+    if (!source || !encoder || !source->Open())
+    {
+        return 1;
+    }
+    transcription.audio_format = encoder->Format();  // unless the URL says otherwise
+
+    Progress progress;
+    Mp3BufferPool buffers;
+    if (transcribe)
+    {
+        TranscriptionHandlers handlers;
+        handlers.inject = [&progress](const std::string& text) {
+            fwrite(text.data(), 1, text.size(), stdout);
+            fflush(stdout);
+            std::lock_guard<std::mutex> lock(progress.mutex);
+            progress.typed = progress.typed || !text.empty();
+        };
+        handlers.on_error = [](const std::string& message) {
+            fprintf(stderr, "%s\n", message.c_str());
+        };
+        handlers.on_finished = [&progress](const Mp3Segment&, bool failed) {
+            std::lock_guard<std::mutex> lock(progress.mutex);
+            progress.finished += 1;
+            progress.failed = progress.failed || failed;
+            progress.changed.notify_all();
+        };
+
+        if (!StartTranscription(transcription, &buffers, std::move(handlers), stderr))
+        {
+            fprintf(stderr, "Failed to start the transcription thread\n");
+            return 1;
+        }
+        if (!options.postprocess_cache_path.empty())
+        {
+            LoadPostProcessCache(options.postprocess_cache_path);
+        }
+        PrepareForTake();
+    }
+
+    // Every segment is written out before it's queued; without --transcribe, that's all of it
+    size_t bytes_written = 0;
+    double seconds_encoded = 0.0;
+    bool write_failed = false;
+    const char* mime_type = encoder->MimeType();
+    PcmBlockPool pool;
+    PcmStore take(pool);
+    CapturePipeline pipeline(take, buffers, [&](Mp3Segment segment) {
+        std::string path = ChunkPath(options.output, segment.chunk_index);
+        write_failed = !WriteFile(path, segment.data) || write_failed;
+        bytes_written += segment.data.size();
+        seconds_encoded += segment.uploaded_duration_seconds;
+        if (!transcribe)
+        {
+            buffers.Release(std::move(segment.data));
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(progress.mutex);
+            progress.queued += 1;
+        }
+        QueueSegment(std::move(segment));
+    });
+
+    CaptureSettings capture;
+    capture.condition = options.condition;
+    capture.trim_silence = options.trim;
+    capture.live_chunks = options.chunks;
+    if (!pipeline.StartTake(1, std::move(encoder), capture))
+    {
+        fprintf(stderr, "Failed to start the encoder\n");
+        return 1;
+    }
+
+    // Same as the recorder's capture thread: everything new is resampled into the take, then the
+    // pipeline catches up with it. It goes in at most a poll interval at a time, so a fast replay
+    // is chunked where a live capture would be.
+    PolyphaseResampler resampler;
+    resampler.Init(source->SampleRate(), CapturePipeline::SAMPLE_RATE);
+    std::vector<short> captured;
+    std::vector<short> resampled;
+    const size_t block_samples = CapturePipeline::SAMPLE_RATE * CAPTURE_POLL_INTERVAL_MS / 1000;
+    auto pump = [&](bool final)
+    {
+        captured.clear();
+        source->Read(&captured);
+        resampled.clear();
+        resampler.Process(captured.data(), captured.size(), &resampled);
+        if (final)
+        {
+            resampler.Flush(&resampled);
+        }
+        for (size_t offset = 0; offset < resampled.size(); offset += block_samples)
+        {
+            pipeline.Append(resampled.data() + offset, std::min(block_samples, resampled.size() - offset));
+            if (!final || offset + block_samples < resampled.size())
+            {
+                pipeline.EncodeNewSamples(false);
+            }
+        }
+    };
+
+    signal(SIGINT, [](int) { interrupted = 1; });
+
+    auto started = std::chrono::steady_clock::now();
+    source->Start();
+    bool replaying = !options.replay.empty();
+    while (!interrupted && !(replaying && source->Finished()) &&
+           (replaying || std::chrono::steady_clock::now() - started < std::chrono::duration<double>(options.seconds)))
+    {
+        if (!replaying || !options.fast)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_POLL_INTERVAL_MS));
+        }
+        pump(false);
+    }
+    source->Stop();
+    pump(true);
+
+    if (!pipeline.FinishTake(SteadyClockMs()) && pipeline.ChunkIndex() == 0)
+    {
+        fprintf(stderr, "No speech detected\n");
+    }
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    fprintf(stderr, "%.2f s captured at %d Hz, %.2f s encoded into %d file(s), %zu bytes of %s in %.2f s\n",
+        (double)take.Size() / CapturePipeline::SAMPLE_RATE, source->SampleRate(), seconds_encoded, pipeline.ChunkIndex(),
+        bytes_written, mime_type, wall_seconds);
+
+    bool failed = write_failed;
+    if (transcribe)
+    {
+        std::unique_lock<std::mutex> lock(progress.mutex);
+        progress.changed.wait(lock, [&progress]() { return progress.finished == progress.queued; });
+        failed = failed || progress.failed;
+        if (progress.typed)
+        {
+            printf("\n");
+        }
+        lock.unlock();
+        StopTranscription();
+    }
+    return failed ? 1 : 0;
+}